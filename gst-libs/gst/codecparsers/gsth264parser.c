@@ -85,6 +85,7 @@
 #endif
 
 #include "gsth264parser.h"
+#include "parserutils.h"
 
 #include <gst/base/gstbytereader.h>
 #include <gst/base/gstbitreader.h>
@@ -188,16 +189,32 @@ ceil_log2 (guint32 v)
 
 /****** Nal parser ******/
 
+/* The emulation prevention bytes are looked for a window ahead of the reads
+ * at a time, so that parsing a slice header does not scan the whole slice,
+ * and the bits in between are loaded with no per-byte check */
+#define NAL_READER_EPB_WINDOW 64
+/* enough to cover the unread bytes of a full cache */
+#define NAL_READER_EPB_HISTORY 8
+
 typedef struct
 {
   const guint8 *data;
   guint size;
 
-  guint n_epb;                  /* Number of emulation prevention bytes */
   guint byte;                   /* Byte position */
-  guint bits_in_cache;          /* bitpos in the cache of next bit */
-  guint8 first_byte;
+  guint bits_in_cache;          /* Number of bits left in the cache */
   guint64 cache;                /* cached bytes */
+
+  /* there is no emulation prevention byte before epb_end, the byte at
+   * epb_end is one if epb_found, and the next window is scanned from
+   * epb_search */
+  guint epb_end;
+  gboolean epb_found;
+  guint epb_search;
+
+  guint n_epb;                  /* Number of emulation prevention bytes */
+  /* RBSP offsets of the bytes following the last ones */
+  guint epb_next[NAL_READER_EPB_HISTORY];
 } NalReader;
 
 static void
@@ -205,114 +222,162 @@ nal_reader_init (NalReader * nr, const guint8 * data, guint size)
 {
   nr->data = data;
   nr->size = size;
-  nr->n_epb = 0;
 
   nr->byte = 0;
   nr->bits_in_cache = 0;
-  /* fill with something other than 0 to detect emulation prevention bytes */
-  nr->first_byte = 0xff;
-  nr->cache = 0xff;
+  nr->cache = 0;
+
+  nr->epb_end = 0;
+  nr->epb_found = FALSE;
+  nr->epb_search = 0;
+  nr->n_epb = 0;
 }
 
-static inline gboolean
-nal_reader_read (NalReader * nr, guint nbits)
+static void
+nal_reader_scan_epb (NalReader * nr)
 {
-  if (G_UNLIKELY (nr->byte * 8 + (nbits - nr->bits_in_cache) > nr->size * 8)) {
-    GST_DEBUG ("Can not read %u bits, bits in cache %u, Byte * 8 %u, size in "
-        "bits %u", nbits, nr->bits_in_cache, nr->byte * 8, nr->size * 8);
-    return FALSE;
-  }
+  guint end = MIN (nr->epb_search + NAL_READER_EPB_WINDOW, nr->size);
+  gint off;
 
-  while (nr->bits_in_cache < nbits) {
-    guint8 byte;
-    gboolean check_three_byte;
-
-    check_three_byte = TRUE;
-  next_byte:
-    if (G_UNLIKELY (nr->byte >= nr->size))
-      return FALSE;
+  off = scan_for_start_code_prefix (nr->data + nr->epb_search,
+      end - nr->epb_search, 0xff, 0x03);
 
-    byte = nr->data[nr->byte++];
+  if (off != -1) {
+    nr->epb_end = nr->epb_search + off + 2;
+    nr->epb_found = TRUE;
+  } else {
+    /* a prefix starting in the last two bytes is checked with the next
+     * window */
+    nr->epb_end = end;
+    nr->epb_search = MAX (end, 2) - 2;
+  }
+}
 
-    /* check if the byte is a emulation_prevention_three_byte */
-    if (check_three_byte && byte == 0x03 && nr->first_byte == 0x00 &&
-        ((nr->cache & 0xff) == 0)) {
-      /* next byte goes unconditionally to the cache, even if it's 0x03 */
-      check_three_byte = FALSE;
-      nr->n_epb++;
-      goto next_byte;
+static void
+nal_reader_refill_bytes (NalReader * nr)
+{
+  while (nr->bits_in_cache <= 56 && nr->byte < nr->size) {
+    if (nr->byte == nr->epb_end) {
+      if (nr->epb_found) {
+        nr->epb_next[nr->n_epb % NAL_READER_EPB_HISTORY] =
+            nr->byte - nr->n_epb;
+        nr->n_epb++;
+        nr->byte++;
+
+        /* the scan starts again right after it, so that 00 00 03 00 03
+         * only has one */
+        nr->epb_end = nr->epb_search = nr->byte;
+        nr->epb_found = FALSE;
+      }
+      nal_reader_scan_epb (nr);
+      continue;
     }
-    nr->cache = (nr->cache << 8) | nr->first_byte;
-    nr->first_byte = byte;
+
+    nr->cache = (nr->cache << 8) | nr->data[nr->byte++];
     nr->bits_in_cache += 8;
   }
+}
 
-  return TRUE;
+/* Only called with less than 32 bits in the cache */
+static inline void
+nal_reader_refill (NalReader * nr)
+{
+  if (nr->byte + 8 > nr->epb_end && !nr->epb_found && nr->epb_end < nr->size)
+    nal_reader_scan_epb (nr);
+
+  if (G_LIKELY (nr->byte + 8 <= nr->epb_end)) {
+    /* top the cache up to at least 56 bits at once */
+    guint n = (63 - nr->bits_in_cache) >> 3;
+    guint64 next = GST_READ_UINT64_BE (nr->data + nr->byte);
+
+    nr->cache = (nr->cache << (8 * n)) | (next >> (64 - 8 * n));
+    nr->byte += n;
+    nr->bits_in_cache += 8 * n;
+  } else {
+    nal_reader_refill_bytes (nr);
+  }
 }
 
 static inline gboolean
-nal_reader_skip (NalReader * nr, guint nbits)
+nal_reader_read (NalReader * nr, guint nbits)
 {
-  if (G_UNLIKELY (!nal_reader_read (nr, nbits)))
-    return FALSE;
+  if (G_UNLIKELY (nr->bits_in_cache < nbits)) {
+    nal_reader_refill (nr);
 
-  nr->bits_in_cache -= nbits;
+    if (G_UNLIKELY (nr->bits_in_cache < nbits)) {
+      GST_DEBUG ("Can not read %u bits, bits in cache %u, Byte * 8 %u, size "
+          "in bits %u", nbits, nr->bits_in_cache, nr->byte * 8, nr->size * 8);
+      return FALSE;
+    }
+  }
 
   return TRUE;
 }
 
 static inline gboolean
-nal_reader_skip_to_byte (NalReader * nr)
+nal_reader_skip (NalReader * nr, guint nbits)
 {
-  if (nr->bits_in_cache == 0) {
-    if (G_LIKELY ((nr->size - nr->byte) > 0))
-      nr->byte++;
-    else
-      return FALSE;
-  }
+  if (G_UNLIKELY (!nal_reader_read (nr, nbits)))
+    return FALSE;
 
-  nr->bits_in_cache = 0;
+  nr->bits_in_cache -= nbits;
 
   return TRUE;
 }
 
+/* Position in the RBSP */
 static inline guint
 nal_reader_get_pos (const NalReader * nr)
 {
-  return nr->byte * 8 - nr->bits_in_cache;
+  return (nr->byte - nr->n_epb) * 8 - nr->bits_in_cache;
 }
 
-static inline guint
+/* Number of bits left in the RBSP */
+static guint
 nal_reader_get_remaining (const NalReader * nr)
 {
-  return (nr->size - nr->byte) * 8 + nr->bits_in_cache;
+  guint search = nr->epb_search;
+  guint n_epb = 0;
+  gint off;
+
+  if (nr->epb_found) {
+    search = nr->epb_end + 1;
+    n_epb++;
+  }
+
+  while ((off = scan_for_start_code_prefix (nr->data + search,
+              nr->size - search, 0xff, 0x03)) != -1) {
+    search += off + 3;
+    n_epb++;
+  }
+
+  return (nr->size - nr->byte - n_epb) * 8 + nr->bits_in_cache;
 }
 
+/* Number of emulation prevention bytes up to the current position, each
+ * one counting as soon as a bit after it was read */
 static inline guint
 nal_reader_get_epb_count (const NalReader * nr)
 {
-  return nr->n_epb;
+  guint pos = nal_reader_get_pos (nr);
+  guint n = nr->n_epb;
+
+  while (n > 0 && nr->epb_next[(n - 1) % NAL_READER_EPB_HISTORY] * 8 >= pos)
+    n--;
+
+  return n;
 }
 
 #define GST_NAL_READER_READ_BITS(bits) \
 static gboolean \
 nal_reader_get_bits_uint##bits (NalReader *nr, guint##bits *val, guint nbits) \
 { \
-  guint shift; \
-  \
   if (!nal_reader_read (nr, nbits)) \
     return FALSE; \
   \
   /* bring the required bits down and truncate */ \
-  shift = nr->bits_in_cache - nbits; \
-  *val = nr->first_byte >> shift; \
-  \
-  *val |= nr->cache << (8 - shift); \
-  /* mask out required bits */ \
-  if (nbits < bits) \
-    *val &= ((guint##bits)1 << nbits) - 1; \
-  \
-  nr->bits_in_cache = shift; \
+  nr->bits_in_cache -= nbits; \
+  *val = (nr->cache >> nr->bits_in_cache) & (((guint64) 1 << nbits) - 1); \
   \
   return TRUE; \
 } \
@@ -486,17 +551,6 @@ set_nalu_datas (GstH264NalUnit * nalu)
   GST_DEBUG ("Nal type %u, ref_idc %u", nalu->type, nalu->ref_idc);
 }
 
-static inline gint
-scan_for_start_codes (const guint8 * data, guint size)
-{
-  GstByteReader br;
-  gst_byte_reader_init (&br, data, size);
-
-  /* NALU not empty, so we can at least expect 1 (even 2) bytes following sc */
-  return gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
-      0, size);
-}
-
 static gboolean
 gst_h264_parser_more_data (NalReader * nr)
 {
@@ -1766,6 +1820,30 @@ GstH264ParserResult
 gst_h264_parser_parse_slice_hdr (GstH264NalParser * nalparser,
     GstH264NalUnit * nalu, GstH264SliceHdr * slice,
     gboolean parse_pred_weight_table, gboolean parse_dec_ref_pic_marking)
+{
+  return gst_h264_parser_parse_slice_hdr_depth (nalparser, nalu, slice,
+      GST_H264_SLICE_HDR_PARSE_FULL);
+}
+
+/**
+ * gst_h264_parser_parse_slice_hdr_depth:
+ * @nalparser: a #GstH264NalParser
+ * @nalu: The #GST_H264_NAL_SLICE #GstH264NalUnit to parse
+ * @slice: The #GstH264SliceHdr to fill.
+ * @depth: How much of the slice header to parse
+ *
+ * Parses @data, and fills the @slice structure. With
+ * #GST_H264_SLICE_HDR_PARSE_HEADER, only the fields needed to find out
+ * which picture the slice belongs to are filled, which is enough to find
+ * access unit boundaries and is much cheaper than a full parse. The
+ * header_size and n_emulation_prevention_bytes fields are then set to 0.
+ *
+ * Returns: a #GstH264ParserResult
+ */
+GstH264ParserResult
+gst_h264_parser_parse_slice_hdr_depth (GstH264NalParser * nalparser,
+    GstH264NalUnit * nalu, GstH264SliceHdr * slice,
+    GstH264SliceHdrParseDepth depth)
 {
   NalReader nr;
   gint pps_id;
@@ -1851,6 +1929,12 @@ gst_h264_parser_parse_slice_hdr (GstH264NalParser * nalparser,
       READ_SE (&nr, slice->delta_pic_order_cnt[1]);
   }
 
+  if (depth == GST_H264_SLICE_HDR_PARSE_HEADER) {
+    slice->header_size = 0;
+    slice->n_emulation_prevention_bytes = 0;
+    return GST_H264_PARSER_OK;
+  }
+
   if (pps->redundant_pic_cnt_present_flag)
     READ_UE_ALLOWED (&nr, slice->redundant_pic_cnt, 0, G_MAXINT8);
 
@@ -1919,8 +2003,10 @@ gst_h264_parser_parse_slice_hdr (GstH264NalParser * nalparser,
     READ_UINT16 (&nr, slice->slice_group_change_cycle, n);
   }
 
-  slice->header_size = nal_reader_get_pos (&nr);
+  /* in the escaped data */
   slice->n_emulation_prevention_bytes = nal_reader_get_epb_count (&nr);
+  slice->header_size = nal_reader_get_pos (&nr) +
+      8 * slice->n_emulation_prevention_bytes;
 
   return GST_H264_PARSER_OK;
 
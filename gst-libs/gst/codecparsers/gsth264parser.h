@@ -205,6 +205,21 @@ typedef enum
   GST_H264_S_SI_SLICE = 9
 } GstH264SliceType;
 
+/**
+ * GstH264SliceHdrParseDepth:
+ * @GST_H264_SLICE_HDR_PARSE_HEADER: Only parse the fields identifying the
+ *   picture the slice belongs to, from first_mb_in_slice to the picture
+ *   order count
+ * @GST_H264_SLICE_HDR_PARSE_FULL: Parse the whole slice header
+ *
+ * How much of a slice header to parse.
+ */
+typedef enum
+{
+  GST_H264_SLICE_HDR_PARSE_HEADER,
+  GST_H264_SLICE_HDR_PARSE_FULL
+} GstH264SliceHdrParseDepth;
+
 typedef struct _GstH264NalParser              GstH264NalParser;
 
 typedef struct _GstH264NalUnit                GstH264NalUnit;
@@ -739,6 +754,10 @@ GstH264ParserResult gst_h264_parser_parse_slice_hdr   (GstH264NalParser *nalpars
                                                        GstH264SliceHdr *slice, gboolean parse_pred_weight_table,
                                                        gboolean parse_dec_ref_pic_marking);
 
+GstH264ParserResult gst_h264_parser_parse_slice_hdr_depth (GstH264NalParser *nalparser,
+                                                       GstH264NalUnit *nalu, GstH264SliceHdr *slice,
+                                                       GstH264SliceHdrParseDepth depth);
+
 GstH264ParserResult gst_h264_parser_parse_sps         (GstH264NalParser *nalparser, GstH264NalUnit *nalu,
                                                        GstH264SPS *sps, gboolean parse_vui_params);
 
@@ -265,24 +265,21 @@ failed:
 static guint
 find_psc (GstByteReader * br)
 {
-  guint psc_pos = -1, psc;
+  const guint8 *data;
+  guint remaining = gst_byte_reader_get_remaining (br);
+  gint off;
 
-  if (!gst_byte_reader_peek_uint24_be (br, &psc))
-    goto failed;
+  if (!gst_byte_reader_peek_data (br, remaining, &data))
+    return -1;
 
   /* Scan for the picture start code (22 bits - 0x0020) */
-  while ((gst_byte_reader_get_remaining (br) >= 3)) {
-    if (gst_byte_reader_peek_uint24_be (br, &psc) &&
-        ((psc & 0xfffffc) == 0x000080)) {
-      psc_pos = gst_byte_reader_get_pos (br);
-      break;
-    } else
-      gst_byte_reader_skip_unchecked (br, 1);
-  }
+  off = scan_for_start_code_prefix (data, remaining, 0xfc, 0x80);
+  if (off == -1)
+    return -1;
 
-failed:
+  gst_byte_reader_skip_unchecked (br, off);
 
-  return psc_pos;
+  return gst_byte_reader_get_pos (br);
 }
 
 static inline guint8
@@ -428,12 +425,9 @@ gst_mpeg4_parse (GstMpeg4Packet * packet, gboolean skip_user_data,
     gsize size)
 {
   gint off1, off2;
-  GstByteReader br;
   GstMpeg4ParseResult resync_res;
   static guint first_resync_marker = TRUE;
 
-  gst_byte_reader_init (&br, data, size);
-
   g_return_val_if_fail (packet != NULL, GST_MPEG4_PARSER_ERROR);
 
   if (size - offset <= 4) {
@@ -461,13 +455,13 @@ gst_mpeg4_parse (GstMpeg4Packet * packet, gboolean skip_user_data,
     first_resync_marker = TRUE;
   }
 
-  off1 = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
-      offset, size - offset);
+  off1 = scan_for_start_codes (data + offset, size - offset);
 
   if (off1 == -1) {
     GST_DEBUG ("No start code prefix in this buffer");
     return GST_MPEG4_PARSER_NO_PACKET;
   }
+  off1 += offset;
 
   /* Recursively skip user data if needed */
   if (skip_user_data && data[off1 + 3] == GST_MPEG4_USER_DATA)
@@ -480,8 +474,12 @@ gst_mpeg4_parse (GstMpeg4Packet * packet, gboolean skip_user_data,
   packet->type = (GstMpeg4StartCode) (data[off1 + 3]);
 
 find_end:
-  off2 = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
-      off1 + 4, size - off1 - 4);
+  off2 = -1;
+  if (off1 + 4 < size) {
+    off2 = scan_for_start_codes (data + off1 + 4, size - off1 - 4);
+    if (off2 != -1)
+      off2 += off1 + 4;
+  }
 
   if (off2 == -1) {
     GST_DEBUG ("Packet start %d, No end found", off1 + 4);
@@ -55,3 +55,231 @@ failed:
     return FALSE;
   }
 }
+
+/* Start code scanning
+ *
+ * All the parsers look for two zero bytes followed by a byte that matches
+ * a pattern. The scanners below first look for the pairs of zero bytes, 16
+ * or 32 of them at a time when SIMD instructions are available, and only
+ * then check the third byte. The SSE2 and NEON versions are used when the
+ * compiler targets them, the AVX2 version when the CPU supports it at
+ * runtime. */
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SCAN_SSE2 1
+#endif
+
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__) && \
+    !defined (__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#include <immintrin.h>
+#define HAVE_SCAN_AVX2 1
+#endif
+
+#if defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_SCAN_NEON 1
+#endif
+
+/* @value is never 0, so a non-zero byte that doesn't match can't be
+ * part of a prefix at any of the three positions */
+static gint
+scan_for_start_code_prefix_scalar (const guint8 * data, guint start,
+    guint size, guint8 mask, guint8 value)
+{
+  guint i = start;
+
+  while (i + 3 <= size) {
+    guint8 c = data[i + 2];
+
+    if (c != 0 && (c & mask) != value)
+      i += 3;
+    else if (data[i + 1])
+      i += 2;
+    else if (data[i] || (c & mask) != value)
+      i++;
+    else
+      return i;
+  }
+
+  return -1;
+}
+
+static gint
+scan_for_start_code_prefix_c (const guint8 * data, guint size, guint8 mask,
+    guint8 value)
+{
+  return scan_for_start_code_prefix_scalar (data, 0, size, mask, value);
+}
+
+/* Checks the candidates of a bit mask of positions following @i that are
+ * preceded by two zero bytes */
+static inline gint
+check_start_code_candidates (const guint8 * data, guint i, guint32 zeros,
+    guint8 mask, guint8 value)
+{
+  while (zeros) {
+    guint j = g_bit_nth_lsf (zeros, -1);
+
+    if ((data[i + j + 2] & mask) == value)
+      return i + j;
+    zeros &= zeros - 1;
+  }
+
+  return -1;
+}
+
+#ifdef HAVE_SCAN_SSE2
+static gint
+scan_for_start_code_prefix_sse2 (const guint8 * data, guint size,
+    guint8 mask, guint8 value)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  guint i = 0;
+
+  /* The last candidate of a block needs 2 more bytes */
+  while (i + 18 <= size) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (data + i));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (data + i + 1));
+    guint32 zeros = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (a,
+                zero), _mm_cmpeq_epi8 (b, zero)));
+
+    if (G_UNLIKELY (zeros)) {
+      gint ret = check_start_code_candidates (data, i, zeros, mask, value);
+
+      if (ret != -1)
+        return ret;
+    }
+    i += 16;
+  }
+
+  return scan_for_start_code_prefix_scalar (data, i, size, mask, value);
+}
+#endif
+
+#ifdef HAVE_SCAN_AVX2
+__attribute__ ((target ("avx2")))
+static gint
+scan_for_start_code_prefix_avx2 (const guint8 * data, guint size,
+    guint8 mask, guint8 value)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  guint i = 0;
+
+  while (i + 34 <= size) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (data + i));
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (data + i + 1));
+    guint32 zeros = _mm256_movemask_epi8 (_mm256_and_si256 (_mm256_cmpeq_epi8 (a,
+                zero), _mm256_cmpeq_epi8 (b, zero)));
+
+    if (G_UNLIKELY (zeros)) {
+      gint ret = check_start_code_candidates (data, i, zeros, mask, value);
+
+      if (ret != -1)
+        return ret;
+    }
+    i += 32;
+  }
+
+  return scan_for_start_code_prefix_scalar (data, i, size, mask, value);
+}
+#endif
+
+#ifdef HAVE_SCAN_NEON
+static gint
+scan_for_start_code_prefix_neon (const guint8 * data, guint size,
+    guint8 mask, guint8 value)
+{
+  const uint8x16_t zero = vdupq_n_u8 (0);
+  guint i = 0;
+
+  while (i + 18 <= size) {
+    uint8x16_t a = vld1q_u8 (data + i);
+    uint8x16_t b = vld1q_u8 (data + i + 1);
+    uint64x2_t zeros =
+        vreinterpretq_u64_u8 (vandq_u8 (vceqq_u8 (a, zero), vceqq_u8 (b,
+                zero)));
+
+    /* NEON has no movemask, only check the block when it has a pair of
+     * zero bytes */
+    if (G_UNLIKELY (vgetq_lane_u64 (zeros, 0) | vgetq_lane_u64 (zeros, 1))) {
+      gint ret =
+          scan_for_start_code_prefix_scalar (data, i, i + 18, mask, value);
+
+      if (ret != -1)
+        return ret;
+    }
+    i += 16;
+  }
+
+  return scan_for_start_code_prefix_scalar (data, i, size, mask, value);
+}
+#endif
+
+static const ScanForStartCodePrefixImpl scan_impls[] = {
+  {"c", scan_for_start_code_prefix_c},
+#ifdef HAVE_SCAN_SSE2
+  {"sse2", scan_for_start_code_prefix_sse2},
+#endif
+#ifdef HAVE_SCAN_NEON
+  {"neon", scan_for_start_code_prefix_neon},
+#endif
+#ifdef HAVE_SCAN_AVX2
+  /* Last, so that it can be left out when the CPU doesn't support it */
+  {"avx2", scan_for_start_code_prefix_avx2},
+#endif
+};
+
+/* Returns the implementations that can run on this CPU, so that they can
+ * all be tested */
+const ScanForStartCodePrefixImpl *
+scan_for_start_code_prefix_get_impls (guint * n_impls)
+{
+  *n_impls = G_N_ELEMENTS (scan_impls);
+
+#ifdef HAVE_SCAN_AVX2
+  __builtin_cpu_init ();
+  if (!__builtin_cpu_supports ("avx2"))
+    (*n_impls)--;
+#endif
+
+  return scan_impls;
+}
+
+static gpointer
+select_scan_func (gpointer data)
+{
+  ScanForStartCodePrefixFunc func = scan_for_start_code_prefix_c;
+
+#if defined (HAVE_SCAN_SSE2)
+  func = scan_for_start_code_prefix_sse2;
+#elif defined (HAVE_SCAN_NEON)
+  func = scan_for_start_code_prefix_neon;
+#endif
+
+#ifdef HAVE_SCAN_AVX2
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    func = scan_for_start_code_prefix_avx2;
+#endif
+
+  return (gpointer) func;
+}
+
+/* Returns the offset of the first two zero bytes in @data that are followed
+ * by a byte that is @value after applying @mask, or -1. @value must not be
+ * 0 */
+gint
+scan_for_start_code_prefix (const guint8 * data, guint size, guint8 mask,
+    guint8 value)
+{
+  static GOnce once = G_ONCE_INIT;
+  ScanForStartCodePrefixFunc func;
+
+  g_return_val_if_fail (value != 0, -1);
+
+  func = (ScanForStartCodePrefixFunc) g_once (&once, select_scan_func, NULL);
+
+  return func (data, size, mask, value);
+}
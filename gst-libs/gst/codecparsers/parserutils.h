@@ -105,4 +105,33 @@ gboolean
 decode_vlc (GstBitReader * br, guint * res, const VLCTable * table,
     guint length);
 
+typedef gint (*ScanForStartCodePrefixFunc) (const guint8 * data, guint size,
+    guint8 mask, guint8 value);
+
+typedef struct _ScanForStartCodePrefixImpl ScanForStartCodePrefixImpl;
+
+struct _ScanForStartCodePrefixImpl
+{
+  const gchar *name;
+  ScanForStartCodePrefixFunc func;
+};
+
+gint
+scan_for_start_code_prefix (const guint8 * data, guint size, guint8 mask,
+    guint8 value);
+
+const ScanForStartCodePrefixImpl *
+scan_for_start_code_prefix_get_impls (guint * n_impls);
+
+/* Returns the offset of the first 0x00 0x00 0x01 start code prefix in @data
+ * that is followed by at least one byte, or -1 */
+static inline gint
+scan_for_start_codes (const guint8 * data, guint size)
+{
+  if (size < 4)
+    return -1;
+
+  return scan_for_start_code_prefix (data, size - 1, 0xff, 0x01);
+}
+
 #endif /* __PARSER_UTILS__ */
@@ -0,0 +1,98 @@
+/*
+ * mpegts-crc-private.h
+ * MPEG-2 CRC32 used by the PSI/SI sections of transport streams
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __MPEGTS_CRC_PRIVATE_H__
+#define __MPEGTS_CRC_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* CRC-32/MPEG-2: polynomial 0x04c11db7, msb first, initial value
+ * 0xffffffff, no final xor. Running it over a whole section including its
+ * CRC_32 field gives 0 for a valid section.
+ *
+ * The 8 tables allow processing 8 bytes per iteration (slice-by-8):
+ * mpegts_crc_tab[0] is the classic byte-at-a-time table, and
+ * mpegts_crc_tab[k][n] is the CRC of byte n followed by k zero bytes. */
+static guint32 mpegts_crc_tab[8][256];
+
+static inline void
+mpegts_crc_init (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    guint i, j, k;
+
+    for (i = 0; i < 256; i++) {
+      guint32 crc = i << 24;
+
+      for (j = 0; j < 8; j++)
+        crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+      mpegts_crc_tab[0][i] = crc;
+    }
+
+    for (k = 1; k < 8; k++) {
+      for (i = 0; i < 256; i++) {
+        guint32 crc = mpegts_crc_tab[k - 1][i];
+
+        mpegts_crc_tab[k][i] = (crc << 8) ^ mpegts_crc_tab[0][crc >> 24];
+      }
+    }
+
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
+static inline guint32
+mpegts_crc32 (const guint8 * data, guint datalen)
+{
+  const guint32 (*tab)[256] = (const guint32 (*)[256]) mpegts_crc_tab;
+  guint32 crc = 0xffffffff;
+
+  mpegts_crc_init ();
+
+  while (datalen >= 8) {
+    guint32 a, b;
+
+    a = crc ^ (((guint32) data[0] << 24) | (data[1] << 16) |
+        (data[2] << 8) | data[3]);
+    b = ((guint32) data[4] << 24) | (data[5] << 16) | (data[6] << 8) |
+        data[7];
+
+    crc = tab[7][a >> 24] ^ tab[6][(a >> 16) & 0xff] ^
+        tab[5][(a >> 8) & 0xff] ^ tab[4][a & 0xff] ^
+        tab[3][b >> 24] ^ tab[2][(b >> 16) & 0xff] ^
+        tab[1][(b >> 8) & 0xff] ^ tab[0][b & 0xff];
+
+    data += 8;
+    datalen -= 8;
+  }
+
+  while (datalen--)
+    crc = (crc << 8) ^ tab[0][((crc >> 24) ^ *data++) & 0xff];
+
+  return crc;
+}
+
+G_END_DECLS
+
+#endif /* __MPEGTS_CRC_PRIVATE_H__ */
@@ -0,0 +1,148 @@
+/* GStreamer
+ *
+ * gstbandwidthestimator.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Network throughput estimation for adaptive streaming.
+ *
+ * Downloaders report every chunk of data they receive together with the
+ * time it took to arrive. Chunks are grouped into samples covering at least
+ * SAMPLE_MIN_DURATION, so that bursts of data coming out of the socket
+ * buffers don't turn into absurdly high rates, and the estimate is the
+ * harmonic mean of the rates of the last WINDOW_SIZE samples weighted by
+ * their size, ie. the bytes received over the time spent receiving them.
+ * The harmonic mean is dominated by the slow samples, which errs on the
+ * side of not stalling. */
+
+#include <string.h>
+#include "gstfragmented.h"
+#include "gstbandwidthestimator.h"
+
+#define GST_CAT_DEFAULT fragmented_debug
+
+#define SAMPLE_MIN_DURATION (100 * GST_MSECOND)
+#define WINDOW_SIZE 20
+
+typedef struct
+{
+  guint64 bytes;
+  GstClockTime elapsed;
+} GstBandwidthSample;
+
+struct _GstBandwidthEstimator
+{
+  GMutex lock;
+
+  /* sample being accumulated */
+  GstBandwidthSample pending;
+
+  /* ring buffer of the last samples and their sum */
+  GstBandwidthSample window[WINDOW_SIZE];
+  guint head;
+  guint n_samples;
+  GstBandwidthSample total;
+};
+
+GstBandwidthEstimator *
+gst_bandwidth_estimator_new (void)
+{
+  GstBandwidthEstimator *estimator;
+
+  estimator = g_new0 (GstBandwidthEstimator, 1);
+  g_mutex_init (&estimator->lock);
+
+  return estimator;
+}
+
+void
+gst_bandwidth_estimator_free (GstBandwidthEstimator * estimator)
+{
+  g_return_if_fail (estimator != NULL);
+
+  g_mutex_clear (&estimator->lock);
+  g_free (estimator);
+}
+
+void
+gst_bandwidth_estimator_reset (GstBandwidthEstimator * estimator)
+{
+  g_return_if_fail (estimator != NULL);
+
+  g_mutex_lock (&estimator->lock);
+  memset (&estimator->pending, 0, sizeof (estimator->pending));
+  memset (&estimator->total, 0, sizeof (estimator->total));
+  estimator->head = 0;
+  estimator->n_samples = 0;
+  g_mutex_unlock (&estimator->lock);
+}
+
+/* @elapsed is the time between the moment the downloader was ready to
+ * receive data and the arrival of @bytes */
+void
+gst_bandwidth_estimator_add_sample (GstBandwidthEstimator * estimator,
+    gsize bytes, GstClockTime elapsed)
+{
+  GstBandwidthSample *slot;
+
+  g_return_if_fail (estimator != NULL);
+
+  g_mutex_lock (&estimator->lock);
+  estimator->pending.bytes += bytes;
+  estimator->pending.elapsed += elapsed;
+
+  if (estimator->pending.elapsed < SAMPLE_MIN_DURATION) {
+    g_mutex_unlock (&estimator->lock);
+    return;
+  }
+
+  slot = &estimator->window[estimator->head];
+  if (estimator->n_samples == WINDOW_SIZE) {
+    estimator->total.bytes -= slot->bytes;
+    estimator->total.elapsed -= slot->elapsed;
+  } else {
+    estimator->n_samples++;
+  }
+  *slot = estimator->pending;
+  estimator->total.bytes += slot->bytes;
+  estimator->total.elapsed += slot->elapsed;
+  estimator->head = (estimator->head + 1) % WINDOW_SIZE;
+
+  GST_LOG ("New sample: %" G_GUINT64_FORMAT " bytes in %" GST_TIME_FORMAT,
+      slot->bytes, GST_TIME_ARGS (slot->elapsed));
+
+  memset (&estimator->pending, 0, sizeof (estimator->pending));
+  g_mutex_unlock (&estimator->lock);
+}
+
+/* Returns the estimated bandwidth in bits per second, or 0 if there isn't
+ * any complete sample yet */
+guint64
+gst_bandwidth_estimator_get_bitrate (GstBandwidthEstimator * estimator)
+{
+  guint64 bitrate = 0;
+
+  g_return_val_if_fail (estimator != NULL, 0);
+
+  g_mutex_lock (&estimator->lock);
+  if (estimator->total.elapsed > 0)
+    bitrate = gst_util_uint64_scale (estimator->total.bytes * 8, GST_SECOND,
+        estimator->total.elapsed);
+  g_mutex_unlock (&estimator->lock);
+
+  return bitrate;
+}
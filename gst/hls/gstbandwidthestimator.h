@@ -0,0 +1,38 @@
+/* GStreamer
+ *
+ * gstbandwidthestimator.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_BANDWIDTH_ESTIMATOR_H__
+#define __GST_BANDWIDTH_ESTIMATOR_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstBandwidthEstimator GstBandwidthEstimator;
+
+GstBandwidthEstimator * gst_bandwidth_estimator_new (void);
+void gst_bandwidth_estimator_free (GstBandwidthEstimator * estimator);
+void gst_bandwidth_estimator_reset (GstBandwidthEstimator * estimator);
+void gst_bandwidth_estimator_add_sample (GstBandwidthEstimator * estimator,
+    gsize bytes, GstClockTime elapsed);
+guint64 gst_bandwidth_estimator_get_bitrate (GstBandwidthEstimator * estimator);
+
+G_END_DECLS
+#endif /* __GST_BANDWIDTH_ESTIMATOR_H__ */
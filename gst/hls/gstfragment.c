@@ -45,6 +45,17 @@ struct _GstFragmentPrivate
   GstBuffer *buffer;
   GstCaps *caps;
   GMutex lock;
+
+  /* Streaming fragments: downloaded buffers are queued here and handed out
+   * with gst_fragment_pop_buffer() instead of being accumulated in @buffer */
+  gboolean streaming;
+  GQueue chunks;
+  gsize queued;                 /* bytes in @chunks */
+  gsize max_queued;
+  gsize size;                   /* total bytes added */
+  GstClockTime stalled;         /* time the producer waited for the consumer */
+  gboolean cancelled;
+  GCond cond;
 };
 
 G_DEFINE_TYPE (GstFragment, gst_fragment, G_TYPE_OBJECT);
@@ -158,6 +169,8 @@ gst_fragment_init (GstFragment * fragment)
   fragment->priv = priv = GST_FRAGMENT_GET_PRIVATE (fragment);
 
   g_mutex_init (&fragment->priv->lock);
+  g_cond_init (&fragment->priv->cond);
+  g_queue_init (&priv->chunks);
   priv->buffer = NULL;
   fragment->download_start_time = gst_util_get_timestamp ();
   fragment->start_time = 0;
@@ -174,6 +187,21 @@ gst_fragment_new (void)
   return GST_FRAGMENT (g_object_new (GST_TYPE_FRAGMENT, NULL));
 }
 
+/* Creates a fragment whose data can be consumed while it is still being
+ * downloaded. gst_fragment_add_buffer() blocks once @max_queued bytes are
+ * waiting to be popped, which throttles the download to the consumer. */
+GstFragment *
+gst_fragment_new_streaming (gsize max_queued)
+{
+  GstFragment *fragment;
+
+  fragment = gst_fragment_new ();
+  fragment->priv->streaming = TRUE;
+  fragment->priv->max_queued = MAX (max_queued, 1);
+
+  return fragment;
+}
+
 static void
 gst_fragment_finalize (GObject * gobject)
 {
@@ -181,6 +209,7 @@ gst_fragment_finalize (GObject * gobject)
 
   g_free (fragment->name);
   g_mutex_clear (&fragment->priv->lock);
+  g_cond_clear (&fragment->priv->cond);
 
   G_OBJECT_CLASS (gst_fragment_parent_class)->finalize (gobject);
 }
@@ -200,6 +229,10 @@ gst_fragment_dispose (GObject * object)
     priv->caps = NULL;
   }
 
+  g_queue_foreach (&priv->chunks, (GFunc) gst_buffer_unref, NULL);
+  g_queue_clear (&priv->chunks);
+  priv->queued = 0;
+
   G_OBJECT_CLASS (gst_fragment_parent_class)->dispose (object);
 }
 
@@ -208,7 +241,7 @@ gst_fragment_get_buffer (GstFragment * fragment)
 {
   g_return_val_if_fail (fragment != NULL, NULL);
 
-  if (!fragment->completed)
+  if (!fragment->completed || fragment->priv->buffer == NULL)
     return NULL;
 
   gst_buffer_ref (fragment->priv->buffer);
@@ -246,19 +279,165 @@ gst_fragment_get_caps (GstFragment * fragment)
 gboolean
 gst_fragment_add_buffer (GstFragment * fragment, GstBuffer * buffer)
 {
+  GstFragmentPrivate *priv;
+  gsize size;
+
   g_return_val_if_fail (fragment != NULL, FALSE);
   g_return_val_if_fail (buffer != NULL, FALSE);
 
+  priv = fragment->priv;
+
   if (fragment->completed) {
     GST_WARNING ("Fragment is completed, could not add more buffers");
+    gst_buffer_unref (buffer);
     return FALSE;
   }
 
+  size = gst_buffer_get_size (buffer);
+
+  if (priv->streaming) {
+    g_mutex_lock (&priv->lock);
+    if (priv->queued > 0 && priv->queued + size > priv->max_queued) {
+      GstClockTime wait_start = gst_util_get_timestamp ();
+
+      while (priv->queued > 0 && priv->queued + size > priv->max_queued
+          && !priv->cancelled) {
+        GST_LOG ("%" G_GSIZE_FORMAT " bytes queued, waiting for the consumer",
+            priv->queued);
+        g_cond_wait (&priv->cond, &priv->lock);
+      }
+      priv->stalled += gst_util_get_timestamp () - wait_start;
+    }
+    if (priv->cancelled) {
+      g_mutex_unlock (&priv->lock);
+      gst_buffer_unref (buffer);
+      return FALSE;
+    }
+    g_queue_push_tail (&priv->chunks, buffer);
+    priv->queued += size;
+    priv->size += size;
+    g_cond_broadcast (&priv->cond);
+    g_mutex_unlock (&priv->lock);
+    return TRUE;
+  }
+
   GST_DEBUG ("Adding new buffer to the fragment");
+  priv->size += size;
   /* We steal the buffers you pass in */
-  if (fragment->priv->buffer == NULL)
-    fragment->priv->buffer = buffer;
+  if (priv->buffer == NULL)
+    priv->buffer = buffer;
   else
-    fragment->priv->buffer = gst_buffer_append (fragment->priv->buffer, buffer);
+    priv->buffer = gst_buffer_append (priv->buffer, buffer);
   return TRUE;
 }
+
+/* Pops the next downloaded buffer of a streaming fragment, waiting for the
+ * download if needed. Returns NULL once all the data has been popped, or
+ * if the download was cancelled; @fragment->completed tells both apart. */
+GstBuffer *
+gst_fragment_pop_buffer (GstFragment * fragment)
+{
+  GstFragmentPrivate *priv;
+  GstBuffer *buffer;
+
+  g_return_val_if_fail (fragment != NULL, NULL);
+  g_return_val_if_fail (fragment->priv->streaming, NULL);
+
+  priv = fragment->priv;
+
+  g_mutex_lock (&priv->lock);
+  while (g_queue_is_empty (&priv->chunks) && !fragment->completed
+      && !priv->cancelled)
+    g_cond_wait (&priv->cond, &priv->lock);
+
+  if (priv->cancelled) {
+    buffer = NULL;
+  } else {
+    buffer = g_queue_pop_head (&priv->chunks);
+    if (buffer) {
+      priv->queued -= gst_buffer_get_size (buffer);
+      g_cond_broadcast (&priv->cond);
+    }
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return buffer;
+}
+
+/* Marks the download as finished, waking up any consumer waiting in
+ * gst_fragment_pop_buffer() */
+void
+gst_fragment_set_completed (GstFragment * fragment)
+{
+  g_return_if_fail (fragment != NULL);
+
+  g_mutex_lock (&fragment->priv->lock);
+  fragment->completed = TRUE;
+  fragment->download_stop_time = gst_util_get_timestamp ();
+  g_cond_broadcast (&fragment->priv->cond);
+  g_mutex_unlock (&fragment->priv->lock);
+}
+
+/* Waits for the download of @fragment to finish. Returns FALSE if it was
+ * cancelled */
+gboolean
+gst_fragment_wait (GstFragment * fragment)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (fragment != NULL, FALSE);
+
+  g_mutex_lock (&fragment->priv->lock);
+  while (!fragment->completed && !fragment->priv->cancelled)
+    g_cond_wait (&fragment->priv->cond, &fragment->priv->lock);
+  ret = !fragment->priv->cancelled;
+  g_mutex_unlock (&fragment->priv->lock);
+
+  return ret;
+}
+
+/* Aborts the download of @fragment: the producer and the consumers stop
+ * waiting and any data not popped yet is dropped. Completed fragments are
+ * left untouched. */
+void
+gst_fragment_cancel (GstFragment * fragment)
+{
+  g_return_if_fail (fragment != NULL);
+
+  g_mutex_lock (&fragment->priv->lock);
+  if (!fragment->completed)
+    fragment->priv->cancelled = TRUE;
+  g_cond_broadcast (&fragment->priv->cond);
+  g_mutex_unlock (&fragment->priv->lock);
+}
+
+gsize
+gst_fragment_get_size (GstFragment * fragment)
+{
+  g_return_val_if_fail (fragment != NULL, 0);
+
+  return fragment->priv->size;
+}
+
+/* Time spent downloading @fragment, not counting the time the download of a
+ * streaming fragment was throttled by its consumer. Returns
+ * GST_CLOCK_TIME_NONE until the download is completed. */
+GstClockTime
+gst_fragment_get_download_time (GstFragment * fragment)
+{
+  GstClockTime elapsed = GST_CLOCK_TIME_NONE;
+
+  g_return_val_if_fail (fragment != NULL, GST_CLOCK_TIME_NONE);
+
+  g_mutex_lock (&fragment->priv->lock);
+  if (fragment->completed) {
+    elapsed = fragment->download_stop_time - fragment->download_start_time;
+    if (elapsed > fragment->priv->stalled)
+      elapsed -= fragment->priv->stalled;
+    else
+      elapsed = 0;
+  }
+  g_mutex_unlock (&fragment->priv->lock);
+
+  return elapsed;
+}
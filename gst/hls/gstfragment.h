@@ -65,6 +65,13 @@ void gst_fragment_set_caps (GstFragment * fragment, GstCaps * caps);
 GstCaps * gst_fragment_get_caps (GstFragment * fragment);
 gboolean gst_fragment_add_buffer (GstFragment *fragment, GstBuffer *buffer);
 GstFragment * gst_fragment_new (void);
+GstFragment * gst_fragment_new_streaming (gsize max_queued);
+GstBuffer * gst_fragment_pop_buffer (GstFragment *fragment);
+void gst_fragment_set_completed (GstFragment *fragment);
+void gst_fragment_cancel (GstFragment *fragment);
+gboolean gst_fragment_wait (GstFragment *fragment);
+gsize gst_fragment_get_size (GstFragment *fragment);
+GstClockTime gst_fragment_get_download_time (GstFragment *fragment);
 
 G_END_DECLS
 #endif /* __GSTFRAGMENT_H__ */
@@ -46,6 +46,7 @@
 #define GLIB_DISABLE_DEPRECATION_WARNINGS
 
 #include <string.h>
+#include <gst/base/gsttypefindhelper.h>
 #include <gst/glib-compat-private.h>
 #include "gsthlsdemux.h"
 
@@ -69,6 +70,9 @@ enum
   PROP_FRAGMENTS_CACHE,
   PROP_BITRATE_LIMIT,
   PROP_CONNECTION_SPEED,
+  PROP_STREAMING,
+  PROP_MAX_IN_FLIGHT_BYTES,
+  PROP_MAX_DOWNLOADS,
   PROP_LAST
 };
 
@@ -78,6 +82,19 @@ static const float update_interval_factor[] = { 1, 0.5, 1.5, 3 };
 #define DEFAULT_FAILED_COUNT 3
 #define DEFAULT_BITRATE_LIMIT 0.8
 #define DEFAULT_CONNECTION_SPEED    0
+#define DEFAULT_STREAMING FALSE
+#define DEFAULT_MAX_IN_FLIGHT_BYTES (1024 * 1024)
+#define DEFAULT_MAX_DOWNLOADS 1
+
+/* how much of a fragment we accumulate at most when typefinding it in
+ * streaming mode */
+#define STREAMING_TYPEFIND_MAX_SIZE (64 * 1024)
+
+/* Amount of data buffered downstream, in target durations, below which we
+ * don't switch to a higher bitrate and above which we don't switch to a
+ * lower one */
+#define BUFFER_LEVEL_LOW 1.5
+#define BUFFER_LEVEL_HIGH 3
 
 /* GObject */
 static void gst_hls_demux_set_property (GObject * object, guint prop_id,
@@ -108,6 +125,12 @@ static gboolean gst_hls_demux_schedule (GstHLSDemux * demux);
 static gboolean gst_hls_demux_switch_playlist (GstHLSDemux * demux);
 static gboolean gst_hls_demux_get_next_fragment (GstHLSDemux * demux,
     gboolean caching);
+static GstFlowReturn gst_hls_demux_prefetch (GstHLSDemux * demux);
+static GstFragment *gst_hls_demux_peek_download (GstHLSDemux * demux);
+static GstFragment *gst_hls_demux_pop_download (GstHLSDemux * demux);
+static void gst_hls_demux_cancel_downloads (GstHLSDemux * demux);
+static void gst_hls_demux_clear_downloads (GstHLSDemux * demux,
+    gboolean rewind);
 static gboolean gst_hls_demux_update_playlist (GstHLSDemux * demux,
     gboolean update);
 static void gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose);
@@ -141,6 +164,7 @@ gst_hls_demux_dispose (GObject * obj)
       GST_DEBUG_OBJECT (demux, "Leaving updates task");
       demux->cancelled = TRUE;
       gst_uri_downloader_cancel (demux->downloader);
+      gst_hls_demux_cancel_downloads (demux);
       gst_task_stop (demux->updates_task);
       g_mutex_lock (&demux->updates_timed_lock);
       GST_TASK_SIGNAL (demux->updates_task);
@@ -162,6 +186,17 @@ gst_hls_demux_dispose (GObject * obj)
 
   gst_hls_demux_reset (demux, TRUE);
 
+  while (!g_queue_is_empty (demux->idle_downloaders))
+    g_object_unref (g_queue_pop_head (demux->idle_downloaders));
+  g_queue_free (demux->idle_downloaders);
+  g_queue_free (demux->downloads);
+  g_mutex_clear (&demux->downloads_lock);
+
+  if (demux->estimator != NULL) {
+    gst_bandwidth_estimator_free (demux->estimator);
+    demux->estimator = NULL;
+  }
+
   g_queue_free (demux->queue);
 
   G_OBJECT_CLASS (parent_class)->dispose (obj);
@@ -199,6 +234,26 @@ gst_hls_demux_class_init (GstHLSDemuxClass * klass)
           0, G_MAXUINT / 1000, DEFAULT_CONNECTION_SPEED,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_STREAMING,
+      g_param_spec_boolean ("streaming", "Streaming",
+          "Push the fragments downstream while they are being downloaded "
+          "instead of caching complete fragments",
+          DEFAULT_STREAMING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_IN_FLIGHT_BYTES,
+      g_param_spec_uint ("max-in-flight-bytes", "Max in-flight bytes",
+          "Maximum amount of downloaded data waiting to be pushed in streaming "
+          "mode, the download is throttled above it",
+          1, G_MAXUINT, DEFAULT_MAX_IN_FLIGHT_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_DOWNLOADS,
+      g_param_spec_uint ("max-downloads", "Max downloads",
+          "Maximum number of fragments downloaded in parallel, the ones "
+          "following the fragment needed next are prefetched",
+          1, 16, DEFAULT_MAX_DOWNLOADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class->change_state = GST_DEBUG_FUNCPTR (gst_hls_demux_change_state);
 
   gst_element_class_add_pad_template (element_class,
@@ -231,13 +286,22 @@ gst_hls_demux_init (GstHLSDemux * demux)
 
   /* Downloader */
   demux->downloader = gst_uri_downloader_new ();
+  demux->estimator = gst_bandwidth_estimator_new ();
+  g_mutex_init (&demux->downloads_lock);
+  demux->downloads = g_queue_new ();
+  demux->idle_downloaders = g_queue_new ();
 
   demux->do_typefind = TRUE;
+  gst_segment_init (&demux->segment, GST_FORMAT_TIME);
+  demux->download_end = GST_CLOCK_TIME_NONE;
 
   /* Properties */
   demux->fragments_cache = DEFAULT_FRAGMENTS_CACHE;
   demux->bitrate_limit = DEFAULT_BITRATE_LIMIT;
   demux->connection_speed = DEFAULT_CONNECTION_SPEED;
+  demux->streaming = DEFAULT_STREAMING;
+  demux->max_in_flight_bytes = DEFAULT_MAX_IN_FLIGHT_BYTES;
+  demux->max_downloads = DEFAULT_MAX_DOWNLOADS;
 
   demux->queue = g_queue_new ();
 
@@ -271,6 +335,15 @@ gst_hls_demux_set_property (GObject * object, guint prop_id,
     case PROP_CONNECTION_SPEED:
       demux->connection_speed = g_value_get_uint (value) * 1000;
       break;
+    case PROP_STREAMING:
+      demux->streaming = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_IN_FLIGHT_BYTES:
+      demux->max_in_flight_bytes = g_value_get_uint (value);
+      break;
+    case PROP_MAX_DOWNLOADS:
+      demux->max_downloads = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -293,6 +366,15 @@ gst_hls_demux_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_CONNECTION_SPEED:
       g_value_set_uint (value, demux->connection_speed / 1000);
       break;
+    case PROP_STREAMING:
+      g_value_set_boolean (value, demux->streaming);
+      break;
+    case PROP_MAX_IN_FLIGHT_BYTES:
+      g_value_set_uint (value, demux->max_in_flight_bytes);
+      break;
+    case PROP_MAX_DOWNLOADS:
+      g_value_set_uint (value, demux->max_downloads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -314,8 +396,14 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition)
          the main playlist. It might have been stopped if we were in PAUSED
          state and we filled our queue with enough cached fragments
        */
-      if (gst_m3u8_client_get_uri (demux->client)[0] != '\0')
+      if (gst_m3u8_client_get_uri (demux->client)[0] != '\0') {
         gst_task_start (demux->updates_task);
+        /* In streaming mode the stream task pauses when it sees the
+         * cancellation of PLAYING_TO_PAUSED, and only the updates of live
+         * playlists would start it again */
+        if (demux->streaming && !demux->end_of_playlist)
+          gst_task_start (demux->stream_task);
+      }
       break;
     default:
       break;
@@ -327,12 +415,20 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition)
     case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
       demux->cancelled = TRUE;
       gst_uri_downloader_cancel (demux->downloader);
+      /* in streaming mode fragments are fetched by the stream task, which is
+       * started again when going back to PLAYING */
+      if (!demux->streaming)
+        gst_hls_demux_cancel_downloads (demux);
       gst_task_stop (demux->updates_task);
       g_mutex_lock (&demux->updates_timed_lock);
       GST_TASK_SIGNAL (demux->updates_task);
       g_mutex_unlock (&demux->updates_timed_lock);
       g_rec_mutex_lock (&demux->updates_lock);
       g_rec_mutex_unlock (&demux->updates_lock);
+      /* the fragments that were being downloaded are fetched again when
+       * going back to PLAYING */
+      if (!demux->streaming)
+        gst_hls_demux_clear_downloads (demux, TRUE);
       demux->cancelled = FALSE;
       break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
@@ -414,6 +510,7 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       demux->cancelled = TRUE;
       gst_task_pause (demux->stream_task);
       gst_uri_downloader_cancel (demux->downloader);
+      gst_hls_demux_cancel_downloads (demux);
       gst_task_stop (demux->updates_task);
       g_mutex_lock (&demux->updates_timed_lock);
       GST_TASK_SIGNAL (demux->updates_task);
@@ -432,12 +529,21 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       }
       g_queue_clear (demux->queue);
 
+      gst_hls_demux_clear_downloads (demux, FALSE);
+      if (demux->current_fragment) {
+        g_object_unref (demux->current_fragment);
+        demux->current_fragment = NULL;
+      }
+
       GST_M3U8_CLIENT_LOCK (demux->client);
       GST_DEBUG_OBJECT (demux, "seeking to sequence %d", current_sequence);
       demux->client->sequence = current_sequence;
       gst_m3u8_client_get_current_position (demux->client, &position);
       demux->position_shift = start - position;
       demux->need_segment = TRUE;
+      GST_OBJECT_LOCK (demux);
+      demux->download_end = GST_CLOCK_TIME_NONE;
+      GST_OBJECT_UNLOCK (demux);
       GST_M3U8_CLIENT_UNLOCK (demux->client);
 
 
@@ -622,6 +728,7 @@ gst_hls_demux_pause_tasks (GstHLSDemux * demux, gboolean caching)
 
   if (GST_TASK_STATE (demux->stream_task) != GST_TASK_STOPPED) {
     demux->stop_stream_task = TRUE;
+    gst_hls_demux_cancel_downloads (demux);
     gst_task_pause (demux->stream_task);
   }
 }
@@ -630,6 +737,7 @@ static void
 gst_hls_demux_stop (GstHLSDemux * demux)
 {
   gst_uri_downloader_cancel (demux->downloader);
+  gst_hls_demux_cancel_downloads (demux);
 
   if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
     demux->cancelled = TRUE;
@@ -687,19 +795,41 @@ switch_pads (GstHLSDemux * demux, GstCaps * newcaps)
   }
 }
 
+/* Typefinds the first data of the current fragment in streaming mode,
+ * appending more of it to @buf if the first buffer isn't enough */
+static GstCaps *
+gst_hls_demux_typefind_streaming (GstHLSDemux * demux, GstBuffer ** buf)
+{
+  GstCaps *caps;
+  GstBuffer *next;
+
+  while (!(caps = gst_type_find_helper_for_buffer (NULL, *buf, NULL))) {
+    if (gst_buffer_get_size (*buf) >= STREAMING_TYPEFIND_MAX_SIZE)
+      break;
+    next = gst_fragment_pop_buffer (demux->current_fragment);
+    if (next == NULL)
+      break;
+    *buf = gst_buffer_append (*buf, next);
+  }
+
+  return caps;
+}
+
 static void
 gst_hls_demux_stream_loop (GstHLSDemux * demux)
 {
   GstFragment *fragment;
   GstBuffer *buf;
   GstFlowReturn ret;
-  GstCaps *bufcaps, *srccaps = NULL;
+  GstCaps *bufcaps = NULL, *srccaps = NULL;
 
   /* Loop for the source pad task. The task is started when we have
    * received the main playlist from the source element. It tries first to
    * cache the first fragments and then it waits until it has more data in the
    * queue. This task is woken up when we push a new fragment to the queue or
-   * when we reached the end of the playlist  */
+   * when we reached the end of the playlist.
+   * In streaming mode nothing is cached, the task downloads the fragments
+   * itself and pushes their data as soon as it arrives. */
 
   if (G_UNLIKELY (demux->need_cache)) {
     if (!gst_hls_demux_cache_fragments (demux))
@@ -711,31 +841,107 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
     GST_INFO_OBJECT (demux, "First fragments cached successfully");
   }
 
-  if (g_queue_is_empty (demux->queue)) {
-    if (demux->end_of_playlist)
-      goto end_of_playlist;
+  if (demux->streaming) {
+    if (demux->current_fragment == NULL) {
+      ret = gst_hls_demux_prefetch (demux);
+      demux->current_fragment = gst_hls_demux_peek_download (demux);
+      if (demux->current_fragment == NULL) {
+        if (ret != GST_FLOW_EOS)
+          goto fragment_error;
+        GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
+        if (!gst_m3u8_client_is_live (demux->client)) {
+          demux->end_of_playlist = TRUE;
+          goto end_of_playlist;
+        }
+        /* live playlist, wait for the updates task to get new fragments */
+        goto pause_task;
+      }
+      demux->fragment_start = TRUE;
+    }
 
-    goto pause_task;
-  }
+    if (demux->cancelled)
+      goto pause_task;
+
+    fragment = demux->current_fragment;
+    buf = gst_fragment_pop_buffer (fragment);
+    if (buf == NULL) {
+      demux->current_fragment = NULL;
+      g_object_unref (gst_hls_demux_pop_download (demux));
+      if (fragment->completed) {
+        GST_DEBUG_OBJECT (demux, "Fragment pushed completely");
+        demux->client->update_failed_count = 0;
+        GST_OBJECT_LOCK (demux);
+        demux->download_end = fragment->stop_time;
+        GST_OBJECT_UNLOCK (demux);
+        gst_hls_demux_update_fragment_bitrate (demux, fragment);
+        gst_hls_demux_switch_playlist (demux);
+        g_object_unref (fragment);
+        return;
+      }
+      g_object_unref (fragment);
+      if (demux->cancelled)
+        goto pause_task;
+      goto fragment_error;
+    }
 
-  fragment = g_queue_pop_head (demux->queue);
-  buf = gst_fragment_get_buffer (fragment);
+    if (G_UNLIKELY (demux->fragment_start)) {
+      demux->fragment_start = FALSE;
+
+      /* We actually need to do this every time we switch bitrate */
+      if (G_UNLIKELY (demux->do_typefind)) {
+        bufcaps = gst_hls_demux_typefind_streaming (demux, &buf);
+        if (bufcaps == NULL) {
+          gst_buffer_unref (buf);
+          goto typefind_error;
+        }
+        gst_caps_replace (&demux->input_caps, bufcaps);
+        GST_INFO_OBJECT (demux, "Input source caps: %" GST_PTR_FORMAT,
+            demux->input_caps);
+        demux->do_typefind = FALSE;
+      } else {
+        bufcaps = gst_caps_ref (demux->input_caps);
+      }
+
+      buf = gst_buffer_make_writable (buf);
+      GST_BUFFER_PTS (buf) = fragment->start_time;
+      GST_OBJECT_LOCK (demux);
+      demux->download_end = fragment->start_time;
+      GST_OBJECT_UNLOCK (demux);
+      if (fragment->discontinuous) {
+        GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
+        GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+      }
+    }
+  } else {
+    if (g_queue_is_empty (demux->queue)) {
+      if (demux->end_of_playlist)
+        goto end_of_playlist;
+
+      goto pause_task;
+    }
+
+    fragment = g_queue_pop_head (demux->queue);
+    buf = gst_fragment_get_buffer (fragment);
+    bufcaps = gst_fragment_get_caps (fragment);
+    g_object_unref (fragment);
+  }
 
   /* Figure out if we need to create/switch pads */
-  if (G_LIKELY (demux->srcpad))
-    srccaps = gst_pad_get_current_caps (demux->srcpad);
-  bufcaps = gst_fragment_get_caps (fragment);
-  if (G_UNLIKELY (!srccaps || !gst_caps_is_equal_fixed (bufcaps, srccaps)
-          || demux->need_segment)) {
-    switch_pads (demux, bufcaps);
-    demux->need_segment = TRUE;
+  if (G_UNLIKELY (bufcaps)) {
+    if (G_LIKELY (demux->srcpad))
+      srccaps = gst_pad_get_current_caps (demux->srcpad);
+    if (G_UNLIKELY (!srccaps || !gst_caps_is_equal_fixed (bufcaps, srccaps)
+            || demux->need_segment)) {
+      switch_pads (demux, bufcaps);
+      demux->need_segment = TRUE;
+    }
+    gst_caps_unref (bufcaps);
+    if (G_LIKELY (srccaps))
+      gst_caps_unref (srccaps);
   }
-  gst_caps_unref (bufcaps);
-  if (G_LIKELY (srccaps))
-    gst_caps_unref (srccaps);
-  g_object_unref (fragment);
 
-  if (demux->need_segment) {
+  /* in streaming mode, only the first buffer of a fragment is timestamped */
+  if (demux->need_segment && GST_BUFFER_PTS_IS_VALID (buf)) {
     GstSegment segment;
     GstClockTime start = GST_BUFFER_PTS (buf);
 
@@ -747,6 +953,9 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
     segment.start = start;
     segment.time = start;
     gst_pad_push_event (demux->srcpad, gst_event_new_segment (&segment));
+    GST_OBJECT_LOCK (demux);
+    demux->segment = segment;
+    GST_OBJECT_UNLOCK (demux);
     demux->need_segment = FALSE;
     demux->position_shift = 0;
   }
@@ -776,6 +985,28 @@ cache_error:
     return;
   }
 
+fragment_error:
+  {
+    /* the next iteration moves on to the following fragment */
+    demux->client->update_failed_count++;
+    if (demux->client->update_failed_count < DEFAULT_FAILED_COUNT) {
+      GST_WARNING_OBJECT (demux, "Could not fetch the next fragment");
+      return;
+    }
+    GST_ELEMENT_ERROR (demux, RESOURCE, NOT_FOUND,
+        ("Could not fetch the next fragment"), (NULL));
+    gst_hls_demux_pause_tasks (demux, FALSE);
+    return;
+  }
+
+typefind_error:
+  {
+    GST_ELEMENT_ERROR (demux, STREAM, TYPE_NOT_FOUND,
+        ("Could not determine type of stream"), (NULL));
+    gst_hls_demux_pause_tasks (demux, FALSE);
+    return;
+  }
+
 error_pushing:
   {
     if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
@@ -830,8 +1061,22 @@ gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose)
   }
   g_queue_clear (demux->queue);
 
+  gst_hls_demux_clear_downloads (demux, FALSE);
+  if (demux->current_fragment) {
+    g_object_unref (demux->current_fragment);
+    demux->current_fragment = NULL;
+  }
+
+  if (demux->estimator)
+    gst_bandwidth_estimator_reset (demux->estimator);
+
   demux->position_shift = 0;
   demux->need_segment = TRUE;
+  demux->fragment_bitrate = 0;
+  GST_OBJECT_LOCK (demux);
+  gst_segment_init (&demux->segment, GST_FORMAT_TIME);
+  demux->download_end = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (demux);
 }
 
 static gboolean
@@ -887,6 +1132,10 @@ gst_hls_demux_updates_loop (GstHLSDemux * demux)
           goto error;
         }
       }
+
+      /* in streaming mode the stream task might be waiting for new fragments */
+      if (demux->streaming)
+        gst_task_start (demux->stream_task);
     }
 
     /* if it's a live source and the playlist couldn't be updated, there aren't
@@ -903,8 +1152,8 @@ gst_hls_demux_updates_loop (GstHLSDemux * demux)
     if (demux->cancelled)
       goto quit;
 
-    /* fetch the next fragment */
-    if (g_queue_is_empty (demux->queue)) {
+    /* fetch the next fragment, the stream task does it in streaming mode */
+    if (!demux->streaming && g_queue_is_empty (demux->queue)) {
       if (!gst_hls_demux_get_next_fragment (demux, FALSE)) {
         if (demux->cancelled) {
           goto quit;
@@ -986,8 +1235,8 @@ gst_hls_demux_cache_fragments (GstHLSDemux * demux)
           gst_message_new_duration_changed (GST_OBJECT (demux)));
   }
 
-  /* Cache the first fragments */
-  for (i = 0; i < demux->fragments_cache; i++) {
+  /* Cache the first fragments, unless they are pushed while downloading */
+  for (i = 0; !demux->streaming && i < demux->fragments_cache; i++) {
     gst_element_post_message (GST_ELEMENT (demux),
         gst_message_new_buffering (GST_OBJECT (demux),
             100 * i / demux->fragments_cache));
@@ -1089,27 +1338,129 @@ gst_hls_demux_update_playlist (GstHLSDemux * demux, gboolean update)
   return updated;
 }
 
+/* Returns how much data we have ahead of the playback position, whether it
+ * is already downstream or still waiting in our queue. The end of the
+ * downloaded data is converted to running time with the last segment we
+ * pushed and compared with the running time of the pipeline, since the
+ * position reported downstream is in another time base. Returns
+ * GST_CLOCK_TIME_NONE when it isn't known, e.g. when not playing. */
+static GstClockTime
+gst_hls_demux_get_buffer_level (GstHLSDemux * demux)
+{
+  GstClock *clock = NULL;
+  GstClockTime base_time, now, download_end, end;
+
+  GST_OBJECT_LOCK (demux);
+  download_end = demux->download_end;
+  end = gst_segment_to_running_time (&demux->segment, GST_FORMAT_TIME,
+      download_end);
+  if (GST_STATE (demux) == GST_STATE_PLAYING
+      && (clock = GST_ELEMENT_CLOCK (demux)))
+    gst_object_ref (clock);
+  base_time = GST_ELEMENT_CAST (demux)->base_time;
+  GST_OBJECT_UNLOCK (demux);
+
+  if (clock == NULL || !GST_CLOCK_TIME_IS_VALID (download_end)) {
+    if (clock)
+      gst_object_unref (clock);
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  now = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  /* data that ends before the segment start is all behind us */
+  if (!GST_CLOCK_TIME_IS_VALID (end))
+    return 0;
+
+  now = now > base_time ? now - base_time : 0;
+
+  return end > now ? end - now : 0;
+}
+
+/* Keeps track of the throughput of the last completed fragment, used until
+ * the estimator has enough samples */
+static void
+gst_hls_demux_update_fragment_bitrate (GstHLSDemux * demux,
+    GstFragment * fragment)
+{
+  GstClockTime download_time = gst_fragment_get_download_time (fragment);
+
+  if (GST_CLOCK_TIME_IS_VALID (download_time) && download_time > 0)
+    demux->fragment_bitrate =
+        gst_util_uint64_scale (gst_fragment_get_size (fragment),
+        8 * GST_SECOND, download_time);
+}
+
+static void
+gst_hls_demux_post_switch_decision (GstHLSDemux * demux, guint max_bitrate,
+    GstClockTime buffer_level, gint old_bandwidth, gint new_bandwidth,
+    const gchar * reason)
+{
+  GstStructure *s;
+
+  s = gst_structure_new ("hls-switch-decision",
+      "bandwidth-estimate", G_TYPE_UINT64,
+      gst_bandwidth_estimator_get_bitrate (demux->estimator),
+      "max-bitrate", G_TYPE_UINT, max_bitrate,
+      "buffer-level", G_TYPE_UINT64, buffer_level,
+      "old-bitrate", G_TYPE_INT, old_bandwidth,
+      "new-bitrate", G_TYPE_INT, new_bandwidth,
+      "reason", G_TYPE_STRING, reason, NULL);
+  gst_element_post_message (GST_ELEMENT_CAST (demux),
+      gst_message_new_element (GST_OBJECT_CAST (demux), s));
+}
+
 static gboolean
 gst_hls_demux_change_playlist (GstHLSDemux * demux, guint max_bitrate)
 {
   GList *previous_variant, *current_variant;
   gint old_bandwidth, new_bandwidth;
+  GstClockTime buffer_level, target_duration;
+  const gchar *reason = "bandwidth";
 
   /* If user specifies a connection speed never use a playlist with a bandwidth
    * superior than it */
   if (demux->connection_speed != 0 && max_bitrate > demux->connection_speed)
     max_bitrate = demux->connection_speed;
 
-  previous_variant = demux->client->main->current_variant;
+  buffer_level = gst_hls_demux_get_buffer_level (demux);
+  target_duration = gst_m3u8_client_get_target_duration (demux->client);
+
   current_variant = gst_m3u8_client_get_playlist_for_bitrate (demux->client,
       max_bitrate);
 
+  GST_M3U8_CLIENT_LOCK (demux->client);
+  previous_variant = demux->client->main->current_variant;
+
+  /* Going up with little data buffered risks a stall if the estimate was
+   * optimistic, and going down while a lot is buffered reacts to dips that
+   * the buffer can absorb */
+  if (GST_CLOCK_TIME_IS_VALID (buffer_level) &&
+      GST_CLOCK_TIME_IS_VALID (target_duration)) {
+    old_bandwidth = GST_M3U8 (previous_variant->data)->bandwidth;
+    new_bandwidth = GST_M3U8 (current_variant->data)->bandwidth;
+
+    if (new_bandwidth > old_bandwidth &&
+        buffer_level < target_duration * BUFFER_LEVEL_LOW) {
+      current_variant = previous_variant;
+      reason = "buffer-low";
+    } else if (new_bandwidth < old_bandwidth &&
+        buffer_level > target_duration * BUFFER_LEVEL_HIGH) {
+      current_variant = previous_variant;
+      reason = "buffer-high";
+    }
+  }
+
 retry_failover_protection:
   old_bandwidth = GST_M3U8 (previous_variant->data)->bandwidth;
   new_bandwidth = GST_M3U8 (current_variant->data)->bandwidth;
 
   /* Don't do anything else if the playlist is the same */
   if (new_bandwidth == old_bandwidth) {
+    GST_M3U8_CLIENT_UNLOCK (demux->client);
+    GST_LOG_OBJECT (demux, "Staying on %dbps (%s), max allowed is %dbps",
+        old_bandwidth, reason, max_bitrate);
     return TRUE;
   }
 
@@ -1119,11 +1470,18 @@ retry_failover_protection:
   gst_m3u8_client_set_current (demux->client, current_variant->data);
 
   GST_INFO_OBJECT (demux, "Client was on %dbps, max allowed is %dbps, switching"
-      " to bitrate %dbps", old_bandwidth, max_bitrate, new_bandwidth);
+      " to bitrate %dbps, buffer level %" GST_TIME_FORMAT, old_bandwidth,
+      max_bitrate, new_bandwidth, GST_TIME_ARGS (buffer_level));
 
   if (gst_hls_demux_update_playlist (demux, FALSE)) {
     GstStructure *s;
 
+    gst_hls_demux_post_switch_decision (demux, max_bitrate, buffer_level,
+        old_bandwidth, new_bandwidth, reason);
+
+    /* the prefetched fragments are from the previous variant */
+    gst_hls_demux_clear_downloads (demux, TRUE);
+
     s = gst_structure_new ("playlist",
         "uri", G_TYPE_STRING, gst_m3u8_client_get_current_uri (demux->client),
         "bitrate", G_TYPE_INT, new_bandwidth, NULL);
@@ -1190,12 +1548,7 @@ gst_hls_demux_schedule (GstHLSDemux * demux)
 static gboolean
 gst_hls_demux_switch_playlist (GstHLSDemux * demux)
 {
-  GTimeVal now;
-  GstClockTime diff;
-  gsize size;
-  gint bitrate;
-  GstFragment *fragment = g_queue_peek_tail (demux->queue);
-  GstBuffer *buffer;
+  guint64 bitrate;
 
   GST_M3U8_CLIENT_LOCK (demux->client);
   if (!demux->client->main->lists) {
@@ -1204,50 +1557,60 @@ gst_hls_demux_switch_playlist (GstHLSDemux * demux)
   }
   GST_M3U8_CLIENT_UNLOCK (demux->client);
 
-  /* compare the time when the fragment was downloaded with the time when it was
-   * scheduled */
-  g_get_current_time (&now);
-  diff = (GST_TIMEVAL_TO_TIME (now) - GST_TIMEVAL_TO_TIME (demux->next_update));
-  buffer = gst_fragment_get_buffer (fragment);
-  size = gst_buffer_get_size (buffer);
-  bitrate = (size * 8) / ((double) diff / GST_SECOND);
+  bitrate = gst_bandwidth_estimator_get_bitrate (demux->estimator);
+  if (bitrate == 0)
+    bitrate = demux->fragment_bitrate;
+  if (bitrate == 0) {
+    GST_DEBUG_OBJECT (demux, "No bandwidth estimate yet");
+    return TRUE;
+  }
 
-  GST_DEBUG ("Downloaded %d bytes in %" GST_TIME_FORMAT ". Bitrate is : %d",
-      (guint) size, GST_TIME_ARGS (diff), bitrate);
+  GST_DEBUG_OBJECT (demux, "Estimated bandwidth is %" G_GUINT64_FORMAT "bps",
+      bitrate);
 
-  gst_buffer_unref (buffer);
-  return gst_hls_demux_change_playlist (demux, bitrate * demux->bitrate_limit);
+  return gst_hls_demux_change_playlist (demux,
+      MIN (bitrate * demux->bitrate_limit, G_MAXUINT));
 }
 
 static gboolean
 gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
 {
   GstFragment *download;
-  const gchar *next_fragment_uri;
-  GstClockTime duration;
-  GstClockTime timestamp;
   GstBuffer *buf;
-  gboolean discont;
+  GstFlowReturn ret;
 
-  if (!gst_m3u8_client_get_next_fragment (demux->client, &discont,
-          &next_fragment_uri, &duration, &timestamp)) {
+  ret = gst_hls_demux_prefetch (demux);
+  download = gst_hls_demux_peek_download (demux);
+
+  if (download == NULL) {
+    if (ret != GST_FLOW_EOS)
+      goto error;
     GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
     demux->end_of_playlist = TRUE;
     gst_task_start (demux->stream_task);
     return FALSE;
   }
 
-  GST_INFO_OBJECT (demux, "Fetching next fragment %s", next_fragment_uri);
-
-  download = gst_uri_downloader_fetch_uri (demux->downloader,
-      next_fragment_uri);
-
-  if (download == NULL)
+  /* the downloads can finish in any order, but we take them in playlist
+   * order: wait for the first one */
+  GST_INFO_OBJECT (demux, "Waiting for fragment %s", download->name);
+  if (!gst_fragment_wait (download)) {
+    g_object_unref (download);
+    /* whoever cancelled us takes care of the downloads */
+    if (demux->cancelled)
+      return FALSE;
+    g_object_unref (gst_hls_demux_pop_download (demux));
     goto error;
+  }
+  g_object_unref (gst_hls_demux_pop_download (demux));
 
   buf = gst_fragment_get_buffer (download);
-  GST_BUFFER_DURATION (buf) = duration;
-  GST_BUFFER_PTS (buf) = timestamp;
+  GST_BUFFER_DURATION (buf) = download->stop_time - download->start_time;
+  GST_BUFFER_PTS (buf) = download->start_time;
+  GST_OBJECT_LOCK (demux);
+  demux->download_end = download->stop_time;
+  GST_OBJECT_UNLOCK (demux);
+  gst_hls_demux_update_fragment_bitrate (demux, download);
 
   /* We actually need to do this every time we switch bitrate */
   if (G_UNLIKELY (demux->do_typefind)) {
@@ -1265,10 +1628,11 @@ gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
     gst_fragment_set_caps (download, demux->input_caps);
   }
 
-  if (discont) {
+  if (download->discontinuous) {
     GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
     GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
   }
+  gst_buffer_unref (buf);
 
   g_queue_push_tail (demux->queue, download);
   if (!caching) {
@@ -1283,3 +1647,182 @@ error:
     return FALSE;
   }
 }
+
+/* Fragment downloads
+ *
+ * Up to max-downloads fragments are downloaded in parallel, each by its own
+ * GstUriDownloader. The downloads are kept in playlist order in
+ * demux->downloads: the first one is the fragment needed next and the
+ * others are speculative prefetches, dropped when switching variant or
+ * seeking. In streaming mode the first fragment is pushed while it is being
+ * downloaded, and the prefetched ones pause once they have
+ * max-in-flight-bytes waiting. */
+
+typedef struct
+{
+  GstUriDownloader *downloader;
+  GstFragment *fragment;
+} GstHLSDemuxDownload;
+
+/* Starts downloading the next fragment of the playlist. Returns GST_FLOW_EOS
+ * if the playlist has no more fragments for now. Must be called with the
+ * downloads lock */
+static GstFlowReturn
+gst_hls_demux_start_download (GstHLSDemux * demux)
+{
+  GstHLSDemuxDownload *download;
+  GstUriDownloader *downloader;
+  GstFragment *fragment;
+  const gchar *next_fragment_uri;
+  GstClockTime duration;
+  GstClockTime timestamp;
+  gboolean discont;
+
+  if (!gst_m3u8_client_get_next_fragment (demux->client, &discont,
+          &next_fragment_uri, &duration, &timestamp))
+    return GST_FLOW_EOS;
+
+  GST_INFO_OBJECT (demux, "Fetching next fragment %s", next_fragment_uri);
+
+  if (demux->streaming)
+    fragment = gst_fragment_new_streaming (demux->max_in_flight_bytes);
+  else
+    fragment = gst_fragment_new ();
+  g_free (fragment->name);
+  fragment->name = g_strdup (next_fragment_uri);
+  GST_M3U8_CLIENT_LOCK (demux->client);
+  fragment->index = demux->client->sequence - 1;
+  GST_M3U8_CLIENT_UNLOCK (demux->client);
+  fragment->start_time = timestamp;
+  fragment->stop_time = timestamp + duration;
+  fragment->discontinuous = discont;
+
+  downloader = g_queue_pop_head (demux->idle_downloaders);
+  if (downloader == NULL) {
+    downloader = gst_uri_downloader_new ();
+    gst_uri_downloader_set_bandwidth_estimator (downloader, demux->estimator);
+  }
+
+  if (!gst_uri_downloader_start (downloader, next_fragment_uri, fragment)) {
+    GST_WARNING_OBJECT (demux, "Could not start downloading %s",
+        next_fragment_uri);
+    g_queue_push_head (demux->idle_downloaders, downloader);
+    g_object_unref (fragment);
+    return GST_FLOW_ERROR;
+  }
+
+  download = g_slice_new (GstHLSDemuxDownload);
+  download->downloader = downloader;
+  download->fragment = fragment;
+  g_queue_push_tail (demux->downloads, download);
+
+  return GST_FLOW_OK;
+}
+
+/* Starts downloads until max-downloads are in flight */
+static GstFlowReturn
+gst_hls_demux_prefetch (GstHLSDemux * demux)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  g_mutex_lock (&demux->downloads_lock);
+  while (g_queue_get_length (demux->downloads) < demux->max_downloads) {
+    ret = gst_hls_demux_start_download (demux);
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+  g_mutex_unlock (&demux->downloads_lock);
+
+  return ret;
+}
+
+/* Returns a new reference to the fragment needed next */
+static GstFragment *
+gst_hls_demux_peek_download (GstHLSDemux * demux)
+{
+  GstHLSDemuxDownload *download;
+  GstFragment *fragment = NULL;
+
+  g_mutex_lock (&demux->downloads_lock);
+  download = g_queue_peek_head (demux->downloads);
+  if (download)
+    fragment = g_object_ref (download->fragment);
+  g_mutex_unlock (&demux->downloads_lock);
+
+  return fragment;
+}
+
+/* Frees @download and returns its fragment. Must be called with the
+ * downloads lock */
+static GstFragment *
+gst_hls_demux_release_download (GstHLSDemux * demux,
+    GstHLSDemuxDownload * download)
+{
+  GstFragment *fragment = download->fragment;
+
+  /* stops the source, cancelling the fragment if it was still running */
+  gst_uri_downloader_reset (download->downloader);
+  g_queue_push_tail (demux->idle_downloaders, download->downloader);
+  g_slice_free (GstHLSDemuxDownload, download);
+
+  return fragment;
+}
+
+/* Removes the first download and returns its fragment */
+static GstFragment *
+gst_hls_demux_pop_download (GstHLSDemux * demux)
+{
+  GstHLSDemuxDownload *download;
+  GstFragment *fragment = NULL;
+
+  g_mutex_lock (&demux->downloads_lock);
+  download = g_queue_pop_head (demux->downloads);
+  if (download)
+    fragment = gst_hls_demux_release_download (demux, download);
+  g_mutex_unlock (&demux->downloads_lock);
+
+  return fragment;
+}
+
+/* Aborts the running downloads, waking up whoever waits for them. They stay
+ * in the list until it is cleared */
+static void
+gst_hls_demux_cancel_downloads (GstHLSDemux * demux)
+{
+  GList *walk;
+
+  g_mutex_lock (&demux->downloads_lock);
+  for (walk = demux->downloads->head; walk; walk = walk->next) {
+    GstHLSDemuxDownload *download = walk->data;
+
+    gst_uri_downloader_cancel (download->downloader);
+  }
+  g_mutex_unlock (&demux->downloads_lock);
+}
+
+/* Drops all the downloads. With @rewind, the playlist goes back to the
+ * first dropped fragment so that it gets fetched again */
+static void
+gst_hls_demux_clear_downloads (GstHLSDemux * demux, gboolean rewind)
+{
+  GstHLSDemuxDownload *download;
+  gint sequence = -1;
+
+  g_mutex_lock (&demux->downloads_lock);
+  while ((download = g_queue_pop_head (demux->downloads))) {
+    GstFragment *fragment = gst_hls_demux_release_download (demux, download);
+
+    if (sequence == -1)
+      sequence = fragment->index;
+    g_object_unref (fragment);
+  }
+  g_mutex_unlock (&demux->downloads_lock);
+
+  if (rewind && sequence != -1) {
+    GST_DEBUG_OBJECT (demux, "Dropped the prefetched fragments, going back "
+        "to sequence %d", sequence);
+    GST_M3U8_CLIENT_LOCK (demux->client);
+    demux->client->sequence = sequence;
+    GST_M3U8_CLIENT_UNLOCK (demux->client);
+  }
+}
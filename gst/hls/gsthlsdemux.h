@@ -29,6 +29,7 @@
 #include "m3u8.h"
 #include "gstfragmented.h"
 #include "gsturidownloader.h"
+#include "gstbandwidthestimator.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_HLS_DEMUX \
@@ -60,17 +61,30 @@ struct _GstHLSDemux
 
   GstBuffer *playlist;
   GstCaps *input_caps;
-  GstUriDownloader *downloader;
+  GstUriDownloader *downloader; /* Fetches the playlists */
+  GstBandwidthEstimator *estimator;     /* Fed by the fragment downloads */
   GstM3U8Client *client;        /* M3U8 client */
   GQueue *queue;                /* Queue storing the fetched fragments */
   gboolean need_cache;          /* Wheter we need to cache some fragments before starting to push data */
   gboolean end_of_playlist;
   gboolean do_typefind;         /* Whether we need to typefind the next buffer */
 
+  /* Fragment downloads */
+  GMutex downloads_lock;
+  GQueue *downloads;            /* Downloads in flight, in playlist order */
+  GQueue *idle_downloaders;
+
+  /* Streaming mode: fragments are pushed while they are downloaded */
+  GstFragment *current_fragment; /* Fragment being downloaded and pushed */
+  gboolean fragment_start;      /* Whether the next buffer starts a fragment */
+
   /* Properties */
   guint fragments_cache;        /* number of fragments needed to be cached to start playing */
   gfloat bitrate_limit;         /* limit of the available bitrate to use */
   guint connection_speed;       /* Network connection speed in kbps (0 = unknown) */
+  gboolean streaming;           /* push fragments while downloading them */
+  guint max_in_flight_bytes;    /* Max downloaded but not pushed bytes */
+  guint max_downloads;          /* Max fragment downloads in flight */
 
   /* Streaming task */
   GstTask *stream_task;
@@ -87,6 +101,10 @@ struct _GstHLSDemux
   /* Position in the stream */
   GstClockTime position_shift;
   gboolean need_segment;
+  /* protected by the object lock, see gst_hls_demux_get_buffer_level() */
+  GstSegment segment;           /* Last segment pushed */
+  GstClockTime download_end;    /* Stream time of the downloaded data end */
+  guint64 fragment_bitrate;     /* Throughput of the last fragment */
 };
 
 struct _GstHLSDemuxClass
@@ -41,6 +41,11 @@ struct _GstUriDownloaderPrivate
   GstFragment *download;
   GMutex lock;
   GCond cond;
+  GMutex fetch_lock;            /* serializes gst_uri_downloader_fetch_uri() */
+
+  /* Throughput measurement */
+  GstBandwidthEstimator *estimator;
+  GstClockTime ready_time;      /* when we started waiting for data */
 };
 
 static void gst_uri_downloader_finalize (GObject * object);
@@ -100,6 +105,7 @@ gst_uri_downloader_init (GstUriDownloader * downloader)
 
   g_mutex_init (&downloader->priv->lock);
   g_cond_init (&downloader->priv->cond);
+  g_mutex_init (&downloader->priv->fetch_lock);
 }
 
 static void
@@ -137,6 +143,7 @@ gst_uri_downloader_finalize (GObject * object)
 
   g_mutex_clear (&downloader->priv->lock);
   g_cond_clear (&downloader->priv->cond);
+  g_mutex_clear (&downloader->priv->fetch_lock);
 
   G_OBJECT_CLASS (gst_uri_downloader_parent_class)->finalize (object);
 }
@@ -162,9 +169,7 @@ gst_uri_downloader_sink_event (GstPad * pad, GstObject * parent,
       GST_DEBUG_OBJECT (downloader, "Got EOS on the fetcher pad");
       if (downloader->priv->download != NULL) {
         /* signal we have fetched the URI */
-        downloader->priv->download->completed = TRUE;
-        downloader->priv->download->download_stop_time =
-            gst_util_get_timestamp ();
+        gst_fragment_set_completed (downloader->priv->download);
         GST_OBJECT_UNLOCK (downloader);
         GST_DEBUG_OBJECT (downloader, "Signaling chain funtion");
         g_mutex_lock (&downloader->priv->lock);
@@ -216,8 +221,11 @@ static GstFlowReturn
 gst_uri_downloader_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 {
   GstUriDownloader *downloader;
+  GstFragment *download;
+  GstClockTime now;
 
   downloader = GST_URI_DOWNLOADER (gst_pad_get_element_private (pad));
+  now = gst_util_get_timestamp ();
 
   /* HTML errors (404, 500, etc...) are also pushed through this pad as
    * response but the source element will also post a warning or error message
@@ -227,14 +235,28 @@ gst_uri_downloader_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
   if (downloader->priv->download == NULL) {
     /* Download cancelled, quit */
     GST_OBJECT_UNLOCK (downloader);
+    gst_buffer_unref (buf);
     goto done;
   }
+  /* adding to a streaming fragment can block until the consumer catches up,
+   * don't hold the lock meanwhile so that the download can be cancelled */
+  download = g_object_ref (downloader->priv->download);
+  GST_OBJECT_UNLOCK (downloader);
 
   GST_LOG_OBJECT (downloader, "The uri fetcher received a new buffer "
       "of size %" G_GSIZE_FORMAT, gst_buffer_get_size (buf));
-  if (!gst_fragment_add_buffer (downloader->priv->download, buf))
+
+  /* time the arrival of the data from the moment we were ready to receive
+   * it, so that the time a streaming fragment spends waiting for its
+   * consumer doesn't count as network time */
+  if (downloader->priv->estimator && now > downloader->priv->ready_time)
+    gst_bandwidth_estimator_add_sample (downloader->priv->estimator,
+        gst_buffer_get_size (buf), now - downloader->priv->ready_time);
+
+  if (!gst_fragment_add_buffer (download, buf))
     GST_WARNING_OBJECT (downloader, "Could not add buffer to fragment");
-  GST_OBJECT_UNLOCK (downloader);
+  g_object_unref (download);
+  downloader->priv->ready_time = gst_util_get_timestamp ();
 
 done:
   {
@@ -247,6 +269,9 @@ gst_uri_downloader_stop (GstUriDownloader * downloader)
 {
   GstPad *pad;
 
+  if (downloader->priv->urisrc == NULL)
+    return;
+
   GST_DEBUG_OBJECT (downloader, "Stopping source element");
 
   /* remove the bus' sync handler */
@@ -261,6 +286,8 @@ gst_uri_downloader_stop (GstUriDownloader * downloader)
   gst_element_set_state (downloader->priv->urisrc, GST_STATE_NULL);
   gst_element_get_state (downloader->priv->urisrc, NULL, NULL,
       GST_CLOCK_TIME_NONE);
+  gst_object_unref (downloader->priv->urisrc);
+  downloader->priv->urisrc = NULL;
 }
 
 void
@@ -269,6 +296,7 @@ gst_uri_downloader_cancel (GstUriDownloader * downloader)
   GST_OBJECT_LOCK (downloader);
   if (downloader->priv->download != NULL) {
     GST_DEBUG_OBJECT (downloader, "Cancelling download");
+    gst_fragment_cancel (downloader->priv->download);
     g_object_unref (downloader->priv->download);
     downloader->priv->download = NULL;
     GST_OBJECT_UNLOCK (downloader);
@@ -317,6 +345,9 @@ gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri)
   GstStateChangeReturn ret;
   GstFragment *download = NULL;
 
+  /* the lock below is released while waiting, so concurrent fetches from
+   * different threads have to wait here for their turn */
+  g_mutex_lock (&downloader->priv->fetch_lock);
   g_mutex_lock (&downloader->priv->lock);
 
   if (!gst_uri_downloader_set_uri (downloader, uri)) {
@@ -324,6 +355,7 @@ gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri)
   }
 
   downloader->priv->download = gst_fragment_new ();
+  downloader->priv->ready_time = gst_util_get_timestamp ();
 
   ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_PLAYING);
   if (ret == GST_STATE_CHANGE_FAILURE) {
@@ -354,6 +386,90 @@ quit:
   {
     gst_uri_downloader_stop (downloader);
     g_mutex_unlock (&downloader->priv->lock);
+    g_mutex_unlock (&downloader->priv->fetch_lock);
     return download;
   }
 }
+
+/* Starts downloading @uri into @fragment without waiting for the download to
+ * finish. @fragment is completed from the source's streaming thread on EOS,
+ * or cancelled on errors, so it should usually be a streaming fragment
+ * consumed with gst_fragment_pop_buffer(). */
+gboolean
+gst_uri_downloader_start (GstUriDownloader * downloader, const gchar * uri,
+    GstFragment * fragment)
+{
+  GstStateChangeReturn ret;
+
+  g_return_val_if_fail (fragment != NULL, FALSE);
+
+  /* a previous download might still be running */
+  gst_uri_downloader_reset (downloader);
+
+  g_mutex_lock (&downloader->priv->lock);
+
+  if (!gst_uri_downloader_set_uri (downloader, uri))
+    goto error;
+
+  GST_OBJECT_LOCK (downloader);
+  fragment->download_start_time = gst_util_get_timestamp ();
+  downloader->priv->ready_time = fragment->download_start_time;
+  downloader->priv->download = g_object_ref (fragment);
+  GST_OBJECT_UNLOCK (downloader);
+
+  ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_PLAYING);
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    GST_OBJECT_LOCK (downloader);
+    g_object_unref (downloader->priv->download);
+    downloader->priv->download = NULL;
+    GST_OBJECT_UNLOCK (downloader);
+    goto error;
+  }
+
+  GST_DEBUG_OBJECT (downloader, "Started fetching %s", uri);
+  g_mutex_unlock (&downloader->priv->lock);
+  return TRUE;
+
+error:
+  {
+    gst_uri_downloader_stop (downloader);
+    g_mutex_unlock (&downloader->priv->lock);
+    return FALSE;
+  }
+}
+
+/* Stops the download started with gst_uri_downloader_start(). A fragment
+ * that wasn't completed yet is cancelled, completed fragments keep the data
+ * that has not been popped. Must not be called concurrently with
+ * gst_uri_downloader_start() on the same downloader. */
+void
+gst_uri_downloader_reset (GstUriDownloader * downloader)
+{
+  GstFragment *download;
+
+  GST_OBJECT_LOCK (downloader);
+  download = downloader->priv->download;
+  downloader->priv->download = NULL;
+  GST_OBJECT_UNLOCK (downloader);
+
+  if (download) {
+    /* wakes up the streaming thread if it is blocked on a full fragment */
+    if (!download->completed)
+      gst_fragment_cancel (download);
+    g_object_unref (download);
+  }
+
+  /* not taking priv->lock here: the EOS handler might be waiting for it to
+   * signal gst_uri_downloader_fetch_uri() and stopping the source waits for
+   * its streaming thread */
+  gst_uri_downloader_stop (downloader);
+}
+
+/* Makes the downloader report the timing of the data it receives to
+ * @estimator, which must outlive it. NULL disables the measurements. */
+void
+gst_uri_downloader_set_bandwidth_estimator (GstUriDownloader * downloader,
+    GstBandwidthEstimator * estimator)
+{
+  downloader->priv->estimator = estimator;
+}
@@ -25,6 +25,7 @@
 #include <glib-object.h>
 #include <gst/gst.h>
 #include "gstfragment.h"
+#include "gstbandwidthestimator.h"
 
 G_BEGIN_DECLS
 
@@ -57,7 +58,10 @@ GType gst_uri_downloader_get_type (void);
 
 GstUriDownloader * gst_uri_downloader_new (void);
 GstFragment * gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri);
+gboolean gst_uri_downloader_start (GstUriDownloader * downloader, const gchar * uri, GstFragment * fragment);
+void gst_uri_downloader_reset (GstUriDownloader * downloader);
 void gst_uri_downloader_cancel (GstUriDownloader *downloader);
+void gst_uri_downloader_set_bandwidth_estimator (GstUriDownloader * downloader, GstBandwidthEstimator * estimator);
 void gst_uri_downloader_free (GstUriDownloader *downloader);
 
 G_END_DECLS
@@ -25,6 +25,8 @@
 #include "gstinteraudiosink.h"
 #include "gstintersubsrc.h"
 #include "gstintersubsink.h"
+#include "gstinterstreamsrc.h"
+#include "gstinterstreamsink.h"
 #include "gstintervideosrc.h"
 #include "gstintervideosink.h"
 #include "gstintersurface.h"
@@ -44,6 +46,10 @@ plugin_init (GstPlugin * plugin)
       GST_TYPE_INTER_VIDEO_SRC);
   gst_element_register (plugin, "intervideosink", GST_RANK_NONE,
       GST_TYPE_INTER_VIDEO_SINK);
+  gst_element_register (plugin, "interstreamsrc", GST_RANK_NONE,
+      GST_TYPE_INTER_STREAM_SRC);
+  gst_element_register (plugin, "interstreamsink", GST_RANK_NONE,
+      GST_TYPE_INTER_STREAM_SINK);
 
   return TRUE;
 }
@@ -0,0 +1,251 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstinterstreamsink
+ *
+ * The interstreamsink element hands whatever it receives, buffers and
+ * serialized events alike, to the interstreamsrc elements with the same
+ * channel name in other pipelines of the same process. Any caps are
+ * accepted, so it can be used for encoded streams too.
+ *
+ * The buffers are passed by reference and never copied. Each interstreamsrc
+ * has its own bounded queue, see #GstInterStreamSrc:max-buffers and
+ * #GstInterStreamSrc:leaky: interstreamsink blocks while a non-leaky queue
+ * is full. The QoS, latency and reconfigure events of the interstreamsrc
+ * elements are sent upstream from interstreamsink.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v videotestsrc ! x264enc ! interstreamsink channel=cam1
+ * ]|
+ *
+ * The interstreamsink element cannot be used effectively with gst-launch,
+ * as it requires a second pipeline in the application to send the stream
+ * to.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include "gstinterstreamsink.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_inter_stream_sink_debug_category);
+#define GST_CAT_DEFAULT gst_inter_stream_sink_debug_category
+
+/* prototypes */
+
+
+static void gst_inter_stream_sink_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_inter_stream_sink_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_inter_stream_sink_finalize (GObject * object);
+
+static gboolean gst_inter_stream_sink_start (GstBaseSink * sink);
+static gboolean gst_inter_stream_sink_stop (GstBaseSink * sink);
+static gboolean gst_inter_stream_sink_unlock (GstBaseSink * sink);
+static gboolean gst_inter_stream_sink_unlock_stop (GstBaseSink * sink);
+static gboolean gst_inter_stream_sink_event (GstBaseSink * sink,
+    GstEvent * event);
+static GstFlowReturn gst_inter_stream_sink_render (GstBaseSink * sink,
+    GstBuffer * buffer);
+
+enum
+{
+  PROP_0,
+  PROP_CHANNEL
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_inter_stream_sink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+
+/* class initialization */
+
+G_DEFINE_TYPE (GstInterStreamSink, gst_inter_stream_sink, GST_TYPE_BASE_SINK);
+
+static void
+gst_inter_stream_sink_class_init (GstInterStreamSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (gst_inter_stream_sink_debug_category,
+      "interstreamsink", 0, "debug category for interstreamsink element");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_inter_stream_sink_sink_template));
+
+  gst_element_class_set_static_metadata (element_class,
+      "Internal stream sink",
+      "Sink",
+      "Virtual stream sink for internal process communication",
+      "GStreamer maintainers <gstreamer-devel@lists.freedesktop.org>");
+
+  gobject_class->set_property = gst_inter_stream_sink_set_property;
+  gobject_class->get_property = gst_inter_stream_sink_get_property;
+  gobject_class->finalize = gst_inter_stream_sink_finalize;
+  base_sink_class->start = GST_DEBUG_FUNCPTR (gst_inter_stream_sink_start);
+  base_sink_class->stop = GST_DEBUG_FUNCPTR (gst_inter_stream_sink_stop);
+  base_sink_class->unlock = GST_DEBUG_FUNCPTR (gst_inter_stream_sink_unlock);
+  base_sink_class->unlock_stop =
+      GST_DEBUG_FUNCPTR (gst_inter_stream_sink_unlock_stop);
+  base_sink_class->event = GST_DEBUG_FUNCPTR (gst_inter_stream_sink_event);
+  base_sink_class->render = GST_DEBUG_FUNCPTR (gst_inter_stream_sink_render);
+
+  g_object_class_install_property (gobject_class, PROP_CHANNEL,
+      g_param_spec_string ("channel", "Channel",
+          "Channel name to match inter src and sink elements",
+          "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_inter_stream_sink_init (GstInterStreamSink * interstreamsink)
+{
+  interstreamsink->channel = g_strdup ("default");
+}
+
+void
+gst_inter_stream_sink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (object);
+
+  switch (property_id) {
+    case PROP_CHANNEL:
+      g_free (interstreamsink->channel);
+      interstreamsink->channel = g_value_dup_string (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_inter_stream_sink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (object);
+
+  switch (property_id) {
+    case PROP_CHANNEL:
+      g_value_set_string (value, interstreamsink->channel);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_inter_stream_sink_finalize (GObject * object)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (object);
+
+  /* clean up object here */
+  g_free (interstreamsink->channel);
+
+  G_OBJECT_CLASS (gst_inter_stream_sink_parent_class)->finalize (object);
+}
+
+
+static gboolean
+gst_inter_stream_sink_start (GstBaseSink * sink)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (sink);
+
+  interstreamsink->surface = gst_inter_surface_get (interstreamsink->channel);
+  gst_inter_surface_set_stream_flushing (interstreamsink->surface, FALSE);
+  gst_inter_surface_set_stream_sinkpad (interstreamsink->surface,
+      GST_BASE_SINK_PAD (sink));
+
+  return TRUE;
+}
+
+static gboolean
+gst_inter_stream_sink_stop (GstBaseSink * sink)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (sink);
+
+  gst_inter_surface_set_stream_sinkpad (interstreamsink->surface, NULL);
+  gst_inter_surface_clear_stream (interstreamsink->surface);
+
+  gst_inter_surface_unref (interstreamsink->surface);
+  interstreamsink->surface = NULL;
+
+  return TRUE;
+}
+
+static gboolean
+gst_inter_stream_sink_unlock (GstBaseSink * sink)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (sink);
+
+  gst_inter_surface_set_stream_flushing (interstreamsink->surface, TRUE);
+
+  return TRUE;
+}
+
+static gboolean
+gst_inter_stream_sink_unlock_stop (GstBaseSink * sink)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (sink);
+
+  gst_inter_surface_set_stream_flushing (interstreamsink->surface, FALSE);
+
+  return TRUE;
+}
+
+static gboolean
+gst_inter_stream_sink_event (GstBaseSink * sink, GstEvent * event)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (sink);
+
+  /* flushing stays within this pipeline, the srcs only see the new
+   * segment */
+  if (GST_EVENT_IS_SERIALIZED (event)
+      && GST_EVENT_TYPE (event) != GST_EVENT_FLUSH_STOP) {
+    GST_DEBUG_OBJECT (interstreamsink, "forwarding %" GST_PTR_FORMAT, event);
+    gst_inter_surface_push_stream (interstreamsink->surface,
+        GST_MINI_OBJECT_CAST (gst_event_ref (event)));
+  }
+
+  return GST_BASE_SINK_CLASS (gst_inter_stream_sink_parent_class)->event (sink,
+      event);
+}
+
+static GstFlowReturn
+gst_inter_stream_sink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstInterStreamSink *interstreamsink = GST_INTER_STREAM_SINK (sink);
+
+  return gst_inter_surface_push_stream (interstreamsink->surface,
+      GST_MINI_OBJECT_CAST (gst_buffer_ref (buffer)));
+}
@@ -0,0 +1,53 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifndef _GST_INTER_STREAM_SINK_H_
+#define _GST_INTER_STREAM_SINK_H_
+
+#include <gst/base/gstbasesink.h>
+#include "gstintersurface.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_INTER_STREAM_SINK   (gst_inter_stream_sink_get_type())
+#define GST_INTER_STREAM_SINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_INTER_STREAM_SINK,GstInterStreamSink))
+#define GST_INTER_STREAM_SINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_INTER_STREAM_SINK,GstInterStreamSinkClass))
+#define GST_IS_INTER_STREAM_SINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_INTER_STREAM_SINK))
+#define GST_IS_INTER_STREAM_SINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_INTER_STREAM_SINK))
+
+typedef struct _GstInterStreamSink GstInterStreamSink;
+typedef struct _GstInterStreamSinkClass GstInterStreamSinkClass;
+
+struct _GstInterStreamSink
+{
+  GstBaseSink base_interstreamsink;
+
+  GstInterSurface *surface;
+  char *channel;
+};
+
+struct _GstInterStreamSinkClass
+{
+  GstBaseSinkClass base_interstreamsink_class;
+};
+
+GType gst_inter_stream_sink_get_type (void);
+
+G_END_DECLS
+
+#endif
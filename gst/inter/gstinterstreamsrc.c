@@ -0,0 +1,452 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstinterstreamsrc
+ *
+ * The interstreamsrc element pushes the buffers and serialized events that
+ * an interstreamsink with the same channel name receives in another
+ * pipeline of the same process, with their caps, segment and timestamps
+ * unchanged. Several interstreamsrc elements can share a channel, each of
+ * them gets every buffer by reference.
+ *
+ * An interstreamsrc that joins a channel in the middle of a stream first
+ * gets the stream-start, caps and segment events of that stream. The
+ * buffers are queued until they are pushed, up to
+ * #GstInterStreamSrc:max-buffers. When the queue is full, interstreamsink
+ * blocks or, depending on #GstInterStreamSrc:leaky, the newest or oldest
+ * buffers are dropped.
+ *
+ * interstreamsrc is a live source. Since the timestamps come from the
+ * other pipeline, synchronizing on them only makes sense if both pipelines
+ * have the same clock and base time. The QoS, latency and reconfigure
+ * events it receives are sent upstream from the interstreamsink, seeks are
+ * refused.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v interstreamsrc channel=cam1 ! h264parse ! mp4mux ! filesink location=cam1.mp4
+ * ]|
+ *
+ * The interstreamsrc element cannot be used effectively with gst-launch,
+ * as it requires a second pipeline in the application to receive the
+ * stream from.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include "gstinterstreamsrc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_inter_stream_src_debug_category);
+#define GST_CAT_DEFAULT gst_inter_stream_src_debug_category
+
+/* prototypes */
+
+
+static void gst_inter_stream_src_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_inter_stream_src_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_inter_stream_src_finalize (GObject * object);
+
+static GstStateChangeReturn gst_inter_stream_src_change_state (GstElement *
+    element, GstStateChange transition);
+static gboolean gst_inter_stream_src_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active);
+static gboolean gst_inter_stream_src_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static gboolean gst_inter_stream_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static void gst_inter_stream_src_loop (GstPad * pad);
+
+enum
+{
+  PROP_0,
+  PROP_CHANNEL,
+  PROP_MAX_BUFFERS,
+  PROP_LEAKY,
+  PROP_BUFFERS_DROPPED
+};
+
+#define DEFAULT_MAX_BUFFERS 200
+#define DEFAULT_LEAKY GST_INTER_STREAM_LEAKY_NO
+
+#define GST_TYPE_INTER_STREAM_LEAKY (gst_inter_stream_leaky_get_type ())
+
+static GType
+gst_inter_stream_leaky_get_type (void)
+{
+  static GType leaky_type = 0;
+  static const GEnumValue leaky[] = {
+    {GST_INTER_STREAM_LEAKY_NO, "Not Leaky", "no"},
+    {GST_INTER_STREAM_LEAKY_UPSTREAM, "Leaky on upstream (new buffers)",
+        "upstream"},
+    {GST_INTER_STREAM_LEAKY_DOWNSTREAM, "Leaky on downstream (old buffers)",
+        "downstream"},
+    {0, NULL, NULL},
+  };
+
+  if (!leaky_type) {
+    leaky_type = g_enum_register_static ("GstInterStreamLeaky", leaky);
+  }
+  return leaky_type;
+}
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_inter_stream_src_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+
+/* class initialization */
+
+G_DEFINE_TYPE (GstInterStreamSrc, gst_inter_stream_src, GST_TYPE_ELEMENT);
+
+static void
+gst_inter_stream_src_class_init (GstInterStreamSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (gst_inter_stream_src_debug_category,
+      "interstreamsrc", 0, "debug category for interstreamsrc element");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_inter_stream_src_src_template));
+
+  gst_element_class_set_static_metadata (element_class,
+      "Internal stream source",
+      "Source",
+      "Virtual stream source for internal process communication",
+      "GStreamer maintainers <gstreamer-devel@lists.freedesktop.org>");
+
+  gobject_class->set_property = gst_inter_stream_src_set_property;
+  gobject_class->get_property = gst_inter_stream_src_get_property;
+  gobject_class->finalize = gst_inter_stream_src_finalize;
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_inter_stream_src_change_state);
+
+  g_object_class_install_property (gobject_class, PROP_CHANNEL,
+      g_param_spec_string ("channel", "Channel",
+          "Channel name to match inter src and sink elements",
+          "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BUFFERS,
+      g_param_spec_uint ("max-buffers", "Max buffers",
+          "Maximum number of buffers in the queue (0 = unlimited)", 0,
+          G_MAXUINT, DEFAULT_MAX_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LEAKY,
+      g_param_spec_enum ("leaky", "Leaky",
+          "Where the queue leaks when it is full, if at all",
+          GST_TYPE_INTER_STREAM_LEAKY, DEFAULT_LEAKY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BUFFERS_DROPPED,
+      g_param_spec_uint64 ("buffers-dropped", "Buffers dropped",
+          "Number of buffers dropped because the queue was full", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_inter_stream_src_init (GstInterStreamSrc * interstreamsrc)
+{
+  interstreamsrc->srcpad =
+      gst_pad_new_from_static_template (&gst_inter_stream_src_src_template,
+      "src");
+  gst_pad_set_activatemode_function (interstreamsrc->srcpad,
+      GST_DEBUG_FUNCPTR (gst_inter_stream_src_activate_mode));
+  gst_pad_set_event_function (interstreamsrc->srcpad,
+      GST_DEBUG_FUNCPTR (gst_inter_stream_src_event));
+  gst_pad_set_query_function (interstreamsrc->srcpad,
+      GST_DEBUG_FUNCPTR (gst_inter_stream_src_query));
+  gst_element_add_pad (GST_ELEMENT (interstreamsrc), interstreamsrc->srcpad);
+
+  GST_OBJECT_FLAG_SET (interstreamsrc, GST_ELEMENT_FLAG_SOURCE);
+
+  interstreamsrc->channel = g_strdup ("default");
+  interstreamsrc->max_buffers = DEFAULT_MAX_BUFFERS;
+  interstreamsrc->leaky = DEFAULT_LEAKY;
+}
+
+void
+gst_inter_stream_src_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstInterStreamSrc *interstreamsrc = GST_INTER_STREAM_SRC (object);
+
+  switch (property_id) {
+    case PROP_CHANNEL:
+      GST_OBJECT_LOCK (interstreamsrc);
+      g_free (interstreamsrc->channel);
+      interstreamsrc->channel = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (interstreamsrc);
+      break;
+    case PROP_MAX_BUFFERS:
+    case PROP_LEAKY:
+      GST_OBJECT_LOCK (interstreamsrc);
+      if (property_id == PROP_MAX_BUFFERS)
+        interstreamsrc->max_buffers = g_value_get_uint (value);
+      else
+        interstreamsrc->leaky = g_value_get_enum (value);
+      if (interstreamsrc->queue)
+        gst_inter_surface_configure_stream_queue (interstreamsrc->surface,
+            interstreamsrc->queue, interstreamsrc->max_buffers,
+            interstreamsrc->leaky);
+      GST_OBJECT_UNLOCK (interstreamsrc);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_inter_stream_src_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstInterStreamSrc *interstreamsrc = GST_INTER_STREAM_SRC (object);
+
+  switch (property_id) {
+    case PROP_CHANNEL:
+      GST_OBJECT_LOCK (interstreamsrc);
+      g_value_set_string (value, interstreamsrc->channel);
+      GST_OBJECT_UNLOCK (interstreamsrc);
+      break;
+    case PROP_MAX_BUFFERS:
+      GST_OBJECT_LOCK (interstreamsrc);
+      g_value_set_uint (value, interstreamsrc->max_buffers);
+      GST_OBJECT_UNLOCK (interstreamsrc);
+      break;
+    case PROP_LEAKY:
+      GST_OBJECT_LOCK (interstreamsrc);
+      g_value_set_enum (value, interstreamsrc->leaky);
+      GST_OBJECT_UNLOCK (interstreamsrc);
+      break;
+    case PROP_BUFFERS_DROPPED:
+    {
+      guint64 n_dropped = 0;
+
+      GST_OBJECT_LOCK (interstreamsrc);
+      if (interstreamsrc->queue) {
+        g_mutex_lock (&interstreamsrc->surface->stream_mutex);
+        n_dropped = interstreamsrc->queue->n_dropped;
+        g_mutex_unlock (&interstreamsrc->surface->stream_mutex);
+      }
+      GST_OBJECT_UNLOCK (interstreamsrc);
+      g_value_set_uint64 (value, n_dropped);
+      break;
+    }
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_inter_stream_src_finalize (GObject * object)
+{
+  GstInterStreamSrc *interstreamsrc = GST_INTER_STREAM_SRC (object);
+
+  /* clean up object here */
+  g_free (interstreamsrc->channel);
+
+  G_OBJECT_CLASS (gst_inter_stream_src_parent_class)->finalize (object);
+}
+
+
+static GstStateChangeReturn
+gst_inter_stream_src_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstStateChangeReturn ret;
+
+  ret =
+      GST_ELEMENT_CLASS (gst_inter_stream_src_parent_class)->change_state
+      (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      /* the data comes from another pipeline, we can't preroll */
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static gboolean
+gst_inter_stream_src_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstInterStreamSrc *interstreamsrc = GST_INTER_STREAM_SRC (parent);
+  GstInterStreamQueue *queue;
+  GstInterSurface *surface;
+  gboolean result;
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+
+  if (active) {
+    GST_OBJECT_LOCK (interstreamsrc);
+    surface = gst_inter_surface_get (interstreamsrc->channel);
+    interstreamsrc->surface = surface;
+    interstreamsrc->queue = gst_inter_surface_add_stream_queue (surface,
+        interstreamsrc->max_buffers, interstreamsrc->leaky);
+    GST_OBJECT_UNLOCK (interstreamsrc);
+
+    GST_DEBUG_OBJECT (interstreamsrc, "Starting task on srcpad");
+    result = gst_pad_start_task (pad,
+        (GstTaskFunction) gst_inter_stream_src_loop, pad, NULL);
+  } else {
+    surface = interstreamsrc->surface;
+    queue = interstreamsrc->queue;
+    if (queue == NULL)
+      return TRUE;
+
+    /* wake up the task if it waits for data */
+    gst_inter_surface_set_stream_queue_flushing (surface, queue, TRUE);
+
+    GST_DEBUG_OBJECT (interstreamsrc, "Stopping task on srcpad");
+    result = gst_pad_stop_task (pad);
+
+    GST_OBJECT_LOCK (interstreamsrc);
+    interstreamsrc->queue = NULL;
+    interstreamsrc->surface = NULL;
+    GST_OBJECT_UNLOCK (interstreamsrc);
+
+    gst_inter_surface_remove_stream_queue (surface, queue);
+    gst_inter_surface_unref (surface);
+  }
+
+  return result;
+}
+
+static gboolean
+gst_inter_stream_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstInterStreamSrc *interstreamsrc = GST_INTER_STREAM_SRC (parent);
+  GstPad *sinkpad = NULL;
+  gboolean res;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEEK:
+      /* the other pipeline decides what gets played */
+      res = FALSE;
+      break;
+    case GST_EVENT_QOS:
+    case GST_EVENT_LATENCY:
+    case GST_EVENT_RECONFIGURE:
+      GST_OBJECT_LOCK (interstreamsrc);
+      if (interstreamsrc->surface)
+        sinkpad =
+            gst_inter_surface_get_stream_sinkpad (interstreamsrc->surface);
+      GST_OBJECT_UNLOCK (interstreamsrc);
+      if (sinkpad == NULL) {
+        res = FALSE;
+        break;
+      }
+      GST_DEBUG_OBJECT (interstreamsrc, "forwarding %" GST_PTR_FORMAT, event);
+      res = gst_pad_push_event (sinkpad, event);
+      gst_object_unref (sinkpad);
+      return res;
+    default:
+      res = TRUE;
+      break;
+  }
+  gst_event_unref (event);
+
+  return res;
+}
+
+static gboolean
+gst_inter_stream_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY:
+      gst_query_set_latency (query, TRUE, 0, GST_CLOCK_TIME_NONE);
+      return TRUE;
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static void
+gst_inter_stream_src_loop (GstPad * pad)
+{
+  GstInterStreamSrc *interstreamsrc =
+      GST_INTER_STREAM_SRC (GST_PAD_PARENT (pad));
+  GstMiniObject *object;
+  GstFlowReturn ret;
+
+  object = gst_inter_surface_pop_stream (interstreamsrc->surface,
+      interstreamsrc->queue);
+  if (object == NULL)
+    goto flushing;
+
+  if (GST_IS_EVENT (object)) {
+    GST_DEBUG_OBJECT (interstreamsrc, "pushing %" GST_PTR_FORMAT, object);
+    gst_pad_push_event (pad, GST_EVENT_CAST (object));
+    return;
+  }
+
+  ret = gst_pad_push (pad, GST_BUFFER_CAST (object));
+  /* after EOS, downstream refuses buffers until the next stream-start or
+   * segment, which we will push as usual */
+  if (ret != GST_FLOW_OK && ret != GST_FLOW_EOS)
+    goto pause;
+
+  return;
+
+flushing:
+  {
+    GST_DEBUG_OBJECT (interstreamsrc, "we are flushing");
+    gst_pad_pause_task (pad);
+    return;
+  }
+pause:
+  {
+    GST_DEBUG_OBJECT (interstreamsrc, "pausing task, reason %s",
+        gst_flow_get_name (ret));
+    /* don't make the sink wait for room in a queue nobody reads anymore,
+     * the pad activation that starts the task again makes a new queue */
+    gst_inter_surface_set_stream_queue_flushing (interstreamsrc->surface,
+        interstreamsrc->queue, TRUE);
+    gst_pad_pause_task (pad);
+    if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+      GST_ELEMENT_ERROR (interstreamsrc, STREAM, FAILED,
+          ("Internal data stream error."),
+          ("stream stopped, reason %s", gst_flow_get_name (ret)));
+      gst_pad_push_event (pad, gst_event_new_eos ());
+    }
+    return;
+  }
+}
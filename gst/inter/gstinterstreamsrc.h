@@ -0,0 +1,59 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifndef _GST_INTER_STREAM_SRC_H_
+#define _GST_INTER_STREAM_SRC_H_
+
+#include <gst/gst.h>
+#include "gstintersurface.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_INTER_STREAM_SRC   (gst_inter_stream_src_get_type())
+#define GST_INTER_STREAM_SRC(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_INTER_STREAM_SRC,GstInterStreamSrc))
+#define GST_INTER_STREAM_SRC_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_INTER_STREAM_SRC,GstInterStreamSrcClass))
+#define GST_IS_INTER_STREAM_SRC(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_INTER_STREAM_SRC))
+#define GST_IS_INTER_STREAM_SRC_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_INTER_STREAM_SRC))
+
+typedef struct _GstInterStreamSrc GstInterStreamSrc;
+typedef struct _GstInterStreamSrcClass GstInterStreamSrcClass;
+
+struct _GstInterStreamSrc
+{
+  GstElement base_interstreamsrc;
+
+  GstPad *srcpad;
+
+  GstInterSurface *surface;
+  GstInterStreamQueue *queue;
+
+  char *channel;
+  guint max_buffers;
+  GstInterStreamLeaky leaky;
+};
+
+struct _GstInterStreamSrcClass
+{
+  GstElementClass base_interstreamsrc_class;
+};
+
+GType gst_inter_stream_src_get_type (void);
+
+G_END_DECLS
+
+#endif
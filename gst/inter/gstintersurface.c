@@ -21,43 +21,467 @@
 #include "config.h"
 #endif
 
-#include <string.h>
-
 #include "gstintersurface.h"
 
-static GList *list;
+typedef struct
+{
+  GstBuffer *buffer;
+  GstClockTime time;
+} GstInterVideoFrame;
+
+/* The surfaces by name. The registry is only used when elements start and
+ * stop: in between they keep a reference to their surface, and the audio,
+ * video and subtitle paths of a surface each have their own lock so that
+ * they don't contend with each other. */
+static GHashTable *surfaces;
 static GMutex mutex;
 
+static void gst_inter_video_frame_free (GstInterVideoFrame * frame);
 
+/* Returns a reference to the surface called @name, creating it if needed */
 GstInterSurface *
 gst_inter_surface_get (const char *name)
 {
-  GList *g;
   GstInterSurface *surface;
 
   g_mutex_lock (&mutex);
 
-  for (g = list; g; g = g_list_next (g)) {
-    surface = (GstInterSurface *) g->data;
-    if (strcmp (name, surface->name) == 0) {
-      g_mutex_unlock (&mutex);
-      return surface;
-    }
+  if (surfaces == NULL)
+    surfaces = g_hash_table_new (g_str_hash, g_str_equal);
+
+  surface = g_hash_table_lookup (surfaces, name);
+  if (surface) {
+    surface->ref_count++;
+    g_mutex_unlock (&mutex);
+    return surface;
   }
 
   surface = g_malloc0 (sizeof (GstInterSurface));
   surface->name = g_strdup (name);
-  g_mutex_init (&surface->mutex);
+  surface->ref_count = 1;
+  g_mutex_init (&surface->audio_mutex);
+  g_mutex_init (&surface->video_mutex);
+  g_mutex_init (&surface->sub_mutex);
+  g_mutex_init (&surface->stream_mutex);
+  g_cond_init (&surface->stream_cond);
   surface->audio_adapter = gst_adapter_new ();
+  g_queue_init (&surface->video_queue);
 
-  list = g_list_append (list, surface);
+  g_hash_table_insert (surfaces, surface->name, surface);
   g_mutex_unlock (&mutex);
 
   return surface;
 }
 
+/* Releases a reference taken with gst_inter_surface_get(). The surface and
+ * the data still queued in it are freed when the last element using it
+ * stops. */
 void
 gst_inter_surface_unref (GstInterSurface * surface)
 {
+  GstInterVideoFrame *frame;
+
+  g_mutex_lock (&mutex);
+  if (--surface->ref_count > 0) {
+    g_mutex_unlock (&mutex);
+    return;
+  }
+  g_hash_table_remove (surfaces, surface->name);
+  g_mutex_unlock (&mutex);
+
+  while ((frame = g_queue_pop_head (&surface->video_queue)))
+    gst_inter_video_frame_free (frame);
+  g_object_unref (surface->audio_adapter);
+  if (surface->sub_buffer)
+    gst_buffer_unref (surface->sub_buffer);
+  /* the stream queues belong to the srcs, which are all gone */
+  gst_inter_surface_clear_stream (surface);
+  g_mutex_clear (&surface->audio_mutex);
+  g_mutex_clear (&surface->video_mutex);
+  g_mutex_clear (&surface->sub_mutex);
+  g_mutex_clear (&surface->stream_mutex);
+  g_cond_clear (&surface->stream_cond);
+  g_free (surface->name);
+  g_free (surface);
+}
+
+static void
+gst_inter_video_frame_free (GstInterVideoFrame * frame)
+{
+  gst_buffer_unref (frame->buffer);
+  g_slice_free (GstInterVideoFrame, frame);
+}
+
+/* Queues @buffer, taking ownership of it. @time is the clock time at which
+ * the frame should be shown, or GST_CLOCK_TIME_NONE if it is unknown, in
+ * which case the frames are handed out in arrival order. The oldest frames
+ * are dropped when there are more than @max_frames. Returns the number of
+ * dropped frames. */
+guint
+gst_inter_surface_push_video (GstInterSurface * surface, GstBuffer * buffer,
+    GstClockTime time, guint max_frames)
+{
+  GstInterVideoFrame *frame;
+  GList *l;
+  guint n_dropped = 0;
 
+  frame = g_slice_new (GstInterVideoFrame);
+  frame->buffer = buffer;
+  frame->time = time;
+
+  g_mutex_lock (&surface->video_mutex);
+
+  /* frames almost always arrive in order, so search from the tail */
+  l = surface->video_queue.tail;
+  if (GST_CLOCK_TIME_IS_VALID (time)) {
+    while (l && GST_CLOCK_TIME_IS_VALID (((GstInterVideoFrame *) l->data)->time)
+        && ((GstInterVideoFrame *) l->data)->time > time)
+      l = l->prev;
+  }
+  if (l)
+    g_queue_insert_after (&surface->video_queue, l, frame);
+  else
+    g_queue_push_head (&surface->video_queue, frame);
+
+  while (surface->video_queue.length > MAX (max_frames, 1)) {
+    gst_inter_video_frame_free (g_queue_pop_head (&surface->video_queue));
+    n_dropped++;
+  }
+
+  g_mutex_unlock (&surface->video_mutex);
+
+  return n_dropped;
+}
+
+/* Takes the queued frame that is nearest to the clock time @target, or
+ * returns NULL if none is nearer than the frame at @current that the caller
+ * is already showing. The frames queued before the returned one are dropped
+ * and counted in @n_skipped. Without a @target, the frames are simply taken
+ * in order. */
+GstBuffer *
+gst_inter_surface_take_video (GstInterSurface * surface, GstClockTime target,
+    GstClockTime current, GstClockTime * time, guint * n_skipped)
+{
+  GstInterVideoFrame *frame;
+  GstBuffer *buffer = NULL;
+  GList *l, *best = NULL;
+  guint64 best_dist = G_MAXUINT64;
+
+  *n_skipped = 0;
+
+  g_mutex_lock (&surface->video_mutex);
+
+  if (GST_CLOCK_TIME_IS_VALID (target) && GST_CLOCK_TIME_IS_VALID (current))
+    best_dist = current > target ? current - target : target - current;
+
+  for (l = surface->video_queue.head; l; l = l->next) {
+    guint64 dist;
+
+    frame = l->data;
+    if (!GST_CLOCK_TIME_IS_VALID (target)
+        || !GST_CLOCK_TIME_IS_VALID (frame->time)) {
+      if (best == NULL)
+        best = l;
+      break;
+    }
+
+    dist = frame->time > target ? frame->time - target : target - frame->time;
+    /* the queue is ordered, so once we go past the target the frames only
+     * get further away */
+    if (dist > best_dist)
+      break;
+    best = l;
+    best_dist = dist;
+  }
+
+  if (best) {
+    while (surface->video_queue.head != best) {
+      gst_inter_video_frame_free (g_queue_pop_head (&surface->video_queue));
+      (*n_skipped)++;
+    }
+    frame = g_queue_pop_head (&surface->video_queue);
+    buffer = frame->buffer;
+    *time = frame->time;
+    g_slice_free (GstInterVideoFrame, frame);
+  }
+
+  g_mutex_unlock (&surface->video_mutex);
+
+  return buffer;
+}
+
+void
+gst_inter_surface_clear_video (GstInterSurface * surface)
+{
+  GstInterVideoFrame *frame;
+
+  g_mutex_lock (&surface->video_mutex);
+  while ((frame = g_queue_pop_head (&surface->video_queue)))
+    gst_inter_video_frame_free (frame);
+  g_mutex_unlock (&surface->video_mutex);
+}
+
+/* Adds a queue for an interstreamsrc. It starts with the sticky events of
+ * the current stream, if any */
+GstInterStreamQueue *
+gst_inter_surface_add_stream_queue (GstInterSurface * surface,
+    guint max_buffers, GstInterStreamLeaky leaky)
+{
+  GstInterStreamQueue *queue;
+
+  queue = g_slice_new0 (GstInterStreamQueue);
+  g_queue_init (&queue->items);
+  queue->max_buffers = max_buffers;
+  queue->leaky = leaky;
+
+  g_mutex_lock (&surface->stream_mutex);
+  if (surface->stream_start)
+    g_queue_push_tail (&queue->items, gst_event_ref (surface->stream_start));
+  if (surface->stream_caps)
+    g_queue_push_tail (&queue->items, gst_event_ref (surface->stream_caps));
+  if (surface->stream_segment)
+    g_queue_push_tail (&queue->items, gst_event_ref (surface->stream_segment));
+  surface->stream_queues = g_list_prepend (surface->stream_queues, queue);
+  g_mutex_unlock (&surface->stream_mutex);
+
+  return queue;
+}
+
+void
+gst_inter_surface_configure_stream_queue (GstInterSurface * surface,
+    GstInterStreamQueue * queue, guint max_buffers, GstInterStreamLeaky leaky)
+{
+  g_mutex_lock (&surface->stream_mutex);
+  queue->max_buffers = max_buffers;
+  queue->leaky = leaky;
+  /* the sink might be waiting for the room this made */
+  g_cond_broadcast (&surface->stream_cond);
+  g_mutex_unlock (&surface->stream_mutex);
+}
+
+void
+gst_inter_surface_remove_stream_queue (GstInterSurface * surface,
+    GstInterStreamQueue * queue)
+{
+  GstMiniObject *object;
+
+  g_mutex_lock (&surface->stream_mutex);
+  surface->stream_queues = g_list_remove (surface->stream_queues, queue);
+  /* the sink might be waiting for room in this queue */
+  g_cond_broadcast (&surface->stream_cond);
+  g_mutex_unlock (&surface->stream_mutex);
+
+  while ((object = g_queue_pop_head (&queue->items)))
+    gst_mini_object_unref (object);
+  g_slice_free (GstInterStreamQueue, queue);
+}
+
+/* While flushing, the queue gets nothing and what it had is dropped */
+void
+gst_inter_surface_set_stream_queue_flushing (GstInterSurface * surface,
+    GstInterStreamQueue * queue, gboolean flushing)
+{
+  GQueue items = G_QUEUE_INIT;
+  GstMiniObject *object;
+
+  g_mutex_lock (&surface->stream_mutex);
+  queue->flushing = flushing;
+  if (flushing) {
+    items = queue->items;
+    g_queue_init (&queue->items);
+    queue->n_buffers = 0;
+  }
+  g_cond_broadcast (&surface->stream_cond);
+  g_mutex_unlock (&surface->stream_mutex);
+
+  while ((object = g_queue_pop_head (&items)))
+    gst_mini_object_unref (object);
+}
+
+/* Waits for the next buffer or event of @queue. Returns NULL when the queue
+ * is set flushing */
+GstMiniObject *
+gst_inter_surface_pop_stream (GstInterSurface * surface,
+    GstInterStreamQueue * queue)
+{
+  GstMiniObject *object = NULL;
+
+  g_mutex_lock (&surface->stream_mutex);
+  while (!queue->flushing && g_queue_is_empty (&queue->items))
+    g_cond_wait (&surface->stream_cond, &surface->stream_mutex);
+
+  if (!queue->flushing) {
+    object = g_queue_pop_head (&queue->items);
+    if (GST_IS_BUFFER (object)) {
+      queue->n_buffers--;
+      g_cond_broadcast (&surface->stream_cond);
+    }
+  }
+  g_mutex_unlock (&surface->stream_mutex);
+
+  return object;
+}
+
+static gboolean
+gst_inter_stream_queue_is_full (GstInterStreamQueue * queue)
+{
+  return queue->max_buffers > 0 && queue->n_buffers >= queue->max_buffers;
+}
+
+/* Drops the oldest buffer of @queue, keeping the events */
+static void
+gst_inter_stream_queue_drop_oldest (GstInterStreamQueue * queue)
+{
+  GList *l;
+
+  for (l = queue->items.head; l; l = l->next) {
+    if (GST_IS_BUFFER (l->data)) {
+      gst_buffer_unref (l->data);
+      g_queue_delete_link (&queue->items, l);
+      queue->n_buffers--;
+      queue->n_dropped++;
+      return;
+    }
+  }
+}
+
+static void
+gst_inter_surface_store_sticky_locked (GstInterSurface * surface,
+    GstEvent * event)
+{
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_STREAM_START:
+      gst_event_replace (&surface->stream_start, event);
+      gst_event_replace (&surface->stream_caps, NULL);
+      gst_event_replace (&surface->stream_segment, NULL);
+      break;
+    case GST_EVENT_CAPS:
+      gst_event_replace (&surface->stream_caps, event);
+      break;
+    case GST_EVENT_SEGMENT:
+      gst_event_replace (&surface->stream_segment, event);
+      break;
+    default:
+      break;
+  }
+}
+
+/* Hands @object, a buffer or a serialized event, to all the interstreamsrcs
+ * of the surface, taking ownership of it. Each of them gets a reference, the
+ * data is never copied.
+ *
+ * Events are always queued. A buffer waits for room in the queues that are
+ * not leaky, and when a leaky queue is full either the new buffer or the
+ * oldest queued one is dropped for it. Returns GST_FLOW_FLUSHING if the wait
+ * was interrupted with gst_inter_surface_set_stream_flushing(). */
+GstFlowReturn
+gst_inter_surface_push_stream (GstInterSurface * surface,
+    GstMiniObject * object)
+{
+  gboolean is_buffer = GST_IS_BUFFER (object);
+  GList *l;
+
+  g_mutex_lock (&surface->stream_mutex);
+
+  if (is_buffer) {
+    for (;;) {
+      gboolean full = FALSE;
+
+      if (surface->stream_flushing) {
+        g_mutex_unlock (&surface->stream_mutex);
+        gst_mini_object_unref (object);
+        return GST_FLOW_FLUSHING;
+      }
+
+      for (l = surface->stream_queues; l; l = l->next) {
+        GstInterStreamQueue *queue = l->data;
+
+        if (queue->leaky == GST_INTER_STREAM_LEAKY_NO && !queue->flushing
+            && gst_inter_stream_queue_is_full (queue)) {
+          full = TRUE;
+          break;
+        }
+      }
+      if (!full)
+        break;
+
+      /* the list of queues can change while we wait, so look at it again
+       * when woken up */
+      g_cond_wait (&surface->stream_cond, &surface->stream_mutex);
+    }
+  } else {
+    gst_inter_surface_store_sticky_locked (surface, GST_EVENT_CAST (object));
+  }
+
+  for (l = surface->stream_queues; l; l = l->next) {
+    GstInterStreamQueue *queue = l->data;
+
+    if (queue->flushing)
+      continue;
+
+    if (is_buffer) {
+      if (gst_inter_stream_queue_is_full (queue)) {
+        if (queue->leaky == GST_INTER_STREAM_LEAKY_UPSTREAM) {
+          queue->n_dropped++;
+          continue;
+        }
+        gst_inter_stream_queue_drop_oldest (queue);
+      }
+      queue->n_buffers++;
+    }
+    g_queue_push_tail (&queue->items, gst_mini_object_ref (object));
+  }
+
+  g_cond_broadcast (&surface->stream_cond);
+  g_mutex_unlock (&surface->stream_mutex);
+
+  gst_mini_object_unref (object);
+
+  return GST_FLOW_OK;
+}
+
+void
+gst_inter_surface_set_stream_flushing (GstInterSurface * surface,
+    gboolean flushing)
+{
+  g_mutex_lock (&surface->stream_mutex);
+  surface->stream_flushing = flushing;
+  g_cond_broadcast (&surface->stream_cond);
+  g_mutex_unlock (&surface->stream_mutex);
+}
+
+/* Sets the pad of the interstreamsink, NULL when it stops */
+void
+gst_inter_surface_set_stream_sinkpad (GstInterSurface * surface, GstPad * pad)
+{
+  g_mutex_lock (&surface->stream_mutex);
+  gst_object_replace ((GstObject **) & surface->stream_sinkpad,
+      (GstObject *) pad);
+  g_mutex_unlock (&surface->stream_mutex);
+}
+
+/* Returns a reference to the pad of the interstreamsink, to push the
+ * upstream events of the srcs from, or NULL if there is none */
+GstPad *
+gst_inter_surface_get_stream_sinkpad (GstInterSurface * surface)
+{
+  GstPad *pad = NULL;
+
+  g_mutex_lock (&surface->stream_mutex);
+  if (surface->stream_sinkpad)
+    pad = gst_object_ref (surface->stream_sinkpad);
+  g_mutex_unlock (&surface->stream_mutex);
+
+  return pad;
+}
+
+/* Forgets the current stream, for when the interstreamsink stops */
+void
+gst_inter_surface_clear_stream (GstInterSurface * surface)
+{
+  g_mutex_lock (&surface->stream_mutex);
+  gst_event_replace (&surface->stream_start, NULL);
+  gst_event_replace (&surface->stream_caps, NULL);
+  gst_event_replace (&surface->stream_segment, NULL);
+  g_mutex_unlock (&surface->stream_mutex);
 }
@@ -26,11 +26,50 @@
 G_BEGIN_DECLS
 
 typedef struct _GstInterSurface GstInterSurface;
+typedef struct _GstInterStreamQueue GstInterStreamQueue;
+
+typedef enum
+{
+  GST_INTER_STREAM_LEAKY_NO,
+  GST_INTER_STREAM_LEAKY_UPSTREAM,
+  GST_INTER_STREAM_LEAKY_DOWNSTREAM
+} GstInterStreamLeaky;
+
+/* The buffers and serialized events on their way to one interstreamsrc */
+struct _GstInterStreamQueue
+{
+  GQueue items;
+  guint n_buffers;
+  guint max_buffers;
+  GstInterStreamLeaky leaky;
+  gboolean flushing;
+  guint64 n_dropped;
+};
 
 struct _GstInterSurface
 {
-  GMutex mutex;
   char *name;
+  /* protected by the registry lock */
+  int ref_count;
+
+  /* protect the audio_adapter, the video_queue and the sub_buffer */
+  GMutex audio_mutex;
+  GMutex video_mutex;
+  GMutex sub_mutex;
+
+  /* stream, protected by stream_mutex. stream_cond is signalled when items
+   * are added to or removed from the queues */
+  GMutex stream_mutex;
+  GCond stream_cond;
+  GList *stream_queues;
+  gboolean stream_flushing;
+  /* replayed to the queues added in the middle of a stream */
+  GstEvent *stream_start;
+  GstEvent *stream_caps;
+  GstEvent *stream_segment;
+  /* the pad of the interstreamsink, that the upstream events of the srcs
+   * are pushed from */
+  GstPad *stream_sinkpad;
 
   /* video */
   GstVideoFormat format;
@@ -39,13 +78,13 @@ struct _GstInterSurface
   int width;
   int height;
   int n_frames;
-  int video_buffer_count;
 
   /* audio */
   int sample_rate;
   int n_channels;
 
-  GstBuffer *video_buffer;
+  /* GstInterVideoFrame, ordered by time */
+  GQueue video_queue;
   GstBuffer *sub_buffer;
   GstAdapter *audio_adapter;
 };
@@ -54,6 +93,32 @@ struct _GstInterSurface
 GstInterSurface * gst_inter_surface_get (const char *name);
 void gst_inter_surface_unref (GstInterSurface *surface);
 
+guint gst_inter_surface_push_video (GstInterSurface *surface,
+    GstBuffer *buffer, GstClockTime time, guint max_frames);
+GstBuffer * gst_inter_surface_take_video (GstInterSurface *surface,
+    GstClockTime target, GstClockTime current, GstClockTime *time,
+    guint *n_skipped);
+void gst_inter_surface_clear_video (GstInterSurface *surface);
+
+GstInterStreamQueue * gst_inter_surface_add_stream_queue (
+    GstInterSurface *surface, guint max_buffers, GstInterStreamLeaky leaky);
+void gst_inter_surface_configure_stream_queue (GstInterSurface *surface,
+    GstInterStreamQueue *queue, guint max_buffers, GstInterStreamLeaky leaky);
+void gst_inter_surface_remove_stream_queue (GstInterSurface *surface,
+    GstInterStreamQueue *queue);
+void gst_inter_surface_set_stream_queue_flushing (GstInterSurface *surface,
+    GstInterStreamQueue *queue, gboolean flushing);
+GstMiniObject * gst_inter_surface_pop_stream (GstInterSurface *surface,
+    GstInterStreamQueue *queue);
+GstFlowReturn gst_inter_surface_push_stream (GstInterSurface *surface,
+    GstMiniObject *object);
+void gst_inter_surface_set_stream_flushing (GstInterSurface *surface,
+    gboolean flushing);
+void gst_inter_surface_clear_stream (GstInterSurface *surface);
+void gst_inter_surface_set_stream_sinkpad (GstInterSurface *surface,
+    GstPad *pad);
+GstPad * gst_inter_surface_get_stream_sinkpad (GstInterSurface *surface);
+
 
 G_END_DECLS
 
@@ -23,6 +23,11 @@
  * in connection with an intervideosrc element in a different pipeline,
  * similar to interaudiosink and interaudiosrc.
  *
+ * Up to #GstInterVideoSink:max-frames frames are queued, and intervideosrc
+ * picks the one whose timestamp is nearest to the running time of each of
+ * its output frames. For this to work, both pipelines must use the same
+ * clock.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -67,9 +72,13 @@ static GstFlowReturn gst_inter_video_sink_render (GstBaseSink * sink,
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_MAX_FRAMES,
+  PROP_FRAMES_DROPPED
 };
 
+#define DEFAULT_MAX_FRAMES 4
+
 /* pad templates */
 
 static GstStaticPadTemplate gst_inter_video_sink_sink_template =
@@ -116,12 +125,24 @@ gst_inter_video_sink_class_init (GstInterVideoSinkClass * klass)
       g_param_spec_string ("channel", "Channel",
           "Channel name to match inter src and sink elements",
           "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_FRAMES,
+      g_param_spec_uint ("max-frames", "Max frames",
+          "Maximum number of frames queued for the inter src, the oldest "
+          "are dropped beyond that", 1, 64, DEFAULT_MAX_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FRAMES_DROPPED,
+      g_param_spec_uint64 ("frames-dropped", "Frames dropped",
+          "Number of frames dropped because the queue was full", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 gst_inter_video_sink_init (GstInterVideoSink * intervideosink)
 {
   intervideosink->channel = g_strdup ("default");
+  intervideosink->max_frames = DEFAULT_MAX_FRAMES;
 }
 
 void
@@ -135,6 +156,11 @@ gst_inter_video_sink_set_property (GObject * object, guint property_id,
       g_free (intervideosink->channel);
       intervideosink->channel = g_value_dup_string (value);
       break;
+    case PROP_MAX_FRAMES:
+      GST_OBJECT_LOCK (intervideosink);
+      intervideosink->max_frames = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (intervideosink);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -151,6 +177,16 @@ gst_inter_video_sink_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, intervideosink->channel);
       break;
+    case PROP_MAX_FRAMES:
+      GST_OBJECT_LOCK (intervideosink);
+      g_value_set_uint (value, intervideosink->max_frames);
+      GST_OBJECT_UNLOCK (intervideosink);
+      break;
+    case PROP_FRAMES_DROPPED:
+      GST_OBJECT_LOCK (intervideosink);
+      g_value_set_uint64 (value, intervideosink->n_dropped);
+      GST_OBJECT_UNLOCK (intervideosink);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -197,6 +233,7 @@ gst_inter_video_sink_start (GstBaseSink * sink)
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
   intervideosink->surface = gst_inter_surface_get (intervideosink->channel);
+  intervideosink->n_dropped = 0;
 
   return TRUE;
 }
@@ -206,12 +243,7 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
-  g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = NULL;
-  g_mutex_unlock (&intervideosink->surface->mutex);
+  gst_inter_surface_clear_video (intervideosink->surface);
 
   gst_inter_surface_unref (intervideosink->surface);
   intervideosink->surface = NULL;
@@ -219,18 +251,56 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
   return TRUE;
 }
 
+/* Returns the clock time at which @buffer is rendered */
+static GstClockTime
+gst_inter_video_sink_get_clock_time (GstInterVideoSink * intervideosink,
+    GstBuffer * buffer)
+{
+  GstBaseSink *sink = GST_BASE_SINK (intervideosink);
+  GstClockTime running_time;
+  GstClock *clock;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_CLOCK_TIME_NONE;
+
+  clock = gst_element_get_clock (GST_ELEMENT (sink));
+  if (clock == NULL)
+    return GST_CLOCK_TIME_NONE;
+  gst_object_unref (clock);
+
+  running_time = gst_segment_to_running_time (&sink->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return GST_CLOCK_TIME_NONE;
+
+  return running_time + gst_element_get_base_time (GST_ELEMENT (sink)) +
+      gst_base_sink_get_latency (sink);
+}
+
 static GstFlowReturn
 gst_inter_video_sink_render (GstBaseSink * sink, GstBuffer * buffer)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
+  GstClockTime time;
+  guint max_frames;
+  guint n_dropped;
+
+  time = gst_inter_video_sink_get_clock_time (intervideosink, buffer);
+
+  GST_OBJECT_LOCK (intervideosink);
+  max_frames = intervideosink->max_frames;
+  GST_OBJECT_UNLOCK (intervideosink);
+
+  n_dropped = gst_inter_surface_push_video (intervideosink->surface,
+      gst_buffer_ref (buffer), time, max_frames);
 
-  g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
+  if (n_dropped > 0) {
+    GST_DEBUG_OBJECT (intervideosink, "queue full, dropped %u frames",
+        n_dropped);
+    GST_OBJECT_LOCK (intervideosink);
+    intervideosink->n_dropped += n_dropped;
+    GST_OBJECT_UNLOCK (intervideosink);
   }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
-  g_mutex_unlock (&intervideosink->surface->mutex);
 
   return GST_FLOW_OK;
 }
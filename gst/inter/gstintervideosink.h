@@ -40,6 +40,9 @@ struct _GstInterVideoSink
 
   GstInterSurface *surface;
   char *channel;
+  guint max_frames;
+
+  guint64 n_dropped;
 
   int fps_n;
   int fps_d;
@@ -70,7 +70,9 @@ static GstCaps *gst_inter_video_src_fixate (GstBaseSrc * src, GstCaps * caps);
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_FRAMES_DROPPED,
+  PROP_FRAMES_DUPLICATED
 };
 
 /* pad templates */
@@ -121,6 +123,15 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
           "Channel name to match inter src and sink elements",
           "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_FRAMES_DROPPED,
+      g_param_spec_uint64 ("frames-dropped", "Frames dropped",
+          "Number of frames from the inter sink that were skipped", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FRAMES_DUPLICATED,
+      g_param_spec_uint64 ("frames-duplicated", "Frames duplicated",
+          "Number of frames from the inter sink that were sent more than once",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -159,6 +170,16 @@ gst_inter_video_src_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, intervideosrc->channel);
       break;
+    case PROP_FRAMES_DROPPED:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->n_dropped);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_FRAMES_DUPLICATED:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->n_duplicated);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -200,6 +221,10 @@ gst_inter_video_src_start (GstBaseSrc * src)
   GST_DEBUG_OBJECT (intervideosrc, "start");
 
   intervideosrc->surface = gst_inter_surface_get (intervideosrc->channel);
+  intervideosrc->video_time = GST_CLOCK_TIME_NONE;
+  intervideosrc->video_buffer_count = 0;
+  intervideosrc->n_dropped = 0;
+  intervideosrc->n_duplicated = 0;
 
   return TRUE;
 }
@@ -211,6 +236,8 @@ gst_inter_video_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intervideosrc, "stop");
 
+  gst_buffer_replace (&intervideosrc->video_buffer, NULL);
+
   gst_inter_surface_unref (intervideosrc->surface);
   intervideosrc->surface = NULL;
 
@@ -251,21 +278,52 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
 {
   GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
   GstBuffer *buffer;
+  GstClockTime timestamp;
+  GstClockTime target = GST_CLOCK_TIME_NONE;
+  GstClockTime time;
+  GstClock *clock;
+  guint n_skipped;
 
   GST_DEBUG_OBJECT (intervideosrc, "create");
 
-  buffer = NULL;
+  timestamp = gst_util_uint64_scale_int (GST_SECOND * intervideosrc->n_frames,
+      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+      GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
 
-  g_mutex_lock (&intervideosrc->surface->mutex);
-  if (intervideosrc->surface->video_buffer) {
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
-    intervideosrc->surface->video_buffer_count++;
-    if (intervideosrc->surface->video_buffer_count >= 30) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
+  /* the clock time at which this frame will be pushed */
+  clock = gst_element_get_clock (GST_ELEMENT (src));
+  if (clock) {
+    target = gst_element_get_base_time (GST_ELEMENT (src)) + timestamp;
+    gst_object_unref (clock);
+  }
+
+  buffer = gst_inter_surface_take_video (intervideosrc->surface, target,
+      intervideosrc->video_time, &time, &n_skipped);
+
+  GST_OBJECT_LOCK (intervideosrc);
+  intervideosrc->n_dropped += n_skipped;
+  if (buffer) {
+    gst_buffer_replace (&intervideosrc->video_buffer, NULL);
+    intervideosrc->video_buffer = buffer;
+    intervideosrc->video_time = time;
+    intervideosrc->video_buffer_count = 0;
+  } else if (intervideosrc->video_buffer) {
+    intervideosrc->n_duplicated++;
+  }
+  GST_OBJECT_UNLOCK (intervideosrc);
+
+  if (n_skipped > 0)
+    GST_DEBUG_OBJECT (intervideosrc, "skipped %u frames", n_skipped);
+
+  buffer = NULL;
+  if (intervideosrc->video_buffer) {
+    buffer = gst_buffer_ref (intervideosrc->video_buffer);
+    intervideosrc->video_buffer_count++;
+    if (intervideosrc->video_buffer_count >= 30) {
+      gst_buffer_replace (&intervideosrc->video_buffer, NULL);
+      intervideosrc->video_time = GST_CLOCK_TIME_NONE;
     }
   }
-  g_mutex_unlock (&intervideosrc->surface->mutex);
 
   if (buffer == NULL) {
     GstMapInfo map;
@@ -286,10 +344,7 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
 
   buffer = gst_buffer_make_writable (buffer);
 
-  GST_BUFFER_TIMESTAMP (buffer) =
-      gst_util_uint64_scale_int (GST_SECOND * intervideosrc->n_frames,
-      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
-      GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
+  GST_BUFFER_TIMESTAMP (buffer) = timestamp;
   GST_DEBUG_OBJECT (intervideosrc, "create ts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (buffer)));
   GST_BUFFER_DURATION (buffer) =
@@ -45,6 +45,15 @@ struct _GstInterVideoSrc
 
   GstVideoInfo info;
   int n_frames;
+
+  /* the last frame taken from the surface, repeated until a newer one is
+   * nearer to the output time */
+  GstBuffer *video_buffer;
+  GstClockTime video_time;
+  int video_buffer_count;
+
+  guint64 n_dropped;
+  guint64 n_duplicated;
 };
 
 struct _GstInterVideoSrcClass
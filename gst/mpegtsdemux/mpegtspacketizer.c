@@ -28,6 +28,13 @@
  * with newer GLib versions (>= 2.31.0) */
 #define GLIB_DISABLE_DEPRECATION_WARNINGS
 
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_SYNC_NEON 1
+#endif
+
 /* Skew calculation pameters */
 #define MAX_TIME	(2 * GST_SECOND)
 
@@ -175,6 +182,36 @@ G_DEFINE_TYPE_EXTENDED (MpegTSPacketizer2, mpegts_packetizer, G_TYPE_OBJECT, 0,
  * 256 should be sufficient for most multiplexes */
 #define MAX_PCR_OBS_CHANNELS 256
 
+/* Minimum distance (in time) between two entries of the PCR index when
+ * recording PCR while reading linearly */
+#define PCR_INDEX_MIN_INTERVAL (500 * GST_MSECOND)
+/* Maximum byte distance between two consecutively observed PCR for them to
+ * be considered adjacent (i.e. no data was skipped in between) */
+#define PCR_INDEX_ADJACENT_DISTANCE (4 * 1024 * 1024)
+/* PCR jumps bigger than this between adjacent PCR are discontinuities */
+#define PCR_INDEX_DISCONT_THRESHOLD (15 * GST_SECOND)
+/* Seek bisection stops once the target is bracketed this closely */
+#define PCR_INDEX_SEEK_ACCURACY (GST_SECOND)
+#define PCR_INDEX_SEEK_MIN_BYTES (64 * 1024)
+/* Once the index of a PID reaches this size, every other entry is dropped
+ * and the minimum distance between entries doubled */
+#define PCR_INDEX_MAX_ENTRIES 2048
+
+/* One entry of the sparse PCR index */
+typedef struct
+{
+  /* Upstream offset of the packet carrying the PCR */
+  guint64 offset;
+  /* PCR value as found in the stream (27MHz) */
+  guint64 pcr;
+  /* Position on the continuous (rollover/discont corrected) timeline of
+   * the PID, 0 being the entry with the lowest offset */
+  GstClockTime ts;
+  /* Entries with different segment ids are separated by a PCR
+   * discontinuity, their PCR values can't be compared */
+  guint segment;
+} MpegTSPCRIndexEntry;
+
 typedef struct _MpegTSPCR
 {
   guint16 pid;
@@ -206,6 +243,19 @@ typedef struct _MpegTSPCR
   guint64 last_pcr;
   GstClockTime last_pcr_ts;
 
+  /* Sparse PCR => offset index, sorted by offset */
+  GArray *index;
+  /* Current minimum distance between entries, grows when thinning */
+  GstClockTime index_interval;
+  /* Last PCR observed while reading linearly, used to detect
+   * discontinuities between adjacent PCR */
+  gboolean have_prev;
+  guint64 prev_offset;
+  guint64 prev_pcr;
+  GstClockTime prev_ts;
+  guint prev_segment;
+  /* Last used segment id */
+  guint last_segment;
 } MpegTSPCR;
 
 struct _MpegTSPacketizerPrivate
@@ -215,6 +265,9 @@ struct _MpegTSPacketizerPrivate
   guint8 *mapped;
   guint offset;
   guint mapped_size;
+  /* Buffer taken from the adapter that mapped points into */
+  GstBuffer *mapped_buffer;
+  GstMapInfo mapped_info;
 
   /* Reference offset */
   guint64 refoffset;
@@ -231,9 +284,35 @@ struct _MpegTSPacketizerPrivate
 
   /* Conversion tables */
   GIConv iconvs[_ICONV_MAX];
+
+  /* Parsed NIT/SDT/EIT sections, see
+   * mpegts_packetizer_get_cached_section(). The lock protects the cache and
+   * its counters, which are read by mpegts_packetizer_get_stats() */
+  GMutex section_cache_lock;
+  GHashTable *section_cache;
+  GQueue section_lru;
+  guint64 section_cache_hits;
+  guint64 section_cache_misses;
+  guint64 section_cache_evictions;
 };
 
+/* Maximum number of parsed sections kept in the section cache */
+#define SECTION_CACHE_MAX_ENTRIES 4096
+
+typedef struct
+{
+  /* pid, table_id, subtable_extension and section_number */
+  guint64 key;
+  guint8 version_number;
+  guint32 crc;
+  GstStructure *structure;
+  /* in the LRU queue */
+  GList link;
+} MpegTSSectionCacheEntry;
+
 static void mpegts_packetizer_dispose (GObject * object);
+static void mpegts_packetizer_release_mapped (MpegTSPacketizer2 * packetizer,
+    gboolean keep_rest);
 static void mpegts_packetizer_finalize (GObject * object);
 static gchar *get_encoding_and_convert (MpegTSPacketizer2 * packetizer,
     const gchar * text, guint length);
@@ -241,6 +320,8 @@ static GstClockTime calculate_skew (MpegTSPCR * pcr, guint64 pcrtime,
     GstClockTime time);
 static void record_pcr (MpegTSPacketizer2 * packetizer, MpegTSPCR * pcrtable,
     guint64 pcr, guint64 offset);
+static gboolean pcr_index_add (MpegTSPCR * pcrtable, guint64 pcr,
+    guint64 offset, gboolean linear);
 
 #define CONTINUITY_UNSET 255
 #define MAX_CONTINUITY 15
@@ -284,6 +365,11 @@ get_pcr_table (MpegTSPacketizer2 * packetizer, guint16 pid)
     res->prev_send_diff = GST_CLOCK_TIME_NONE;
     res->prev_out_time = GST_CLOCK_TIME_NONE;
     res->pcroffset = 0;
+
+    res->index = g_array_new (FALSE, FALSE, sizeof (MpegTSPCRIndexEntry));
+    res->index_interval = PCR_INDEX_MIN_INTERVAL;
+    res->have_prev = FALSE;
+    res->last_segment = 0;
   }
 
   return res;
@@ -296,6 +382,7 @@ flush_observations (MpegTSPacketizer2 * packetizer)
   gint i;
 
   for (i = 0; i < priv->lastobsid; i++) {
+    g_array_free (priv->observations[i]->index, TRUE);
     g_free (priv->observations[i]);
     priv->observations[i] = NULL;
   }
@@ -303,6 +390,32 @@ flush_observations (MpegTSPacketizer2 * packetizer)
   priv->lastobsid = 0;
 }
 
+/* Forget about linear reading state (skew and adjacent PCR) but keep
+ * the PCR index and first/last observations, which are still valid
+ * after seeking in the same stream */
+static void
+reset_observations (MpegTSPacketizer2 * packetizer)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  gint i;
+
+  for (i = 0; i < priv->lastobsid; i++) {
+    MpegTSPCR *pcr = priv->observations[i];
+
+    pcr->have_prev = FALSE;
+    pcr->base_time = GST_CLOCK_TIME_NONE;
+    pcr->base_pcrtime = GST_CLOCK_TIME_NONE;
+    pcr->last_pcrtime = GST_CLOCK_TIME_NONE;
+    pcr->window_pos = 0;
+    pcr->window_filling = TRUE;
+    pcr->window_min = 0;
+    pcr->window_size = 0;
+    pcr->skew = 0;
+    pcr->prev_send_diff = GST_CLOCK_TIME_NONE;
+    pcr->prev_out_time = GST_CLOCK_TIME_NONE;
+  }
+}
+
 static gint
 mpegts_packetizer_stream_subtable_compare (gconstpointer a, gconstpointer b)
 {
@@ -376,6 +489,160 @@ mpegts_packetizer_class_init (MpegTSPacketizer2Class * klass)
   gobject_class->finalize = mpegts_packetizer_finalize;
 }
 
+static void
+section_cache_entry_free (MpegTSSectionCacheEntry * entry)
+{
+  gst_structure_free (entry->structure);
+  g_slice_free (MpegTSSectionCacheEntry, entry);
+}
+
+static inline guint64
+section_cache_key (MpegTSPacketizerSection * section)
+{
+  /* section_number follows the version byte in long form sections */
+  return ((guint64) (section->pid & 0x1fff) << 32) |
+      ((guint64) section->table_id << 24) |
+      ((guint64) section->subtable_extension << 8) | section->data[6];
+}
+
+/* Must be called with the section cache lock */
+static void
+section_cache_remove (MpegTSPacketizerPrivate * priv,
+    MpegTSSectionCacheEntry * entry)
+{
+  g_queue_unlink (&priv->section_lru, &entry->link);
+  g_hash_table_remove (priv->section_cache, &entry->key);
+}
+
+static void
+section_cache_clear (MpegTSPacketizerPrivate * priv)
+{
+  g_mutex_lock (&priv->section_cache_lock);
+  g_hash_table_remove_all (priv->section_cache);
+  g_queue_init (&priv->section_lru);
+  g_mutex_unlock (&priv->section_cache_lock);
+}
+
+/**
+ * mpegts_packetizer_get_cached_section:
+ * @packetizer: a #MpegTSPacketizer2
+ * @section: a complete section
+ *
+ * Tables like the EIT are split in many sections sharing the same version
+ * number, which defeats the subtable change detection done in
+ * mpegts_packetizer_parse_section_header(). The sections are repeated all
+ * the time though, so the structures parsed from NIT, SDT and EIT sections
+ * are kept around, and looked up here before parsing @section again.
+ *
+ * Returns: (transfer none): the structure parsed from an earlier section
+ * with the same version and CRC as @section, or %NULL. It is owned by the
+ * packetizer and stays valid until the next section is parsed.
+ */
+const GstStructure *
+mpegts_packetizer_get_cached_section (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerSection * section)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  MpegTSSectionCacheEntry *entry;
+  const GstStructure *structure = NULL;
+  guint64 key;
+
+  if (G_UNLIKELY (section->section_length < 8))
+    return NULL;
+
+  key = section_cache_key (section);
+
+  g_mutex_lock (&priv->section_cache_lock);
+  entry = g_hash_table_lookup (priv->section_cache, &key);
+  if (entry && entry->version_number == section->version_number &&
+      entry->crc == section->crc) {
+    GST_LOG ("cached section pid 0x%04x table_id 0x%02x subtable_extension %d "
+        "section_number %d", section->pid, section->table_id,
+        section->subtable_extension, section->data[6]);
+    /* Most recently used entries are at the head */
+    g_queue_unlink (&priv->section_lru, &entry->link);
+    g_queue_push_head_link (&priv->section_lru, &entry->link);
+    priv->section_cache_hits++;
+    structure = entry->structure;
+  } else {
+    priv->section_cache_misses++;
+  }
+  g_mutex_unlock (&priv->section_cache_lock);
+
+  return structure;
+}
+
+static void
+section_cache_store (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerSection * section, const GstStructure * structure)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  MpegTSSectionCacheEntry *entry;
+  guint64 key;
+
+  if (G_UNLIKELY (section->section_length < 8))
+    return;
+
+  key = section_cache_key (section);
+
+  g_mutex_lock (&priv->section_cache_lock);
+
+  /* An older version of the section */
+  entry = g_hash_table_lookup (priv->section_cache, &key);
+  if (entry)
+    section_cache_remove (priv, entry);
+
+  /* Bound memory usage by dropping the least recently used section, this
+   * only happens with huge EPGs */
+  if (G_UNLIKELY (g_hash_table_size (priv->section_cache) >=
+          SECTION_CACHE_MAX_ENTRIES)) {
+    entry = g_queue_peek_tail (&priv->section_lru);
+    GST_LOG ("section cache full, evicting key 0x%" G_GINT64_MODIFIER "x",
+        entry->key);
+    section_cache_remove (priv, entry);
+    priv->section_cache_evictions++;
+  }
+
+  entry = g_slice_new0 (MpegTSSectionCacheEntry);
+  entry->key = key;
+  entry->version_number = section->version_number;
+  entry->crc = section->crc;
+  entry->structure = gst_structure_copy (structure);
+  entry->link.data = entry;
+
+  g_hash_table_insert (priv->section_cache, &entry->key, entry);
+  g_queue_push_head_link (&priv->section_lru, &entry->link);
+
+  g_mutex_unlock (&priv->section_cache_lock);
+}
+
+/**
+ * mpegts_packetizer_get_stats:
+ * @packetizer: a #MpegTSPacketizer2
+ *
+ * Can be called from any thread.
+ *
+ * Returns: a new #GstStructure with the section cache statistics
+ */
+GstStructure *
+mpegts_packetizer_get_stats (MpegTSPacketizer2 * packetizer)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  GstStructure *stats;
+
+  g_mutex_lock (&priv->section_cache_lock);
+  stats = gst_structure_new ("mpegts-packetizer-stats",
+      "section-cache-hits", G_TYPE_UINT64, priv->section_cache_hits,
+      "section-cache-misses", G_TYPE_UINT64, priv->section_cache_misses,
+      "section-cache-entries", G_TYPE_UINT,
+      priv->section_cache ? g_hash_table_size (priv->section_cache) : 0,
+      "section-cache-evictions", G_TYPE_UINT64, priv->section_cache_evictions,
+      NULL);
+  g_mutex_unlock (&priv->section_cache_lock);
+
+  return stats;
+}
+
 static void
 mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
 {
@@ -406,6 +673,14 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   priv->nb_seen_offsets = 0;
   priv->refoffset = -1;
   priv->last_in_time = GST_CLOCK_TIME_NONE;
+
+  g_mutex_init (&priv->section_cache_lock);
+  priv->section_cache = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+      NULL, (GDestroyNotify) section_cache_entry_free);
+  g_queue_init (&priv->section_lru);
+  priv->section_cache_hits = 0;
+  priv->section_cache_misses = 0;
+  priv->section_cache_evictions = 0;
 }
 
 static void
@@ -429,6 +704,7 @@ mpegts_packetizer_dispose (GObject * object)
       g_free (packetizer->streams);
     }
 
+    mpegts_packetizer_release_mapped (packetizer, FALSE);
     gst_adapter_clear (packetizer->adapter);
     g_object_unref (packetizer->adapter);
     packetizer->disposed = TRUE;
@@ -440,6 +716,10 @@ mpegts_packetizer_dispose (GObject * object)
         g_iconv_close (packetizer->priv->iconvs[i]);
 
     flush_observations (packetizer);
+
+    section_cache_clear (packetizer->priv);
+    g_hash_table_destroy (packetizer->priv->section_cache);
+    packetizer->priv->section_cache = NULL;
   }
 
   if (G_OBJECT_CLASS (mpegts_packetizer_parent_class)->dispose)
@@ -449,6 +729,10 @@ mpegts_packetizer_dispose (GObject * object)
 static void
 mpegts_packetizer_finalize (GObject * object)
 {
+  MpegTSPacketizer2 *packetizer = GST_MPEGTS_PACKETIZER (object);
+
+  g_mutex_clear (&packetizer->priv->section_cache_lock);
+
   if (G_OBJECT_CLASS (mpegts_packetizer_parent_class)->finalize)
     G_OBJECT_CLASS (mpegts_packetizer_parent_class)->finalize (object);
 }
@@ -1650,6 +1934,8 @@ mpegts_packetizer_parse_nit (MpegTSPacketizer2 * packetizer,
 
   GST_DEBUG ("NIT %" GST_PTR_FORMAT, nit);
 
+  section_cache_store (packetizer, section, nit);
+
   return nit;
 
 error:
@@ -1844,6 +2130,8 @@ mpegts_packetizer_parse_sdt (MpegTSPacketizer2 * packetizer,
 
   gst_structure_id_take_value (sdt, QUARK_SERVICES, &services);
 
+  section_cache_store (packetizer, section, sdt);
+
   return sdt;
 
 error:
@@ -2337,6 +2625,8 @@ mpegts_packetizer_parse_eit (MpegTSPacketizer2 * packetizer,
 
   GST_DEBUG ("EIT %" GST_PTR_FORMAT, eit);
 
+  section_cache_store (packetizer, section, eit);
+
   return eit;
 
 error:
@@ -2443,6 +2733,43 @@ mpegts_packetizer_parse_tot (MpegTSPacketizer2 * packetizer,
   return tot;
 }
 
+/* Releases the currently mapped data. If @keep_rest is TRUE, the data
+ * that wasn't consumed yet is put back in front of the adapter */
+static void
+mpegts_packetizer_release_mapped (MpegTSPacketizer2 * packetizer,
+    gboolean keep_rest)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+
+  if (priv->mapped_buffer == NULL) {
+    priv->mapped = NULL;
+    return;
+  }
+
+  gst_buffer_unmap (priv->mapped_buffer, &priv->mapped_info);
+
+  if (keep_rest && priv->offset < priv->mapped_size) {
+    GstBuffer *rest;
+    GList *list = NULL, *tmp;
+    guint avail;
+
+    rest = gst_buffer_copy_region (priv->mapped_buffer, GST_BUFFER_COPY_ALL,
+        priv->offset, priv->mapped_size - priv->offset);
+    avail = gst_adapter_available (packetizer->adapter);
+    if (avail)
+      list = gst_adapter_take_list (packetizer->adapter, avail);
+    gst_adapter_push (packetizer->adapter, rest);
+    for (tmp = list; tmp; tmp = tmp->next)
+      gst_adapter_push (packetizer->adapter, (GstBuffer *) tmp->data);
+    g_list_free (list);
+  }
+
+  gst_buffer_unref (priv->mapped_buffer);
+  priv->mapped_buffer = NULL;
+  priv->mapped = NULL;
+  priv->offset = 0;
+}
+
 void
 mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
 {
@@ -2464,20 +2791,24 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
     memset (packetizer->streams, 0, 8192 * sizeof (MpegTSPacketizerStream *));
   }
 
+  mpegts_packetizer_release_mapped (packetizer, FALSE);
   gst_adapter_clear (packetizer->adapter);
   packetizer->offset = 0;
   packetizer->empty = TRUE;
   packetizer->priv->available = 0;
-  packetizer->priv->mapped = NULL;
   packetizer->priv->mapped_size = 0;
   packetizer->priv->offset = 0;
   packetizer->priv->last_in_time = GST_CLOCK_TIME_NONE;
+  reset_observations (packetizer);
+  section_cache_clear (packetizer->priv);
 }
 
+/* A hard flush also discards all PCR observations, use it when the
+ * upcoming data might not belong to the same stream anymore */
 void
-mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer)
+mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer, gboolean hard)
 {
-  GST_DEBUG ("Flushing");
+  GST_DEBUG ("Flushing (hard:%d)", hard);
 
   if (packetizer->streams) {
     int i;
@@ -2487,16 +2818,19 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer)
       }
     }
   }
+  mpegts_packetizer_release_mapped (packetizer, FALSE);
   gst_adapter_clear (packetizer->adapter);
 
   packetizer->offset = 0;
   packetizer->empty = TRUE;
   packetizer->priv->available = 0;
-  packetizer->priv->mapped = NULL;
   packetizer->priv->offset = 0;
   packetizer->priv->mapped_size = 0;
   packetizer->priv->last_in_time = GST_CLOCK_TIME_NONE;
-  flush_observations (packetizer);
+  if (hard)
+    flush_observations (packetizer);
+  else
+    reset_observations (packetizer);
 }
 
 void
@@ -2538,63 +2872,154 @@ mpegts_packetizer_push (MpegTSPacketizer2 * packetizer, GstBuffer * buffer)
     packetizer->priv->last_in_time = GST_BUFFER_TIMESTAMP (buffer);
 }
 
-static gboolean
-mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
+/* Number of consecutive sync bytes required to lock on a packet size */
+#define SYNC_LOCK_COUNT 4
+/* Amount of data needed to test all candidate positions and packet sizes */
+#define SYNC_SCAN_SIZE (MPEGTS_MAX_PACKETSIZE * SYNC_LOCK_COUNT)
+/* One extra (zero) word so that unaligned 64 bit windows can be read
+ * anywhere in the scanned area */
+#define SYNC_BITMAP_WORDS ((SYNC_SCAN_SIZE + 63) / 64 + 2)
+
+/* Sets bit N of @bitmap if data[N] is a sync byte, @size must be a multiple
+ * of 16 */
+static void
+mpegts_sync_bitmap (const guint8 * data, guint size, guint64 * bitmap)
+{
+  guint i;
+#if defined (__SSE2__)
+  const __m128i sync = _mm_set1_epi8 (PACKET_SYNC_BYTE);
+
+  for (i = 0; i < size; i += 16) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (data + i));
+    guint64 m = (guint16) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, sync));
+
+    bitmap[i / 64] |= m << (i % 64);
+  }
+#elif defined (HAVE_SYNC_NEON)
+  static const guint8 weights[16] = {
+    1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+  };
+  const uint8x16_t sync = vdupq_n_u8 (PACKET_SYNC_BYTE);
+  const uint8x16_t w = vld1q_u8 (weights);
+
+  for (i = 0; i < size; i += 16) {
+    uint8x16_t eq = vandq_u8 (vceqq_u8 (vld1q_u8 (data + i), sync), w);
+    uint8x8_t sum = vpadd_u8 (vget_low_u8 (eq), vget_high_u8 (eq));
+    guint64 m;
+
+    sum = vpadd_u8 (sum, sum);
+    sum = vpadd_u8 (sum, sum);
+    m = vget_lane_u8 (sum, 0) | (vget_lane_u8 (sum, 1) << 8);
+    bitmap[i / 64] |= m << (i % 64);
+  }
+#else
+  for (i = 0; i < size; i++)
+    if (data[i] == PACKET_SYNC_BYTE)
+      bitmap[i / 64] |= G_GUINT64_CONSTANT (1) << (i % 64);
+#endif
+}
+
+/* Returns the 64 bits of @bitmap starting at bit @pos */
+static inline guint64
+mpegts_sync_bitmap_window (const guint64 * bitmap, guint pos)
+{
+  guint w = pos / 64, b = pos % 64;
+
+  if (b == 0)
+    return bitmap[w];
+  return (bitmap[w] >> b) | (bitmap[w + 1] << (64 - b));
+}
+
+static inline guint
+mpegts_ctz64 (guint64 v)
+{
+#if defined (__GNUC__)
+  return __builtin_ctzll (v);
+#else
+  guint n = 0;
+
+  while (!(v & 1)) {
+    v >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* Looks in one pass for the first position < MPEGTS_MAX_PACKETSIZE in @data
+ * (SYNC_SCAN_SIZE bytes) that starts SYNC_LOCK_COUNT sync bytes spaced by
+ * one of the possible packet sizes. Returns the position or -1 and sets
+ * @packetsize */
+static gint
+mpegts_find_sync_lattice (const guint8 * data, guint * packetsize)
 {
-  guint8 *dest;
-  int i, pos = -1, j;
   static const guint psizes[] = {
     MPEGTS_NORMAL_PACKETSIZE,
     MPEGTS_M2TS_PACKETSIZE,
     MPEGTS_DVB_ASI_PACKETSIZE,
     MPEGTS_ATSC_PACKETSIZE
   };
-
-
-  dest = g_malloc (MPEGTS_MAX_PACKETSIZE * 4);
-  /* wait for 3 sync bytes */
-  while (packetizer->priv->available >= MPEGTS_MAX_PACKETSIZE * 4) {
-
-    /* check for sync bytes */
-    gst_adapter_copy (packetizer->adapter, dest, 0, MPEGTS_MAX_PACKETSIZE * 4);
-    /* find first sync byte */
-    pos = -1;
-    for (i = 0; i < MPEGTS_MAX_PACKETSIZE; i++) {
-      if (dest[i] == PACKET_SYNC_BYTE) {
-        for (j = 0; j < 4; j++) {
-          guint packetsize = psizes[j];
-          /* check each of the packet size possibilities in turn */
-          if (dest[i] == PACKET_SYNC_BYTE
-              && dest[i + packetsize] == PACKET_SYNC_BYTE
-              && dest[i + packetsize * 2] == PACKET_SYNC_BYTE
-              && dest[i + packetsize * 3] == PACKET_SYNC_BYTE) {
-            packetizer->know_packet_size = TRUE;
-            packetizer->packet_size = packetsize;
-            packetizer->caps = gst_caps_new_simple ("video/mpegts",
-                "systemstream", G_TYPE_BOOLEAN, TRUE,
-                "packetsize", G_TYPE_INT, packetsize, NULL);
-            if (packetsize == MPEGTS_M2TS_PACKETSIZE)
-              pos = i - 4;
-            else
-              pos = i;
-            break;
-          }
-        }
-        break;
+  guint64 bitmap[SYNC_BITMAP_WORDS];
+  gint res = -1;
+  guint i, j, k, base;
+
+  memset (bitmap, 0, sizeof (bitmap));
+  mpegts_sync_bitmap (data, SYNC_SCAN_SIZE, bitmap);
+
+  for (base = 0; base < MPEGTS_MAX_PACKETSIZE; base += 64) {
+    for (j = 0; j < G_N_ELEMENTS (psizes); j++) {
+      guint64 cand = mpegts_sync_bitmap_window (bitmap, base);
+
+      for (k = 1; k < SYNC_LOCK_COUNT && cand; k++)
+        cand &= mpegts_sync_bitmap_window (bitmap, base + k * psizes[j]);
+      if (cand == 0)
+        continue;
+
+      i = base + mpegts_ctz64 (cand);
+      if (i < MPEGTS_MAX_PACKETSIZE && (res == -1 || (gint) i < res)) {
+        res = i;
+        *packetsize = psizes[j];
       }
     }
+    if (res != -1)
+      break;
+  }
 
-    if (packetizer->know_packet_size)
+  return res;
+}
+
+static gboolean
+mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  const guint8 *data;
+  guint packetsize = 0;
+  gint pos = -1;
+
+  /* wait for 4 sync bytes */
+  while (priv->available >= SYNC_SCAN_SIZE) {
+    data = gst_adapter_map (packetizer->adapter, SYNC_SCAN_SIZE);
+    pos = mpegts_find_sync_lattice (data, &packetsize);
+    gst_adapter_unmap (packetizer->adapter);
+
+    if (pos != -1) {
+      packetizer->know_packet_size = TRUE;
+      packetizer->packet_size = packetsize;
+      packetizer->caps = gst_caps_new_simple ("video/mpegts",
+          "systemstream", G_TYPE_BOOLEAN, TRUE,
+          "packetsize", G_TYPE_INT, packetsize, NULL);
+      /* M2TS packets start 4 bytes before the sync byte */
+      if (packetsize == MPEGTS_M2TS_PACKETSIZE)
+        pos = pos >= 4 ? pos - 4 : pos + MPEGTS_M2TS_PACKETSIZE - 4;
       break;
+    }
 
     /* Skip MPEGTS_MAX_PACKETSIZE */
     gst_adapter_flush (packetizer->adapter, MPEGTS_MAX_PACKETSIZE);
-    packetizer->priv->available -= MPEGTS_MAX_PACKETSIZE;
+    priv->available -= MPEGTS_MAX_PACKETSIZE;
     packetizer->offset += MPEGTS_MAX_PACKETSIZE;
   }
 
-  g_free (dest);
-
   if (packetizer->know_packet_size) {
     GST_DEBUG ("have packetsize detected: %d of %u bytes",
         packetizer->know_packet_size, packetizer->packet_size);
@@ -2603,7 +3028,7 @@ mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
       GST_DEBUG ("Flushing out %d bytes", pos);
       gst_adapter_flush (packetizer->adapter, pos);
       packetizer->offset += pos;
-      packetizer->priv->available -= MPEGTS_MAX_PACKETSIZE;
+      priv->available -= pos;
     }
   } else {
     /* drop invalid data and move to the next possible packets */
@@ -2613,6 +3038,27 @@ mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
   return packetizer->know_packet_size;
 }
 
+/* Returns the position (at most @packet_size) of the first sync byte in
+ * @data after the first byte that is also followed by a sync byte one packet
+ * later, favoring a consistent lattice over isolated 0x47 in the payload */
+static guint
+mpegts_find_resync (const guint8 * data, gsize size, guint packet_size)
+{
+  const guint8 *p = data + 1, *first = NULL;
+  gsize limit = MIN (size, packet_size);
+
+  while (p < data + limit &&
+      (p = memchr (p, PACKET_SYNC_BYTE, data + limit - p))) {
+    if (p + packet_size >= data + size || p[packet_size] == PACKET_SYNC_BYTE)
+      return p - data;
+    if (first == NULL)
+      first = p;
+    p++;
+  }
+
+  return first ? first - data : packet_size;
+}
+
 gboolean
 mpegts_packetizer_has_packets (MpegTSPacketizer2 * packetizer)
 {
@@ -2638,13 +3084,23 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
 
   while ((avail = priv->available) >= packetizer->packet_size) {
     if (priv->mapped == NULL) {
-      priv->mapped_size =
-          priv->available - (priv->available % packetizer->packet_size);
-      priv->mapped =
-          (guint8 *) gst_adapter_map (packetizer->adapter, priv->mapped_size);
+      guint fast = gst_adapter_available_fast (packetizer->adapter);
+
+      /* Take as many packets as possible without copying. Packets straddling
+       * input buffers are taken (and merged) one by one */
+      if (fast >= packetizer->packet_size)
+        priv->mapped_size = fast - (fast % packetizer->packet_size);
+      else
+        priv->mapped_size = packetizer->packet_size;
+      priv->mapped_buffer =
+          gst_adapter_take_buffer (packetizer->adapter, priv->mapped_size);
+      gst_buffer_map (priv->mapped_buffer, &priv->mapped_info, GST_MAP_READ);
+      priv->mapped = priv->mapped_info.data;
       priv->offset = 0;
     }
     packet->data_start = priv->mapped + priv->offset;
+    packet->buffer = priv->mapped_buffer;
+    packet->buffer_data = priv->mapped;
 
     /* M2TS packets don't start with the sync byte, all other variants do */
     if (packetizer->packet_size == MPEGTS_M2TS_PACKETSIZE)
@@ -2666,28 +3122,22 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
 
     GST_LOG ("Lost sync %d", packetizer->packet_size);
 
-    /* Find the 0x47 in the buffer */
-    for (i = 0; i < packetizer->packet_size; i++)
-      if (packet->data_start[i] == 0x47)
-        break;
+    /* This packet is not valid, the offset will be advanced below */
+    packetizer->offset -= packetizer->packet_size;
 
-    if (packetizer->packet_size == MPEGTS_M2TS_PACKETSIZE) {
-      if (i >= 4)
-        i -= 4;
-      else
-        i += 188;
-    }
+    /* Find the next 0x47 in the buffer that is followed by another one one
+     * packet later */
+    i = mpegts_find_resync (packet->data_start,
+        priv->mapped + priv->mapped_size - packet->data_start,
+        packetizer->packet_size);
 
+    /* For M2TS, the packet start moves along with data_start */
     GST_DEBUG ("Flushing %d bytes out", i);
-    /* gst_adapter_flush (packetizer->adapter, i); */
-    /* Pop out the remaining data... */
     priv->offset += i;
     priv->available -= i;
-    if (G_UNLIKELY (priv->available < packetizer->packet_size)) {
-      GST_DEBUG ("Flushing %d bytes out", priv->offset);
-      gst_adapter_flush (packetizer->adapter, priv->offset);
-      priv->mapped = NULL;
-    }
+    packetizer->offset += i;
+    /* The mapped area is no longer aligned on packets, remap it */
+    mpegts_packetizer_release_mapped (packetizer, TRUE);
     continue;
   }
 
@@ -2705,12 +3155,7 @@ mpegts_packetizer_process_next_packet (MpegTSPacketizer2 * packetizer)
 
   ret = mpegts_packetizer_next_packet (packetizer, &packet);
   if (ret != PACKET_NEED_MORE) {
-    packetizer->priv->offset += packetizer->packet_size;
-    packetizer->priv->available -= packetizer->packet_size;
-    if (G_UNLIKELY (packetizer->priv->available < packetizer->packet_size)) {
-      gst_adapter_flush (packetizer->adapter, packetizer->priv->offset);
-      packetizer->priv->mapped = NULL;
-    }
+    mpegts_packetizer_clear_packet (packetizer, &packet);
   }
   return ret;
 }
@@ -2724,10 +3169,9 @@ mpegts_packetizer_clear_packet (MpegTSPacketizer2 * packetizer,
   priv->offset += packetizer->packet_size;
   priv->available -= packetizer->packet_size;
 
-  if (G_UNLIKELY (priv->mapped && priv->available < packetizer->packet_size)) {
-    gst_adapter_flush (packetizer->adapter, priv->offset);
-    priv->mapped = NULL;
-  }
+  if (G_UNLIKELY (priv->mapped &&
+          priv->offset + packetizer->packet_size > priv->mapped_size))
+    mpegts_packetizer_release_mapped (packetizer, FALSE);
 }
 
 gboolean
@@ -3631,6 +4075,299 @@ record_pcr (MpegTSPacketizer2 * packetizer, MpegTSPCR * pcrtable, guint64 pcr,
     pcrtable->last_offset = offset;
     priv->nb_seen_offsets++;
   }
+
+  pcr_index_add (pcrtable, pcr % PCR_MAX_VALUE, offset, TRUE);
+}
+
+/* Difference between two PCR values, taking one rollover into account */
+static inline guint64
+pcr_diff (guint64 from, guint64 to)
+{
+  if (G_LIKELY (to >= from))
+    return to - from;
+  return to + PCR_MAX_VALUE - from;
+}
+
+/* Returns the position of the first entry whose offset is >= @offset */
+static guint
+pcr_index_find (GArray * index, guint64 offset)
+{
+  guint lo = 0, hi = index->len;
+
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    if (g_array_index (index, MpegTSPCRIndexEntry, mid).offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/* Returns the position of the last entry whose ts is <= @ts, or -1 */
+static gint
+pcr_index_find_ts (GArray * index, GstClockTime ts)
+{
+  gint lo = 0, hi = index->len;
+
+  while (lo < hi) {
+    gint mid = (lo + hi) / 2;
+
+    if (g_array_index (index, MpegTSPCRIndexEntry, mid).ts <= ts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo - 1;
+}
+
+/* Average bitrate (in bytes per second) over the whole index, or 0 */
+static guint64
+pcr_index_byterate (GArray * index)
+{
+  MpegTSPCRIndexEntry *first, *last;
+
+  if (index->len < 2)
+    return 0;
+
+  first = &g_array_index (index, MpegTSPCRIndexEntry, 0);
+  last = &g_array_index (index, MpegTSPCRIndexEntry, index->len - 1);
+  if (last->ts <= first->ts)
+    return 0;
+
+  return gst_util_uint64_scale (last->offset - first->offset, GST_SECOND,
+      last->ts - first->ts);
+}
+
+/* Drops every other entry of the index of @pcrtable, keeping the first
+ * and last ones and the entries on both sides of a discontinuity, and
+ * makes further entries twice as sparse */
+static void
+pcr_index_thin (MpegTSPCR * pcrtable)
+{
+  GArray *index = pcrtable->index;
+  MpegTSPCRIndexEntry *entries = (MpegTSPCRIndexEntry *) index->data;
+  guint i, n = 1;
+
+  for (i = 1; i < index->len; i++) {
+    if ((i & 1) && i != index->len - 1 &&
+        entries[i].segment == entries[i - 1].segment &&
+        entries[i].segment == entries[i + 1].segment)
+      continue;
+    entries[n++] = entries[i];
+  }
+  g_array_set_size (index, n);
+  pcrtable->index_interval *= 2;
+
+  GST_DEBUG ("Thinned PCR index of pid 0x%04x to %u entries, one every %"
+      GST_TIME_FORMAT, pcrtable->pid, n,
+      GST_TIME_ARGS (pcrtable->index_interval));
+}
+
+/* Position of @offset on the timeline of @index, interpolated between the
+ * surrounding entries or extrapolated with the average bitrate (possibly
+ * before the first entry, hence signed). The index must have at least 2
+ * entries. Returns FALSE if the bitrate is unknown */
+static gboolean
+pcr_index_offset_to_ts (GArray * index, guint64 offset, gint64 * ts)
+{
+  MpegTSPCRIndexEntry *lo, *hi;
+  guint64 byterate;
+  guint pos;
+
+  pos = pcr_index_find (index, offset);
+  pos = CLAMP (pos, 1, index->len - 1);
+  lo = &g_array_index (index, MpegTSPCRIndexEntry, pos - 1);
+  hi = &g_array_index (index, MpegTSPCRIndexEntry, pos);
+
+  if (offset >= lo->offset && offset <= hi->offset) {
+    *ts = lo->ts + gst_util_uint64_scale (offset - lo->offset,
+        hi->ts - lo->ts, hi->offset - lo->offset);
+    return TRUE;
+  }
+
+  byterate = pcr_index_byterate (index);
+  if (byterate == 0)
+    return FALSE;
+
+  if (offset < lo->offset)
+    *ts = (gint64) lo->ts - (gint64) gst_util_uint64_scale (lo->offset - offset,
+        GST_SECOND, byterate);
+  else
+    *ts = hi->ts + gst_util_uint64_scale (offset - hi->offset, GST_SECOND,
+        byterate);
+
+  return TRUE;
+}
+
+/* Offset of the position @ts on the timeline of @index, see
+ * pcr_index_offset_to_ts() */
+static guint64
+pcr_index_ts_to_offset (GArray * index, gint64 ts)
+{
+  MpegTSPCRIndexEntry *lo, *hi;
+  guint64 byterate;
+  gint pos;
+
+  pos = ts < 0 ? 0 : pcr_index_find_ts (index, ts);
+  pos = CLAMP (pos, 0, (gint) index->len - 2);
+  lo = &g_array_index (index, MpegTSPCRIndexEntry, pos);
+  hi = &g_array_index (index, MpegTSPCRIndexEntry, pos + 1);
+
+  if (ts >= (gint64) lo->ts && ts <= (gint64) hi->ts)
+    return lo->offset + gst_util_uint64_scale (ts - lo->ts,
+        hi->offset - lo->offset, hi->ts - lo->ts);
+
+  byterate = pcr_index_byterate (index);
+  if (ts < (gint64) lo->ts) {
+    guint64 diff = gst_util_uint64_scale (lo->ts - ts, byterate, GST_SECOND);
+
+    return diff < lo->offset ? lo->offset - diff : 0;
+  }
+
+  return hi->offset + gst_util_uint64_scale (ts - hi->ts, byterate,
+      GST_SECOND);
+}
+
+/* Adds a PCR observation to the index of @pcrtable.
+ *
+ * If @linear is TRUE, the PCR was read right after the previously recorded
+ * one (normal playback), which allows detecting discontinuities. Otherwise
+ * (seek probes) the PCR is placed on the timeline relative to its
+ * neighbours in the index.
+ *
+ * Returns TRUE if a new entry was added to the index */
+static gboolean
+pcr_index_add (MpegTSPCR * pcrtable, guint64 pcr, guint64 offset,
+    gboolean linear)
+{
+  GArray *index = pcrtable->index;
+  MpegTSPCRIndexEntry entry, *prev = NULL, *next = NULL;
+  gboolean force = FALSE;
+  gint64 ts;
+  guint pos;
+
+  /* Reading linearly only ever appends */
+  if (index->len == 0 ||
+      g_array_index (index, MpegTSPCRIndexEntry, index->len - 1).offset <
+      offset)
+    pos = index->len;
+  else
+    pos = pcr_index_find (index, offset);
+  if (pos > 0)
+    prev = &g_array_index (index, MpegTSPCRIndexEntry, pos - 1);
+  if (pos < index->len) {
+    next = &g_array_index (index, MpegTSPCRIndexEntry, pos);
+    if (next->offset == offset)
+      goto existing;
+  }
+
+  entry.offset = offset;
+  entry.pcr = pcr;
+
+  if (linear && pcrtable->have_prev && offset > pcrtable->prev_offset &&
+      offset - pcrtable->prev_offset <= PCR_INDEX_ADJACENT_DISTANCE) {
+    GstClockTime diff = PCRTIME_TO_GSTTIME (pcr_diff (pcrtable->prev_pcr, pcr));
+
+    if (G_UNLIKELY (diff > PCR_INDEX_DISCONT_THRESHOLD)) {
+      guint64 byterate = pcr_index_byterate (index);
+
+      /* Estimate how much time the skipped bytes represent */
+      diff = 0;
+      if (byterate)
+        diff = gst_util_uint64_scale (offset - pcrtable->prev_offset,
+            GST_SECOND, byterate);
+      GST_DEBUG ("PCR discontinuity on pid 0x%04x at offset %" G_GUINT64_FORMAT,
+          pcrtable->pid, offset);
+      entry.segment = ++pcrtable->last_segment;
+      force = TRUE;
+    } else
+      entry.segment = pcrtable->prev_segment;
+    ts = pcrtable->prev_ts + diff;
+
+    /* Don't break the ordering of the index */
+    if ((prev && ts < (gint64) prev->ts) || (next && ts > (gint64) next->ts))
+      goto inconsistent;
+  } else if (prev == NULL && next == NULL) {
+    ts = 0;
+    entry.segment = pcrtable->last_segment;
+  } else {
+    gint64 from_prev = -1, from_next = -1;
+
+    if (prev)
+      from_prev = prev->ts + PCRTIME_TO_GSTTIME (pcr_diff (prev->pcr, pcr));
+    if (next)
+      from_next = next->ts - PCRTIME_TO_GSTTIME (pcr_diff (pcr, next->pcr));
+
+    if (prev && (next == NULL || (from_prev <= (gint64) next->ts &&
+                (prev->segment == next->segment
+                    || from_next < (gint64) prev->ts)))) {
+      ts = from_prev;
+      entry.segment = prev->segment;
+    } else if (next && (prev == NULL || from_next >= (gint64) prev->ts)) {
+      ts = from_next;
+      entry.segment = next->segment;
+    } else
+      goto inconsistent;
+  }
+
+  if (G_UNLIKELY (ts < 0)) {
+    guint i;
+
+    /* New first entry, rebase the timeline */
+    GST_DEBUG ("Rebasing PCR index of pid 0x%04x by %" GST_TIME_FORMAT,
+        pcrtable->pid, GST_TIME_ARGS (-ts));
+    for (i = 0; i < index->len; i++)
+      g_array_index (index, MpegTSPCRIndexEntry, i).ts += -ts;
+    pcrtable->prev_ts += -ts;
+    ts = 0;
+  }
+  entry.ts = ts;
+
+  /* Remember for the next linear observation. Seek probes are not
+   * adjacent to anything, they must not be taken for the last PCR read */
+  if (linear) {
+    pcrtable->have_prev = TRUE;
+    pcrtable->prev_offset = offset;
+    pcrtable->prev_pcr = pcr;
+    pcrtable->prev_ts = entry.ts;
+    pcrtable->prev_segment = entry.segment;
+  }
+
+  /* Keep the index sparse */
+  if (!force && ((prev && entry.ts - prev->ts < pcrtable->index_interval) ||
+          (next && next->ts - entry.ts < pcrtable->index_interval)))
+    return FALSE;
+
+  GST_LOG ("pid 0x%04x: indexing offset %" G_GUINT64_FORMAT " ts %"
+      GST_TIME_FORMAT " segment %u (%u entries)", pcrtable->pid, offset,
+      GST_TIME_ARGS (entry.ts), entry.segment, index->len + 1);
+  g_array_insert_val (index, pos, entry);
+
+  if (G_UNLIKELY (index->len >= PCR_INDEX_MAX_ENTRIES))
+    pcr_index_thin (pcrtable);
+
+  return TRUE;
+
+existing:
+  if (linear) {
+    pcrtable->have_prev = TRUE;
+    pcrtable->prev_offset = offset;
+    pcrtable->prev_pcr = next->pcr;
+    pcrtable->prev_ts = next->ts;
+    pcrtable->prev_segment = next->segment;
+  }
+  return FALSE;
+
+inconsistent:
+  GST_DEBUG ("PCR %" G_GUINT64_FORMAT " at offset %" G_GUINT64_FORMAT
+      " doesn't fit in the index of pid 0x%04x", pcr, offset, pcrtable->pid);
+  if (linear)
+    pcrtable->have_prev = FALSE;
+  return FALSE;
 }
 
 guint
@@ -3658,6 +4395,20 @@ mpegts_packetizer_offset_to_ts (MpegTSPacketizer2 * packetizer, guint64 offset,
 
   pcrtable = get_pcr_table (packetizer, pid);
 
+  if (pcrtable->index->len >= 2) {
+    gint64 ts, ref_ts;
+
+    /* Like below, times are counted from the reference offset */
+    if (!pcr_index_offset_to_ts (pcrtable->index, offset, &ts) ||
+        !pcr_index_offset_to_ts (pcrtable->index, priv->refoffset, &ref_ts))
+      return GST_CLOCK_TIME_NONE;
+    res = MAX (ts - ref_ts, 0);
+    GST_DEBUG ("Returning timestamp %" GST_TIME_FORMAT " for offset %"
+        G_GUINT64_FORMAT " (from index)", GST_TIME_ARGS (res), offset);
+
+    return res;
+  }
+
   /* Convert byte difference into time difference */
   res = PCRTIME_TO_GSTTIME (gst_util_uint64_scale (offset - priv->refoffset,
           pcrtable->last_pcr - pcrtable->first_pcr,
@@ -3715,6 +4466,19 @@ mpegts_packetizer_ts_to_offset (MpegTSPacketizer2 * packetizer, GstClockTime ts,
   if (pcrtable->first_pcr == -1)
     return -1;
 
+  if (pcrtable->index->len >= 2 && priv->refoffset != -1) {
+    gint64 ref_ts;
+
+    /* The inverse of mpegts_packetizer_offset_to_ts() */
+    if (pcr_index_offset_to_ts (pcrtable->index, priv->refoffset, &ref_ts)) {
+      res = pcr_index_ts_to_offset (pcrtable->index, ts + ref_ts);
+      GST_DEBUG ("Returning offset %" G_GUINT64_FORMAT " for ts %"
+          GST_TIME_FORMAT " (from index)", res, GST_TIME_ARGS (ts));
+
+      return res;
+    }
+  }
+
   GST_DEBUG ("ts(pcr) %" G_GUINT64_FORMAT " first_pcr:%" G_GUINT64_FORMAT,
       GSTTIME_TO_MPEGTIME (ts), pcrtable->first_pcr);
 
@@ -3738,3 +4502,112 @@ mpegts_packetizer_set_reference_offset (MpegTSPacketizer2 * packetizer,
 
   packetizer->priv->refoffset = refoffset;
 }
+
+/* Finds out where to read next to narrow down the position of @ts in the
+ * PCR index of @pcr_pid. Returns FALSE if the index is already accurate
+ * enough around @ts (or can't be refined) */
+gboolean
+mpegts_packetizer_index_next_probe (MpegTSPacketizer2 * packetizer,
+    GstClockTime ts, guint16 pcr_pid, guint64 * offset)
+{
+  MpegTSPCR *pcrtable;
+  MpegTSPCRIndexEntry *lo, *hi;
+  GArray *index;
+  gint64 ref_ts;
+  gint pos;
+
+  if (!packetizer->calculate_offset || !packetizer->know_packet_size ||
+      packetizer->priv->refoffset == -1)
+    return FALSE;
+
+  pcrtable = get_pcr_table (packetizer, pcr_pid);
+  index = pcrtable->index;
+
+  /* Same time base as mpegts_packetizer_ts_to_offset() */
+  if (index->len < 2 ||
+      !pcr_index_offset_to_ts (index, packetizer->priv->refoffset, &ref_ts) ||
+      (gint64) ts + ref_ts < 0)
+    return FALSE;
+  ts += ref_ts;
+
+  /* Only refine within the known range */
+  pos = pcr_index_find_ts (index, ts);
+  if (pos < 0 || pos >= (gint) index->len - 1)
+    return FALSE;
+
+  lo = &g_array_index (index, MpegTSPCRIndexEntry, pos);
+  hi = &g_array_index (index, MpegTSPCRIndexEntry, pos + 1);
+  if (hi->ts - lo->ts <= PCR_INDEX_SEEK_ACCURACY ||
+      hi->offset - lo->offset <= PCR_INDEX_SEEK_MIN_BYTES)
+    return FALSE;
+
+  *offset = lo->offset + gst_util_uint64_scale (ts - lo->ts,
+      hi->offset - lo->offset, hi->ts - lo->ts);
+  /* Round down to a packet boundary and make sure we'll pick up a PCR
+   * that is not already known */
+  *offset -= (*offset - lo->offset) % packetizer->packet_size;
+  if (*offset <= lo->offset)
+    *offset = lo->offset + packetizer->packet_size;
+
+  GST_DEBUG ("ts %" GST_TIME_FORMAT " is between offsets %" G_GUINT64_FORMAT
+      " and %" G_GUINT64_FORMAT ", probing at %" G_GUINT64_FORMAT,
+      GST_TIME_ARGS (ts), lo->offset, hi->offset, *offset);
+
+  return TRUE;
+}
+
+/* Looks for the first PCR of @pcr_pid in @buffer (which must start at
+ * GST_BUFFER_OFFSET) and adds it to the PCR index. Returns TRUE if the
+ * index was extended */
+gboolean
+mpegts_packetizer_index_scan_buffer (MpegTSPacketizer2 * packetizer,
+    GstBuffer * buffer, guint16 pcr_pid)
+{
+  guint packet_size = packetizer->packet_size;
+  gboolean res = FALSE;
+  GstMapInfo map;
+  guint8 *data;
+  gsize i, start, skip;
+
+  if (!packetizer->know_packet_size)
+    return FALSE;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return FALSE;
+
+  /* M2TS packets have a 4 bytes header before the sync byte */
+  skip = packet_size == MPEGTS_M2TS_PACKETSIZE ? 4 : 0;
+
+  /* Find the packet lattice */
+  for (start = 0; start < packet_size; start++) {
+    if (start + skip + 2 * packet_size >= map.size)
+      goto done;
+    data = map.data + start + skip;
+    if (data[0] == PACKET_SYNC_BYTE && data[packet_size] == PACKET_SYNC_BYTE
+        && data[2 * packet_size] == PACKET_SYNC_BYTE)
+      break;
+  }
+  if (start == packet_size)
+    goto done;
+
+  for (i = start; i + skip + 188 <= map.size; i += packet_size) {
+    data = map.data + i + skip;
+    if (data[0] != PACKET_SYNC_BYTE)
+      break;
+    /* PID, adaptation field with the PCR flag set */
+    if ((GST_READ_UINT16_BE (data + 1) & 0x1fff) == pcr_pid &&
+        (data[3] & 0x20) && data[4] >= 7 && (data[5] & MPEGTS_AFC_PCR_FLAG)) {
+      guint64 pcr = mpegts_packetizer_compute_pcr (data + 6);
+
+      GST_DEBUG ("Found PCR %" G_GUINT64_FORMAT " at offset %"
+          G_GUINT64_FORMAT, pcr, GST_BUFFER_OFFSET (buffer) + i);
+      res = pcr_index_add (get_pcr_table (packetizer, pcr_pid), pcr,
+          GST_BUFFER_OFFSET (buffer) + i, FALSE);
+      break;
+    }
+  }
+
+done:
+  gst_buffer_unmap (buffer, &map);
+  return res;
+}
@@ -122,6 +122,11 @@ typedef struct
   guint8 *data_end;
   guint8 *data;
 
+  /* Input buffer containing the packet (not reffed) and the address
+   * its mapped data starts at, which allows sharing the payload */
+  GstBuffer *buffer;
+  guint8 *buffer_data;
+
   guint8  afc_flags;
   guint64 pcr;
   guint64 opcr;
@@ -167,7 +172,8 @@ G_GNUC_INTERNAL GType mpegts_packetizer_get_type(void);
 
 G_GNUC_INTERNAL MpegTSPacketizer2 *mpegts_packetizer_new (void);
 G_GNUC_INTERNAL void mpegts_packetizer_clear (MpegTSPacketizer2 *packetizer);
-G_GNUC_INTERNAL void mpegts_packetizer_flush (MpegTSPacketizer2 *packetizer);
+G_GNUC_INTERNAL void mpegts_packetizer_flush (MpegTSPacketizer2 *packetizer, gboolean hard);
+G_GNUC_INTERNAL GstStructure *mpegts_packetizer_get_stats (MpegTSPacketizer2 *packetizer);
 G_GNUC_INTERNAL void mpegts_packetizer_push (MpegTSPacketizer2 *packetizer, GstBuffer *buffer);
 G_GNUC_INTERNAL gboolean mpegts_packetizer_has_packets (MpegTSPacketizer2 *packetizer);
 G_GNUC_INTERNAL MpegTSPacketizerPacketReturn mpegts_packetizer_next_packet (MpegTSPacketizer2 *packetizer,
@@ -187,6 +193,8 @@ G_GNUC_INTERNAL GstStructure *mpegts_packetizer_parse_pat (MpegTSPacketizer2 *pa
   MpegTSPacketizerSection *section);
 G_GNUC_INTERNAL GstStructure *mpegts_packetizer_parse_pmt (MpegTSPacketizer2 *packetizer,
   MpegTSPacketizerSection *section);
+G_GNUC_INTERNAL const GstStructure *mpegts_packetizer_get_cached_section (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerSection *section);
 G_GNUC_INTERNAL GstStructure *mpegts_packetizer_parse_nit (MpegTSPacketizer2 *packetizer,
   MpegTSPacketizerSection *section);
 G_GNUC_INTERNAL GstStructure *mpegts_packetizer_parse_sdt (MpegTSPacketizer2 *packetizer,
@@ -213,6 +221,15 @@ mpegts_packetizer_pts_to_ts (MpegTSPacketizer2 * packetizer,
 G_GNUC_INTERNAL void
 mpegts_packetizer_set_reference_offset (MpegTSPacketizer2 * packetizer,
 					guint64 refoffset);
+
+/* PCR index, only filled if calculate_offset is TRUE */
+G_GNUC_INTERNAL gboolean
+mpegts_packetizer_index_next_probe (MpegTSPacketizer2 * packetizer,
+				    GstClockTime ts, guint16 pcr_pid,
+				    guint64 * offset);
+G_GNUC_INTERNAL gboolean
+mpegts_packetizer_index_scan_buffer (MpegTSPacketizer2 * packetizer,
+				     GstBuffer * buffer, guint16 pcr_pid);
 G_END_DECLS
 
 #endif /* GST_MPEGTS_PACKETIZER_H */
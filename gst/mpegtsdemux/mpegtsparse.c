@@ -40,6 +40,9 @@
 #define TABLE_ID_UNSET 0xFF
 #define RUNNING_STATUS_RUNNING 4
 
+#define DEFAULT_MAX_PACKETS 1
+#define DEFAULT_MAX_LATENCY 0
+
 GST_DEBUG_CATEGORY_STATIC (mpegts_parse_debug);
 #define GST_CAT_DEFAULT mpegts_parse_debug
 
@@ -64,6 +67,12 @@ struct _MpegTSParsePad
 
   /* the return of the latest push */
   GstFlowReturn flow_return;
+
+  /* Packets aggregated for the next push, sharing the input memory */
+  GstBuffer *pending;
+  guint pending_packets;
+  /* Input timestamp of the first pending packet */
+  GstClockTime pending_ts;
 };
 
 static GstStaticPadTemplate src_template =
@@ -81,6 +90,8 @@ GST_STATIC_PAD_TEMPLATE ("program_%u", GST_PAD_SRC,
 enum
 {
   ARG_0,
+  PROP_MAX_PACKETS,
+  PROP_MAX_LATENCY,
   /* FILL ME */
 };
 
@@ -105,6 +116,10 @@ static void mpegts_parse_release_pad (GstElement * element, GstPad * pad);
 static gboolean mpegts_parse_src_pad_query (GstPad * pad, GstObject * parent,
     GstQuery * query);
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
+static void mpegts_parse_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void mpegts_parse_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 
 #define mpegts_parse_parent_class parent_class
 G_DEFINE_TYPE (MpegTSParse2, mpegts_parse, GST_TYPE_MPEGTS_BASE);
@@ -115,9 +130,27 @@ static GstFlowReturn mpegts_parse_input_done (MpegTSBase * base,
 static void
 mpegts_parse_class_init (MpegTSParse2Class * klass)
 {
+  GObjectClass *gobject_class;
   GstElementClass *element_class;
   MpegTSBaseClass *ts_class;
 
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->set_property = mpegts_parse_set_property;
+  gobject_class->get_property = mpegts_parse_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PACKETS,
+      g_param_spec_uint ("max-packets", "Maximum packets",
+          "Maximum number of packets pushed in one buffer on program pads "
+          "(1 = one buffer per packet)", 1, G_MAXUINT16, DEFAULT_MAX_PACKETS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_LATENCY,
+      g_param_spec_uint64 ("max-latency", "Maximum latency",
+          "Maximum time packets can be held back on program pads when "
+          "aggregating them (0 = push at the end of each input buffer)",
+          0, G_MAXUINT64, DEFAULT_MAX_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   element_class->pad_removed = mpegts_parse_pad_removed;
   element_class->request_new_pad = mpegts_parse_request_new_pad;
@@ -150,6 +183,45 @@ mpegts_parse_init (MpegTSParse2 * parse)
 
   parse->srcpad = gst_pad_new_from_static_template (&src_template, "src");
   gst_element_add_pad (GST_ELEMENT (parse), parse->srcpad);
+
+  parse->max_packets = DEFAULT_MAX_PACKETS;
+  parse->max_latency = DEFAULT_MAX_LATENCY;
+}
+
+static void
+mpegts_parse_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  MpegTSParse2 *parse = GST_MPEGTS_PARSE (object);
+
+  switch (prop_id) {
+    case PROP_MAX_PACKETS:
+      parse->max_packets = g_value_get_uint (value);
+      break;
+    case PROP_MAX_LATENCY:
+      parse->max_latency = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+static void
+mpegts_parse_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  MpegTSParse2 *parse = GST_MPEGTS_PARSE (object);
+
+  switch (prop_id) {
+    case PROP_MAX_PACKETS:
+      g_value_set_uint (value, parse->max_packets);
+      break;
+    case PROP_MAX_LATENCY:
+      g_value_set_uint64 (value, parse->max_latency);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
 }
 
 static void
@@ -180,6 +252,129 @@ mpegts_parse_reset (MpegTSBase * base)
 
 }
 
+static void
+mpegts_parse_tspad_drop_pending (MpegTSParsePad * tspad)
+{
+  if (tspad->pending) {
+    gst_buffer_unref (tspad->pending);
+    tspad->pending = NULL;
+  }
+  tspad->pending_packets = 0;
+}
+
+/* Takes the packets aggregated on @tspad */
+static GstBuffer *
+mpegts_parse_tspad_take_pending (MpegTSParsePad * tspad)
+{
+  GstBuffer *buf = tspad->pending;
+
+  if (buf) {
+    GST_LOG_OBJECT (tspad->pad, "taking %u aggregated packets",
+        tspad->pending_packets);
+    tspad->pending = NULL;
+    tspad->pending_packets = 0;
+  }
+
+  return buf;
+}
+
+/* Pushes the packets aggregated on @tspad */
+static GstFlowReturn
+mpegts_parse_tspad_push_pending (MpegTSParse2 * parse, MpegTSParsePad * tspad)
+{
+  GstBuffer *buf = mpegts_parse_tspad_take_pending (tspad);
+
+  if (buf == NULL)
+    return GST_FLOW_OK;
+
+  return gst_pad_push (tspad->pad, buf);
+}
+
+/* Returns a memory holding @packet, shared with the input buffer when the
+ * packet doesn't straddle several of its memories */
+static GstMemory *
+mpegts_parse_packet_memory (MpegTSPacketizerPacket * packet)
+{
+  gsize size = packet->data_end - packet->data_start;
+  guint idx, length;
+  gsize skip;
+  GstMemory *mem;
+  GstMapInfo map;
+
+  if (G_LIKELY (gst_buffer_find_memory (packet->buffer,
+              packet->data_start - packet->buffer_data, size, &idx, &length,
+              &skip) && length == 1))
+    return gst_memory_share (gst_buffer_peek_memory (packet->buffer, idx),
+        skip, size);
+
+  mem = gst_allocator_alloc (NULL, size, NULL);
+  gst_memory_map (mem, &map, GST_MAP_WRITE);
+  memcpy (map.data, packet->data_start, size);
+  gst_memory_unmap (mem, &map);
+
+  return mem;
+}
+
+/* Pushes @packet on @tspad, or aggregates it with the previous ones if
+ * max-packets is bigger than 1. Packets following each other in the input
+ * end up in a single memory */
+static GstFlowReturn
+mpegts_parse_tspad_push_packet (MpegTSParse2 * parse, MpegTSParsePad * tspad,
+    MpegTSPacketizerPacket * packet)
+{
+  GstMemory *mem, *last;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gsize offset;
+  guint n;
+
+  mem = mpegts_parse_packet_memory (packet);
+
+  if (parse->max_packets <= 1 && tspad->pending == NULL) {
+    GstBuffer *buf = gst_buffer_new ();
+
+    gst_buffer_append_memory (buf, mem);
+    return gst_pad_push (tspad->pad, buf);
+  }
+
+  if (tspad->pending) {
+    n = gst_buffer_n_memory (tspad->pending);
+    last = gst_buffer_peek_memory (tspad->pending, n - 1);
+
+    if (gst_memory_is_span (last, mem, &offset)) {
+      GstMemory *span = gst_memory_share (last->parent, offset,
+          last->size + mem->size);
+
+      gst_memory_unref (mem);
+      gst_buffer_replace_memory (tspad->pending, n - 1, span);
+      mem = NULL;
+    } else if (n >= gst_buffer_get_max_memory ()) {
+      /* Don't let the buffer merge its memories */
+      ret = mpegts_parse_tspad_push_pending (parse, tspad);
+    }
+  }
+
+  if (tspad->pending == NULL) {
+    tspad->pending = gst_buffer_new ();
+    tspad->pending_ts = packet->origts;
+  }
+  if (mem)
+    gst_buffer_append_memory (tspad->pending, mem);
+  tspad->pending_packets++;
+
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  if (tspad->pending_packets >= parse->max_packets)
+    return mpegts_parse_tspad_push_pending (parse, tspad);
+
+  if (parse->max_latency && GST_CLOCK_TIME_IS_VALID (tspad->pending_ts) &&
+      GST_CLOCK_TIME_IS_VALID (packet->origts) &&
+      packet->origts >= tspad->pending_ts + parse->max_latency)
+    return mpegts_parse_tspad_push_pending (parse, tspad);
+
+  return GST_FLOW_OK;
+}
+
 static gboolean
 push_event (MpegTSBase * base, GstEvent * event)
 {
@@ -189,6 +384,14 @@ push_event (MpegTSBase * base, GstEvent * event)
   for (tmp = parse->srcpads; tmp; tmp = tmp->next) {
     GstPad *pad = (GstPad *) tmp->data;
     if (pad) {
+      MpegTSParsePad *tspad = gst_pad_get_element_private (pad);
+
+      /* Keep aggregated packets ordered with serialized events */
+      if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_START ||
+          GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+        mpegts_parse_tspad_drop_pending (tspad);
+      else if (GST_EVENT_IS_SERIALIZED (event))
+        mpegts_parse_tspad_push_pending (parse, tspad);
       gst_event_ref (event);
       gst_pad_push_event (pad, event);
     }
@@ -216,6 +419,9 @@ mpegts_parse_create_tspad (MpegTSParse2 * parse, const gchar * pad_name)
   tspad->program = NULL;
   tspad->pushed = FALSE;
   tspad->flow_return = GST_FLOW_NOT_LINKED;
+  tspad->pending = NULL;
+  tspad->pending_packets = 0;
+  tspad->pending_ts = GST_CLOCK_TIME_NONE;
   gst_pad_set_element_private (pad, tspad);
 
   return tspad;
@@ -224,6 +430,7 @@ mpegts_parse_create_tspad (MpegTSParse2 * parse, const gchar * pad_name)
 static void
 mpegts_parse_destroy_tspad (MpegTSParse2 * parse, MpegTSParsePad * tspad)
 {
+  mpegts_parse_tspad_drop_pending (tspad);
   /* free the wrapper */
   g_free (tspad);
 }
@@ -330,13 +537,8 @@ mpegts_parse_tspad_push_section (MpegTSParse2 * parse, MpegTSParsePad * tspad,
       "pushing section: %d program number: %d table_id: %d", to_push,
       tspad->program_number, section->table_id);
 
-  if (to_push) {
-    GstBuffer *buf =
-        gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
-    gst_buffer_fill (buf, 0, packet->data_start,
-        packet->data_end - packet->data_start);
-    ret = gst_pad_push (tspad->pad, buf);
-  }
+  if (to_push)
+    ret = mpegts_parse_tspad_push_packet (parse, tspad, packet);
 
   return ret;
 }
@@ -360,12 +562,8 @@ mpegts_parse_tspad_push (MpegTSParse2 * parse, MpegTSParsePad * tspad,
   }
 
   if (pad_pids == NULL || pad_pids[packet->pid]) {
-    GstBuffer *buf =
-        gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
-    gst_buffer_fill (buf, 0, packet->data_start,
-        packet->data_end - packet->data_start);
     /* push if there's no filter or if the pid is in the filter */
-    ret = gst_pad_push (tspad->pad, buf);
+    ret = mpegts_parse_tspad_push_packet (parse, tspad, packet);
   }
 
 out:
@@ -466,12 +664,61 @@ mpegts_parse_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
   return ret;
 }
 
+typedef struct
+{
+  GstPad *pad;
+  GstBuffer *buffer;
+} MpegTSParsePending;
+
 static GstFlowReturn
 mpegts_parse_input_done (MpegTSBase * base, GstBuffer * buffer)
 {
   MpegTSParse2 *parse = GST_MPEGTS_PARSE (base);
+  GstClockTime ts = GST_BUFFER_TIMESTAMP (buffer);
+  GstFlowReturn ret, pending_ret = GST_FLOW_OK;
+  GArray *ready;
+  GList *tmp;
+  guint i;
+
+  /* Take the aggregated packets that shouldn't wait for the next input
+   * buffer under the lock, and push them once it's released. The pads
+   * are kept alive by the references we take, their private data might
+   * not be once the lock is released. */
+  ready = g_array_new (FALSE, FALSE, sizeof (MpegTSParsePending));
+  GST_OBJECT_LOCK (parse);
+  for (tmp = parse->srcpads; tmp; tmp = tmp->next) {
+    MpegTSParsePad *tspad = gst_pad_get_element_private ((GstPad *) tmp->data);
 
-  return gst_pad_push (parse->srcpad, buffer);
+    if (tspad->pending && (parse->max_latency == 0
+            || !GST_CLOCK_TIME_IS_VALID (ts)
+            || !GST_CLOCK_TIME_IS_VALID (tspad->pending_ts)
+            || ts >= tspad->pending_ts + parse->max_latency)) {
+      MpegTSParsePending pending;
+
+      pending.pad = gst_object_ref (tspad->pad);
+      pending.buffer = mpegts_parse_tspad_take_pending (tspad);
+      g_array_append_val (ready, pending);
+    }
+  }
+  GST_OBJECT_UNLOCK (parse);
+
+  for (i = 0; i < ready->len; i++) {
+    MpegTSParsePending *pending =
+        &g_array_index (ready, MpegTSParsePending, i);
+
+    ret = gst_pad_push (pending->pad, pending->buffer);
+    if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED &&
+        pending_ret == GST_FLOW_OK)
+      pending_ret = ret;
+    gst_object_unref (pending->pad);
+  }
+  g_array_free (ready, TRUE);
+
+  ret = gst_pad_push (parse->srcpad, buffer);
+  if (ret == GST_FLOW_OK)
+    ret = pending_ret;
+
+  return ret;
 }
 
 static MpegTSParsePad *
@@ -52,6 +52,10 @@ struct _MpegTSParse2 {
   GstPad *srcpad;
 
   GList *srcpads;
+
+  /* Aggregation on program pads */
+  guint max_packets;
+  GstClockTime max_latency;
 };
 
 struct _MpegTSParse2Class {
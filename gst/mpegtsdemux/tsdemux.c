@@ -69,6 +69,9 @@
  */
 #define SEEK_TIMESTAMP_OFFSET (500 * GST_MSECOND)
 
+/* Initial size of the output buffers when the PES size is unknown */
+#define DEFAULT_PES_ALLOCATION 8192
+
 #define SEGMENT_FORMAT "[format:%s, rate:%f, start:%"			\
   GST_TIME_FORMAT", stop:%"GST_TIME_FORMAT", time:%"GST_TIME_FORMAT	\
   ", base:%"GST_TIME_FORMAT", position:%"GST_TIME_FORMAT		\
@@ -121,8 +124,26 @@ struct _TSDemuxStream
   /* Output data */
   PendingPacketState state;
 
-  /* Data to push (allocated) */
+  /* Data to push (points into buffer) */
   guint8 *data;
+  /* Output buffer from pool that is being filled, and its mapping */
+  GstBuffer *buffer;
+  GstMapInfo map;
+  /* Pool of output buffers of pool_size bytes, sized once. Bigger PES get
+   * buffers allocated outside of it */
+  GstBufferPool *pool;
+  guint pool_size;
+  /* Allocator and parameters downstream asked for */
+  GstAllocator *allocator;
+  GstAllocationParams params;
+  gboolean need_allocation;
+  /* Biggest PES pushed before the pool was created */
+  guint max_size;
+
+  /* zero-copy mode: payload shared from the input buffers. If the PES
+   * requires more memories than a buffer can hold, it is copied instead */
+  GstBuffer *shared;
+  gboolean share_memory;
 
   /* Size of data to push (if known) */
   guint expected_size;
@@ -217,6 +238,7 @@ enum
   ARG_0,
   PROP_PROGRAM_NUMBER,
   PROP_EMIT_STATS,
+  PROP_ZERO_COPY_SMALL_PES,
   /* FILL ME */
 };
 
@@ -247,6 +269,7 @@ static void gst_ts_demux_flush_streams (GstTSDemux * tsdemux);
 static GstFlowReturn
 gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream);
 static void gst_ts_demux_stream_flush (TSDemuxStream * stream);
+static void gst_ts_demux_stream_clear_data (TSDemuxStream * stream);
 
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
 
@@ -287,6 +310,14 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
           "Emit messages for every pcr/opcr/pts/dts", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_ZERO_COPY_SMALL_PES,
+      g_param_spec_boolean ("zero-copy-small-pes", "Zero copy small PES",
+          "Assemble PES packets of known size that span fewer TS packets than "
+          "a buffer can hold memories (such as audio frames) from shared "
+          "memory of the input buffers instead of copying their payload. "
+          "Other PES, such as most video frames, are always copied", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&video_template));
@@ -360,6 +391,9 @@ gst_ts_demux_set_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       demux->emit_statistics = g_value_get_boolean (value);
       break;
+    case PROP_ZERO_COPY_SMALL_PES:
+      demux->zero_copy = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -378,6 +412,9 @@ gst_ts_demux_get_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       g_value_set_boolean (value, demux->emit_statistics);
       break;
+    case PROP_ZERO_COPY_SMALL_PES:
+      g_value_set_boolean (value, demux->zero_copy);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -489,6 +526,7 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
   GstSegment seeksegment;
   gboolean update;
   guint64 start_offset;
+  GstClockTime target;
 
   gst_event_parse_seek (event, &rate, &format, &flags, &start_type, &start,
       &stop_type, &stop);
@@ -525,9 +563,11 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
       SEGMENT_ARGS (seeksegment));
 
   /* Convert start/stop to offset */
+  target = MAX (0, start - SEEK_TIMESTAMP_OFFSET);
+  mpegts_base_refine_seek_index (base, target, demux->program->pcr_pid);
   start_offset =
-      mpegts_packetizer_ts_to_offset (base->packetizer, MAX (0,
-          start - SEEK_TIMESTAMP_OFFSET), demux->program->pcr_pid);
+      mpegts_packetizer_ts_to_offset (base->packetizer, target,
+      demux->program->pcr_pid);
 
   if (G_UNLIKELY (start_offset == -1)) {
     GST_WARNING ("Couldn't convert start position to an offset");
@@ -1019,6 +1059,10 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * bstream,
     stream->active = FALSE;
 
     stream->need_newsegment = TRUE;
+    stream->need_allocation = TRUE;
+    stream->share_memory = FALSE;
+    stream->max_size = 0;
+    gst_allocation_params_init (&stream->params);
     stream->pts = GST_CLOCK_TIME_NONE;
     stream->dts = GST_CLOCK_TIME_NONE;
     stream->raw_pts = 0;
@@ -1052,6 +1096,16 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
     stream->pad = NULL;
   }
   gst_ts_demux_stream_flush (stream);
+  if (stream->pool) {
+    gst_buffer_pool_set_active (stream->pool, FALSE);
+    gst_object_unref (stream->pool);
+    stream->pool = NULL;
+    stream->pool_size = 0;
+  }
+  if (stream->allocator) {
+    gst_object_unref (stream->allocator);
+    stream->allocator = NULL;
+  }
   stream->flow_return = GST_FLOW_NOT_LINKED;
 }
 
@@ -1085,6 +1139,167 @@ activate_pad_for_stream (GstTSDemux * tsdemux, TSDemuxStream * stream)
         ((MpegTSBaseStream *) stream)->stream_type);
 }
 
+/* Drops the data being assembled */
+static void
+gst_ts_demux_stream_clear_data (TSDemuxStream * stream)
+{
+  if (stream->buffer) {
+    gst_buffer_unmap (stream->buffer, &stream->map);
+    gst_buffer_unref (stream->buffer);
+    stream->buffer = NULL;
+  }
+  if (stream->shared) {
+    gst_buffer_unref (stream->shared);
+    stream->shared = NULL;
+  }
+  stream->data = NULL;
+  stream->allocated_size = 0;
+}
+
+/* Gets an output buffer of at least @size bytes. The stream pool is created
+ * once downstream was queried, for the biggest PES seen until then, and
+ * bigger PES get their own buffer */
+static GstFlowReturn
+gst_ts_demux_stream_alloc (TSDemuxStream * stream, guint size)
+{
+  GstFlowReturn res;
+
+  if (G_UNLIKELY (stream->pool == NULL && !stream->need_allocation)) {
+    GstStructure *config;
+
+    stream->pool_size = MAX (size, stream->max_size);
+    GST_DEBUG ("stream %p: new buffer pool of %u bytes", stream,
+        stream->pool_size);
+
+    stream->pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (stream->pool);
+    gst_buffer_pool_config_set_params (config, NULL, stream->pool_size, 0, 0);
+    gst_buffer_pool_config_set_allocator (config, stream->allocator,
+        &stream->params);
+    gst_buffer_pool_set_config (stream->pool, config);
+    gst_buffer_pool_set_active (stream->pool, TRUE);
+  }
+
+  if (G_LIKELY (stream->pool && size <= stream->pool_size)) {
+    res = gst_buffer_pool_acquire_buffer (stream->pool, &stream->buffer, NULL);
+    if (G_UNLIKELY (res != GST_FLOW_OK)) {
+      GST_WARNING ("stream %p: failed to acquire a buffer: %s", stream,
+          gst_flow_get_name (res));
+      stream->buffer = NULL;
+      stream->data = NULL;
+      stream->allocated_size = 0;
+      return res;
+    }
+    /* Buffers come back from downstream resized to their content */
+    gst_buffer_set_size (stream->buffer, stream->pool_size);
+  } else {
+    GST_LOG ("stream %p: %u bytes do not fit in the pool buffers", stream,
+        size);
+    stream->buffer =
+        gst_buffer_new_allocate (stream->allocator, size, &stream->params);
+  }
+  gst_buffer_map (stream->buffer, &stream->map, GST_MAP_WRITE);
+  stream->data = stream->map.data;
+  stream->allocated_size = stream->map.size;
+
+  return GST_FLOW_OK;
+}
+
+/* Grows the output buffer so that it can hold @size bytes */
+static GstFlowReturn
+gst_ts_demux_stream_grow (TSDemuxStream * stream, guint size)
+{
+  GstBuffer *old = stream->buffer;
+  GstMapInfo oldmap = stream->map;
+  GstFlowReturn res;
+
+  GST_LOG ("resizing buffer");
+  stream->buffer = NULL;
+  res = gst_ts_demux_stream_alloc (stream,
+      MAX (stream->allocated_size * 2, size));
+  if (G_LIKELY (res == GST_FLOW_OK))
+    memcpy (stream->data, oldmap.data, stream->current_size);
+  gst_buffer_unmap (old, &oldmap);
+  gst_buffer_unref (old);
+
+  return res;
+}
+
+/* Copies the shared data assembled so far into a single output buffer, the
+ * rest of the PES will be copied too */
+static GstFlowReturn
+gst_ts_demux_stream_unshare (TSDemuxStream * stream, guint size)
+{
+  GstFlowReturn res;
+
+  GST_DEBUG ("stream %p: copying PES of %u memories", stream,
+      gst_buffer_n_memory (stream->shared));
+
+  res = gst_ts_demux_stream_alloc (stream, MAX (size, DEFAULT_PES_ALLOCATION));
+  if (G_LIKELY (res == GST_FLOW_OK))
+    gst_buffer_extract (stream->shared, 0, stream->data, stream->current_size);
+  gst_buffer_unref (stream->shared);
+  stream->shared = NULL;
+
+  return res;
+}
+
+/* Appends payload of @packet to the data being assembled. If no output
+ * buffer can be allocated, the rest of the PES is dropped */
+static inline GstFlowReturn
+gst_ts_demux_stream_append (GstTSDemux * demux, TSDemuxStream * stream,
+    MpegTSPacketizerPacket * packet, guint8 * data, guint size)
+{
+  GstFlowReturn res = GST_FLOW_OK;
+
+  if (stream->shared) {
+    GstMemory *mem = NULL, *last;
+    guint idx, length, n;
+    gsize skip, offset;
+
+    if (G_LIKELY (gst_buffer_find_memory (packet->buffer,
+                data - packet->buffer_data, size, &idx, &length, &skip)
+            && length == 1))
+      mem = gst_memory_share (gst_buffer_peek_memory (packet->buffer, idx),
+          skip, size);
+    n = gst_buffer_n_memory (stream->shared);
+    last = n ? gst_buffer_peek_memory (stream->shared, n - 1) : NULL;
+
+    if (mem && last && gst_memory_is_span (last, mem, &offset)) {
+      /* Contiguous with the previous payload, extend that one */
+      GstMemory *span = gst_memory_share (last->parent, offset,
+          last->size + size);
+
+      gst_memory_unref (mem);
+      gst_buffer_replace_memory (stream->shared, n - 1, span);
+    } else if (mem && G_LIKELY (n < gst_buffer_get_max_memory ())) {
+      gst_buffer_append_memory (stream->shared, mem);
+    } else {
+      if (mem)
+        gst_memory_unref (mem);
+      res = gst_ts_demux_stream_unshare (stream, MAX (stream->expected_size,
+              stream->current_size + size));
+    }
+  }
+
+  if (stream->shared == NULL) {
+    if (G_UNLIKELY (res == GST_FLOW_OK &&
+            stream->current_size + size > stream->allocated_size))
+      res = gst_ts_demux_stream_grow (stream, stream->current_size + size);
+    if (G_UNLIKELY (res != GST_FLOW_OK))
+      goto alloc_failed;
+    memcpy (stream->data + stream->current_size, data, size);
+  }
+  stream->current_size += size;
+
+  return GST_FLOW_OK;
+
+alloc_failed:
+  gst_ts_demux_stream_clear_data (stream);
+  stream->state = PENDING_PACKET_DISCONT;
+  return res;
+}
+
 static void
 gst_ts_demux_stream_flush (TSDemuxStream * stream)
 {
@@ -1092,9 +1307,7 @@ gst_ts_demux_stream_flush (TSDemuxStream * stream)
 
   GST_DEBUG ("flushing stream %p", stream);
 
-  if (stream->data)
-    g_free (stream->data);
-  stream->data = NULL;
+  gst_ts_demux_stream_clear_data (stream);
   stream->state = PENDING_PACKET_EMPTY;
   stream->expected_size = 0;
   stream->allocated_size = 0;
@@ -1259,9 +1472,9 @@ gst_ts_demux_record_dts (GstTSDemux * demux, TSDemuxStream * stream,
   }
 }
 
-static void
+static GstFlowReturn
 gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
-    guint8 * data, guint32 length, guint64 bufferoffset)
+    MpegTSPacketizerPacket * packet, guint8 * data, guint32 length)
 {
   MpegTSBase *base = (MpegTSBase *) demux;
   PESHeader header;
@@ -1279,8 +1492,8 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
     goto discont;
   }
 
-  gst_ts_demux_record_dts (demux, stream, header.DTS, bufferoffset);
-  gst_ts_demux_record_pts (demux, stream, header.PTS, bufferoffset);
+  gst_ts_demux_record_dts (demux, stream, header.DTS, packet->offset);
+  gst_ts_demux_record_pts (demux, stream, header.PTS, packet->offset);
 
   GST_DEBUG_OBJECT (base,
       "stream PTS %" GST_TIME_FORMAT " DTS %" GST_TIME_FORMAT,
@@ -1302,33 +1515,43 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
   data += header.header_size;
   length -= header.header_size;
 
-  /* Create the output buffer */
-  if (stream->expected_size)
-    stream->allocated_size = stream->expected_size;
-  else
-    stream->allocated_size = 8192;
-  g_assert (stream->data == NULL);
-  stream->data = g_malloc (stream->allocated_size);
-  memcpy (stream->data, data, length);
-  stream->current_size = length;
+  /* Create the output buffer. Only PES of known size that fit in the
+   * memories of a single buffer are shared, others (such as most video PES,
+   * which are unbounded) are copied right away */
+  g_assert (stream->data == NULL && stream->shared == NULL);
+  stream->current_size = 0;
+  if (demux->zero_copy && stream->share_memory && stream->expected_size &&
+      stream->expected_size / 184 < gst_buffer_get_max_memory ()) {
+    stream->shared = gst_buffer_new ();
+  } else {
+    GstFlowReturn res = gst_ts_demux_stream_alloc (stream,
+        stream->expected_size ? stream->expected_size :
+        DEFAULT_PES_ALLOCATION);
+
+    if (G_UNLIKELY (res != GST_FLOW_OK)) {
+      stream->state = PENDING_PACKET_DISCONT;
+      return res;
+    }
+  }
 
   stream->state = PENDING_PACKET_BUFFER;
 
-  return;
+  return gst_ts_demux_stream_append (demux, stream, packet, data, length);
 
 discont:
   stream->state = PENDING_PACKET_DISCONT;
-  return;
+  return GST_FLOW_OK;
 }
 
  /* ONLY CALL THIS:
   * * WITH packet->payload != NULL
   * * WITH pending/current flushed out if beginning of new PES packet
   */
-static inline void
+static inline GstFlowReturn
 gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
     MpegTSPacketizerPacket * packet)
 {
+  GstFlowReturn res = GST_FLOW_OK;
   guint8 *data;
   guint size;
 
@@ -1353,35 +1576,26 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
       GST_LOG ("HEADER: Parsing PES header");
 
       /* parse the header */
-      gst_ts_demux_parse_pes_header (demux, stream, data, size, packet->offset);
+      res = gst_ts_demux_parse_pes_header (demux, stream, packet, data, size);
       break;
     }
     case PENDING_PACKET_BUFFER:
     {
       GST_LOG ("BUFFER: appending data");
-      if (G_UNLIKELY (stream->current_size + size > stream->allocated_size)) {
-        GST_LOG ("resizing buffer");
-        stream->allocated_size = stream->allocated_size * 2;
-        stream->data = g_realloc (stream->data, stream->allocated_size);
-      }
-      memcpy (stream->data + stream->current_size, data, size);
-      stream->current_size += size;
+      res = gst_ts_demux_stream_append (demux, stream, packet, data, size);
       break;
     }
     case PENDING_PACKET_DISCONT:
     {
       GST_LOG ("DISCONT: not storing/pushing");
-      if (G_UNLIKELY (stream->data)) {
-        g_free (stream->data);
-        stream->data = NULL;
-      }
+      gst_ts_demux_stream_clear_data (stream);
       break;
     }
     default:
       break;
   }
 
-  return;
+  return res;
 }
 
 static void
@@ -1491,6 +1705,43 @@ push_new_segment:
   stream->need_newsegment = FALSE;
 }
 
+/* Picks up the allocator downstream wants, and whether it accepts
+ * buffers sharing the input memory */
+static void
+gst_ts_demux_stream_query_allocation (GstTSDemux * demux,
+    TSDemuxStream * stream)
+{
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstQuery *query;
+  GstCaps *caps;
+
+  stream->need_allocation = FALSE;
+
+  caps = gst_pad_get_current_caps (stream->pad);
+  query = gst_query_new_allocation (caps, FALSE);
+  if (caps)
+    gst_caps_unref (caps);
+
+  gst_allocation_params_init (&params);
+  if (gst_pad_peer_query (stream->pad, query) &&
+      gst_query_get_n_allocation_params (query) > 0)
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+  gst_query_unref (query);
+
+  /* Shared payloads start anywhere in the input packets, only hand them out
+   * if downstream has no allocator or alignment of its own */
+  stream->share_memory = allocator == NULL && params.align == 0;
+  GST_DEBUG_OBJECT (stream->pad, "allocator %" GST_PTR_FORMAT " align %"
+      G_GSIZE_FORMAT ", sharing memory: %d", allocator, params.align,
+      stream->share_memory);
+
+  if (stream->allocator)
+    gst_object_unref (stream->allocator);
+  stream->allocator = allocator;
+  stream->params = params;
+}
+
 static GstFlowReturn
 gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
 {
@@ -1503,7 +1754,7 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
       "stream:%p, pid:0x%04x stream_type:%d state:%d", stream, bs->pid,
       bs->stream_type, stream->state);
 
-  if (G_UNLIKELY (stream->data == NULL)) {
+  if (G_UNLIKELY (stream->data == NULL && stream->shared == NULL)) {
     GST_LOG ("stream->data == NULL");
     goto beach;
   }
@@ -1521,21 +1772,32 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
   if (G_UNLIKELY (!stream->active))
     activate_pad_for_stream (demux, stream);
 
-  if (G_UNLIKELY (stream->pad == NULL)) {
-    g_free (stream->data);
+  if (G_UNLIKELY (stream->pad == NULL))
     goto beach;
-  }
 
   if (G_UNLIKELY (demux->program == NULL)) {
     GST_LOG_OBJECT (demux, "No program");
-    g_free (stream->data);
     goto beach;
   }
 
   if (G_UNLIKELY (stream->need_newsegment))
     calculate_and_push_newsegment (demux, stream);
 
-  buffer = gst_buffer_new_wrapped (stream->data, stream->current_size);
+  if (G_UNLIKELY (stream->need_allocation))
+    gst_ts_demux_stream_query_allocation (demux, stream);
+
+  if (G_UNLIKELY (stream->pool == NULL))
+    stream->max_size = MAX (stream->max_size, stream->current_size);
+
+  if (stream->shared) {
+    buffer = stream->shared;
+    stream->shared = NULL;
+  } else {
+    buffer = stream->buffer;
+    gst_buffer_unmap (buffer, &stream->map);
+    gst_buffer_set_size (buffer, stream->current_size);
+    stream->buffer = NULL;
+  }
 
   GST_DEBUG_OBJECT (stream->pad, "stream->pts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (stream->pts));
@@ -1562,7 +1824,7 @@ beach:
   /* Reset everything */
   GST_LOG ("Resetting to EMPTY, returning %s", gst_flow_get_name (res));
   stream->state = PENDING_PACKET_EMPTY;
-  stream->data = NULL;
+  gst_ts_demux_stream_clear_data (stream);
   stream->expected_size = 0;
   stream->current_size = 0;
 
@@ -1593,7 +1855,10 @@ gst_ts_demux_handle_packet (GstTSDemux * demux, TSDemuxStream * stream,
 
   if (packet->payload && (res == GST_FLOW_OK || res == GST_FLOW_NOT_LINKED)
       && stream->pad) {
-    gst_ts_demux_queue_data (demux, stream, packet);
+    GstFlowReturn qres = gst_ts_demux_queue_data (demux, stream, packet);
+
+    if (G_UNLIKELY (qres != GST_FLOW_OK))
+      return qres;
     GST_DEBUG ("current_size:%d, expected_size:%d",
         stream->current_size, stream->expected_size);
     /* Finally check if the data we queued completes a packet */
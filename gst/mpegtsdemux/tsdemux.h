@@ -57,6 +57,7 @@ struct _GstTSDemux
    * accessed from the application thread and the streaming thread */
   guint program_number;		/* Required program number (ignore:-1) */
   gboolean emit_statistics;
+  gboolean zero_copy;		/* Share input memory in small PES */
 
   /*< private >*/
   MpegTSBaseProgram *program;	/* Current program */
@@ -109,11 +109,16 @@ enum
   ARG_M2TS_MODE,
   ARG_PAT_INTERVAL,
   ARG_PMT_INTERVAL,
-  ARG_ALIGNMENT
+  ARG_ALIGNMENT,
+  ARG_ALIGN_KEYFRAMES
 };
 
 #define MPEGTSMUX_DEFAULT_ALIGNMENT    -1
 #define MPEGTSMUX_DEFAULT_M2TS         FALSE
+#define MPEGTSMUX_DEFAULT_ALIGN_KEYFRAMES FALSE
+
+/* Packets per output block when no alignment is requested */
+#define MPEGTSMUX_BLOCK_PACKETS        64
 
 static GstStaticPadTemplate mpegtsmux_sink_factory =
     GST_STATIC_PAD_TEMPLATE ("sink_%d",
@@ -152,14 +157,11 @@ static void gst_mpegtsmux_get_property (GObject * object, guint prop_id,
 
 static void mpegtsmux_reset (MpegTsMux * mux, gboolean alloc);
 static void mpegtsmux_dispose (GObject * object);
-static void alloc_packet_cb (GstBuffer ** _buf, void *user_data);
-static gboolean new_packet_cb (GstBuffer * buf, void *user_data,
-    gint64 new_pcr);
+static guint8 *alloc_packet_cb (void *user_data);
+static gboolean new_packet_cb (guint8 * data, void *user_data, gint64 new_pcr);
 static void release_buffer_cb (guint8 * data, void *user_data);
-static GstFlowReturn mpegtsmux_collect_packet (MpegTsMux * mux,
-    GstBuffer * buf);
 static GstFlowReturn mpegtsmux_push_packets (MpegTsMux * mux, gboolean force);
-static gboolean new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf,
+static gboolean new_packet_m2ts (MpegTsMux * mux, gboolean have_packet,
     gint64 new_pcr);
 
 static void mpegtsdemux_prepare_srcpad (MpegTsMux * mux);
@@ -276,6 +278,15 @@ mpegtsmux_class_init (MpegTsMuxClass * klass)
           "(-1 = auto, 0 = all available packets)",
           -1, G_MAXINT, MPEGTSMUX_DEFAULT_ALIGNMENT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      ARG_ALIGN_KEYFRAMES, g_param_spec_boolean ("align-keyframes",
+          "Align keyframes",
+          "With alignment, pad the buffer before each keyframe with dummy "
+          "packets so that keyframes always start a buffer. Otherwise a "
+          "buffer is marked as keyframe if a keyframe starts in it",
+          MPEGTSMUX_DEFAULT_ALIGN_KEYFRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -302,8 +313,7 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->tsmux = tsmux_new ();
   tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
 
-  mux->adapter = gst_adapter_new ();
-  mux->out_adapter = gst_adapter_new ();
+  g_queue_init (&mux->out_blocks);
 
   /* properties */
   mux->m2ts_mode = MPEGTSMUX_DEFAULT_M2TS;
@@ -311,6 +321,7 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->pmt_interval = TSMUX_DEFAULT_PMT_INTERVAL;
   mux->prog_map = NULL;
   mux->alignment = MPEGTSMUX_DEFAULT_ALIGNMENT;
+  mux->align_keyframes = MPEGTSMUX_DEFAULT_ALIGN_KEYFRAMES;
 
   /* initial state */
   mpegtsmux_reset (mux, TRUE);
@@ -342,6 +353,30 @@ mpegtsmux_pad_reset (MpegTsPadData * pad_data)
   pad_data->prog = NULL;
 }
 
+static void
+mpegtsmux_block_free (MpegTsMuxBlock * block)
+{
+  gst_buffer_unmap (block->buffer, &block->map);
+  gst_buffer_unref (block->buffer);
+  g_slice_free (MpegTsMuxBlock, block);
+}
+
+static void
+mpegtsmux_clear_blocks (MpegTsMux * mux)
+{
+  MpegTsMuxBlock *block;
+
+  while ((block = g_queue_pop_head (&mux->out_blocks)))
+    mpegtsmux_block_free (block);
+  mux->m2ts_pending = 0;
+
+  if (mux->out_pool) {
+    gst_buffer_pool_set_active (mux->out_pool, FALSE);
+    gst_object_unref (mux->out_pool);
+    mux->out_pool = NULL;
+  }
+}
+
 static void
 mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
 {
@@ -350,6 +385,7 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
   mux->first = TRUE;
   mux->last_flow_ret = GST_FLOW_OK;
   mux->previous_pcr = -1;
+  mux->previous_offset = 0;
   mux->pcr_rate_num = mux->pcr_rate_den = 1;
   mux->last_ts = 0;
   mux->is_delta = TRUE;
@@ -365,8 +401,7 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->element_index = NULL;
   }
 #endif
-  gst_adapter_clear (mux->adapter);
-  gst_adapter_clear (mux->out_adapter);
+  mpegtsmux_clear_blocks (mux);
 
   if (mux->tsmux) {
     tsmux_free (mux->tsmux);
@@ -389,7 +424,6 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->streamheader = NULL;
   }
   gst_event_replace (&mux->force_key_unit_event, NULL);
-  gst_buffer_replace (&mux->out_buffer, NULL);
 
   GST_COLLECT_PADS_STREAM_LOCK (mux->collect);
   for (walk = mux->collect->data; walk != NULL; walk = g_slist_next (walk))
@@ -410,14 +444,6 @@ mpegtsmux_dispose (GObject * object)
 
   mpegtsmux_reset (mux, FALSE);
 
-  if (mux->adapter) {
-    g_object_unref (mux->adapter);
-    mux->adapter = NULL;
-  }
-  if (mux->out_adapter) {
-    g_object_unref (mux->out_adapter);
-    mux->out_adapter = NULL;
-  }
   if (mux->collect) {
     gst_object_unref (mux->collect);
     mux->collect = NULL;
@@ -472,6 +498,9 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
     case ARG_ALIGNMENT:
       mux->alignment = g_value_get_int (value);
       break;
+    case ARG_ALIGN_KEYFRAMES:
+      mux->align_keyframes = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -500,6 +529,9 @@ gst_mpegtsmux_get_property (GObject * object, guint prop_id,
     case ARG_ALIGNMENT:
       g_value_set_int (value, mux->alignment);
       break;
+    case ARG_ALIGN_KEYFRAMES:
+      g_value_set_boolean (value, mux->align_keyframes);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1053,7 +1085,7 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
   if (G_UNLIKELY (best == NULL)) {
     /* EOS */
     /* drain some possibly cached data */
-    new_packet_m2ts (mux, NULL, -1);
+    new_packet_m2ts (mux, FALSE, -1);
     mpegtsmux_push_packets (mux, TRUE);
     gst_pad_push_event (mux->srcpad, gst_event_new_eos ());
 
@@ -1265,24 +1297,17 @@ mpegtsmux_release_pad (GstElement * element, GstPad * pad)
 }
 
 static void
-new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
-    guint len)
+new_packet_common_init (MpegTsMux * mux, MpegTsMuxBlock * block, guint8 * data)
 {
-  /* Packets should be at least 188 bytes, but check anyway */
-  g_return_if_fail (len >= 2 || !data);
-
-  if (!mux->streamheader_sent && data) {
+  if (!mux->streamheader_sent) {
     guint pid = ((data[1] & 0x1f) << 8) | data[2];
     /* if it's a PAT or a PMT */
     if (pid == 0x00 || (pid >= TSMUX_START_PMT_PID && pid < TSMUX_START_ES_PID)) {
+      guint prefix = mux->out_packet_size - NORMAL_TS_PACKET_LENGTH;
       GstBuffer *hbuf;
 
-      if (!buf) {
-        hbuf = gst_buffer_new_and_alloc (len);
-        gst_buffer_fill (hbuf, 0, data, len);
-      } else {
-        hbuf = gst_buffer_copy (buf);
-      }
+      hbuf = gst_buffer_new_and_alloc (mux->out_packet_size);
+      gst_buffer_fill (hbuf, 0, data - prefix, mux->out_packet_size);
       mux->streamheader = g_list_append (mux->streamheader, hbuf);
     } else if (mux->streamheader) {
       mpegtsdemux_set_header_on_caps (mux);
@@ -1290,136 +1315,223 @@ new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
     }
   }
 
-  if (buf) {
-    if (mux->is_delta) {
-      GST_LOG_OBJECT (mux, "marking as delta unit");
-      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  if (mux->is_delta) {
+    GST_LOG_OBJECT (mux, "marking as delta unit");
+  } else {
+    GST_DEBUG_OBJECT (mux, "marking as non-delta unit");
+    /* keyframes usually start a block, see alloc_packet_cb(). Otherwise the
+     * block they start in is not a delta unit either */
+    block->delta = FALSE;
+    mux->is_delta = TRUE;
+  }
+}
+
+/* Appends a new output block from our pool to the queue */
+static MpegTsMuxBlock *
+mpegtsmux_new_block (MpegTsMux * mux)
+{
+  MpegTsMuxBlock *block;
+  GstBuffer *buf = NULL;
+
+  if (G_UNLIKELY (mux->out_pool == NULL)) {
+    GstStructure *config;
+    gint align = mux->alignment;
+
+    if (mux->m2ts_mode) {
+      mux->out_packet_size = M2TS_PACKET_LENGTH;
+      if (align < 0)
+        align = 32;
     } else {
-      GST_DEBUG_OBJECT (mux, "marking as non-delta unit");
-      mux->is_delta = TRUE;
+      mux->out_packet_size = NORMAL_TS_PACKET_LENGTH;
+      if (align < 0)
+        align = 0;
+    }
+    mux->out_block_size =
+        (align ? align : MPEGTSMUX_BLOCK_PACKETS) * mux->out_packet_size;
+
+    GST_DEBUG_OBJECT (mux, "using output blocks of %u bytes",
+        mux->out_block_size);
+
+    mux->out_pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (mux->out_pool);
+    gst_buffer_pool_config_set_params (config, NULL, mux->out_block_size, 0,
+        0);
+    if (!gst_buffer_pool_set_config (mux->out_pool, config) ||
+        !gst_buffer_pool_set_active (mux->out_pool, TRUE)) {
+      GST_WARNING_OBJECT (mux, "failed to configure output buffer pool");
+      gst_object_unref (mux->out_pool);
+      mux->out_pool = NULL;
+      return NULL;
     }
   }
+
+  if (gst_buffer_pool_acquire_buffer (mux->out_pool, &buf,
+          NULL) != GST_FLOW_OK)
+    return NULL;
+
+  /* the buffer might have been resized when it was last pushed */
+  if (gst_buffer_get_size (buf) != mux->out_block_size)
+    gst_buffer_set_size (buf, mux->out_block_size);
+
+  block = g_slice_new (MpegTsMuxBlock);
+  block->buffer = buf;
+  gst_buffer_map (buf, &block->map, GST_MAP_WRITE);
+  block->size = 0;
+  block->ts = GST_CLOCK_TIME_NONE;
+  block->delta = TRUE;
+  g_queue_push_tail (&mux->out_blocks, block);
+
+  return block;
 }
 
-static GstFlowReturn
-mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
+/* Fills the rest of @block with null packets */
+static void
+mpegtsmux_pad_block (MpegTsMux * mux, MpegTsMuxBlock * block)
 {
-  gint align = mux->alignment;
-  gint av, packet_size;
-  GstBuffer *buf;
-  GstFlowReturn ret = GST_FLOW_OK;
-  GstClockTime ts;
+  guint packet_size = mux->out_packet_size;
+  guint8 *data;
+  guint32 header = 0;
+  gint dummy;
 
-  if (mux->m2ts_mode) {
-    packet_size = M2TS_PACKET_LENGTH;
-    if (align < 0)
-      align = 32;
-  } else {
-    packet_size = NORMAL_TS_PACKET_LENGTH;
-    if (align < 0)
-      align = 0;
-  }
+  data = block->map.data + block->size;
+  if (block->size)
+    header = GST_READ_UINT32_BE (data - packet_size);
 
-  av = gst_adapter_available (mux->out_adapter);
-  GST_LOG_OBJECT (mux, "align %d, av %d", align, av);
+  dummy = (mux->out_block_size - block->size) / packet_size;
+  GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
 
-  if (!align)
-    align = av;
-  else
-    align *= packet_size;
+  for (; dummy > 0; dummy--) {
+    gint offset;
 
-  /* FIXME: what about DTS here? */
-  GST_LOG_OBJECT (mux, "aligning to %d bytes", align);
-  if (G_LIKELY ((align <= av) && av)) {
-    GST_LOG_OBJECT (mux, "pushing %d aligned bytes", av - (av % align));
-    ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
-    buf = gst_adapter_take_buffer (mux->out_adapter, av - (av % align));
-    g_assert (buf);
-    GST_BUFFER_PTS (buf) = ts;
-
-    ret = gst_pad_push (mux->srcpad, buf);
-    av = av % align;
+    if (packet_size > NORMAL_TS_PACKET_LENGTH) {
+      GST_WRITE_UINT32_BE (data, header);
+      /* simply increase header a bit and never mind too much */
+      header++;
+      offset = 4;
+    } else {
+      offset = 0;
+    }
+    GST_WRITE_UINT8 (data + offset, TSMUX_SYNC_BYTE);
+    /* null packet PID */
+    GST_WRITE_UINT16_BE (data + offset + 1, 0x1FFF);
+    /* no adaptation field exists | continuity counter undefined */
+    GST_WRITE_UINT8 (data + offset + 3, 0x10);
+    /* payload */
+    memset (data + offset + 4, 0, NORMAL_TS_PACKET_LENGTH - 4);
+    data += packet_size;
   }
 
-  if (av && force) {
-    guint8 *data;
-    guint32 header;
-    gint dummy;
-    GstMapInfo map;
+  block->size = mux->out_block_size;
+}
 
-    GST_LOG_OBJECT (mux, "handling %d leftover bytes", av);
-    buf = gst_buffer_new_and_alloc (align);
-    gst_buffer_map (buf, &map, GST_MAP_READ);
-    data = map.data;
-    ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
+/* Whether output blocks are only pushed once full */
+static inline gboolean
+mpegtsmux_is_aligned (MpegTsMux * mux)
+{
+  return mux->alignment > 0 || (mux->m2ts_mode && mux->alignment < 0);
+}
 
-    gst_adapter_copy (mux->out_adapter, data, 0, av);
-    gst_adapter_clear (mux->out_adapter);
-    GST_BUFFER_PTS (buf) = ts;
+/* Ends @block before it is full, so that the next packet starts a new one */
+static void
+mpegtsmux_close_block (MpegTsMux * mux, MpegTsMuxBlock * block)
+{
+  guint dummy;
 
-    data += av;
-    header = GST_READ_UINT32_BE (data - packet_size);
+  if (!mpegtsmux_is_aligned (mux))
+    return;
 
-    dummy = (map.size - av) / packet_size;
-    GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
+  dummy = (mux->out_block_size - block->size) / mux->out_packet_size;
+  mpegtsmux_pad_block (mux, block);
 
-    for (; dummy > 0; dummy--) {
-      gint offset;
+  /* The timestamp headers of the padding are interpolated along with those
+   * of the packets still waiting for the next PCR */
+  if (mux->out_packet_size > NORMAL_TS_PACKET_LENGTH)
+    mux->m2ts_pending += dummy;
+}
 
-      if (packet_size > NORMAL_TS_PACKET_LENGTH) {
-        GST_WRITE_UINT32_BE (data, header);
-        /* simply increase header a bit and never mind too much */
-        header++;
-        offset = 4;
-      } else {
-        offset = 0;
-      }
-      GST_WRITE_UINT8 (data + offset, TSMUX_SYNC_BYTE);
-      /* null packet PID */
-      GST_WRITE_UINT16_BE (data + offset + 1, 0x1FFF);
-      /* no adaptation field exists | continuity counter undefined */
-      GST_WRITE_UINT8 (data + offset + 3, 0x10);
-      /* payload */
-      memset (data + offset + 4, 0, NORMAL_TS_PACKET_LENGTH - 4);
-      data += packet_size;
-    }
+/* Takes ownership of @block */
+static GstFlowReturn
+mpegtsmux_push_block (MpegTsMux * mux, MpegTsMuxBlock * block)
+{
+  GstBuffer *buf = block->buffer;
 
-    gst_buffer_unmap (buf, &map);
+  gst_buffer_unmap (buf, &block->map);
+  gst_buffer_set_size (buf, block->size);
 
-    ret = gst_pad_push (mux->srcpad, buf);
-  }
+  /* FIXME: what about DTS here? */
+  GST_BUFFER_PTS (buf) = block->ts;
+  if (block->delta)
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  else
+    GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
 
-  return ret;
+  GST_LOG_OBJECT (mux, "pushing block of %" G_GSIZE_FORMAT " bytes",
+      block->size);
+  g_slice_free (MpegTsMuxBlock, block);
+
+  return gst_pad_push (mux->srcpad, buf);
 }
 
 static GstFlowReturn
-mpegtsmux_collect_packet (MpegTsMux * mux, GstBuffer * buf)
+mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
 {
-  GST_LOG_OBJECT (mux, "collecting packet size %" G_GSIZE_FORMAT,
-      gst_buffer_get_size (buf));
-  gst_adapter_push (mux->out_adapter, buf);
+  MpegTsMuxBlock *block;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gsize queued = 0, pending;
+  gboolean aligned;
+  GList *walk;
 
-  return GST_FLOW_OK;
+  /* Without alignment, whatever is available goes out */
+  aligned = mpegtsmux_is_aligned (mux);
+  /* M2TS packets still waiting for their header sit at the end */
+  pending = mux->m2ts_pending * M2TS_PACKET_LENGTH;
+
+  for (walk = mux->out_blocks.head; walk; walk = walk->next)
+    queued += ((MpegTsMuxBlock *) walk->data)->size;
+
+  GST_LOG_OBJECT (mux, "aligned %d, queued %" G_GSIZE_FORMAT ", pending %"
+      G_GSIZE_FORMAT, aligned, queued, pending);
+
+  while ((block = g_queue_peek_head (&mux->out_blocks))) {
+    if (block->size == 0 || queued - block->size < pending)
+      break;
+
+    if (block->size < mux->out_block_size && aligned) {
+      if (!force)
+        break;
+      mpegtsmux_pad_block (mux, block);
+    }
+
+    g_queue_pop_head (&mux->out_blocks);
+    queued -= MIN (queued, block->size);
+
+    ret = mpegtsmux_push_block (mux, block);
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  return ret;
 }
 
 static gboolean
-new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
+new_packet_m2ts (MpegTsMux * mux, gboolean have_packet, gint64 new_pcr)
 {
-  GstBuffer *out_buf;
-  int chunk_bytes;
-  GstMapInfo map;
+  gint64 chunk_bytes;
+  MpegTsMuxBlock *block;
+  GList *walk;
+  gsize pos;
 
-  GST_LOG_OBJECT (mux, "Have buffer %p with new_pcr=%" G_GINT64_FORMAT,
-      buf, new_pcr);
+  GST_LOG_OBJECT (mux, "Have packet %d with new_pcr=%" G_GINT64_FORMAT,
+      have_packet, new_pcr);
 
-  chunk_bytes = gst_adapter_available (mux->adapter);
+  chunk_bytes = mux->m2ts_pending * M2TS_PACKET_LENGTH;
 
-  if (G_LIKELY (buf)) {
+  if (G_LIKELY (have_packet)) {
     if (new_pcr < 0) {
-      /* If there is no pcr in current ts packet then just add the packet
-         to the adapter for later output when we see a PCR */
+      /* If there is no pcr in current ts packet then just leave its
+         header to be written when we see a PCR */
       GST_LOG_OBJECT (mux, "Accumulating non-PCR packet");
-      gst_adapter_push (mux->adapter, buf);
+      mux->m2ts_pending++;
       goto exit;
     }
 
@@ -1429,7 +1541,7 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
       mux->previous_pcr = new_pcr;
       mux->previous_offset = chunk_bytes;
       GST_LOG_OBJECT (mux, "Accumulating non-PCR packet");
-      gst_adapter_push (mux->adapter, buf);
+      mux->m2ts_pending++;
       goto exit;
     }
   } else {
@@ -1437,7 +1549,7 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
   }
 
   /* interpolate if needed, and 2 points available */
-  if (chunk_bytes && (new_pcr != mux->previous_pcr)) {
+  if (chunk_bytes) {
     gint64 offset = 0;
 
     GST_LOG_OBJECT (mux, "Processing pending packets; "
@@ -1446,21 +1558,32 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
         mux->previous_pcr, (gint) mux->previous_offset,
         new_pcr, (gint) chunk_bytes);
 
-    g_assert (chunk_bytes > mux->previous_offset);
     /* if draining, use previous rate */
-    if (G_LIKELY (new_pcr > 0)) {
+    if (G_LIKELY (new_pcr > 0 && new_pcr != mux->previous_pcr)) {
+      g_assert (chunk_bytes > mux->previous_offset);
       mux->pcr_rate_num = new_pcr - mux->previous_pcr;
       mux->pcr_rate_den = chunk_bytes - mux->previous_offset;
     }
 
-    while (offset < chunk_bytes) {
-      guint64 cur_pcr, ts;
+    /* Find the first pending packet, they are the last ones written
+     * apart from the current one */
+    pos = chunk_bytes + (have_packet ? M2TS_PACKET_LENGTH : 0);
+    walk = mux->out_blocks.tail;
+    block = walk->data;
+    while (pos > block->size) {
+      pos -= block->size;
+      walk = walk->prev;
+      block = walk->data;
+    }
+    pos = block->size - pos;
 
-      /* Loop, pulling packets of the adapter, updating their 4 byte
-       * timestamp header and pushing */
+    while (offset < chunk_bytes) {
+      guint64 cur_pcr;
 
       /* interpolate PCR */
-      if (G_LIKELY (offset >= mux->previous_offset))
+      if (G_UNLIKELY (mux->previous_pcr < 0))
+        cur_pcr = 0;
+      else if (G_LIKELY (offset >= mux->previous_offset))
         cur_pcr = mux->previous_pcr +
             gst_util_uint64_scale (offset - mux->previous_offset,
             mux->pcr_rate_num, mux->pcr_rate_den);
@@ -1469,41 +1592,35 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
             gst_util_uint64_scale (mux->previous_offset - offset,
             mux->pcr_rate_num, mux->pcr_rate_den);
 
-      /* FIXME: what about DTS here? */
-      ts = gst_adapter_prev_pts (mux->adapter, NULL);
-      out_buf = gst_adapter_take_buffer (mux->adapter, M2TS_PACKET_LENGTH);
-      g_assert (out_buf);
-      offset += M2TS_PACKET_LENGTH;
-
-      GST_BUFFER_PTS (out_buf) = ts;
-
-      gst_buffer_map (out_buf, &map, GST_MAP_WRITE);
+      if (pos >= block->size) {
+        walk = walk->next;
+        block = walk->data;
+        pos = 0;
+      }
 
       /* The header is the bottom 30 bits of the PCR, apparently not
        * encoded into base + ext as in the packets themselves */
-      GST_WRITE_UINT32_BE (map.data, cur_pcr & 0x3FFFFFFF);
-      gst_buffer_unmap (out_buf, &map);
+      GST_WRITE_UINT32_BE (block->map.data + pos, cur_pcr & 0x3FFFFFFF);
 
       GST_LOG_OBJECT (mux, "Outputting a packet of length %d PCR %"
           G_GUINT64_FORMAT, M2TS_PACKET_LENGTH, cur_pcr);
-      mpegtsmux_collect_packet (mux, out_buf);
+      pos += M2TS_PACKET_LENGTH;
+      offset += M2TS_PACKET_LENGTH;
     }
+    mux->m2ts_pending = 0;
   }
 
-  if (G_UNLIKELY (!buf))
+  if (G_UNLIKELY (!have_packet))
     goto exit;
 
-  gst_buffer_map (buf, &map, GST_MAP_WRITE);
-
   /* Finally, output the passed in packet */
   /* Only write the bottom 30 bits of the PCR */
-  GST_WRITE_UINT32_BE (map.data, new_pcr & 0x3FFFFFFF);
-
-  gst_buffer_unmap (buf, &map);
+  block = g_queue_peek_tail (&mux->out_blocks);
+  GST_WRITE_UINT32_BE (block->map.data + block->size - M2TS_PACKET_LENGTH,
+      new_pcr & 0x3FFFFFFF);
 
   GST_LOG_OBJECT (mux, "Outputting a packet of length %d PCR %"
       G_GUINT64_FORMAT, M2TS_PACKET_LENGTH, new_pcr);
-  mpegtsmux_collect_packet (mux, buf);
 
   if (new_pcr != mux->previous_pcr) {
     mux->previous_pcr = new_pcr;
@@ -1517,59 +1634,68 @@ exit:
 /* Called when the TsMux has prepared a packet for output. Return FALSE
  * on error */
 static gboolean
-new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
+new_packet_cb (guint8 * data, void *user_data, gint64 new_pcr)
 {
   MpegTsMux *mux = (MpegTsMux *) user_data;
-  gint offset = 0;
-  GstMapInfo map;
+  MpegTsMuxBlock *block;
 
 #if 0
   GST_LOG_OBJECT (mux, "handling packet %d", mux->spn_count);
   mux->spn_count++;
 #endif
 
-  if (mux->m2ts_mode) {
-    offset = 4;
-    gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH + offset);
-  }
+  /* the packet was written at the end of the last block */
+  block = g_queue_peek_tail (&mux->out_blocks);
+  g_assert (block != NULL && data == block->map.data + block->size +
+      mux->out_packet_size - NORMAL_TS_PACKET_LENGTH);
 
-  gst_buffer_map (buf, &map, GST_MAP_READWRITE);
-
-  if (offset) {
-    /* there should be a better way to do this */
-    memmove (map.data + offset, map.data, map.size - offset);
-  }
-
-  GST_BUFFER_PTS (buf) = mux->last_ts;
+  if (block->size == 0)
+    block->ts = mux->last_ts;
   /* do common init (flags and streamheaders) */
-  new_packet_common_init (mux, buf, map.data + offset, map.size);
-
-  gst_buffer_unmap (buf, &map);
+  new_packet_common_init (mux, block, data);
+  block->size += mux->out_packet_size;
 
   /* all is meant for downstream, including any prefix */
-  if (offset)
-    return new_packet_m2ts (mux, buf, new_pcr);
-  else
-    mpegtsmux_collect_packet (mux, buf);
+  if (mux->out_packet_size > NORMAL_TS_PACKET_LENGTH)
+    return new_packet_m2ts (mux, TRUE, new_pcr);
 
   return TRUE;
 }
 
 /* called when TsMux needs new packet to write into */
-static void
-alloc_packet_cb (GstBuffer ** _buf, void *user_data)
+static guint8 *
+alloc_packet_cb (void *user_data)
 {
   MpegTsMux *mux = (MpegTsMux *) user_data;
-  GstBuffer *buf;
-  gint offset = 0;
-
-  if (mux->m2ts_mode == TRUE)
-    offset = 4;
+  MpegTsMuxBlock *block;
+  guint8 *data;
+
+  block = g_queue_peek_tail (&mux->out_blocks);
+  /* A keyframe starts a new block, unless that takes padding and was not
+   * asked for */
+  if (block && block->size > 0 && !mux->is_delta &&
+      (!mpegtsmux_is_aligned (mux) || mux->align_keyframes)) {
+    GST_DEBUG_OBJECT (mux, "closing block of %" G_GSIZE_FORMAT " bytes "
+        "before keyframe", block->size);
+    mpegtsmux_close_block (mux, block);
+    block = NULL;
+  }
+  if (block == NULL || block->size + mux->out_packet_size > mux->out_block_size) {
+    block = mpegtsmux_new_block (mux);
+    if (G_UNLIKELY (block == NULL)) {
+      GST_WARNING_OBJECT (mux, "could not get an output block");
+      return NULL;
+    }
+  }
 
-  buf = gst_buffer_new_and_alloc (NORMAL_TS_PACKET_LENGTH + offset);
-  gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH);
+  data = block->map.data + block->size;
+  if (mux->out_packet_size > NORMAL_TS_PACKET_LENGTH) {
+    /* the timestamp header is written once the PCR is known */
+    GST_WRITE_UINT32_BE (data, 0);
+    data += mux->out_packet_size - NORMAL_TS_PACKET_LENGTH;
+  }
 
-  *_buf = buf;
+  return data;
 }
 
 static void
@@ -118,6 +118,7 @@ G_BEGIN_DECLS
 typedef struct MpegTsMux MpegTsMux;
 typedef struct MpegTsMuxClass MpegTsMuxClass;
 typedef struct MpegTsPadData MpegTsPadData;
+typedef struct MpegTsMuxBlock MpegTsMuxBlock;
 
 typedef GstBuffer * (*MpegTsPadDataPrepareFunction) (GstBuffer * buf,
     MpegTsPadData * data, MpegTsMux * mux);
@@ -140,6 +141,7 @@ struct MpegTsMux {
   guint pat_interval;
   guint pmt_interval;
   gint alignment;
+  gboolean align_keyframes;
 
   /* state */
   gboolean first;
@@ -158,11 +160,15 @@ struct MpegTsMux {
   gint64 previous_offset;
   gint64 pcr_rate_num;
   gint64 pcr_rate_den;
-  GstAdapter *adapter;
+  /* packets at the end of the output blocks still waiting for their
+   * timestamp header */
+  guint m2ts_pending;
 
-  /* output buffer aggregation */
-  GstAdapter *out_adapter;
-  GstBuffer *out_buffer;
+  /* output blocks, packets are written into the last one */
+  GstBufferPool *out_pool;
+  guint out_block_size;
+  guint out_packet_size;
+  GQueue out_blocks;
 
 #if 0
   /* SPN/PTS index handling */
@@ -171,6 +177,16 @@ struct MpegTsMux {
 #endif
 };
 
+/* A pool buffer TS packets are serialised into */
+struct MpegTsMuxBlock {
+  GstBuffer *buffer;
+  GstMapInfo map;
+  /* bytes written so far */
+  gsize size;
+  GstClockTime ts;
+  gboolean delta;
+};
+
 struct MpegTsMuxClass {
   GstElementClass parent_class;
 };
@@ -85,7 +85,8 @@
 
 #include "tsmux.h"
 #include "tsmuxstream.h"
-#include "crc.h"
+
+#include <gst/mpegts-crc-private.h>
 
 #define GST_CAT_DEFAULT mpegtsmux_debug
 
@@ -149,7 +150,9 @@ tsmux_new (void)
  * @user_data: user data passed to @func
  *
  * Set the callback function and user data to be called when @mux has output to
- * produce. @user_data will be passed as user data in @func.
+ * produce. @func is called with the packet data previously obtained from the
+ * alloc function once the packet is complete.
+ * @user_data will be passed as user data in @func.
  */
 void
 tsmux_set_write_func (TsMux * mux, TsMuxWriteFunc func, void *user_data)
@@ -167,7 +170,9 @@ tsmux_set_write_func (TsMux * mux, TsMuxWriteFunc func, void *user_data)
  * @user_data: user data passed to @func
  *
  * Set the callback function and user data to be called when @mux needs
- * a new buffer to write a packet into.
+ * memory to write a packet into. @func has to return %TSMUX_PACKET_LENGTH
+ * writable bytes that stay valid until the packet is passed to the write
+ * function, or %NULL on error.
  * @user_data will be passed as user data in @func.
  */
 void
@@ -453,33 +458,22 @@ tsmux_find_stream (TsMux * mux, guint16 pid)
   return found;
 }
 
-static gboolean
-tsmux_get_buffer (TsMux * mux, GstBuffer ** buf)
+static guint8 *
+tsmux_get_packet (TsMux * mux)
 {
-  g_return_val_if_fail (buf, FALSE);
-
   if (G_UNLIKELY (!mux->alloc_func))
-    return FALSE;
-
-  mux->alloc_func (buf, mux->alloc_func_data);
-
-  if (!*buf)
-    return FALSE;
+    return NULL;
 
-  g_assert (gst_buffer_get_size (*buf) == TSMUX_PACKET_LENGTH);
-  return TRUE;
+  return mux->alloc_func (mux->alloc_func_data);
 }
 
 static gboolean
-tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
+tsmux_packet_out (TsMux * mux, guint8 * data, gint64 pcr)
 {
-  if (G_UNLIKELY (mux->write_func == NULL)) {
-    if (buf)
-      gst_buffer_unref (buf);
+  if (G_UNLIKELY (mux->write_func == NULL))
     return TRUE;
-  }
 
-  return mux->write_func (buf, mux->write_func_data, pcr);
+  return mux->write_func (data, mux->write_func_data, pcr);
 }
 
 /*
@@ -745,8 +739,7 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   TsMuxPacketInfo *pi = &stream->pi;
   gboolean res;
   gint64 cur_pcr = -1;
-  GstBuffer *buf = NULL;
-  GstMapInfo map;
+  guint8 *data;
 
   g_return_val_if_fail (mux != NULL, FALSE);
   g_return_val_if_fail (stream != NULL, FALSE);
@@ -827,36 +820,22 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   }
   pi->stream_avail = tsmux_stream_bytes_avail (stream);
 
-  /* obtain buffer */
-  if (!tsmux_get_buffer (mux, &buf))
+  /* obtain packet memory */
+  if (!(data = tsmux_get_packet (mux)))
     return FALSE;
 
-  gst_buffer_map (buf, &map, GST_MAP_READ);
-
-  if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs))
-    goto fail;
-
-
-  if (!tsmux_stream_get_data (stream, map.data + payload_offs, payload_len))
-    goto fail;
+  if (!tsmux_write_ts_header (data, pi, &payload_len, &payload_offs))
+    return FALSE;
 
-  gst_buffer_unmap (buf, &map);
+  if (!tsmux_stream_get_data (stream, data + payload_offs, payload_len))
+    return FALSE;
 
-  res = tsmux_packet_out (mux, buf, cur_pcr);
+  res = tsmux_packet_out (mux, data, cur_pcr);
 
   /* Reset all dynamic flags */
   stream->pi.flags &= TSMUX_PACKET_FLAG_PES_FULL_HEADER;
 
   return res;
-
-  /* ERRORS */
-fail:
-  {
-    gst_buffer_unmap (buf, &map);
-    if (buf)
-      gst_buffer_unref (buf);
-    return FALSE;
-  }
 }
 
 /**
@@ -882,8 +861,7 @@ tsmux_write_section (TsMux * mux, TsMuxSection * section)
   guint payload_remain;
   guint payload_len, payload_offs;
   TsMuxPacketInfo *pi;
-  GstBuffer *buf = NULL;
-  GstMapInfo map;
+  guint8 *data;
 
   pi = &section->pi;
 
@@ -894,64 +872,45 @@ tsmux_write_section (TsMux * mux, TsMuxSection * section)
 
   while (payload_remain > 0) {
 
-    /* obtain buffer */
-    map.data = NULL;
-    if (!tsmux_get_buffer (mux, &buf))
-      goto fail;
-
-    gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    /* obtain packet memory */
+    if (!(data = tsmux_get_packet (mux)))
+      return FALSE;
 
     if (pi->packet_start_unit_indicator) {
       /* Need to write an extra single byte start pointer */
       pi->stream_avail++;
 
-      if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs)) {
+      if (!tsmux_write_ts_header (data, pi, &payload_len, &payload_offs)) {
         pi->stream_avail--;
-        goto fail;
+        return FALSE;
       }
       pi->stream_avail--;
 
       /* Write the pointer byte */
-      map.data[payload_offs] = 0x00;
+      data[payload_offs] = 0x00;
 
       payload_offs++;
       payload_len--;
       pi->packet_start_unit_indicator = FALSE;
     } else {
-      if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs))
-        goto fail;
+      if (!tsmux_write_ts_header (data, pi, &payload_len, &payload_offs))
+        return FALSE;
     }
 
     TS_DEBUG ("Outputting %d bytes to section. %d remaining after",
         payload_len, payload_remain - payload_len);
 
-    memcpy (map.data + payload_offs, cur_in, payload_len);
+    memcpy (data + payload_offs, cur_in, payload_len);
 
     cur_in += payload_len;
     payload_remain -= payload_len;
 
-    gst_buffer_unmap (buf, &map);
-
     /* we do not write PCR in section */
-    if (G_UNLIKELY (!tsmux_packet_out (mux, buf, -1))) {
-      /* buffer given away */
-      buf = NULL;
-      goto fail;
-    }
-    buf = NULL;
+    if (G_UNLIKELY (!tsmux_packet_out (mux, data, -1)))
+      return FALSE;
   }
 
   return TRUE;
-
-  /* ERRORS */
-fail:
-  {
-    if (map.data && buf)
-      gst_buffer_unmap (buf, &map);
-    if (buf)
-      gst_buffer_unref (buf);
-    return FALSE;
-  }
 }
 
 static void
@@ -1023,7 +982,7 @@ tsmux_write_pat (TsMux * mux)
         mux->transport_id, mux->pat_version, 0, 0);
 
     /* Calc and output CRC for data bytes, not including itself */
-    crc = calc_crc32 (pat->data, pat->pi.stream_avail - 4);
+    crc = mpegts_crc32 (pat->data, pat->pi.stream_avail - 4);
     tsmux_put32 (&pos, crc);
 
     TS_DEBUG ("PAT has %d programs, is %u bytes",
@@ -1128,7 +1087,7 @@ tsmux_write_pmt (TsMux * mux, TsMuxProgram * program)
 
     /* Calc and output CRC for data bytes, 
      * but not counting the CRC bytes this time */
-    crc = calc_crc32 (pmt->data, pmt->pi.stream_avail - 4);
+    crc = mpegts_crc32 (pmt->data, pmt->pi.stream_avail - 4);
     tsmux_put32 (&pos, crc);
 
     TS_DEBUG ("PMT for program %d has %d streams, is %u bytes",
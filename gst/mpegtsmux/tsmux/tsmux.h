@@ -99,8 +99,12 @@ G_BEGIN_DECLS
 typedef struct TsMuxSection TsMuxSection;
 typedef struct TsMux TsMux;
 
-typedef gboolean (*TsMuxWriteFunc) (GstBuffer * buf, void *user_data, gint64 new_pcr);
-typedef void (*TsMuxAllocFunc) (GstBuffer ** buf, void *user_data);
+/* Packets are serialised straight into memory provided by the caller:
+ * the alloc function returns TSMUX_PACKET_LENGTH writable bytes for the
+ * next packet and the write function is called once that packet is
+ * complete. */
+typedef gboolean (*TsMuxWriteFunc) (guint8 * data, void *user_data, gint64 new_pcr);
+typedef guint8 * (*TsMuxAllocFunc) (void *user_data);
 
 struct TsMuxSection {
   TsMuxPacketInfo pi;
@@ -163,7 +167,7 @@ struct TsMux {
   /* callback to write finished packet */
   TsMuxWriteFunc write_func;
   void *write_func_data;
-  /* callback to alloc new packet buffer */
+  /* callback to get the memory to write the next packet into */
   TsMuxAllocFunc alloc_func;
   void *alloc_func_data;
 
@@ -114,9 +114,15 @@ enum
   PROP_0,
   PROP_PACKAGE,
   PROP_MAX_DRIFT,
-  PROP_STRUCTURE
+  PROP_STRUCTURE,
+  PROP_LAZY_DESCRIPTIVE_METADATA,
+  PROP_READ_AHEAD,
+  PROP_READ_COUNT,
+  PROP_PULL_COUNT
 };
 
+#define DEFAULT_READ_AHEAD (1024 * 1024)
+
 static gboolean gst_mxf_demux_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
 static gboolean gst_mxf_demux_src_event (GstPad * pad, GstObject * parent,
@@ -150,6 +156,19 @@ gst_mxf_demux_partition_free (GstMXFDemuxPartition * partition)
   g_free (partition);
 }
 
+static void
+gst_mxf_demux_index_table_free (GstMXFDemuxIndexTable * table)
+{
+  guint i;
+
+  for (i = 0; i < table->segments->len; i++)
+    mxf_index_table_segment_reset (&g_array_index (table->segments,
+            MXFIndexTableSegment, i));
+  g_array_free (table->segments, TRUE);
+
+  g_free (table);
+}
+
 static void
 gst_mxf_demux_reset_mxf_state (GstMXFDemux * demux)
 {
@@ -224,6 +243,7 @@ gst_mxf_demux_reset_metadata (GstMXFDemux * demux)
     g_hash_table_destroy (demux->metadata);
   }
   demux->metadata = mxf_metadata_hash_table_new ();
+  g_hash_table_remove_all (demux->pending_descriptive_metadata);
 
   if (demux->tags) {
     gst_tag_list_unref (demux->tags);
@@ -258,6 +278,18 @@ gst_mxf_demux_reset (GstMXFDemux * demux)
 
   gst_adapter_clear (demux->adapter);
 
+  if (demux->n_reads > 0)
+    GST_DEBUG_OBJECT (demux, "Served %" G_GUINT64_FORMAT " reads with %"
+        G_GUINT64_FORMAT " pulls", demux->n_reads, demux->n_pulls);
+
+  if (demux->pull_cache) {
+    gst_buffer_unref (demux->pull_cache);
+    demux->pull_cache = NULL;
+  }
+  demux->pull_cache_offset = 0;
+  demux->n_reads = 0;
+  demux->n_pulls = 0;
+
   gst_mxf_demux_remove_pads (demux);
 
   if (demux->random_index_pack) {
@@ -277,6 +309,12 @@ gst_mxf_demux_reset (GstMXFDemux * demux)
     demux->pending_index_table_segments = NULL;
   }
 
+  g_list_foreach (demux->index_tables, (GFunc) gst_mxf_demux_index_table_free,
+      NULL);
+  g_list_free (demux->index_tables);
+  demux->index_tables = NULL;
+  demux->pulled_index_tables = FALSE;
+
   gst_mxf_demux_reset_mxf_state (demux);
   gst_mxf_demux_reset_metadata (demux);
 }
@@ -314,13 +352,54 @@ done:
   return ret;
 }
 
+/* Small reads are served from a read-ahead window of read-ahead bytes,
+ * so that the key, length and value of consecutive KLV packets only take
+ * one pull from upstream */
 static GstFlowReturn
 gst_mxf_demux_pull_range (GstMXFDemux * demux, guint64 offset,
     guint size, GstBuffer ** buffer)
 {
   GstFlowReturn ret;
+  guint read_ahead = demux->read_ahead;
+
+  demux->n_reads++;
+
+  if (demux->pull_cache && offset >= demux->pull_cache_offset &&
+      offset + size <=
+      demux->pull_cache_offset + gst_buffer_get_size (demux->pull_cache)) {
+    *buffer =
+        gst_buffer_copy_region (demux->pull_cache, GST_BUFFER_COPY_ALL,
+        offset - demux->pull_cache_offset, size);
+    return GST_FLOW_OK;
+  }
+
+  demux->n_pulls++;
+
+  if (size >= read_ahead) {
+    ret = gst_pad_pull_range (demux->sinkpad, offset, size, buffer);
+  } else {
+    if (demux->pull_cache) {
+      gst_buffer_unref (demux->pull_cache);
+      demux->pull_cache = NULL;
+    }
+
+    ret = gst_pad_pull_range (demux->sinkpad, offset, read_ahead,
+        &demux->pull_cache);
+    if (ret == GST_FLOW_OK) {
+      demux->pull_cache_offset = offset;
+
+      /* Less than read-ahead bytes are left before the end of the file */
+      if (gst_buffer_get_size (demux->pull_cache) < size)
+        *buffer = gst_buffer_ref (demux->pull_cache);
+      else
+        *buffer =
+            gst_buffer_copy_region (demux->pull_cache, GST_BUFFER_COPY_ALL, 0,
+            size);
+    } else {
+      demux->pull_cache = NULL;
+    }
+  }
 
-  ret = gst_pad_pull_range (demux->sinkpad, offset, size, buffer);
   if (G_UNLIKELY (ret != GST_FLOW_OK)) {
     GST_WARNING_OBJECT (demux,
         "failed when pulling %u bytes from offset %" G_GUINT64_FORMAT ": %s",
@@ -528,6 +607,16 @@ gst_mxf_demux_resolve_references (GstMXFDemux * demux)
   g_hash_table_iter_init (&iter, demux->metadata);
   while (g_hash_table_iter_next (&iter, NULL, (gpointer) & m)) {
     m->resolved = MXF_METADATA_BASE_RESOLVE_STATE_NONE;
+
+    /* In lazy mode DM segments resolve without the frameworks that are
+     * not parsed yet, but not without missing ones */
+    if (MXF_IS_METADATA_DM_SEGMENT (m)) {
+      MXFMetadataDMSegment *segment = MXF_METADATA_DM_SEGMENT (m);
+
+      segment->dm_framework_pending =
+          g_hash_table_contains (demux->pending_descriptive_metadata,
+          &segment->dm_framework_uid);
+    }
   }
 
   g_hash_table_iter_init (&iter, demux->metadata);
@@ -1341,6 +1430,144 @@ gst_mxf_demux_handle_metadata (GstMXFDemux * demux, const MXFUL * key,
   return ret;
 }
 
+static void
+gst_mxf_demux_descriptive_set_free (GstMXFDemuxDescriptiveSet * set)
+{
+  gst_buffer_unref (set->buffer);
+  g_slice_free (GstMXFDemuxDescriptiveSet, set);
+}
+
+/* Only remembers the descriptive metadata set by its instance UID, it is
+ * parsed by gst_mxf_demux_materialize_descriptive_metadata() */
+static GstFlowReturn
+gst_mxf_demux_index_descriptive_metadata (GstMXFDemux * demux,
+    const MXFUL * key, GstBuffer * buffer)
+{
+  GstMXFDemuxDescriptiveSet *set, *old;
+  MXFUUID instance_uid;
+  gboolean found = FALSE;
+  const guint8 *data, *tag_data;
+  guint16 tag, tag_size;
+  GstMapInfo map;
+  guint size;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  data = map.data;
+  size = map.size;
+  while (mxf_local_tag_parse (data, size, &tag, &tag_size, &tag_data)) {
+    if (tag == 0x3c0a && tag_size == 16) {
+      memcpy (&instance_uid, tag_data, 16);
+      found = TRUE;
+      break;
+    }
+
+    data += 4 + tag_size;
+    size -= 4 + tag_size;
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  if (!found) {
+    GST_WARNING_OBJECT (demux, "Descriptive metadata without instance uid");
+    return GST_FLOW_OK;
+  }
+
+  g_rw_lock_writer_lock (&demux->metadata_lock);
+
+  old = g_hash_table_lookup (demux->pending_descriptive_metadata,
+      &instance_uid);
+  if (old && old->offset >= demux->offset) {
+#ifndef GST_DISABLE_GST_DEBUG
+    gchar str[48];
+#endif
+
+    GST_DEBUG_OBJECT (demux,
+        "Metadata with instance uid %s already exists and is newer",
+        mxf_uuid_to_string (&instance_uid, str));
+    g_rw_lock_writer_unlock (&demux->metadata_lock);
+    return GST_FLOW_OK;
+  }
+
+  set = g_slice_new (GstMXFDemuxDescriptiveSet);
+  memcpy (&set->instance_uid, &instance_uid, sizeof (MXFUUID));
+  memcpy (&set->key, key, sizeof (MXFUL));
+  set->offset = demux->offset;
+  set->primer = &demux->current_partition->primer;
+  set->buffer = gst_buffer_ref (buffer);
+
+  g_hash_table_replace (demux->pending_descriptive_metadata,
+      &set->instance_uid, set);
+  g_rw_lock_writer_unlock (&demux->metadata_lock);
+
+  return GST_FLOW_OK;
+}
+
+/* Parses the descriptive metadata sets that were skipped in lazy mode and
+ * links the DM segments of the structural metadata to their frameworks */
+static void
+gst_mxf_demux_materialize_descriptive_metadata (GstMXFDemux * demux)
+{
+  GstMXFDemuxDescriptiveSet *set;
+  MXFMetadataBase *m;
+  GHashTableIter iter;
+
+  g_rw_lock_writer_lock (&demux->metadata_lock);
+
+  if (g_hash_table_size (demux->pending_descriptive_metadata) == 0)
+    goto out;
+
+  GST_DEBUG_OBJECT (demux, "Parsing %u descriptive metadata sets",
+      g_hash_table_size (demux->pending_descriptive_metadata));
+
+  g_hash_table_iter_init (&iter, demux->pending_descriptive_metadata);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer) & set)) {
+    MXFDescriptiveMetadata *dm;
+    MXFMetadataBase *old;
+    GstMapInfo map;
+
+    gst_buffer_map (set->buffer, &map, GST_MAP_READ);
+    dm = mxf_descriptive_metadata_new (GST_READ_UINT8 (set->key.u + 12),
+        GST_READ_UINT24_BE (set->key.u + 13), set->primer, set->offset,
+        map.data, map.size);
+    gst_buffer_unmap (set->buffer, &map);
+
+    if (!dm)
+      continue;
+
+    old = g_hash_table_lookup (demux->metadata, &set->instance_uid);
+    if (old && (G_TYPE_FROM_INSTANCE (old) != G_TYPE_FROM_INSTANCE (dm) ||
+            old->offset >= set->offset)) {
+      g_object_unref (dm);
+      continue;
+    }
+
+    g_hash_table_replace (demux->metadata,
+        &MXF_METADATA_BASE (dm)->instance_uid, dm);
+  }
+  g_hash_table_remove_all (demux->pending_descriptive_metadata);
+
+  g_hash_table_iter_init (&iter, demux->metadata);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer) & m)) {
+    MXFMetadataDMSegment *segment;
+    MXFMetadataBase *framework;
+
+    if (!MXF_IS_METADATA_DM_SEGMENT (m))
+      continue;
+
+    segment = MXF_METADATA_DM_SEGMENT (m);
+    if (segment->dm_framework)
+      continue;
+
+    framework =
+        g_hash_table_lookup (demux->metadata, &segment->dm_framework_uid);
+    if (framework && MXF_IS_DESCRIPTIVE_METADATA_FRAMEWORK (framework)
+        && mxf_metadata_base_resolve (framework, demux->metadata))
+      segment->dm_framework = MXF_DESCRIPTIVE_METADATA_FRAMEWORK (framework);
+  }
+
+out:
+  g_rw_lock_writer_unlock (&demux->metadata_lock);
+}
+
 static GstFlowReturn
 gst_mxf_demux_handle_descriptive_metadata (GstMXFDemux * demux,
     const MXFUL * key, GstBuffer * buffer)
@@ -1374,6 +1601,9 @@ gst_mxf_demux_handle_descriptive_metadata (GstMXFDemux * demux,
     return GST_FLOW_OK;
   }
 
+  if (demux->lazy_descriptive_metadata)
+    return gst_mxf_demux_index_descriptive_metadata (demux, key, buffer);
+
   gst_buffer_map (buffer, &map, GST_MAP_READ);
   m = mxf_descriptive_metadata_new (scheme, type,
       &demux->current_partition->primer, demux->offset, map.data, map.size);
@@ -1991,14 +2221,14 @@ gst_mxf_demux_handle_index_table_segment (GstMXFDemux * demux,
   return GST_FLOW_OK;
 }
 
+/* Pulls the key and the BER encoded length of the KLV packet at @offset.
+ * @data_offset is set to the offset of the value inside the packet */
 static GstFlowReturn
-gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
-    GstBuffer ** outbuf, guint * read)
+gst_mxf_demux_pull_klv_header (GstMXFDemux * demux, guint64 offset,
+    MXFUL * key, guint64 * length, guint * data_offset)
 {
   GstBuffer *buffer = NULL;
   const guint8 *data;
-  guint64 data_offset = 0;
-  guint64 length;
   GstFlowReturn ret = GST_FLOW_OK;
   GstMapInfo map;
 #ifndef GST_DISABLE_GST_DEBUG
@@ -2021,12 +2251,12 @@ gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
 
   /* Decode BER encoded packet length */
   if ((map.data[16] & 0x80) == 0) {
-    length = map.data[16];
-    data_offset = 17;
+    *length = map.data[16];
+    *data_offset = 17;
   } else {
     guint slen = map.data[16] & 0x7f;
 
-    data_offset = 16 + 1 + slen;
+    *data_offset = 16 + 1 + slen;
 
     gst_buffer_unmap (buffer, &map);
     gst_buffer_unref (buffer);
@@ -2047,17 +2277,38 @@ gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
     gst_buffer_map (buffer, &map, GST_MAP_READ);
 
     data = map.data;
-    length = 0;
+    *length = 0;
     while (slen) {
-      length = (length << 8) | *data;
+      *length = (*length << 8) | *data;
       data++;
       slen--;
     }
   }
 
   gst_buffer_unmap (buffer, &map);
-  gst_buffer_unref (buffer);
-  buffer = NULL;
+
+beach:
+  if (buffer)
+    gst_buffer_unref (buffer);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_mxf_demux_pull_klv_packet (GstMXFDemux * demux, guint64 offset, MXFUL * key,
+    GstBuffer ** outbuf, guint * read)
+{
+  GstBuffer *buffer = NULL;
+  guint data_offset = 0;
+  guint64 length;
+  GstFlowReturn ret = GST_FLOW_OK;
+#ifndef GST_DISABLE_GST_DEBUG
+  gchar str[48];
+#endif
+
+  if ((ret = gst_mxf_demux_pull_klv_header (demux, offset, key, &length,
+              &data_offset)) != GST_FLOW_OK)
+    goto beach;
 
   /* GStreamer's buffer sizes are stored in a guint so we
    * limit ourself to G_MAXUINT large buffers */
@@ -2458,6 +2709,464 @@ gst_mxf_demux_set_partition_for_offset (GstMXFDemux * demux, guint64 offset)
   }
 }
 
+/* Pulls the partition pack at @offset and the index table segments of its
+ * partition, and finds where the essence container data of the partition
+ * starts. @prev_partition is set to the previous partition as written in
+ * the pack: the partition list only links the partitions we know about */
+static GstMXFDemuxPartition *
+gst_mxf_demux_scan_partition (GstMXFDemux * demux, guint64 offset,
+    guint64 * prev_partition)
+{
+  guint64 old_offset = demux->offset;
+  GstMXFDemuxPartition *old_partition = demux->current_partition;
+  GstMXFDemuxPartition *p = NULL;
+  MXFPartitionPack partition;
+  GstBuffer *buffer = NULL;
+  GstMapInfo map;
+  MXFUL key;
+  guint read = 0;
+  guint data_offset = 0;
+  guint64 length;
+  gboolean res;
+
+  demux->offset = demux->run_in + offset;
+
+  if (gst_mxf_demux_pull_klv_packet (demux, demux->offset, &key, &buffer,
+          &read) != GST_FLOW_OK || !mxf_is_partition_pack (&key))
+    goto out;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  res = mxf_partition_pack_parse (&key, &partition, map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+  if (!res)
+    goto out;
+
+  *prev_partition = partition.prev_partition;
+  mxf_partition_pack_reset (&partition);
+
+  if (gst_mxf_demux_handle_partition_pack (demux, &key, buffer) != GST_FLOW_OK)
+    goto out;
+
+  p = demux->current_partition;
+  if (p->scanned)
+    goto out;
+
+  GST_DEBUG_OBJECT (demux, "Scanning partition at offset %" G_GUINT64_FORMAT,
+      offset);
+
+  demux->offset += read;
+  gst_buffer_unref (buffer);
+  buffer = NULL;
+
+  while (gst_mxf_demux_pull_klv_header (demux, demux->offset, &key, &length,
+          &data_offset) == GST_FLOW_OK) {
+    if (mxf_is_primer_pack (&key) && p->partition.header_byte_count != 0) {
+      /* The header byte count includes the primer pack */
+      demux->offset += p->partition.header_byte_count;
+      continue;
+    } else if (mxf_is_index_table_segment (&key)) {
+      if (gst_mxf_demux_pull_klv_packet (demux, demux->offset, &key, &buffer,
+              NULL) != GST_FLOW_OK)
+        break;
+      gst_mxf_demux_handle_index_table_segment (demux, &key, buffer);
+      gst_buffer_unref (buffer);
+      buffer = NULL;
+    } else if (!mxf_is_fill (&key) && !mxf_is_primer_pack (&key) &&
+        !mxf_is_metadata (&key) && !mxf_is_descriptive_metadata (&key)) {
+      if (p->partition.body_sid != 0 && p->essence_container_offset == 0 &&
+          !mxf_is_partition_pack (&key) && !mxf_is_random_index_pack (&key))
+        p->essence_container_offset =
+            demux->offset - demux->run_in - p->partition.this_partition;
+      break;
+    }
+
+    demux->offset += data_offset + length;
+  }
+
+  p->scanned = TRUE;
+
+out:
+  if (buffer)
+    gst_buffer_unref (buffer);
+
+  demux->offset = old_offset;
+  demux->current_partition = old_partition;
+
+  return p;
+}
+
+/* Moves the pending index table segments into the index tables, dropping
+ * the ones that were already repeated in another partition */
+static void
+gst_mxf_demux_collect_index_table_segments (GstMXFDemux * demux)
+{
+  GList *l, *walk;
+
+  for (l = demux->pending_index_table_segments; l; l = l->next) {
+    MXFIndexTableSegment *segment = l->data;
+    GstMXFDemuxIndexTable *table = NULL;
+    guint i;
+
+    for (walk = demux->index_tables; walk; walk = walk->next) {
+      GstMXFDemuxIndexTable *tmp = walk->data;
+
+      if (tmp->body_sid == segment->body_sid &&
+          tmp->index_sid == segment->index_sid) {
+        table = tmp;
+        break;
+      }
+    }
+
+    if (!table) {
+      table = g_new0 (GstMXFDemuxIndexTable, 1);
+      table->body_sid = segment->body_sid;
+      table->index_sid = segment->index_sid;
+      table->segments =
+          g_array_new (FALSE, FALSE, sizeof (MXFIndexTableSegment));
+      demux->index_tables = g_list_append (demux->index_tables, table);
+    }
+
+    for (i = 0; i < table->segments->len; i++) {
+      MXFIndexTableSegment *tmp =
+          &g_array_index (table->segments, MXFIndexTableSegment, i);
+
+      if (tmp->index_start_position >= segment->index_start_position)
+        break;
+    }
+
+    if (i < table->segments->len &&
+        g_array_index (table->segments, MXFIndexTableSegment,
+            i).index_start_position == segment->index_start_position) {
+      MXFIndexTableSegment *tmp =
+          &g_array_index (table->segments, MXFIndexTableSegment, i);
+
+      /* Keep the most complete copy */
+      if (segment->index_duration > tmp->index_duration) {
+        mxf_index_table_segment_reset (tmp);
+        memcpy (tmp, segment, sizeof (MXFIndexTableSegment));
+      } else {
+        mxf_index_table_segment_reset (segment);
+      }
+    } else {
+      g_array_insert_val (table->segments, i, *segment);
+    }
+
+    g_free (segment);
+  }
+
+  g_list_free (demux->pending_index_table_segments);
+  demux->pending_index_table_segments = NULL;
+}
+
+/* Pulls the index table segments of all partitions, walking backwards from
+ * the footer partition where they are usually written */
+static void
+gst_mxf_demux_pull_index_tables (GstMXFDemux * demux)
+{
+  GstMXFDemuxPartition *p;
+  guint64 offset, prev_partition = 0;
+  GList *l;
+
+  if (demux->pulled_index_tables)
+    return;
+  demux->pulled_index_tables = TRUE;
+
+  if (demux->footer_partition_pack_offset != 0) {
+    offset = demux->footer_partition_pack_offset;
+  } else if (demux->random_index_pack && demux->random_index_pack->len > 0) {
+    MXFRandomIndexPackEntry *entry =
+        &g_array_index (demux->random_index_pack, MXFRandomIndexPackEntry,
+        demux->random_index_pack->len - 1);
+    offset = entry->offset - demux->run_in;
+  } else if (demux->partitions) {
+    p = g_list_last (demux->partitions)->data;
+    offset = p->partition.this_partition;
+  } else {
+    return;
+  }
+
+  while ((p = gst_mxf_demux_scan_partition (demux, offset, &prev_partition))) {
+    if (offset == 0 || prev_partition >= offset)
+      break;
+    offset = prev_partition;
+  }
+
+  /* Partitions from the random index pack that are not linked */
+  for (l = demux->partitions; l; l = l->next) {
+    p = l->data;
+
+    if (!p->scanned)
+      gst_mxf_demux_scan_partition (demux, p->partition.this_partition,
+          &prev_partition);
+  }
+
+  gst_mxf_demux_collect_index_table_segments (demux);
+
+  GST_DEBUG_OBJECT (demux, "Have %u index tables",
+      g_list_length (demux->index_tables));
+}
+
+static GstMXFDemuxIndexTable *
+gst_mxf_demux_find_index_table (GstMXFDemux * demux, guint32 body_sid)
+{
+  GList *l;
+
+  for (l = demux->index_tables; l; l = l->next) {
+    GstMXFDemuxIndexTable *tmp = l->data;
+
+    if (tmp->body_sid == body_sid && tmp->segments->len > 0)
+      return tmp;
+  }
+
+  return NULL;
+}
+
+/* Looks up the edit unit @position, in index edit units, of @table and
+ * returns its offset inside the essence container, or -1. With @keyframe
+ * @position is moved back to the previous keyframe. @entry is NULL for
+ * constant bytes per element index tables */
+static guint64
+gst_mxf_demux_index_table_lookup (GstMXFDemux * demux,
+    GstMXFDemuxIndexTable * table, gint64 * position, gboolean keyframe,
+    const MXFIndexTableSegment ** segment, const MXFIndexEntry ** entry)
+{
+  gint64 pos = *position;
+
+  while (pos >= 0) {
+    const MXFIndexTableSegment *s;
+    const MXFIndexEntry *e;
+    guint lo = 0, hi = table->segments->len;
+
+    /* Last segment starting at or before pos */
+    while (hi - lo > 1) {
+      guint mid = (lo + hi) / 2;
+
+      if (g_array_index (table->segments, MXFIndexTableSegment,
+              mid).index_start_position <= pos)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    s = &g_array_index (table->segments, MXFIndexTableSegment, lo);
+    if (s->index_start_position > pos)
+      return -1;
+
+    if (s->edit_unit_byte_count != 0) {
+      guint64 stream_offset = 0;
+      gint64 start = 0;
+      guint i;
+
+      if (s->index_duration > 0
+          && pos >= s->index_start_position + s->index_duration)
+        return -1;
+
+      /* All edit units before pos have the size given by the segment
+       * they belong to */
+      for (i = 0; i <= lo; i++) {
+        const MXFIndexTableSegment *tmp =
+            &g_array_index (table->segments, MXFIndexTableSegment, i);
+        gint64 end;
+
+        if (tmp->edit_unit_byte_count == 0)
+          return -1;
+
+        end = (i == lo) ? pos : tmp->index_start_position + tmp->index_duration;
+        if (end > start) {
+          stream_offset += (end - start) * tmp->edit_unit_byte_count;
+          start = end;
+        }
+      }
+
+      *position = pos;
+      *segment = s;
+      *entry = NULL;
+      return stream_offset;
+    }
+
+    if (pos - s->index_start_position >= s->n_index_entries)
+      return -1;
+
+    e = &s->index_entries[pos - s->index_start_position];
+    if (keyframe && !(e->flags & 0x80)) {
+      /* Continue with the previous keyframe if the entry knows where it is */
+      if (e->key_frame_offset < 0)
+        pos += e->key_frame_offset;
+      else
+        pos--;
+      continue;
+    }
+
+    *position = pos;
+    *segment = s;
+    *entry = e;
+    return e->stream_offset;
+  }
+
+  return -1;
+}
+
+/* Converts an offset inside the essence container @body_sid to a file offset
+ * without run-in, or -1 */
+static guint64
+gst_mxf_demux_stream_offset_to_offset (GstMXFDemux * demux, guint32 body_sid,
+    guint64 stream_offset)
+{
+  GstMXFDemuxPartition *p = NULL;
+  GList *l;
+
+  for (l = demux->partitions; l; l = l->next) {
+    GstMXFDemuxPartition *tmp = l->data;
+
+    if (tmp->partition.body_sid != body_sid
+        || tmp->essence_container_offset == 0)
+      continue;
+
+    if (tmp->partition.body_offset <= stream_offset)
+      p = tmp;
+  }
+
+  if (!p)
+    return -1;
+
+  return p->partition.this_partition + p->essence_container_offset +
+      (stream_offset - p->partition.body_offset);
+}
+
+static gboolean
+gst_mxf_demux_is_essence_element_of_track (GstMXFDemuxEssenceTrack * etrack,
+    const MXFUL * key)
+{
+  if (!mxf_is_generic_container_essence_element (key) &&
+      !mxf_is_avid_essence_container_essence_element (key))
+    return FALSE;
+
+  return etrack->track_number == 0
+      || GST_READ_UINT32_BE (&key->u[12]) == etrack->track_number;
+}
+
+/* Finds the essence element of @etrack in the edit unit at @offset, first
+ * at the offsets given by the delta entries and otherwise by walking the
+ * KLV packets of the content package */
+static guint64
+gst_mxf_demux_find_essence_element_in_edit_unit (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, const MXFIndexTableSegment * segment,
+    const MXFIndexEntry * entry, guint64 offset)
+{
+  MXFUL key;
+  guint64 length;
+  guint data_offset;
+  guint i;
+
+  for (i = 0; i < segment->n_delta_entries; i++) {
+    const MXFDeltaEntry *delta = &segment->delta_entries[i];
+    guint64 element_offset = offset + delta->element_delta;
+
+    if (delta->slice > 0) {
+      if (!entry || delta->slice > segment->slice_count)
+        continue;
+      element_offset += entry->slice_offset[delta->slice - 1];
+    }
+
+    if (gst_mxf_demux_pull_klv_header (demux, demux->run_in + element_offset,
+            &key, &length, &data_offset) == GST_FLOW_OK
+        && gst_mxf_demux_is_essence_element_of_track (etrack, &key))
+      return element_offset;
+  }
+
+  /* A content package only has a few elements */
+  for (i = 0; i < 32; i++) {
+    if (gst_mxf_demux_pull_klv_header (demux, demux->run_in + offset, &key,
+            &length, &data_offset) != GST_FLOW_OK)
+      break;
+
+    if (gst_mxf_demux_is_essence_element_of_track (etrack, &key))
+      return offset;
+
+    if (!mxf_is_mxf_packet (&key) || mxf_is_partition_pack (&key)
+        || mxf_is_random_index_pack (&key))
+      break;
+
+    offset += data_offset + length;
+  }
+
+  return -1;
+}
+
+/* Looks up the essence element @position of @etrack in the index tables of
+ * the file and adds it to the track's index */
+static guint64
+gst_mxf_demux_find_essence_element_in_index_tables (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, gint64 * position, gboolean keyframe)
+{
+  GstMXFDemuxIndexTable *table;
+  const MXFIndexTableSegment *segment = NULL;
+  const MXFIndexEntry *entry = NULL;
+  const MXFFraction *index_rate, *track_rate = NULL;
+  GstMXFDemuxIndex *idx;
+  gint64 pos = *position;
+  guint64 offset;
+  gboolean rescale = FALSE;
+
+  gst_mxf_demux_pull_index_tables (demux);
+  gst_mxf_demux_collect_index_table_segments (demux);
+
+  table = gst_mxf_demux_find_index_table (demux, etrack->body_sid);
+  if (!table)
+    return -1;
+
+  /* The index table counts edit units at its own edit rate, which can
+   * differ from the track's, e.g. for audio indexed per video frame */
+  index_rate =
+      &g_array_index (table->segments, MXFIndexTableSegment, 0).index_edit_rate;
+  if (etrack->source_track && index_rate->n > 0 && index_rate->d > 0) {
+    track_rate = &etrack->source_track->edit_rate;
+    rescale = track_rate->n > 0 && track_rate->d > 0 &&
+        (guint64) index_rate->n * track_rate->d !=
+        (guint64) track_rate->n * index_rate->d;
+  }
+
+  if (rescale)
+    pos = gst_util_uint64_scale (pos,
+        (guint64) index_rate->n * track_rate->d,
+        (guint64) index_rate->d * track_rate->n);
+
+  offset =
+      gst_mxf_demux_index_table_lookup (demux, table, &pos, keyframe,
+      &segment, &entry);
+  if (offset == -1)
+    return -1;
+
+  if (rescale)
+    pos = gst_util_uint64_scale (pos,
+        (guint64) track_rate->n * index_rate->d,
+        (guint64) track_rate->d * index_rate->n);
+
+  offset =
+      gst_mxf_demux_stream_offset_to_offset (demux, etrack->body_sid, offset);
+  if (offset == -1)
+    return -1;
+
+  offset =
+      gst_mxf_demux_find_essence_element_in_edit_unit (demux, etrack, segment,
+      entry, offset);
+  if (offset == -1)
+    return -1;
+
+  if (!etrack->offsets)
+    etrack->offsets = g_array_new (FALSE, TRUE, sizeof (GstMXFDemuxIndex));
+  if (etrack->offsets->len <= pos)
+    g_array_set_size (etrack->offsets, pos + 1);
+
+  idx = &g_array_index (etrack->offsets, GstMXFDemuxIndex, pos);
+  idx->offset = offset;
+  idx->keyframe = !entry || (entry->flags & 0x80);
+
+  *position = pos;
+
+  return offset;
+}
+
 static guint64
 gst_mxf_demux_find_essence_element (GstMXFDemux * demux,
     GstMXFDemuxEssenceTrack * etrack, gint64 * position, gboolean keyframe)
@@ -2536,6 +3245,16 @@ from_index:
       return new_offset;
     }
   } else if (demux->random_access) {
+    guint64 new_offset =
+        gst_mxf_demux_find_essence_element_in_index_tables (demux, etrack,
+        position, keyframe);
+
+    if (new_offset != -1) {
+      GST_DEBUG_OBJECT (demux, "Found in index table at offset %"
+          G_GUINT64_FORMAT, new_offset);
+      return new_offset;
+    }
+
     demux->offset = demux->run_in;
     if (etrack->offsets && etrack->offsets->len) {
       for (i = etrack->offsets->len - 1; i >= 0; i--) {
@@ -3958,6 +4677,12 @@ gst_mxf_demux_set_property (GObject * object, guint prop_id,
     case PROP_MAX_DRIFT:
       demux->max_drift = g_value_get_uint64 (value);
       break;
+    case PROP_LAZY_DESCRIPTIVE_METADATA:
+      demux->lazy_descriptive_metadata = g_value_get_boolean (value);
+      break;
+    case PROP_READ_AHEAD:
+      demux->read_ahead = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -3980,6 +4705,8 @@ gst_mxf_demux_get_property (GObject * object, guint prop_id,
     case PROP_STRUCTURE:{
       GstStructure *s;
 
+      gst_mxf_demux_materialize_descriptive_metadata (demux);
+
       g_rw_lock_reader_lock (&demux->metadata_lock);
       if (demux->preface)
         s = mxf_metadata_base_to_structure (MXF_METADATA_BASE (demux->preface));
@@ -3994,6 +4721,18 @@ gst_mxf_demux_get_property (GObject * object, guint prop_id,
       g_rw_lock_reader_unlock (&demux->metadata_lock);
       break;
     }
+    case PROP_LAZY_DESCRIPTIVE_METADATA:
+      g_value_set_boolean (value, demux->lazy_descriptive_metadata);
+      break;
+    case PROP_READ_AHEAD:
+      g_value_set_uint (value, demux->read_ahead);
+      break;
+    case PROP_READ_COUNT:
+      g_value_set_uint64 (value, demux->n_reads);
+      break;
+    case PROP_PULL_COUNT:
+      g_value_set_uint64 (value, demux->n_pulls);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -4028,6 +4767,7 @@ gst_mxf_demux_finalize (GObject * object)
   demux->essence_tracks = NULL;
 
   g_hash_table_destroy (demux->metadata);
+  g_hash_table_destroy (demux->pending_descriptive_metadata);
 
   g_rw_lock_clear (&demux->metadata_lock);
 
@@ -4064,6 +4804,30 @@ gst_mxf_demux_class_init (GstMXFDemuxClass * klass)
           "Structural metadata of the MXF file",
           GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class,
+      PROP_LAZY_DESCRIPTIVE_METADATA,
+      g_param_spec_boolean ("lazy-descriptive-metadata",
+          "Lazy descriptive metadata",
+          "Only parse the descriptive metadata when it is requested, "
+          "e.g. by reading the structure property", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_READ_AHEAD,
+      g_param_spec_uint ("read-ahead", "Read ahead",
+          "Number of bytes pulled at once in pull mode to serve the reads of "
+          "small KLV packets (0 = disabled)", 0, 64 * 1024 * 1024,
+          DEFAULT_READ_AHEAD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_READ_COUNT,
+      g_param_spec_uint64 ("read-count", "Read count",
+          "Number of reads done in pull mode", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PULL_COUNT,
+      g_param_spec_uint64 ("pull-count", "Pull count",
+          "Number of buffers pulled from upstream in pull mode", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mxf_demux_change_state);
   gstelement_class->query = GST_DEBUG_FUNCPTR (gst_mxf_demux_query);
@@ -4095,9 +4859,14 @@ gst_mxf_demux_init (GstMXFDemux * demux)
   gst_element_add_pad (GST_ELEMENT (demux), demux->sinkpad);
 
   demux->max_drift = 500 * GST_MSECOND;
+  demux->read_ahead = DEFAULT_READ_AHEAD;
 
   demux->adapter = gst_adapter_new ();
   g_rw_lock_init (&demux->metadata_lock);
+  demux->pending_descriptive_metadata =
+      g_hash_table_new_full ((GHashFunc) mxf_uuid_hash,
+      (GEqualFunc) mxf_uuid_is_equal, NULL,
+      (GDestroyNotify) gst_mxf_demux_descriptive_set_free);
 
   demux->src = g_ptr_array_new ();
   demux->essence_tracks =
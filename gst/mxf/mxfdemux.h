@@ -53,14 +53,37 @@ typedef struct
   MXFPrimerPack primer;
   gboolean parsed_metadata;
   guint64 essence_container_offset;
+
+  /* Partition pack, index table segments and start of the
+   * essence container were pulled by gst_mxf_demux_scan_partition() */
+  gboolean scanned;
 } GstMXFDemuxPartition;
 
+typedef struct
+{
+  guint32 body_sid;
+  guint32 index_sid;
+
+  /* MXFIndexTableSegment, sorted by index_start_position */
+  GArray *segments;
+} GstMXFDemuxIndexTable;
+
 typedef struct
 {
   guint64 offset;
   gboolean keyframe;
 } GstMXFDemuxIndex;
 
+/* A descriptive metadata set that is only parsed when needed */
+typedef struct
+{
+  MXFUUID instance_uid;
+  MXFUL key;
+  guint64 offset;
+  MXFPrimerPack *primer;
+  GstBuffer *buffer;
+} GstMXFDemuxDescriptiveSet;
+
 typedef struct
 {
   guint32 body_sid;
@@ -136,6 +159,11 @@ struct _GstMXFDemux
 
   guint64 offset;
 
+  /* Read-ahead window of pull mode */
+  GstBuffer *pull_cache;
+  guint64 pull_cache_offset;
+  guint64 n_reads, n_pulls;
+
   gboolean random_access;
   gboolean flushing;
 
@@ -150,6 +178,8 @@ struct _GstMXFDemux
 
   GArray *essence_tracks;
   GList *pending_index_table_segments;
+  GList *index_tables;
+  gboolean pulled_index_tables;
 
   GArray *random_index_pack;
 
@@ -161,6 +191,8 @@ struct _GstMXFDemux
   gboolean metadata_resolved;
   MXFMetadataPreface *preface;
   GHashTable *metadata;
+  /* GstMXFDemuxDescriptiveSet by instance UID, in lazy mode */
+  GHashTable *pending_descriptive_metadata;
 
   MXFUMID current_package_uid;
   MXFMetadataGenericPackage *current_package;
@@ -171,6 +203,8 @@ struct _GstMXFDemux
   /* Properties */
   gchar *requested_package_string;
   GstClockTime max_drift;
+  gboolean lazy_descriptive_metadata;
+  guint read_ahead;
 };
 
 struct _GstMXFDemuxClass
@@ -1718,7 +1718,7 @@ mxf_metadata_essence_container_data_write_tags (MXFMetadataBase * m,
     t->data = g_slice_alloc (4);
     t->g_slice = TRUE;
     GST_WRITE_UINT32_BE (t->data, self->index_sid);
-    mxf_primer_pack_add_mapping (primer, 0x3f07, &t->ul);
+    mxf_primer_pack_add_mapping (primer, 0x3f06, &t->ul);
     ret = g_list_prepend (ret, t);
   }
 
@@ -3774,6 +3774,11 @@ mxf_metadata_dm_segment_resolve (MXFMetadataBase * m, GHashTable * metadata)
           mxf_uuid_to_string (&self->dm_framework_uid, str));
       return FALSE;
     }
+  } else if (self->dm_framework_pending) {
+    /* It is linked once it was parsed */
+    GST_DEBUG ("DM framework %s not parsed yet",
+        mxf_uuid_to_string (&self->dm_framework_uid, str));
+    self->dm_framework = NULL;
   } else {
     GST_ERROR ("Couldn't find DM framework %s",
         mxf_uuid_to_string (&self->dm_framework_uid, str));
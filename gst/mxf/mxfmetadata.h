@@ -614,6 +614,9 @@ struct _MXFMetadataDMSegment {
       
   MXFUUID dm_framework_uid;
   MXFDescriptiveMetadataFramework *dm_framework;
+
+  /* Set by mxfdemux when the framework is only parsed on request */
+  gboolean dm_framework_pending;
 };
 
 struct _MXFMetadataGenericDescriptor {
@@ -166,6 +166,7 @@ gst_mxf_mux_finalize (GObject * object)
     mux->metadata_list = NULL;
   }
 
+  g_array_free (mux->index_table, TRUE);
   gst_object_unref (mux->collect);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -228,6 +229,12 @@ gst_mxf_mux_reset (GstMXFMux * mux)
   mux->last_gc_timestamp = 0;
   mux->last_gc_position = 0;
   mux->offset = 0;
+  mux->essence_offset = 0;
+
+  if (mux->index_table)
+    g_array_set_size (mux->index_table, 0);
+  else
+    mux->index_table = g_array_new (FALSE, TRUE, sizeof (MXFIndexEntry));
 }
 
 static gboolean
@@ -946,7 +953,7 @@ gst_mxf_mux_create_metadata (GstMXFMux * mux)
 
     cstorage->essence_container_data[0]->linked_package =
         MXF_METADATA_SOURCE_PACKAGE (cstorage->packages[1]);
-    cstorage->essence_container_data[0]->index_sid = 0;
+    cstorage->essence_container_data[0]->index_sid = 2;
     cstorage->essence_container_data[0]->body_sid = 1;
   }
 
@@ -1151,6 +1158,20 @@ gst_mxf_mux_handle_buffer (GstMXFMux * mux, GstMXFMuxPad * cpad)
   if (buf == NULL)
     return ret;
 
+  /* The first element of a content package starts a new index entry, which
+   * stays a random access point unless one of the elements is a delta
+   * unit */
+  while (mux->index_table->len <= mux->last_gc_position) {
+    MXFIndexEntry entry = { 0, };
+
+    entry.stream_offset = mux->offset - mux->essence_offset;
+    entry.flags = 0x80;
+    g_array_append_val (mux->index_table, entry);
+  }
+  if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT))
+    g_array_index (mux->index_table, MXFIndexEntry,
+        mux->last_gc_position).flags &= ~0x80;
+
   gst_buffer_map (buf, &readmap, GST_MAP_READ);
   slen = mxf_ber_encode_size (readmap.size, ber);
   packet = gst_buffer_new_and_alloc (16 + slen + readmap.size);
@@ -1188,6 +1209,7 @@ static GstFlowReturn
 gst_mxf_mux_write_body_partition (GstMXFMux * mux)
 {
   GstBuffer *buf;
+  GstFlowReturn ret;
 
   mux->partition.type = MXF_PARTITION_PACK_BODY;
   mux->partition.this_partition = mux->offset;
@@ -1201,7 +1223,97 @@ gst_mxf_mux_write_body_partition (GstMXFMux * mux)
       mux->preface->content_storage->essence_container_data[0]->body_sid;
 
   buf = mxf_partition_pack_to_buffer (&mux->partition);
-  return gst_mxf_mux_push (mux, buf);
+  ret = gst_mxf_mux_push (mux, buf);
+  mux->essence_offset = mux->offset;
+
+  return ret;
+}
+
+/* Creates the index table segments for the whole essence container. All
+ * content packages having the same size gives a constant edit unit size
+ * (CBE) index without entries, otherwise there is one entry per content
+ * package (VBE), split into as many segments as needed */
+static GList *
+gst_mxf_mux_create_index_table (GstMXFMux * mux, guint64 essence_size,
+    guint64 * index_byte_count)
+{
+  MXFMetadataEssenceContainerData *ecd =
+      mux->preface->content_storage->essence_container_data[0];
+  MXFIndexEntry *entries = (MXFIndexEntry *) mux->index_table->data;
+  guint n_entries = mux->index_table->len;
+  MXFIndexTableSegment segment;
+  guint64 edit_unit_byte_count = 0;
+  gboolean cbe = TRUE;
+  gint64 last_keyframe = -1;
+  GList *buffers = NULL;
+  GstBuffer *buf;
+  guint i, max_entries;
+
+  *index_byte_count = 0;
+
+  if (n_entries == 0)
+    return NULL;
+
+  for (i = 0; i < n_entries; i++) {
+    guint64 end =
+        (i + 1 < n_entries) ? entries[i + 1].stream_offset : essence_size;
+    guint64 size = end - entries[i].stream_offset;
+
+    if (i == 0)
+      edit_unit_byte_count = size;
+    else if (size != edit_unit_byte_count)
+      cbe = FALSE;
+
+    if (entries[i].flags & 0x80) {
+      last_keyframe = i;
+      entries[i].key_frame_offset = 0;
+    } else {
+      /* a CBE index can't tell which edit units are random access points */
+      cbe = FALSE;
+      entries[i].key_frame_offset =
+          (last_keyframe >= 0) ? MAX (last_keyframe - (gint64) i, -128) : 0;
+    }
+  }
+
+  if (edit_unit_byte_count == 0 || edit_unit_byte_count > G_MAXUINT32)
+    cbe = FALSE;
+
+  memset (&segment, 0, sizeof (segment));
+  memcpy (&segment.index_edit_rate, &mux->min_edit_rate, sizeof (MXFFraction));
+  segment.index_sid = ecd->index_sid;
+  segment.body_sid = ecd->body_sid;
+
+  if (cbe) {
+    GST_DEBUG_OBJECT (mux, "Writing CBE index, %u edit units of %"
+        G_GUINT64_FORMAT " bytes", n_entries, edit_unit_byte_count);
+
+    mxf_uuid_init (&segment.instance_id, mux->metadata);
+    segment.index_start_position = 0;
+    segment.index_duration = n_entries;
+    segment.edit_unit_byte_count = edit_unit_byte_count;
+
+    buf = mxf_index_table_segment_to_buffer (&segment);
+    *index_byte_count += gst_buffer_get_size (buf);
+    return g_list_prepend (NULL, buf);
+  }
+
+  GST_DEBUG_OBJECT (mux, "Writing VBE index with %u entries", n_entries);
+
+  /* the entries of a segment must fit into a local tag */
+  max_entries = (G_MAXUINT16 - 8) / 11;
+  for (i = 0; i < n_entries; i += max_entries) {
+    mxf_uuid_init (&segment.instance_id, mux->metadata);
+    segment.index_start_position = i;
+    segment.index_duration = MIN (max_entries, n_entries - i);
+    segment.n_index_entries = segment.index_duration;
+    segment.index_entries = entries + i;
+
+    buf = mxf_index_table_segment_to_buffer (&segment);
+    *index_byte_count += gst_buffer_get_size (buf);
+    buffers = g_list_prepend (buffers, buf);
+  }
+
+  return g_list_reverse (buffers);
 }
 
 static GstFlowReturn
@@ -1303,6 +1415,11 @@ gst_mxf_mux_handle_eos (GstMXFMux * mux)
     GstFlowReturn ret;
     GstSegment segment;
     MXFRandomIndexPackEntry entry;
+    GList *index_buffers, *walk;
+    guint64 index_byte_count;
+
+    index_buffers = gst_mxf_mux_create_index_table (mux,
+        footer_partition - mux->essence_offset, &index_byte_count);
 
     mux->partition.type = MXF_PARTITION_PACK_FOOTER;
     mux->partition.closed = TRUE;
@@ -1311,13 +1428,20 @@ gst_mxf_mux_handle_eos (GstMXFMux * mux)
     mux->partition.prev_partition = body_partition;
     mux->partition.footer_partition = mux->offset;
     mux->partition.header_byte_count = 0;
-    mux->partition.index_byte_count = 0;
-    mux->partition.index_sid = 0;
+    mux->partition.index_byte_count = index_byte_count;
+    mux->partition.index_sid = index_buffers ?
+        mux->preface->content_storage->essence_container_data[0]->index_sid : 0;
     mux->partition.body_offset = 0;
     mux->partition.body_sid = 0;
 
     gst_mxf_mux_write_header_metadata (mux);
 
+    for (walk = index_buffers; walk; walk = walk->next) {
+      if ((ret = gst_mxf_mux_push (mux, walk->data)) != GST_FLOW_OK)
+        GST_ERROR_OBJECT (mux, "Failed pushing index table segment");
+    }
+    g_list_free (index_buffers);
+
     rip = g_array_sized_new (FALSE, FALSE, sizeof (MXFRandomIndexPackEntry), 3);
     entry.offset = 0;
     entry.body_sid = 0;
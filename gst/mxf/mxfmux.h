@@ -92,6 +92,11 @@ typedef struct _GstMXFMux {
   guint64 last_gc_position;
   GstClockTime last_gc_timestamp;
 
+  /* offset of the first essence element in the body partition */
+  guint64 essence_offset;
+  /* MXFIndexEntry for each content package, written to the footer */
+  GArray *index_table;
+
   gchar *application;
 } GstMXFMux;
 
@@ -1307,6 +1307,140 @@ mxf_index_table_segment_reset (MXFIndexTableSegment * segment)
   memset (segment, 0, sizeof (MXFIndexTableSegment));
 }
 
+/* SMPTE 377M 10.2.3. The index entries of the segment must fit into the
+ * 16 bit length of a local tag */
+GstBuffer *
+mxf_index_table_segment_to_buffer (const MXFIndexTableSegment * segment)
+{
+  guint slen;
+  guint8 ber[9];
+  GstBuffer *ret;
+  GstMapInfo map;
+  guint8 *data;
+  guint i, j;
+  guint entry_size =
+      11 + 4 * segment->slice_count + 8 * segment->pos_table_count;
+  guint size;
+
+  g_return_val_if_fail (8 + segment->n_index_entries * entry_size <= 0xffff,
+      NULL);
+  g_return_val_if_fail (8 + segment->n_delta_entries * 6 <= 0xffff, NULL);
+
+  size = (4 + 16) + (4 + 8) + (4 + 8) + (4 + 8) + (4 + 4) + (4 + 4) +
+      (4 + 4) + (4 + 1) + (4 + 1);
+  if (segment->n_delta_entries > 0)
+    size += 4 + 8 + 6 * segment->n_delta_entries;
+  if (segment->n_index_entries > 0)
+    size += 4 + 8 + entry_size * segment->n_index_entries;
+
+  slen = mxf_ber_encode_size (size, ber);
+
+  ret = gst_buffer_new_and_alloc (16 + slen + size);
+  gst_buffer_map (ret, &map, GST_MAP_WRITE);
+
+  memcpy (map.data, MXF_UL (INDEX_TABLE_SEGMENT), 16);
+  memcpy (map.data + 16, ber, slen);
+
+  data = map.data + 16 + slen;
+
+  GST_WRITE_UINT16_BE (data, 0x3c0a);
+  GST_WRITE_UINT16_BE (data + 2, 16);
+  memcpy (data + 4, &segment->instance_id, 16);
+  data += 20;
+
+  GST_WRITE_UINT16_BE (data, 0x3f0b);
+  GST_WRITE_UINT16_BE (data + 2, 8);
+  GST_WRITE_UINT32_BE (data + 4, segment->index_edit_rate.n);
+  GST_WRITE_UINT32_BE (data + 8, segment->index_edit_rate.d);
+  data += 12;
+
+  GST_WRITE_UINT16_BE (data, 0x3f0c);
+  GST_WRITE_UINT16_BE (data + 2, 8);
+  GST_WRITE_UINT64_BE (data + 4, segment->index_start_position);
+  data += 12;
+
+  GST_WRITE_UINT16_BE (data, 0x3f0d);
+  GST_WRITE_UINT16_BE (data + 2, 8);
+  GST_WRITE_UINT64_BE (data + 4, segment->index_duration);
+  data += 12;
+
+  GST_WRITE_UINT16_BE (data, 0x3f05);
+  GST_WRITE_UINT16_BE (data + 2, 4);
+  GST_WRITE_UINT32_BE (data + 4, segment->edit_unit_byte_count);
+  data += 8;
+
+  GST_WRITE_UINT16_BE (data, 0x3f06);
+  GST_WRITE_UINT16_BE (data + 2, 4);
+  GST_WRITE_UINT32_BE (data + 4, segment->index_sid);
+  data += 8;
+
+  GST_WRITE_UINT16_BE (data, 0x3f07);
+  GST_WRITE_UINT16_BE (data + 2, 4);
+  GST_WRITE_UINT32_BE (data + 4, segment->body_sid);
+  data += 8;
+
+  GST_WRITE_UINT16_BE (data, 0x3f08);
+  GST_WRITE_UINT16_BE (data + 2, 1);
+  GST_WRITE_UINT8 (data + 4, segment->slice_count);
+  data += 5;
+
+  GST_WRITE_UINT16_BE (data, 0x3f0e);
+  GST_WRITE_UINT16_BE (data + 2, 1);
+  GST_WRITE_UINT8 (data + 4, segment->pos_table_count);
+  data += 5;
+
+  if (segment->n_delta_entries > 0) {
+    GST_WRITE_UINT16_BE (data, 0x3f09);
+    GST_WRITE_UINT16_BE (data + 2, 8 + 6 * segment->n_delta_entries);
+    GST_WRITE_UINT32_BE (data + 4, segment->n_delta_entries);
+    GST_WRITE_UINT32_BE (data + 8, 6);
+    data += 12;
+
+    for (i = 0; i < segment->n_delta_entries; i++) {
+      const MXFDeltaEntry *entry = &segment->delta_entries[i];
+
+      GST_WRITE_UINT8 (data, entry->pos_table_index);
+      GST_WRITE_UINT8 (data + 1, entry->slice);
+      GST_WRITE_UINT32_BE (data + 2, entry->element_delta);
+      data += 6;
+    }
+  }
+
+  if (segment->n_index_entries > 0) {
+    GST_WRITE_UINT16_BE (data, 0x3f0a);
+    GST_WRITE_UINT16_BE (data + 2,
+        8 + entry_size * segment->n_index_entries);
+    GST_WRITE_UINT32_BE (data + 4, segment->n_index_entries);
+    GST_WRITE_UINT32_BE (data + 8, entry_size);
+    data += 12;
+
+    for (i = 0; i < segment->n_index_entries; i++) {
+      const MXFIndexEntry *entry = &segment->index_entries[i];
+
+      GST_WRITE_UINT8 (data, entry->temporal_offset);
+      GST_WRITE_UINT8 (data + 1, entry->key_frame_offset);
+      GST_WRITE_UINT8 (data + 2, entry->flags);
+      GST_WRITE_UINT64_BE (data + 3, entry->stream_offset);
+      data += 11;
+
+      for (j = 0; j < segment->slice_count; j++) {
+        GST_WRITE_UINT32_BE (data, entry->slice_offset[j]);
+        data += 4;
+      }
+
+      for (j = 0; j < segment->pos_table_count; j++) {
+        GST_WRITE_UINT32_BE (data, entry->pos_table[j].n);
+        GST_WRITE_UINT32_BE (data + 4, entry->pos_table[j].d);
+        data += 8;
+      }
+    }
+  }
+
+  gst_buffer_unmap (ret, &map);
+
+  return ret;
+}
+
 /* SMPTE 377M 8.2 Table 1 and 2 */
 
 static void
@@ -149,12 +149,23 @@ gst_h264_parse_init (GstH264Parse * h264parse)
 }
 
 
+static void
+gst_h264_parse_release_prefix_block (GstH264Parse * h264parse)
+{
+  if (h264parse->prefix_block) {
+    gst_memory_unmap (h264parse->prefix_block, &h264parse->prefix_map);
+    gst_memory_unref (h264parse->prefix_block);
+    h264parse->prefix_block = NULL;
+  }
+}
+
 static void
 gst_h264_parse_finalize (GObject * object)
 {
   GstH264Parse *h264parse = GST_H264_PARSE (object);
 
   g_object_unref (h264parse->frame_out);
+  gst_h264_parse_release_prefix_block (h264parse);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -193,6 +204,7 @@ gst_h264_parse_reset (GstH264Parse * h264parse)
   h264parse->nal_length_size = 4;
   h264parse->packetized = FALSE;
   h264parse->transform = FALSE;
+  h264parse->avc_passthrough = FALSE;
 
   h264parse->align = GST_H264_PARSE_ALIGN_NONE;
   h264parse->format = GST_H264_PARSE_FORMAT_NONE;
@@ -248,6 +260,7 @@ gst_h264_parse_stop (GstBaseParse * parse)
     gst_buffer_replace (&h264parse->pps_nals[i], NULL);
 
   gst_h264_nal_parser_free (h264parse->nalparser);
+  gst_h264_parse_release_prefix_block (h264parse);
 
   return TRUE;
 }
@@ -395,6 +408,113 @@ gst_h264_parse_wrap_nal (GstH264Parse * h264parse, guint format, guint8 * data,
   return buf;
 }
 
+/* Transformed NALs are made of a small prefix memory followed by the
+ * payload shared from the input buffer, so that converting a frame does
+ * not copy it. The prefixes are all carved from one block to save an
+ * allocation per NAL, and NALs up to COPY_NAL_MAX_SIZE (SPS, PPS, SEI, ...)
+ * are copied right after their prefix, which is cheaper than one more
+ * memory in the output buffer. */
+#define PREFIX_BLOCK_SIZE 4096
+#define COPY_NAL_MAX_SIZE 256
+
+/* Copies the NALs in @nals into a single memory, and unrefs them */
+static GstMemory *
+gst_h264_parse_merge_nals (GList * nals)
+{
+  GstMemory *mem;
+  GstMapInfo map;
+  GList *walk;
+  gsize size = 0, offset = 0;
+
+  for (walk = nals; walk; walk = walk->next)
+    size += gst_buffer_get_size (walk->data);
+
+  GST_LOG ("copying %u NALs of %" G_GSIZE_FORMAT " bytes",
+      g_list_length (nals), size);
+  mem = gst_allocator_alloc (NULL, size, NULL);
+  gst_memory_map (mem, &map, GST_MAP_WRITE);
+  for (walk = nals; walk; walk = walk->next) {
+    offset += gst_buffer_extract (walk->data, 0, map.data + offset,
+        size - offset);
+    gst_buffer_unref (walk->data);
+  }
+  gst_memory_unmap (mem, &map);
+
+  return mem;
+}
+
+static gboolean
+gst_h264_parse_buffer_is_shareable (GstBuffer * buffer)
+{
+  guint i, n = gst_buffer_n_memory (buffer);
+
+  for (i = 0; i < n; i++)
+    if (GST_MEMORY_FLAG_IS_SET (gst_buffer_peek_memory (buffer, i),
+            GST_MEMORY_FLAG_NO_SHARE))
+      return FALSE;
+
+  return TRUE;
+}
+
+static GstBuffer *
+gst_h264_parse_wrap_nal_shared (GstH264Parse * h264parse, GstBuffer * src,
+    GstH264NalUnit * nalu)
+{
+  GstBuffer *buf;
+  guint nl = h264parse->nal_length_size;
+  guint size = nalu->size;
+  guint copy = size <= COPY_NAL_MAX_SIZE ? size : 0;
+  guint8 prefix[4];
+  guint8 *dest;
+
+  /* the adapter data baseparse hands out in push mode can not be shared, a
+   * single copy with the prefix then beats a prefix memory and a copy */
+  if (!copy && !gst_h264_parse_buffer_is_shareable (src))
+    return gst_h264_parse_wrap_nal (h264parse, h264parse->format,
+        nalu->data + nalu->offset, size);
+
+  if (h264parse->format == GST_H264_PARSE_FORMAT_AVC) {
+    GST_WRITE_UINT32_BE (prefix, size << (32 - 8 * nl));
+  } else {
+    /* same as in _wrap_nal() */
+    nl = 4;
+    GST_WRITE_UINT32_BE (prefix, 1);
+  }
+
+  if (h264parse->prefix_block == NULL ||
+      h264parse->prefix_used + nl + copy > h264parse->prefix_map.size) {
+    gst_h264_parse_release_prefix_block (h264parse);
+    h264parse->prefix_block =
+        gst_allocator_alloc (NULL, PREFIX_BLOCK_SIZE, NULL);
+    /* stays mapped until used up, the parts that were handed out are never
+     * written again */
+    if (!gst_memory_map (h264parse->prefix_block, &h264parse->prefix_map,
+            GST_MAP_WRITE)) {
+      gst_memory_unref (h264parse->prefix_block);
+      h264parse->prefix_block = NULL;
+      return gst_h264_parse_wrap_nal (h264parse, h264parse->format,
+          nalu->data + nalu->offset, size);
+    }
+    h264parse->prefix_used = 0;
+  }
+
+  dest = h264parse->prefix_map.data + h264parse->prefix_used;
+  memcpy (dest, prefix, nl);
+  if (copy)
+    memcpy (dest + nl, nalu->data + nalu->offset, copy);
+
+  buf = gst_buffer_new ();
+  gst_buffer_append_memory (buf, gst_memory_share (h264parse->prefix_block,
+          h264parse->prefix_used, nl + copy));
+  h264parse->prefix_used += nl + copy;
+
+  if (!copy)
+    gst_buffer_copy_into (buf, src, GST_BUFFER_COPY_MEMORY, nalu->offset,
+        size);
+
+  return buf;
+}
+
 static void
 gst_h264_parser_store_nal (GstH264Parse * h264parse, guint id,
     GstH264NalUnitType naltype, GstH264NalUnit * nalu)
@@ -431,6 +551,23 @@ gst_h264_parser_store_nal (GstH264Parse * h264parse, guint id,
  * so downstream waiting for keyframe can pick up at SPS/PPS/IDR */
 #define NAL_TYPE_IS_KEY(nt) (((nt) == 5) || ((nt) == 7) || ((nt) == 8))
 
+/* mark where config needs to go if interval expired */
+static void
+gst_h264_parse_mark_idr (GstH264Parse * h264parse, gint pos)
+{
+  if (h264parse->idr_pos == -1) {
+    h264parse->idr_pos = pos;
+    GST_DEBUG_OBJECT (h264parse, "marking IDR in frame at offset %d",
+        h264parse->idr_pos);
+  }
+  /* if SEI preceeds (faked) IDR, then we have to insert config there */
+  if (h264parse->sei_pos >= 0 && h264parse->idr_pos > h264parse->sei_pos) {
+    h264parse->idr_pos = h264parse->sei_pos;
+    GST_DEBUG_OBJECT (h264parse, "moved IDR mark to SEI position %d",
+        h264parse->idr_pos);
+  }
+}
+
 /* caller guarantees 2 bytes of nal payload */
 static void
 gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
@@ -545,15 +682,17 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       }
       GST_DEBUG_OBJECT (h264parse, "frame start: %i", h264parse->frame_start);
 #ifndef GST_DISABLE_GST_DEBUG
-      {
+      /* only for logging, the rest of the header is of no use here */
+      if (gst_debug_category_get_threshold (GST_CAT_DEFAULT) >=
+          GST_LEVEL_DEBUG) {
         GstH264SliceHdr slice;
         GstH264ParserResult pres;
 
-        pres = gst_h264_parser_parse_slice_hdr (nalparser, nalu, &slice,
-            FALSE, FALSE);
+        pres = gst_h264_parser_parse_slice_hdr_depth (nalparser, nalu, &slice,
+            GST_H264_SLICE_HDR_PARSE_HEADER);
         GST_DEBUG_OBJECT (h264parse,
-            "parse result %d, first MB: %u, slice type: %u",
-            pres, slice.first_mb_in_slice, slice.type);
+            "parse result %d, first MB: %u, slice type: %u, frame num: %u",
+            pres, slice.first_mb_in_slice, slice.type, slice.frame_num);
       }
 #endif
       if (G_LIKELY (nal_type != GST_H264_NAL_SLICE_IDR &&
@@ -562,22 +701,12 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       /* if we need to sneak codec NALs into the stream,
        * this is a good place, so fake it as IDR
        * (which should be at start anyway) */
-      /* mark where config needs to go if interval expired */
       /* mind replacement buffer if applicable */
-      if (h264parse->idr_pos == -1) {
-        if (h264parse->transform)
-          h264parse->idr_pos = gst_adapter_available (h264parse->frame_out);
-        else
-          h264parse->idr_pos = nalu->sc_offset;
-        GST_DEBUG_OBJECT (h264parse, "marking IDR in frame at offset %d",
-            h264parse->idr_pos);
-      }
-      /* if SEI preceeds (faked) IDR, then we have to insert config there */
-      if (h264parse->sei_pos >= 0 && h264parse->idr_pos > h264parse->sei_pos) {
-        h264parse->idr_pos = h264parse->sei_pos;
-        GST_DEBUG_OBJECT (h264parse, "moved IDR mark to SEI position %d",
-            h264parse->idr_pos);
-      }
+      if (h264parse->transform)
+        gst_h264_parse_mark_idr (h264parse,
+            gst_adapter_available (h264parse->frame_out));
+      else
+        gst_h264_parse_mark_idr (h264parse, nalu->sc_offset);
       break;
     default:
       gst_h264_parser_parse_nal (nalparser, nalu);
@@ -589,8 +718,12 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
     GstBuffer *buf;
 
     GST_LOG_OBJECT (h264parse, "collecting NAL in AVC frame");
-    buf = gst_h264_parse_wrap_nal (h264parse, h264parse->format,
-        nalu->data + nalu->offset, nalu->size);
+    if (h264parse->nal_buffer)
+      buf = gst_h264_parse_wrap_nal_shared (h264parse, h264parse->nal_buffer,
+          nalu);
+    else
+      buf = gst_h264_parse_wrap_nal (h264parse, h264parse->format,
+          nalu->data + nalu->offset, nalu->size);
     gst_adapter_push (h264parse->frame_out, buf);
   }
 }
@@ -644,6 +777,70 @@ gst_h264_parse_collect_nal (GstH264Parse * h264parse, const guint8 * data,
   return complete;
 }
 
+/* looks at an AVC AU that is pushed out as is; only the NAL headers are
+ * read, except for config NALs (and SEI if we are to interpolate
+ * timestamps), which are processed as usual */
+static void
+gst_h264_parse_scan_avc_au (GstH264Parse * h264parse, const guint8 * data,
+    gsize size)
+{
+  const guint nl = h264parse->nal_length_size;
+  GstH264NalUnit nalu;
+  gsize off = 0;
+
+  while (size - off > nl) {
+    guint nal_size = 0, nal_type, i;
+
+    for (i = 0; i < nl; i++)
+      nal_size = (nal_size << 8) | data[off + i];
+
+    if (nal_size > size - off - nl) {
+      GST_DEBUG_OBJECT (h264parse, "parsing packet failed");
+      return;
+    }
+
+    /* nothing to do for broken input */
+    if (G_UNLIKELY (nal_size < 2)) {
+      off += nl + nal_size;
+      continue;
+    }
+
+    nal_type = data[off + nl] & 0x1f;
+    GST_LOG_OBJECT (h264parse, "nal of type %u, size %u at offset %"
+        G_GSIZE_FORMAT, nal_type, nal_size, off);
+
+    if (nal_type == GST_H264_NAL_SPS || nal_type == GST_H264_NAL_PPS ||
+        (nal_type == GST_H264_NAL_SEI && h264parse->do_ts)) {
+      if (gst_h264_parser_identify_nalu_avc (h264parse->nalparser, data, off,
+              size, nl, &nalu) == GST_H264_PARSER_OK)
+        gst_h264_parse_process_nal (h264parse, &nalu);
+    } else {
+      h264parse->keyframe |= NAL_TYPE_IS_KEY (nal_type);
+
+      switch (nal_type) {
+        case GST_H264_NAL_SEI:
+          if (h264parse->sei_pos == -1)
+            h264parse->sei_pos = off;
+          break;
+        case GST_H264_NAL_SLICE:
+        case GST_H264_NAL_SLICE_DPA:
+        case GST_H264_NAL_SLICE_DPB:
+        case GST_H264_NAL_SLICE_DPC:
+        case GST_H264_NAL_SLICE_IDR:
+          /* first_mb_in_slice == 0 */
+          if (data[off + nl + 1] & 0x80)
+            h264parse->frame_start = TRUE;
+          if (nal_type == GST_H264_NAL_SLICE_IDR || h264parse->push_codec)
+            gst_h264_parse_mark_idr (h264parse, off);
+          break;
+        default:
+          break;
+      }
+    }
+
+    off += nl + nal_size;
+  }
+}
 
 static GstFlowReturn
 gst_h264_parse_handle_frame_packetized (GstBaseParse * parse,
@@ -663,11 +860,21 @@ gst_h264_parse_handle_frame_packetized (GstBaseParse * parse,
     return GST_FLOW_NOT_NEGOTIATED;
   }
 
+  if (h264parse->avc_passthrough) {
+    gst_buffer_map (buffer, &map, GST_MAP_READ);
+    gst_h264_parse_scan_avc_au (h264parse, map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+
+    gst_h264_parse_parse_frame (parse, frame);
+    return gst_base_parse_finish_frame (parse, frame, map.size);
+  }
+
   /* need to save buffer from invalidation upon _finish_frame */
   if (h264parse->split_packetized)
     buffer = gst_buffer_copy (frame->buffer);
 
   gst_buffer_map (buffer, &map, GST_MAP_READ);
+  h264parse->nal_buffer = buffer;
 
   left = map.size;
 
@@ -698,6 +905,7 @@ gst_h264_parse_handle_frame_packetized (GstBaseParse * parse,
         map.data, nalu.offset + nalu.size, map.size, nl, &nalu);
   }
 
+  h264parse->nal_buffer = NULL;
   gst_buffer_unmap (buffer, &map);
 
   if (!h264parse->split_packetized) {
@@ -754,9 +962,11 @@ gst_h264_parse_handle_frame (GstBaseParse * parse,
   gst_buffer_map (buffer, &map, GST_MAP_READ);
   data = map.data;
   size = map.size;
+  h264parse->nal_buffer = buffer;
 
   /* expect at least 3 bytes startcode == sc, and 2 bytes NALU payload */
   if (G_UNLIKELY (size < 5)) {
+    h264parse->nal_buffer = NULL;
     gst_buffer_unmap (buffer, &map);
     *skipsize = 1;
     return GST_FLOW_OK;
@@ -898,6 +1108,7 @@ gst_h264_parse_handle_frame (GstBaseParse * parse,
 end:
   framesize = nalu.offset + nalu.size;
 
+  h264parse->nal_buffer = NULL;
   gst_buffer_unmap (buffer, &map);
 
   gst_h264_parse_parse_frame (parse, frame);
@@ -913,6 +1124,7 @@ more:
 
   /* Fall-through. */
 out:
+  h264parse->nal_buffer = NULL;
   gst_buffer_unmap (buffer, &map);
   return GST_FLOW_OK;
 
@@ -1428,8 +1640,24 @@ gst_h264_parse_parse_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
   av = gst_adapter_available (h264parse->frame_out);
   if (av) {
     GstBuffer *buf;
-
-    buf = gst_adapter_take_buffer (h264parse->frame_out, av);
+    GList *bufs, *walk;
+    guint n, n_mem = 0, max_mem = gst_buffer_get_max_memory ();
+
+    /* chain the memories of the collected NALs. Above max_mem, a buffer
+     * merges (copies) all its memories, so the NALs that do not fit are
+     * copied together into the last memory instead */
+    bufs = gst_adapter_take_list (h264parse->frame_out, av);
+    buf = gst_buffer_new ();
+    for (walk = bufs; walk; walk = walk->next) {
+      n = gst_buffer_n_memory (walk->data);
+      if (n_mem + n + (walk->next ? 1 : 0) > max_mem)
+        break;
+      buf = gst_buffer_append (buf, walk->data);
+      n_mem += n;
+    }
+    if (walk)
+      gst_buffer_append_memory (buf, gst_h264_parse_merge_nals (walk));
+    g_list_free (bufs);
     gst_buffer_copy_into (buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
     gst_buffer_replace (&frame->out_buffer, buf);
     gst_buffer_unref (buf);
@@ -1705,6 +1933,9 @@ gst_h264_parse_set_caps (GstBaseParse * parse, GstCaps * caps)
 
   /* reset */
   h264parse->push_codec = FALSE;
+  h264parse->split_packetized = FALSE;
+  h264parse->avc_passthrough = FALSE;
+  gst_base_parse_set_passthrough (parse, FALSE);
 
   str = gst_caps_get_structure (caps, 0);
 
@@ -1830,7 +2061,13 @@ gst_h264_parse_set_caps (GstBaseParse * parse, GstCaps * caps)
   }
 
   if (format == h264parse->format && align == h264parse->align) {
-    gst_base_parse_set_passthrough (parse, TRUE);
+    /* AVC AUs still need a look at their NAL headers to keep track of
+     * keyframes and in-stream config, but are pushed out as they are */
+    if (h264parse->packetized && format == GST_H264_PARSE_FORMAT_AVC &&
+        align == GST_H264_PARSE_ALIGN_AU)
+      h264parse->avc_passthrough = TRUE;
+    else
+      gst_base_parse_set_passthrough (parse, TRUE);
 
     /* we did parse codec-data and might supplement src caps */
     gst_h264_parse_update_src_caps (h264parse, caps);
@@ -67,6 +67,8 @@ struct _GstH264Parse
   gboolean packetized;
   gboolean split_packetized;
   gboolean transform;
+  /* avc au input pushed out as is, only NAL headers need a look */
+  gboolean avc_passthrough;
 
   /* state */
   GstH264NalParser *nalparser;
@@ -102,6 +104,12 @@ struct _GstH264Parse
   gint idr_pos, sei_pos;
   gboolean update_caps;
   GstAdapter *frame_out;
+  /* buffer the NALs being processed are mapped from, if any */
+  GstBuffer *nal_buffer;
+  /* block the transformed NAL prefixes are carved from */
+  GstMemory *prefix_block;
+  GstMapInfo prefix_map;
+  gsize prefix_used;
   gboolean keyframe;
   gboolean frame_start;
   /* AU state */
@@ -23,11 +23,23 @@
  *
  * Send data over shared memory to the matching source.
  *
+ * With #GstShmSink:send-meta, the running times, duration and flags of the
+ * buffers are sent along with them, and so are the caps whenever they
+ * change or a new source connects.
+ *
  * <refsect2>
  * <title>Example launch lines</title>
  * |[
  * gst-launch -v videotestsrc !  shmsink socket-path=/tmp/blah shm-size=1000000
  * ]| Send video to shm buffers.
+ * |[
+ * gst-launch -v videotestsrc !  shmsink socket-path=/tmp/blah shm-size=1000000 ring-size=64
+ * ]| Same, but pass the buffers to the sources through a ring in shared
+ * memory instead of the control socket. The sources need to support it.
+ * |[
+ * gst-launch -v videotestsrc !  shmsink socket-path=/tmp/blah shm-size=1000000 send-meta=true
+ * ]| Send the caps and timestamps too, so that the sources don't need to be
+ * given the caps. The sources need to support it.
  * </refsect2>
  */
 #ifdef HAVE_CONFIG_H
@@ -56,17 +68,33 @@ enum
   PROP_PERMS,
   PROP_SHM_SIZE,
   PROP_WAIT_FOR_CONNECTION,
-  PROP_BUFFER_TIME
+  PROP_BUFFER_TIME,
+  PROP_RING_SIZE,
+  PROP_SEND_META,
+  PROP_SHM_USED,
+  PROP_SHM_FREE_BLOCKS,
+  PROP_SHM_LARGEST_FREE_BLOCK,
+  PROP_SHM_FRAGMENTATION,
+  PROP_SHM_ALLOC_FAILURES
 };
 
 struct GstShmClient
 {
   ShmClient *client;
   GstPollFD pollfd;
+  GstPollFD ring_pollfd;
 };
 
 #define DEFAULT_SIZE ( 256 * 1024 )
 #define DEFAULT_WAIT_FOR_CONNECTION (TRUE)
+#define DEFAULT_RING_SIZE 0
+#define DEFAULT_SEND_META FALSE
+
+/* The buffer flags that are sent to the sources */
+#define SHM_BUFFER_FLAGS (GST_BUFFER_FLAG_LIVE | GST_BUFFER_FLAG_DISCONT | \
+    GST_BUFFER_FLAG_RESYNC | GST_BUFFER_FLAG_CORRUPTED | \
+    GST_BUFFER_FLAG_MARKER | GST_BUFFER_FLAG_HEADER | GST_BUFFER_FLAG_GAP | \
+    GST_BUFFER_FLAG_DROPPABLE | GST_BUFFER_FLAG_DELTA_UNIT)
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
@@ -91,6 +119,7 @@ static void gst_shm_sink_get_property (GObject * object, guint prop_id,
 static gboolean gst_shm_sink_start (GstBaseSink * bsink);
 static gboolean gst_shm_sink_stop (GstBaseSink * bsink);
 static GstFlowReturn gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf);
+static gboolean gst_shm_sink_set_caps (GstBaseSink * bsink, GstCaps * caps);
 
 static gboolean gst_shm_sink_event (GstBaseSink * bsink, GstEvent * event);
 static gboolean gst_shm_sink_unlock (GstBaseSink * bsink);
@@ -349,6 +378,8 @@ gst_shm_sink_init (GstShmSink * self)
   self->size = DEFAULT_SIZE;
   self->wait_for_connection = DEFAULT_WAIT_FOR_CONNECTION;
   self->perms = DEFAULT_PERMS;
+  self->ring_size = DEFAULT_RING_SIZE;
+  self->send_meta = DEFAULT_SEND_META;
 
   gst_allocation_params_init (&self->params);
 }
@@ -371,6 +402,7 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
   gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_shm_sink_start);
   gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_shm_sink_stop);
   gstbasesink_class->render = GST_DEBUG_FUNCPTR (gst_shm_sink_render);
+  gstbasesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_shm_sink_set_caps);
   gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_shm_sink_event);
   gstbasesink_class->unlock = GST_DEBUG_FUNCPTR (gst_shm_sink_unlock);
   gstbasesink_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_shm_sink_unlock_stop);
@@ -410,6 +442,56 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
           -1, G_MAXINT64, -1,
           G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_RING_SIZE,
+      g_param_spec_uint ("ring-size",
+          "Size of the shm ring",
+          "Number of buffers that can be in flight to each client through a"
+          " ring in shared memory, instead of using the control socket for"
+          " every buffer (rounded up to a power of 2, 0 to disable). Only"
+          " applies to the clients that connect after it is set",
+          0, 65536, DEFAULT_RING_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_META,
+      g_param_spec_boolean ("send-meta",
+          "Send the buffer metadata",
+          "Send the running times, duration and flags of the buffers and the"
+          " caps to the clients. Only applies to the clients that connect"
+          " after it is set, which need to support it",
+          DEFAULT_SEND_META, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHM_USED,
+      g_param_spec_uint ("shm-used",
+          "Used size of the shm area",
+          "Number of bytes of the shared memory area currently allocated",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHM_FREE_BLOCKS,
+      g_param_spec_uint ("shm-free-blocks",
+          "Free blocks in the shm area",
+          "Number of separate free blocks in the shared memory area",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHM_LARGEST_FREE_BLOCK,
+      g_param_spec_uint ("shm-largest-free-block",
+          "Largest free block in the shm area",
+          "Size of the largest buffer that can currently be allocated in the"
+          " shared memory area",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHM_FRAGMENTATION,
+      g_param_spec_double ("shm-fragmentation",
+          "Fragmentation of the shm area",
+          "Fraction of the free space of the shared memory area that is not"
+          " in the largest free block (0 is not fragmented)",
+          0.0, 1.0, 0.0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHM_ALLOC_FAILURES,
+      g_param_spec_uint64 ("shm-alloc-failures",
+          "Failed allocations in the shm area",
+          "Number of times a buffer did not fit in the shared memory area",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   signals[SIGNAL_CLIENT_CONNECTED] = g_signal_new ("client-connected",
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
@@ -499,6 +581,20 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
       GST_OBJECT_UNLOCK (object);
       g_cond_broadcast (&self->cond);
       break;
+    case PROP_RING_SIZE:
+      GST_OBJECT_LOCK (object);
+      self->ring_size = g_value_get_uint (value);
+      if (self->pipe)
+        sp_writer_set_ring_size (self->pipe, self->ring_size);
+      GST_OBJECT_UNLOCK (object);
+      break;
+    case PROP_SEND_META:
+      GST_OBJECT_LOCK (object);
+      self->send_meta = g_value_get_boolean (value);
+      if (self->pipe)
+        sp_writer_set_send_meta (self->pipe, self->send_meta);
+      GST_OBJECT_UNLOCK (object);
+      break;
     default:
       break;
   }
@@ -509,9 +605,23 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
 {
   GstShmSink *self = GST_SHM_SINK (object);
+  ShmAllocStats stats = { 0 };
 
   GST_OBJECT_LOCK (object);
 
+  switch (prop_id) {
+    case PROP_SHM_USED:
+    case PROP_SHM_FREE_BLOCKS:
+    case PROP_SHM_LARGEST_FREE_BLOCK:
+    case PROP_SHM_FRAGMENTATION:
+    case PROP_SHM_ALLOC_FAILURES:
+      if (self->pipe)
+        sp_writer_get_alloc_stats (self->pipe, &stats);
+      break;
+    default:
+      break;
+  }
+
   switch (prop_id) {
     case PROP_SOCKET_PATH:
       g_value_set_string (value, self->socket_path);
@@ -528,6 +638,31 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     case PROP_BUFFER_TIME:
       g_value_set_int64 (value, self->buffer_time);
       break;
+    case PROP_RING_SIZE:
+      g_value_set_uint (value, self->ring_size);
+      break;
+    case PROP_SEND_META:
+      g_value_set_boolean (value, self->send_meta);
+      break;
+    case PROP_SHM_USED:
+      g_value_set_uint (value, stats.used);
+      break;
+    case PROP_SHM_FREE_BLOCKS:
+      g_value_set_uint (value, stats.n_free_blocks);
+      break;
+    case PROP_SHM_LARGEST_FREE_BLOCK:
+      g_value_set_uint (value, stats.largest_free);
+      break;
+    case PROP_SHM_FRAGMENTATION:
+      if (stats.size > stats.used)
+        g_value_set_double (value, 1.0 -
+            (gdouble) stats.largest_free / (stats.size - stats.used));
+      else
+        g_value_set_double (value, 0.0);
+      break;
+    case PROP_SHM_ALLOC_FAILURES:
+      g_value_set_uint64 (value, stats.failures);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -564,6 +699,12 @@ gst_shm_sink_start (GstBaseSink * bsink)
   }
 
   sp_set_data (self->pipe, self);
+  if (self->ring_size) {
+    int slots = sp_writer_set_ring_size (self->pipe, self->ring_size);
+
+    GST_DEBUG_OBJECT (self, "Using rings of %d buffers", slots);
+  }
+  sp_writer_set_send_meta (self->pipe, self->send_meta);
   g_free (self->socket_path);
   self->socket_path = g_strdup (sp_writer_get_path (self->pipe));
 
@@ -631,6 +772,24 @@ gst_shm_sink_stop (GstBaseSink * bsink)
   sp_writer_close (self->pipe, NULL, NULL);
   self->pipe = NULL;
 
+  gst_caps_replace (&self->caps, NULL);
+  self->caps_changed = FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_shm_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
+{
+  GstShmSink *self = GST_SHM_SINK (bsink);
+
+  GST_OBJECT_LOCK (self);
+  if (!self->caps || !gst_caps_is_equal (caps, self->caps)) {
+    gst_caps_replace (&self->caps, caps);
+    self->caps_changed = TRUE;
+  }
+  GST_OBJECT_UNLOCK (self);
+
   return TRUE;
 }
 
@@ -652,6 +811,76 @@ gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
   return TRUE;
 }
 
+static GstClockTime
+gst_shm_sink_to_running_time (GstShmSink * self, GstClockTime ts)
+{
+  GstSegment *segment = &GST_BASE_SINK (self)->segment;
+
+  if (segment->format != GST_FORMAT_TIME)
+    return GST_CLOCK_TIME_NONE;
+
+  return gst_segment_to_running_time (segment, GST_FORMAT_TIME, ts);
+}
+
+/* Sends the caps as a buffer in the shm area, so that they reach the
+ * sources in order with the data. If they could not be sent, @unsent is set
+ * to a buffer to unref once the object lock is released. Must be called
+ * with the object lock. */
+static GstFlowReturn
+gst_shm_sink_send_caps_locked (GstShmSink * self, GstBuffer ** unsent)
+{
+  ShmBufferMeta meta = { 0 };
+  GstMemory *memory;
+  GstBuffer *capsbuf;
+  GstMapInfo map;
+  gchar *str;
+  gsize len;
+  int rv;
+
+  str = gst_caps_to_string (self->caps);
+  len = strlen (str) + 1;
+
+  if (len > sp_writer_get_max_buf_size (self->pipe)) {
+    GST_WARNING_OBJECT (self, "Caps of %" G_GSIZE_FORMAT " bytes don't fit "
+        "in the shared memory area, not sending them", len);
+    g_free (str);
+    self->caps_changed = FALSE;
+    return GST_FLOW_OK;
+  }
+
+  while ((memory = gst_shm_sink_allocator_alloc_locked (self->allocator, len,
+              &self->params)) == NULL) {
+    g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+    if (self->unlock) {
+      g_free (str);
+      return GST_FLOW_FLUSHING;
+    }
+  }
+
+  gst_memory_map (memory, &map, GST_MAP_WRITE);
+  memcpy (map.data, str, len);
+  gst_memory_unmap (memory, &map);
+  g_free (str);
+
+  capsbuf = gst_buffer_new ();
+  gst_buffer_append_memory (capsbuf, memory);
+
+  GST_DEBUG_OBJECT (self, "Sending caps %" GST_PTR_FORMAT, self->caps);
+
+  meta.pts = meta.dts = meta.duration = GST_CLOCK_TIME_NONE;
+  meta.type = SP_BUFFER_TYPE_FORMAT;
+  gst_buffer_map (capsbuf, &map, GST_MAP_READ);
+  rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size, &meta,
+      capsbuf);
+  gst_buffer_unmap (capsbuf, &map);
+
+  if (rv <= 0)
+    *unsent = capsbuf;
+  self->caps_changed = FALSE;
+
+  return GST_FLOW_OK;
+}
+
 static GstFlowReturn
 gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
 {
@@ -662,6 +891,8 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
   GstFlowReturn ret = GST_FLOW_OK;
   GstMemory *memory = NULL;
   GstBuffer *sendbuf = NULL;
+  GstBuffer *capsbuf = NULL;
+  ShmBufferMeta meta = { 0 };
 
   GST_OBJECT_LOCK (self);
   while (self->wait_for_connection && !self->clients) {
@@ -676,6 +907,11 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
       goto flushing;
   }
 
+  if (G_UNLIKELY (self->caps_changed && self->caps && self->send_meta)) {
+    ret = gst_shm_sink_send_caps_locked (self, &capsbuf);
+    if (ret != GST_FLOW_OK)
+      goto flushing;
+  }
 
   if (gst_buffer_n_memory (buf) > 1) {
     GST_LOG_OBJECT (self, "Buffer %p has %d GstMemory, we only support a single"
@@ -714,8 +950,11 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     while (self->wait_for_connection && !self->clients) {
       g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
       if (self->unlock) {
-        gst_memory_unref (memory);
         GST_OBJECT_UNLOCK (self);
+        /* freeing it takes the object lock */
+        gst_memory_unref (memory);
+        if (capsbuf)
+          gst_buffer_unref (capsbuf);
         return GST_FLOW_FLUSHING;
       }
     }
@@ -737,12 +976,27 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
    * reading
    */
 
-  rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size, sendbuf);
+  /* The sources only know about running times */
+  meta.pts = gst_shm_sink_to_running_time (self, GST_BUFFER_PTS (buf));
+  meta.dts = gst_shm_sink_to_running_time (self, GST_BUFFER_DTS (buf));
+  meta.duration = GST_BUFFER_DURATION (buf);
+  meta.flags = GST_BUFFER_FLAGS (buf) & SHM_BUFFER_FLAGS;
+  meta.type = SP_BUFFER_TYPE_DATA;
+
+  rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size, &meta,
+      sendbuf);
 
   gst_buffer_unmap (sendbuf, &map);
 
   GST_OBJECT_UNLOCK (self);
 
+  if (capsbuf)
+    gst_buffer_unref (capsbuf);
+
+  /* Nobody got it, so nobody will release it */
+  if (rv <= 0)
+    gst_buffer_unref (sendbuf);
+
   if (rv == -1) {
     GST_ELEMENT_ERROR (self, STREAM, FAILED, ("Invalid allocated buffer"),
         ("The shmpipe library rejects our buffer, this is a bug"));
@@ -755,6 +1009,8 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
 
 flushing:
   GST_OBJECT_UNLOCK (self);
+  if (capsbuf)
+    gst_buffer_unref (capsbuf);
   return GST_FLOW_FLUSHING;
 }
 
@@ -818,7 +1074,19 @@ pollthread_func (gpointer data)
       gclient->pollfd.fd = sp_writer_get_client_fd (client);
       gst_poll_add_fd (self->poll, &gclient->pollfd);
       gst_poll_fd_ctl_read (self->poll, &gclient->pollfd, TRUE);
+      gst_poll_fd_init (&gclient->ring_pollfd);
+      gclient->ring_pollfd.fd = sp_writer_get_client_ring_fd (client);
+      if (gclient->ring_pollfd.fd >= 0) {
+        gst_poll_add_fd (self->poll, &gclient->ring_pollfd);
+        gst_poll_fd_ctl_read (self->poll, &gclient->ring_pollfd, TRUE);
+      }
       self->clients = g_list_prepend (self->clients, gclient);
+
+      /* The new client needs the caps before the next buffer */
+      GST_OBJECT_LOCK (self);
+      self->caps_changed = TRUE;
+      GST_OBJECT_UNLOCK (self);
+
       g_signal_emit (self, signals[SIGNAL_CLIENT_CONNECTED], 0,
           gclient->pollfd.fd);
       /* we need to call gst_poll_wait before calling gst_poll_* status
@@ -862,6 +1130,24 @@ pollthread_func (gpointer data)
         if (rv == 0)
           gst_buffer_unref (tag);
       }
+
+      if (gclient->ring_pollfd.fd >= 0 &&
+          gst_poll_fd_can_read (self->poll, &gclient->ring_pollfd)) {
+        GSList *list = NULL;
+        int rv;
+
+        GST_OBJECT_LOCK (self);
+        rv = sp_writer_recv_ring (self->pipe, gclient->client,
+            (sp_buffer_free_callback) free_buffer_locked, (void **) &list);
+        GST_OBJECT_UNLOCK (self);
+        g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+
+        if (rv < 0) {
+          GST_WARNING_OBJECT (self, "One client has ring error,"
+              " closing (retval: %d)", rv);
+          goto close_client;
+        }
+      }
       continue;
     close_client:
       {
@@ -874,6 +1160,8 @@ pollthread_func (gpointer data)
       }
 
       gst_poll_remove_fd (self->poll, &gclient->pollfd);
+      if (gclient->ring_pollfd.fd >= 0)
+        gst_poll_remove_fd (self->poll, &gclient->ring_pollfd);
       self->clients = g_list_remove (self->clients, gclient);
 
       g_signal_emit (self, signals[SIGNAL_CLIENT_DISCONNECTED], 0,
@@ -63,12 +63,17 @@ struct _GstShmSink
   gboolean stop;
   gboolean unlock;
   GstClockTimeDiff buffer_time;
+  guint ring_size;
+  gboolean send_meta;
 
   GCond cond;
 
   GstShmSinkAllocator *allocator;
 
   GstAllocationParams params;
+
+  GstCaps *caps;
+  gboolean caps_changed;
 };
 
 struct _GstShmSinkClass
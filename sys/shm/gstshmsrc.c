@@ -23,6 +23,12 @@
  *
  * Receive data from the shared memory sink.
  *
+ * If the sink sends them (see #GstShmSink:send-meta), the caps of the sink
+ * are set on the source pad and the buffers get the duration and flags
+ * they had in the sink. Their timestamps are the running times they had in
+ * the sink, shifted so that the first buffer is at the current running time
+ * of the source, unless #GstBaseSrc:do-timestamp is set.
+ *
  * <refsect2>
  * <title>Example launch lines</title>
  * |[
@@ -148,6 +154,7 @@ gst_shm_src_init (GstShmSrc * self)
 {
   self->poll = gst_poll_new (TRUE);
   gst_poll_fd_init (&self->pollfd);
+  gst_poll_fd_init (&self->ring_pollfd);
 }
 
 static void
@@ -240,6 +247,7 @@ gst_shm_src_start_reading (GstShmSrc * self)
   }
 
   self->pipe = gstpipe;
+  self->ts_offset_valid = FALSE;
 
   gst_poll_set_flushing (self->poll, FALSE);
 
@@ -263,6 +271,9 @@ gst_shm_src_stop_reading (GstShmSrc * self)
 
   gst_poll_remove_fd (self->poll, &self->pollfd);
   gst_poll_fd_init (&self->pollfd);
+  if (self->ring_pollfd.fd >= 0)
+    gst_poll_remove_fd (self->poll, &self->ring_pollfd);
+  gst_poll_fd_init (&self->ring_pollfd);
 
   gst_poll_set_flushing (self->poll, TRUE);
 }
@@ -304,6 +315,80 @@ free_buffer (gpointer data)
   g_slice_free (struct GstShmBuffer, gsb);
 }
 
+/* Sets the caps sent by the sink in @buf, and releases it */
+static gboolean
+gst_shm_src_set_caps_from_buffer (GstShmSrc * self, gchar * buf, long size)
+{
+  GstCaps *caps = NULL;
+  GstCaps *current;
+  gboolean ret = TRUE;
+
+  if (size > 0 && buf[size - 1] == '\0')
+    caps = gst_caps_from_string (buf);
+
+  GST_OBJECT_LOCK (self);
+  sp_client_recv_finish (self->pipe->pipe, buf);
+  GST_OBJECT_UNLOCK (self);
+
+  if (!caps) {
+    GST_WARNING_OBJECT (self, "Received invalid caps");
+    return TRUE;
+  }
+
+  current = gst_pad_get_current_caps (GST_BASE_SRC_PAD (self));
+  if (!current || !gst_caps_is_equal (caps, current)) {
+    GST_DEBUG_OBJECT (self, "Received caps %" GST_PTR_FORMAT, caps);
+    ret = gst_base_src_set_caps (GST_BASE_SRC (self), caps);
+  }
+
+  if (current)
+    gst_caps_unref (current);
+  gst_caps_unref (caps);
+
+  return ret;
+}
+
+static GstClockTime
+gst_shm_src_get_running_time (GstShmSrc * self)
+{
+  GstClockTime now = 0;
+  GstClock *clock;
+
+  GST_OBJECT_LOCK (self);
+  clock = GST_ELEMENT_CLOCK (self);
+  if (clock) {
+    GstClockTime base_time = GST_ELEMENT_CAST (self)->base_time;
+
+    now = gst_clock_get_time (clock);
+    now = now > base_time ? now - base_time : 0;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  return now;
+}
+
+/* Maps a running time of the sink to a running time of the source */
+static GstClockTime
+gst_shm_src_rebase (GstShmSrc * self, guint64 ts)
+{
+  if (ts == SP_TIME_NONE)
+    return GST_CLOCK_TIME_NONE;
+
+  /* Both pipelines have their own clock and base time, so the first buffer
+   * is assumed to have no latency */
+  if (!self->ts_offset_valid) {
+    self->ts_offset = GST_CLOCK_DIFF (ts, gst_shm_src_get_running_time (self));
+    self->ts_offset_valid = TRUE;
+    GST_DEBUG_OBJECT (self, "Offsetting the timestamps by %" G_GINT64_FORMAT
+        "ns", self->ts_offset);
+  }
+
+  if (self->ts_offset < 0 && ts < -self->ts_offset)
+    return 0;
+
+  return ts + self->ts_offset;
+}
+
 static GstFlowReturn
 gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
 {
@@ -311,8 +396,24 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   gchar *buf = NULL;
   int rv = 0;
   struct GstShmBuffer *gsb;
+  ShmBufferMeta meta;
 
+again:
   do {
+    /* With a ring, the buffers don't wake us up as long as we keep up */
+    if (self->ring_pollfd.fd >= 0) {
+      GST_OBJECT_LOCK (self);
+      rv = sp_client_recv_ring (self->pipe->pipe, &buf, &meta);
+      GST_OBJECT_UNLOCK (self);
+      if (rv < 0) {
+        GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
+            ("Error reading from the ring: %d", rv));
+        return GST_FLOW_ERROR;
+      }
+      if (buf)
+        break;
+    }
+
     if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
       if (errno == EBUSY)
         return GST_FLOW_FLUSHING;
@@ -340,16 +441,31 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
       buf = NULL;
       GST_LOG_OBJECT (self, "Reading from pipe");
       GST_OBJECT_LOCK (self);
-      rv = sp_client_recv (self->pipe->pipe, &buf);
+      rv = sp_client_recv (self->pipe->pipe, &buf, &meta);
       GST_OBJECT_UNLOCK (self);
       if (rv < 0) {
         GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
             ("Error reading control data: %d", rv));
         return GST_FLOW_ERROR;
       }
+
+      if (self->ring_pollfd.fd < 0 &&
+          sp_client_get_ring_fd (self->pipe->pipe) >= 0) {
+        GST_DEBUG_OBJECT (self, "Receiving buffers through a ring");
+        self->ring_pollfd.fd = sp_client_get_ring_fd (self->pipe->pipe);
+        gst_poll_add_fd (self->poll, &self->ring_pollfd);
+        gst_poll_fd_ctl_read (self->poll, &self->ring_pollfd, TRUE);
+      }
     }
   } while (buf == NULL);
 
+  if (meta.type == SP_BUFFER_TYPE_FORMAT) {
+    if (!gst_shm_src_set_caps_from_buffer (self, buf, rv))
+      return GST_FLOW_NOT_NEGOTIATED;
+    buf = NULL;
+    goto again;
+  }
+
   GST_LOG_OBJECT (self, "Got buffer %p of size %d", buf, rv);
 
   gsb = g_slice_new0 (struct GstShmBuffer);
@@ -360,6 +476,15 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   *outbuf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
       buf, rv, 0, rv, gsb, free_buffer);
 
+  /* Otherwise the base class timestamps them */
+  if (!gst_base_src_get_do_timestamp (GST_BASE_SRC (self))) {
+    GST_BUFFER_DTS (*outbuf) = gst_shm_src_rebase (self, meta.dts);
+    GST_BUFFER_PTS (*outbuf) = gst_shm_src_rebase (self, meta.pts);
+  }
+  if (meta.duration != SP_TIME_NONE)
+    GST_BUFFER_DURATION (*outbuf) = meta.duration;
+  GST_BUFFER_FLAG_SET (*outbuf, meta.flags);
+
   return GST_FLOW_OK;
 }
 
@@ -52,10 +52,14 @@ struct _GstShmSrc
   GstShmPipe *pipe;
   GstPoll *poll;
   GstPollFD pollfd;
-
+  GstPollFD ring_pollfd;
 
   GstFlowReturn flow_return;
   gboolean unlocked;
+
+  /* From the running times of the sink to ours */
+  GstClockTimeDiff ts_offset;
+  gboolean ts_offset_valid;
 };
 
 struct _GstShmSrcClass
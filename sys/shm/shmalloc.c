@@ -33,14 +33,57 @@
 #include <string.h>
 #include <assert.h>
 
+/*
+ * This is a two-level segregated fit allocator (TLSF).
+ *
+ * The space is cut in units of SHM_ALLOC_UNIT bytes. Every free block is in
+ * a list selected by its size: the first level is the power of 2 and the
+ * second level splits each power of 2 in SL_COUNT linear classes. Two
+ * bitmaps tell which lists are non-empty, so finding a free block large
+ * enough is a couple of bit scans, whatever the number of blocks. Freed
+ * blocks are merged with their free neighbours right away.
+ *
+ * The blocks in use are also indexed by their first unit, and a bitmap of
+ * those first units with summary levels above it gives the start of the
+ * block holding any unit with one bit scan per level.
+ */
+
+#define UNIT_SHIFT 7
+#define SHM_ALLOC_UNIT (1UL << UNIT_SHIFT)
+
+#define SL_BITS 4
+#define SL_COUNT (1 << SL_BITS)
+#define FL_COUNT (sizeof (unsigned long) * 8 - SL_BITS + 1)
+
+#define WORD_BITS (sizeof (unsigned long) * 8)
+/* Enough levels of WORD_BITS bits for any number of units */
+#define MAX_LEVELS 12
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
   /* The total size of this space */
   size_t size;
 
-  /* chained list of the blocks contained in this space */
-  ShmAllocBlock *blocks;
+  /* The number of units and the block in use starting at each unit */
+  unsigned long n_units;
+  ShmAllocBlock **used;
+
+  /* Bitmaps of the first units of the blocks in use, level 0 has a bit per
+   * unit and each level above a bit per word of the one below */
+  unsigned int n_levels;
+  unsigned long *starts[MAX_LEVELS];
+
+  /* Free lists and their bitmaps */
+  unsigned long fl_bitmap;
+  unsigned int sl_bitmap[FL_COUNT];
+  ShmAllocBlock *free_lists[FL_COUNT][SL_COUNT];
+
+  /* Statistics */
+  unsigned long used_size;
+  unsigned long n_blocks;
+  unsigned long n_free_blocks;
+  unsigned long failures;
 };
 
 /* A single block of data */
@@ -53,22 +96,268 @@ struct _ShmAllocBlock
 
   /* The offset of this block in the alloc space */
   unsigned long offset;
-  /* The size of the block */
+  /* The size of the block, a multiple of SHM_ALLOC_UNIT */
   unsigned long size;
 
-  /* Pointer to the next block in the chain */
-  ShmAllocBlock *next;
+  /* The blocks just before and after this one in the space */
+  ShmAllocBlock *prev_phys;
+  ShmAllocBlock *next_phys;
+
+  /* The other blocks in the same free list, if this one is free */
+  int is_free;
+  ShmAllocBlock *prev_free;
+  ShmAllocBlock *next_free;
 };
 
 
+/* Index of the most significant bit set, x must not be 0 */
+static inline int
+msb (unsigned long x)
+{
+#ifdef __GNUC__
+  return sizeof (unsigned long) * 8 - 1 - __builtin_clzl (x);
+#else
+  int i = 0;
+
+  while (x >>= 1)
+    i++;
+  return i;
+#endif
+}
+
+/* Index of the least significant bit set, x must not be 0 */
+static inline int
+lsb (unsigned long x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzl (x);
+#else
+  int i = 0;
+
+  while (!(x & 1)) {
+    x >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+static void
+mapping (unsigned long units, int *fl, int *sl)
+{
+  if (units < SL_COUNT) {
+    *fl = 0;
+    *sl = units;
+  } else {
+    int l = msb (units);
+
+    *fl = l - SL_BITS + 1;
+    *sl = (units >> (l - SL_BITS)) - SL_COUNT;
+  }
+}
+
+static void
+insert_free_block (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int fl, sl;
+
+  mapping (block->size >> UNIT_SHIFT, &fl, &sl);
+
+  block->is_free = 1;
+  block->prev_free = NULL;
+  block->next_free = self->free_lists[fl][sl];
+  if (block->next_free)
+    block->next_free->prev_free = block;
+  self->free_lists[fl][sl] = block;
+
+  self->fl_bitmap |= 1UL << fl;
+  self->sl_bitmap[fl] |= 1U << sl;
+  self->n_free_blocks++;
+}
+
+static void
+remove_free_block (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int fl, sl;
+
+  mapping (block->size >> UNIT_SHIFT, &fl, &sl);
+
+  if (block->prev_free)
+    block->prev_free->next_free = block->next_free;
+  else
+    self->free_lists[fl][sl] = block->next_free;
+  if (block->next_free)
+    block->next_free->prev_free = block->prev_free;
+
+  if (!self->free_lists[fl][sl]) {
+    self->sl_bitmap[fl] &= ~(1U << sl);
+    if (!self->sl_bitmap[fl])
+      self->fl_bitmap &= ~(1UL << fl);
+  }
+
+  block->is_free = 0;
+  self->n_free_blocks--;
+}
+
+/* Returns the first block of the first non-empty list from the class of
+ * @units up, or NULL */
+static ShmAllocBlock *
+find_free_list (ShmAllocSpace * self, unsigned long units)
+{
+  unsigned long sl_map, fl_map;
+  int fl, sl;
+
+  mapping (units, &fl, &sl);
+
+  if (fl >= FL_COUNT)
+    return NULL;
+
+  sl_map = self->sl_bitmap[fl] & (~0U << sl);
+  if (!sl_map) {
+    if (fl + 1 >= FL_COUNT)
+      return NULL;
+    fl_map = self->fl_bitmap & (~0UL << (fl + 1));
+    if (!fl_map)
+      return NULL;
+    fl = lsb (fl_map);
+    sl_map = self->sl_bitmap[fl];
+  }
+  sl = lsb (sl_map);
+
+  return self->free_lists[fl][sl];
+}
+
+/* Returns a free block of at least @units units, or NULL */
+static ShmAllocBlock *
+find_free_block (ShmAllocSpace * self, unsigned long units)
+{
+  ShmAllocBlock *block;
+  int fl, sl;
+
+  /* Round up to the next class so that any block in it is large enough */
+  if (units >= SL_COUNT) {
+    unsigned long round = (1UL << (msb (units) - SL_BITS)) - 1;
+
+    if (units <= ~0UL - round) {
+      block = find_free_list (self, units + round);
+      if (block)
+        return block;
+    }
+  } else {
+    block = find_free_list (self, units);
+    if (block)
+      return block;
+  }
+
+  /* Otherwise, the class of @units can still have a block large enough,
+   * such as one that fits exactly */
+  mapping (units, &fl, &sl);
+  for (block = self->free_lists[fl][sl]; block; block = block->next_free)
+    if (block->size >= units << UNIT_SHIFT)
+      return block;
+
+  return NULL;
+}
+
+static void
+starts_set (ShmAllocSpace * self, unsigned long unit)
+{
+  unsigned int l;
+
+  for (l = 0; l < self->n_levels; l++) {
+    unsigned long *word = &self->starts[l][unit / WORD_BITS];
+    int was_empty = (*word == 0);
+
+    *word |= 1UL << (unit % WORD_BITS);
+    if (!was_empty)
+      break;
+    unit /= WORD_BITS;
+  }
+}
+
+static void
+starts_clear (ShmAllocSpace * self, unsigned long unit)
+{
+  unsigned int l;
+
+  for (l = 0; l < self->n_levels; l++) {
+    unsigned long *word = &self->starts[l][unit / WORD_BITS];
+
+    *word &= ~(1UL << (unit % WORD_BITS));
+    if (*word)
+      break;
+    unit /= WORD_BITS;
+  }
+}
+
+/* Returns the last unit at or before @unit that starts a block in use, or
+ * -1 if there is none */
+static long
+starts_find (ShmAllocSpace * self, unsigned long unit)
+{
+  unsigned int l = 0;
+  unsigned long bits;
+
+  /* up to the first level with a bit set at or before the position */
+  for (;;) {
+    bits = self->starts[l][unit / WORD_BITS] &
+        (~0UL >> (WORD_BITS - 1 - unit % WORD_BITS));
+    if (bits)
+      break;
+    if (unit < WORD_BITS || l + 1 >= self->n_levels)
+      return -1;
+    unit = unit / WORD_BITS - 1;
+    l++;
+  }
+  unit = (unit & ~(WORD_BITS - 1)) + msb (bits);
+
+  /* then down to the last bit set under it */
+  while (l > 0) {
+    l--;
+    unit = unit * WORD_BITS + msb (self->starts[l][unit]);
+  }
+
+  return unit;
+}
+
+static ShmAllocBlock *
+new_block (ShmAllocSpace * self, unsigned long offset, unsigned long size)
+{
+  ShmAllocBlock *block = spalloc_new (ShmAllocBlock);
+
+  memset (block, 0, sizeof (ShmAllocBlock));
+  block->space = self;
+  block->offset = offset;
+  block->size = size;
+
+  return block;
+}
+
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
 {
   ShmAllocSpace *self = spalloc_new (ShmAllocSpace);
+  unsigned long n;
 
   memset (self, 0, sizeof (ShmAllocSpace));
 
   self->size = size;
+  self->n_units = size >> UNIT_SHIFT;
+  self->used = calloc (self->n_units ? self->n_units : 1,
+      sizeof (ShmAllocBlock *));
+
+  /* down to a single word at the top */
+  n = self->n_units;
+  do {
+    n = (n + WORD_BITS - 1) / WORD_BITS;
+    self->starts[self->n_levels++] = calloc (n ? n : 1,
+        sizeof (unsigned long));
+  } while (n > 1 && self->n_levels < MAX_LEVELS);
+
+  /* The end of the space that is not a full unit is never used */
+  if (self->n_units)
+    insert_free_block (self, new_block (self, 0,
+            self->n_units << UNIT_SHIFT));
 
   return self;
 }
@@ -76,7 +365,25 @@ shm_alloc_space_new (size_t size)
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  unsigned int l;
+
+  assert (self && self->n_blocks == 0);
+
+  if (self->n_units) {
+    ShmAllocBlock *block;
+    int fl, sl;
+
+    /* Everything was merged back in a single free block */
+    mapping (self->n_units, &fl, &sl);
+    block = self->free_lists[fl][sl];
+    assert (block && block->size == self->n_units << UNIT_SHIFT);
+    remove_free_block (self, block);
+    spalloc_free (ShmAllocBlock, block);
+  }
+
+  for (l = 0; l < self->n_levels; l++)
+    free (self->starts[l]);
+  free (self->used);
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -85,42 +392,42 @@ ShmAllocBlock *
 shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
 {
   ShmAllocBlock *block;
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
-  unsigned long prev_end_offset = 0;
-
+  unsigned long units;
 
-  for (item = self->blocks; item; item = item->next) {
-    unsigned long max_size = 0;
+  units = (size >> UNIT_SHIFT) + ((size & (SHM_ALLOC_UNIT - 1)) ? 1 : 0);
+  if (units == 0)
+    units = 1;
 
-    max_size = item->offset - prev_end_offset;
-
-    if (max_size >= size)
-      break;
+  block = find_free_block (self, units);
 
-    prev_end_offset = item->offset + item->size;
-    prev_item = item;
+  /* Return NULL if there is no big enough space */
+  if (!block) {
+    self->failures++;
+    return NULL;
   }
 
-  /* Return NULL if there is no big enough space, otherwise, there is space
-   * at the end */
-  assert (prev_end_offset <= self->size);
-  if (!item && self->size - prev_end_offset < size)
-    return NULL;
+  remove_free_block (self, block);
 
-  block = spalloc_new (ShmAllocBlock);
-  memset (block, 0, sizeof (ShmAllocBlock));
-  block->offset = prev_end_offset;
-  block->size = size;
-  block->use_count = 1;
-  block->space = self;
+  /* Give the rest back */
+  if (block->size > units << UNIT_SHIFT) {
+    ShmAllocBlock *rest = new_block (self, block->offset +
+        (units << UNIT_SHIFT), block->size - (units << UNIT_SHIFT));
 
-  if (prev_item)
-    prev_item->next = block;
-  else
-    self->blocks = block;
+    rest->prev_phys = block;
+    rest->next_phys = block->next_phys;
+    if (rest->next_phys)
+      rest->next_phys->prev_phys = rest;
+    block->next_phys = rest;
+    block->size = units << UNIT_SHIFT;
 
-  block->next = item;
+    insert_free_block (self, rest);
+  }
+
+  block->use_count = 1;
+  self->used[block->offset >> UNIT_SHIFT] = block;
+  starts_set (self, block->offset >> UNIT_SHIFT);
+  self->used_size += block->size;
+  self->n_blocks++;
 
   return block;
 }
@@ -131,38 +438,60 @@ shm_alloc_space_alloc_block_get_offset (ShmAllocBlock * block)
   return block->offset;
 }
 
+/* Merges @next into @block, both must be out of the free lists */
+static void
+merge_blocks (ShmAllocBlock * block, ShmAllocBlock * next)
+{
+  block->size += next->size;
+  block->next_phys = next->next_phys;
+  if (block->next_phys)
+    block->next_phys->prev_phys = block;
+
+  spalloc_free (ShmAllocBlock, next);
+}
+
 static void
 shm_alloc_space_free_block (ShmAllocBlock * block)
 {
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
   ShmAllocSpace *self = block->space;
 
-  for (item = self->blocks; item; item = item->next) {
-    if (item == block) {
-      if (prev_item)
-        prev_item->next = item->next;
-      else
-        self->blocks = item->next;
-      break;
-    }
-    prev_item = item;
+  self->used[block->offset >> UNIT_SHIFT] = NULL;
+  starts_clear (self, block->offset >> UNIT_SHIFT);
+  self->used_size -= block->size;
+  self->n_blocks--;
+
+  if (block->prev_phys && block->prev_phys->is_free) {
+    ShmAllocBlock *prev = block->prev_phys;
+
+    remove_free_block (self, prev);
+    merge_blocks (prev, block);
+    block = prev;
+  }
+
+  if (block->next_phys && block->next_phys->is_free) {
+    remove_free_block (self, block->next_phys);
+    merge_blocks (block, block->next_phys);
   }
 
-  spalloc_free (ShmAllocBlock, block);
+  insert_free_block (self, block);
 }
 
 ShmAllocBlock *
 shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
 {
-  ShmAllocBlock *block = NULL;
+  unsigned long unit = offset >> UNIT_SHIFT;
+  ShmAllocBlock *block;
+  long start;
 
-  for (block = self->blocks; block; block = block->next) {
-    if (block->offset <= offset && (block->offset + block->size) > offset)
-      return block;
-  }
+  if (unit >= self->n_units)
+    return NULL;
 
-  return NULL;
+  start = starts_find (self, unit);
+  if (start < 0)
+    return NULL;
+
+  block = self->used[start];
+  return (offset < block->offset + block->size) ? block : NULL;
 }
 
 
@@ -180,3 +509,26 @@ shm_alloc_space_block_dec (ShmAllocBlock * block)
   if (block->use_count <= 0)
     shm_alloc_space_free_block (block);
 }
+
+void
+shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats)
+{
+  memset (stats, 0, sizeof (ShmAllocStats));
+
+  stats->size = self->n_units << UNIT_SHIFT;
+  stats->used = self->used_size;
+  stats->n_blocks = self->n_blocks;
+  stats->n_free_blocks = self->n_free_blocks;
+  stats->failures = self->failures;
+
+  /* The largest free block is in the highest non-empty list */
+  if (self->fl_bitmap) {
+    int fl = msb (self->fl_bitmap);
+    int sl = msb (self->sl_bitmap[fl]);
+    ShmAllocBlock *block;
+
+    for (block = self->free_lists[fl][sl]; block; block = block->next_free)
+      if (block->size > stats->largest_free)
+        stats->largest_free = block->size;
+  }
+}
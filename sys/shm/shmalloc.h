@@ -52,6 +52,21 @@ extern "C" {
 
 typedef struct _ShmAllocSpace ShmAllocSpace;
 typedef struct _ShmAllocBlock ShmAllocBlock;
+typedef struct _ShmAllocStats ShmAllocStats;
+
+struct _ShmAllocStats
+{
+  /* Usable size of the space */
+  unsigned long size;
+  /* Bytes in the blocks in use, including the rounding to units */
+  unsigned long used;
+  unsigned long n_blocks;
+  /* Number of free holes and size of the largest one */
+  unsigned long n_free_blocks;
+  unsigned long largest_free;
+  /* Number of allocations that did not fit */
+  unsigned long failures;
+};
 
 ShmAllocSpace *shm_alloc_space_new (size_t size);
 void shm_alloc_space_free (ShmAllocSpace * self);
@@ -66,6 +81,8 @@ void shm_alloc_space_block_dec (ShmAllocBlock * block);
 ShmAllocBlock * shm_alloc_space_block_get (ShmAllocSpace * space,
     unsigned long offset);
 
+void shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats);
+
 
 #ifdef __cplusplus
 }
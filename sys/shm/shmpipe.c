@@ -48,6 +48,7 @@
 #include <assert.h>
 
 #include "shmalloc.h"
+#include "shmring.h"
 
 /*
  * The protocol over the pipe is in packets
@@ -58,7 +59,7 @@
  * Size of path (followed by path)
  *
  * type 2: Close shm area:
- * No payload
+ * Number of descriptors pushed to the ring before (only with a ring)
  *
  * type 3: shm buffer
  * offset
@@ -67,9 +68,30 @@
  * type 4: ack buffer
  * offset
  *
+ * type 5: new ring
+ * Number of slots
+ * The shm fd of the ring and the two notification fds are passed along
+ *
+ * type 6: shm buffer with meta
+ * offset
+ * bufsize
+ * Followed by a ShmBufferMeta
+ *
  * Type 4 goes from the client to the server
  * The rest are from the server to the client
- * The client should never write in the SHM
+ * The client should never write in the SHM, except in the ring
+ *
+ * Once a client has a ring, the buffers and the acks are pushed to it
+ * instead of being sent over the socket, as ShmRingDesc with the same type,
+ * area id, offset and size. As the shm areas are still announced over the
+ * socket, the client might see a buffer from an area it does not know yet,
+ * it then has to read the socket first. It must also not close an area
+ * before it has popped everything that was pushed before the close.
+ *
+ * Type 6 replaces type 3 for the clients accepted after the writer enabled
+ * the metadata with sp_writer_set_send_meta(), as readers that don't know
+ * about it would fail on it. Those are also the only clients that get the
+ * buffers that don't contain data.
  */
 
 
@@ -80,7 +102,9 @@ enum
   COMMAND_NEW_SHM_AREA = 1,
   COMMAND_CLOSE_SHM_AREA = 2,
   COMMAND_NEW_BUFFER = 3,
-  COMMAND_ACK_BUFFER = 4
+  COMMAND_ACK_BUFFER = 4,
+  COMMAND_NEW_RING = 5,
+  COMMAND_NEW_BUFFER_META = 6
 };
 
 typedef struct _ShmArea ShmArea;
@@ -100,6 +124,10 @@ struct _ShmArea
 
   ShmAllocSpace *allocspace;
 
+  /* Client with a ring: closed once this many descriptors are popped */
+  int close_pending;
+  uint32_t close_seq;
+
   ShmArea *next;
 };
 
@@ -139,12 +167,29 @@ struct _ShmPipe
   ShmClient *clients;
 
   mode_t perms;
+
+  /* Writer: size of the rings of the new clients, 0 for no ring */
+  unsigned int ring_slots;
+  /* Writer: whether the new clients get the ShmBufferMeta */
+  int send_meta;
+  /* Client: the ring, if the writer sent one */
+  ShmRing *ring;
+  /* Client: id of the newest area the writer announced */
+  int last_area_id;
 };
 
 struct _ShmClient
 {
   int fd;
 
+  ShmRing *ring;
+  /* Buffers pushed to the ring but not acked yet, at most the number of
+   * slots so that neither direction can overflow */
+  unsigned int ring_pending;
+
+  /* Whether this client gets the ShmBufferMeta */
+  int send_meta;
+
   ShmClient *next;
 };
 
@@ -174,9 +219,17 @@ struct CommandBuffer
       unsigned long size;
     } buffer;
     struct
+    {
+      uint32_t ring_seq;
+    } close_shm_area;
+    struct
     {
       unsigned long offset;
     } ack_buffer;
+    struct
+    {
+      unsigned int slots;
+    } new_ring;
   } payload;
 };
 
@@ -185,6 +238,8 @@ static void sp_close_shm (ShmArea * area);
 static int sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf,
     ShmBuffer * prev_buf, ShmClient * client, void **tag);
 static void sp_shm_area_dec (ShmPipe * self, ShmArea * area);
+static int sp_writer_ack_buffer (ShmPipe * self, ShmClient * client,
+    int area_id, unsigned long offset, void **tag);
 
 
 
@@ -438,6 +493,11 @@ sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
   while (self->clients)
     sp_writer_close_client (self, self->clients, callback, user_data);
 
+  if (self->ring) {
+    shm_ring_free (self->ring);
+    self->ring = NULL;
+  }
+
   sp_dec (self);
 }
 
@@ -477,6 +537,44 @@ send_command (int fd, struct CommandBuffer *cb, unsigned short int type,
   return 1;
 }
 
+static int
+send_command_with_fds (int fd, struct CommandBuffer *cb,
+    unsigned short int type, int area_id, const int *fds, int n_fds)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr cmsg;
+    char buf[CMSG_SPACE (sizeof (int) * SHM_RING_N_FDS)];
+  } control;
+
+  assert (n_fds > 0 && n_fds <= SHM_RING_N_FDS);
+
+  cb->type = type;
+  cb->area_id = area_id;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE (sizeof (int) * n_fds);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int) * n_fds);
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * n_fds);
+
+  if (sendmsg (fd, &msg, MSG_NOSIGNAL) != sizeof (struct CommandBuffer))
+    return 0;
+
+  return 1;
+}
+
 int
 sp_writer_resize (ShmPipe * self, size_t size)
 {
@@ -503,6 +601,9 @@ sp_writer_resize (ShmPipe * self, size_t size)
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
 
+    /* The buffers of the old area already in the ring must stay valid */
+    if (client->ring)
+      cb.payload.close_shm_area.ring_seq = shm_ring_get_pushed (client->ring);
     if (!send_command (client->fd, &cb, COMMAND_CLOSE_SHM_AREA,
             old_current->id))
       continue;
@@ -568,8 +669,12 @@ sp_writer_free_block (ShmBlock * block)
 /* Returns the number of client this has successfully been sent to */
 
 int
-sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
+sp_writer_send_buf (ShmPipe * self, char *buf, size_t size,
+    const ShmBufferMeta * meta, void *tag)
 {
+  static const ShmBufferMeta no_meta = { SP_TIME_NONE, SP_TIME_NONE,
+    SP_TIME_NONE, 0, SP_BUFFER_TYPE_DATA
+  };
   ShmArea *area = NULL;
   unsigned long offset = 0;
   unsigned long bsize = size;
@@ -582,6 +687,9 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   if (self->num_clients == 0)
     return 0;
 
+  if (!meta)
+    meta = &no_meta;
+
   for (area = self->shm_area; area; area = area->next) {
     if (buf >= area->shm_area_buf &&
         buf < (area->shm_area_buf + area->shm_area_len)) {
@@ -607,10 +715,36 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
 
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
-    cb.payload.buffer.offset = offset;
-    cb.payload.buffer.size = bsize;
-    if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
+
+    /* The other clients would take it for data */
+    if (!client->send_meta && meta->type != SP_BUFFER_TYPE_DATA)
       continue;
+
+    if (client->ring) {
+      ShmRingDesc desc = { COMMAND_NEW_BUFFER, area->id, offset, bsize,
+        meta->pts, meta->dts, meta->duration, meta->flags, meta->type
+      };
+
+      if (client->send_meta)
+        desc.type = COMMAND_NEW_BUFFER_META;
+
+      /* Drop the buffer for this client if it is too late, same as when
+       * the socket fails */
+      if (client->ring_pending >= shm_ring_get_slots (client->ring) ||
+          !shm_ring_push (client->ring, &desc))
+        continue;
+      client->ring_pending++;
+    } else {
+      cb.payload.buffer.offset = offset;
+      cb.payload.buffer.size = bsize;
+      if (!send_command (client->fd, &cb, client->send_meta ?
+              COMMAND_NEW_BUFFER_META : COMMAND_NEW_BUFFER,
+              self->shm_area->id))
+        continue;
+      if (client->send_meta && send (client->fd, meta, sizeof (*meta),
+              MSG_NOSIGNAL) != sizeof (*meta))
+        continue;
+    }
     sb->clients[i++] = client->fd;
     c++;
   }
@@ -644,18 +778,118 @@ recv_command (int fd, struct CommandBuffer *cb)
   }
 }
 
+/* Same as recv_command() but also receives up to SHM_RING_N_FDS fds, the
+ * ones that were not received are set to -1 */
+static int
+recv_command_with_fds (int fd, struct CommandBuffer *cb,
+    int fds[SHM_RING_N_FDS])
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr cmsg;
+    char buf[CMSG_SPACE (sizeof (int) * SHM_RING_N_FDS)];
+  } control;
+  int i;
+
+  for (i = 0; i < SHM_RING_N_FDS; i++)
+    fds[i] = -1;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  if (recvmsg (fd, &msg, MSG_DONTWAIT) != sizeof (struct CommandBuffer))
+    return 0;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+
+      if (n > SHM_RING_N_FDS)
+        n = SHM_RING_N_FDS;
+      memcpy (fds, CMSG_DATA (cmsg), sizeof (int) * n);
+    }
+  }
+
+  return 1;
+}
+
+static void
+close_fds (int fds[SHM_RING_N_FDS])
+{
+  int i;
+
+  for (i = 0; i < SHM_RING_N_FDS; i++)
+    if (fds[i] >= 0)
+      close (fds[i]);
+}
+
+static ShmArea *
+sp_find_area (ShmPipe * self, int area_id)
+{
+  ShmArea *area;
+
+  for (area = self->shm_area; area; area = area->next)
+    if (area->id == area_id)
+      return area;
+
+  return NULL;
+}
+
+/* Closes the areas whose close was deferred until everything pushed to the
+ * ring before it has been popped */
+static void
+sp_client_close_ring_areas (ShmPipe * self)
+{
+  uint32_t popped = shm_ring_get_popped (self->ring);
+  ShmArea *area, *next;
+
+  for (area = self->shm_area; area; area = next) {
+    next = area->next;
+    if (area->close_pending && (int32_t) (popped - area->close_seq) >= 0) {
+      area->close_pending = 0;
+      sp_shm_area_dec (self, area);
+    }
+  }
+}
+
+/**
+ * sp_buffer_meta_init:
+ *
+ * Sets @meta to what a buffer sent without metadata has: unknown times, no
+ * flags and data.
+ */
+void
+sp_buffer_meta_init (ShmBufferMeta * meta)
+{
+  meta->pts = meta->dts = meta->duration = SP_TIME_NONE;
+  meta->flags = 0;
+  meta->type = SP_BUFFER_TYPE_DATA;
+}
+
 long int
-sp_client_recv (ShmPipe * self, char **buf)
+sp_client_recv (ShmPipe * self, char **buf, ShmBufferMeta * meta)
 {
   char *area_name = NULL;
   ShmArea *newarea;
   ShmArea *area;
   struct CommandBuffer cb;
+  int fds[SHM_RING_N_FDS];
   int retval;
 
-  if (!recv_command (self->main_socket, &cb))
+  if (!recv_command_with_fds (self->main_socket, &cb, fds))
     return -1;
 
+  if (cb.type != COMMAND_NEW_RING)
+    close_fds (fds);
+
   switch (cb.type) {
     case COMMAND_NEW_SHM_AREA:
       assert (cb.payload.new_shm_area.path_size > 0);
@@ -677,19 +911,45 @@ sp_client_recv (ShmPipe * self, char **buf)
 
       newarea->next = self->shm_area;
       self->shm_area = newarea;
+      if (cb.area_id > self->last_area_id)
+        self->last_area_id = cb.area_id;
       break;
 
     case COMMAND_CLOSE_SHM_AREA:
-      for (area = self->shm_area; area; area = area->next) {
-        if (area->id == cb.area_id) {
-          sp_shm_area_dec (self, area);
-          break;
-        }
+      area = sp_find_area (self, cb.area_id);
+      if (area && self->ring && !area->close_pending) {
+        area->close_pending = 1;
+        area->close_seq = cb.payload.close_shm_area.ring_seq;
+        sp_client_close_ring_areas (self);
+      } else if (area && !area->close_pending) {
+        sp_shm_area_dec (self, area);
+      }
+      break;
+
+    case COMMAND_NEW_RING:
+      if (self->ring) {
+        close_fds (fds);
+        return -5;
       }
+      self->ring = shm_ring_open (fds, cb.payload.new_ring.slots);
+      if (!self->ring)
+        return -6;
       break;
 
     case COMMAND_NEW_BUFFER:
+    case COMMAND_NEW_BUFFER_META:
       assert (buf);
+      if (cb.type == COMMAND_NEW_BUFFER_META) {
+        ShmBufferMeta received;
+
+        retval = recv (self->main_socket, &received, sizeof (received), 0);
+        if (retval != sizeof (received))
+          return -3;
+        if (meta)
+          *meta = received;
+      } else if (meta) {
+        sp_buffer_meta_init (meta);
+      }
       for (area = self->shm_area; area; area = area->next) {
         if (area->id == cb.area_id) {
           *buf = area->shm_area_buf + cb.payload.buffer.offset;
@@ -709,7 +969,6 @@ sp_client_recv (ShmPipe * self, char **buf)
 int
 sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
 {
-  ShmBuffer *buf = NULL, *prev_buf = NULL;
   struct CommandBuffer cb;
 
   if (!recv_command (client->fd, &cb))
@@ -717,25 +976,75 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
 
   switch (cb.type) {
     case COMMAND_ACK_BUFFER:
+      return sp_writer_ack_buffer (self, client, cb.area_id,
+          cb.payload.ack_buffer.offset, tag);
+    default:
+      return -99;
+  }
 
-      for (buf = self->buffers; buf; buf = buf->next) {
-        if (buf->shm_area->id == cb.area_id &&
-            buf->offset == cb.payload.ack_buffer.offset) {
-          return sp_shmbuf_dec (self, buf, prev_buf, client, tag);
-          break;
-        }
-        prev_buf = buf;
-      }
+  return 0;
+}
 
-      if (!buf)
-        return -2;
+static int
+sp_writer_ack_buffer (ShmPipe * self, ShmClient * client, int area_id,
+    unsigned long offset, void **tag)
+{
+  ShmBuffer *buf = NULL, *prev_buf = NULL;
 
-      break;
-    default:
+  for (buf = self->buffers; buf; buf = buf->next) {
+    if (buf->shm_area->id == area_id && buf->offset == offset) {
+      /* The client may fall back to the socket if its ack ring is full */
+      if (client->ring && client->ring_pending > 0)
+        client->ring_pending--;
+      return sp_shmbuf_dec (self, buf, prev_buf, client, tag);
+    }
+    prev_buf = buf;
+  }
+
+  return -2;
+}
+
+/**
+ * sp_writer_recv_ring:
+ *
+ * Processes all the acks pushed by @client to its ring, calling @callback
+ * with the tag of each buffer that is no longer used by any client.
+ *
+ * Returns the number of acks processed, or a negative number on error
+ */
+int
+sp_writer_recv_ring (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void *user_data)
+{
+  ShmRingDesc desc;
+  int count = 0;
+  int ret;
+
+  if (!client->ring)
+    return -1;
+
+  shm_ring_clear (client->ring);
+
+  while ((ret = shm_ring_peek (client->ring, &desc)) > 0) {
+    void *tag = NULL;
+
+    shm_ring_pop (client->ring);
+
+    if (desc.type != COMMAND_ACK_BUFFER)
       return -99;
+
+    ret = sp_writer_ack_buffer (self, client, desc.area_id, desc.offset, &tag);
+    if (ret < 0)
+      return ret;
+    if (ret == 0 && callback)
+      callback (tag, user_data);
+    count++;
   }
 
-  return 0;
+  if (ret < 0)
+    return -3;
+
+  return count;
 }
 
 int
@@ -755,6 +1064,18 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
 
   offset = buf - shm_area->shm_area_buf;
 
+  if (self->ring) {
+    ShmRingDesc desc = { COMMAND_ACK_BUFFER, shm_area->id, offset, 0 };
+
+    sp_shm_area_dec (self, shm_area);
+    if (shm_ring_push (self->ring, &desc))
+      return 1;
+    /* Can't happen with a well behaved writer, use the socket then */
+    cb.payload.ack_buffer.offset = offset;
+    return send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER,
+        desc.area_id);
+  }
+
   sp_shm_area_dec (self, shm_area);
 
   cb.payload.ack_buffer.offset = offset;
@@ -762,6 +1083,102 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
       self->shm_area->id);
 }
 
+int
+sp_client_get_ring_fd (ShmPipe * self)
+{
+  if (!self->ring)
+    return -1;
+
+  return shm_ring_get_fd (self->ring);
+}
+
+/**
+ * sp_client_recv_ring:
+ * @buf: Set to the buffer, or to NULL if there is none
+ * @meta: Set to the metadata of the buffer, can be NULL
+ *
+ * Pops a buffer from the ring, if the writer sent one.
+ *
+ * Returns the size of the buffer, 0 if there is none and a negative number
+ * on error. If this returns no buffer, the client must wait for the ring fd
+ * or the socket to become readable. A buffer from an area that was not
+ * received on the socket yet is left in the ring until it is, one from an
+ * area that will never be received is dropped.
+ */
+long int
+sp_client_recv_ring (ShmPipe * self, char **buf, ShmBufferMeta * meta)
+{
+  ShmRingDesc desc;
+  ShmArea *area;
+  int ret;
+
+  *buf = NULL;
+
+  if (!self->ring)
+    return 0;
+
+again:
+  ret = shm_ring_peek (self->ring, &desc);
+  if (ret == 0) {
+    /* Something may have been pushed between the peek and the clear and
+     * its notification was consumed, so look again */
+    shm_ring_clear (self->ring);
+    ret = shm_ring_peek (self->ring, &desc);
+  }
+
+  if (ret < 0)
+    return -1;
+  if (ret == 0)
+    return 0;
+
+  if (desc.type != COMMAND_NEW_BUFFER && desc.type != COMMAND_NEW_BUFFER_META)
+    return -99;
+
+  area = sp_find_area (self, desc.area_id);
+  if (!area && desc.area_id > self->last_area_id) {
+    /* The writer announces an area on the socket before it pushes buffers
+     * from it. Until that is read, don't let the pending notification wake
+     * the client up again, the writer won't send another one as long as
+     * this buffer is in the ring */
+    shm_ring_clear (self->ring);
+    return 0;
+  } else if (!area) {
+    ShmRingDesc ack = { COMMAND_ACK_BUFFER, desc.area_id, desc.offset, 0 };
+    struct CommandBuffer cb = { 0 };
+
+    /* Older than the last announced area, so it won't ever show up. Give
+     * the buffer back to the writer so that it doesn't wait for it */
+    fprintf (stderr, "Dropping buffer from unknown area %d\n", desc.area_id);
+    shm_ring_pop (self->ring);
+    if (!shm_ring_push (self->ring, &ack)) {
+      cb.payload.ack_buffer.offset = desc.offset;
+      send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER, desc.area_id);
+    }
+    goto again;
+  }
+
+  if (desc.offset >= area->shm_area_len ||
+      desc.size > area->shm_area_len - desc.offset)
+    return -23;
+
+  shm_ring_pop (self->ring);
+
+  *buf = area->shm_area_buf + desc.offset;
+  if (meta && desc.type != COMMAND_NEW_BUFFER_META) {
+    sp_buffer_meta_init (meta);
+  } else if (meta) {
+    meta->pts = desc.pts;
+    meta->dts = desc.dts;
+    meta->duration = desc.duration;
+    meta->flags = desc.flags;
+    meta->type = desc.buffer_type;
+  }
+  sp_shm_area_inc (area);
+  sp_client_close_ring_areas (self);
+
+  return desc.size;
+}
+
 ShmPipe *
 sp_client_open (const char *path)
 {
@@ -830,6 +1247,29 @@ sp_writer_accept_client (ShmPipe * self)
 
   client = spalloc_new (ShmClient);
   client->fd = fd;
+  client->ring = NULL;
+  client->ring_pending = 0;
+  client->send_meta = self->send_meta;
+
+  if (self->ring_slots) {
+    client->ring = shm_ring_new (self->ring_slots);
+
+    /* Without a ring, this client just uses the socket */
+    if (client->ring) {
+      int fds[SHM_RING_N_FDS];
+
+      shm_ring_get_peer_fds (client->ring, fds);
+      memset (&cb, 0, sizeof (cb));
+      cb.payload.new_ring.slots = self->ring_slots;
+      if (!send_command_with_fds (fd, &cb, COMMAND_NEW_RING, 0, fds,
+              SHM_RING_N_FDS)) {
+        fprintf (stderr, "Sending new ring failed: %s", strerror (errno));
+        shm_ring_free (client->ring);
+        spalloc_free (ShmClient, client);
+        goto error;
+      }
+    }
+  }
 
   /* Prepend ot linked list */
   client->next = self->clients;
@@ -925,6 +1365,9 @@ again:
 
   self->num_clients--;
 
+  if (client->ring)
+    shm_ring_free (client->ring);
+
   spalloc_free (ShmClient, client);
 }
 
@@ -976,5 +1419,75 @@ sp_writer_get_max_buf_size (ShmPipe * self)
   if (self->shm_area == NULL)
     return 0;
 
+  /* The allocator may not be able to use the very end of the area */
+  if (self->shm_area->allocspace) {
+    ShmAllocStats stats;
+
+    shm_alloc_space_get_stats (self->shm_area->allocspace, &stats);
+    return stats.size;
+  }
+
   return self->shm_area->shm_area_len;
 }
+
+/**
+ * sp_writer_set_ring_size:
+ * @slots: Number of buffers that can be in flight to each client, 0 to
+ *  use the socket
+ *
+ * Makes the clients accepted from now on use a ring in shared memory
+ * instead of the socket to exchange buffers. @slots is rounded up to a
+ * power of 2.
+ *
+ * Returns the number of slots that will be used
+ */
+int
+sp_writer_set_ring_size (ShmPipe * self, unsigned int slots)
+{
+  unsigned int size = 1;
+
+  if (slots == 0) {
+    self->ring_slots = 0;
+    return 0;
+  }
+
+  while (size < slots && size < (1U << 16))
+    size <<= 1;
+  self->ring_slots = size;
+
+  return size;
+}
+
+/**
+ * sp_writer_set_send_meta:
+ * @send_meta: Whether to send the ShmBufferMeta
+ *
+ * Makes the clients accepted from now on get the ShmBufferMeta of the
+ * buffers, and the buffers that don't contain data. Readers from before
+ * the ShmBufferMeta can't connect to such a writer.
+ */
+void
+sp_writer_set_send_meta (ShmPipe * self, int send_meta)
+{
+  self->send_meta = send_meta;
+}
+
+int
+sp_writer_get_client_ring_fd (ShmClient * client)
+{
+  if (!client->ring)
+    return -1;
+
+  return shm_ring_get_fd (client->ring);
+}
+
+void
+sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats)
+{
+  if (self->shm_area == NULL || self->shm_area->allocspace == NULL) {
+    memset (stats, 0, sizeof (ShmAllocStats));
+    return;
+  }
+
+  shm_alloc_space_get_stats (self->shm_area->allocspace, stats);
+}
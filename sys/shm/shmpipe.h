@@ -41,7 +41,9 @@
  * sp_writer_alloc_block(), then writes something in the buffer
  * (retrieved with sp_writer_block_get_buf(), then calls
  * sp_writer_send_buf() to send the buffer or a subsection to the
- * other side. When it is done with the block, it calls
+ * other side, along with a ShmBufferMeta that the reader gets back from
+ * sp_client_recv() if the writer enabled it with sp_writer_set_send_meta()
+ * before accepting it. When it is done with the block, it calls
  * sp_writer_free_block().  If alloc fails, then the server must wait
  * for events on the client fd (the ones where sp_writer_recv() is
  * called), and then try to re-alloc.
@@ -56,6 +58,16 @@
  * buffers are no longer valid. If was valid buffer was received, the
  * client must release it with sp_client_recv_finish() when it is done
  * reading from it.
+ *
+ * If the writer enabled the ring with sp_writer_set_ring_size() before
+ * accepting a client, the buffers and the acks go through a ring in shared
+ * memory instead of the socket, which is then only used for the setup and
+ * the teardown. The writer must then also select() on the fd returned by
+ * sp_writer_get_client_ring_fd() and call sp_writer_recv_ring() when it is
+ * readable. The reader must call sp_client_recv_ring() before select()ing,
+ * and also select() on the fd from sp_client_get_ring_fd() once it is
+ * valid, until sp_client_recv_ring() returns a buffer. Those buffers are
+ * released with sp_client_recv_finish() too.
  */
 
 
@@ -68,6 +80,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "shmalloc.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -78,8 +91,33 @@ typedef struct _ShmPipe ShmPipe;
 typedef struct _ShmBlock ShmBlock;
 typedef struct _ShmBuffer ShmBuffer;
 
+typedef struct _ShmBufferMeta ShmBufferMeta;
+
 typedef void (*sp_buffer_free_callback) (void * tag, void * user_data);
 
+/* An unknown time in a ShmBufferMeta */
+#define SP_TIME_NONE ((uint64_t) -1)
+
+/* Sent along with each buffer, the pipe itself only looks at the type */
+struct _ShmBufferMeta
+{
+  uint64_t pts;
+  uint64_t dts;
+  uint64_t duration;
+  uint32_t flags;
+  /* One of the SP_BUFFER_TYPE_* */
+  uint32_t type;
+};
+
+enum
+{
+  /* The buffer contains data */
+  SP_BUFFER_TYPE_DATA = 0,
+  /* The buffer describes the format of the following data buffers, only
+   * sent to the clients that get the ShmBufferMeta */
+  SP_BUFFER_TYPE_FORMAT = 1
+};
+
 ShmPipe *sp_writer_create (const char *path, size_t size, mode_t perms);
 const char *sp_writer_get_path (ShmPipe *pipe);
 void sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
@@ -95,25 +133,38 @@ int sp_writer_get_client_fd (ShmClient * client);
 
 ShmBlock *sp_writer_alloc_block (ShmPipe * self, size_t size);
 void sp_writer_free_block (ShmBlock *block);
-int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void * tag);
+int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size,
+    const ShmBufferMeta * meta, void * tag);
 char *sp_writer_block_get_buf (ShmBlock *block);
 ShmPipe *sp_writer_block_get_pipe (ShmBlock *block);
 size_t sp_writer_get_max_buf_size (ShmPipe * self);
+void sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats);
 
 ShmClient * sp_writer_accept_client (ShmPipe * self);
 void sp_writer_close_client (ShmPipe *self, ShmClient * client,
     sp_buffer_free_callback callback, void * user_data);
 int sp_writer_recv (ShmPipe * self, ShmClient * client, void ** tag);
 
+int sp_writer_set_ring_size (ShmPipe * self, unsigned int slots);
+void sp_writer_set_send_meta (ShmPipe * self, int send_meta);
+int sp_writer_get_client_ring_fd (ShmClient * client);
+int sp_writer_recv_ring (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void * user_data);
+
 int sp_writer_pending_writes (ShmPipe * self);
 
 ShmBuffer *sp_writer_get_pending_buffers (ShmPipe * self);
 ShmBuffer *sp_writer_get_next_buffer (ShmBuffer * buffer);
 void *sp_writer_buf_get_tag (ShmBuffer * buffer);
 
+void sp_buffer_meta_init (ShmBufferMeta * meta);
+
 ShmPipe *sp_client_open (const char *path);
-long int sp_client_recv (ShmPipe * self, char **buf);
+long int sp_client_recv (ShmPipe * self, char **buf, ShmBufferMeta * meta);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
+int sp_client_get_ring_fd (ShmPipe * self);
+long int sp_client_recv_ring (ShmPipe * self, char **buf,
+    ShmBufferMeta * meta);
 void sp_client_close (ShmPipe * self);
 
 #ifdef __cplusplus
@@ -0,0 +1,457 @@
+/* GStreamer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "shmring.h"
+#include "shmalloc.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+/* The indexes are free-running counters, the slot is index & (slots - 1).
+ * Each one is only written by one side and they are kept on separate cache
+ * lines so that the producer and the consumer don't bounce them. */
+typedef struct
+{
+  uint32_t head;                /* written by the producer */
+  char _pad1[CACHE_LINE_SIZE - sizeof (uint32_t)];
+  uint32_t tail;                /* written by the consumer */
+  char _pad2[CACHE_LINE_SIZE - sizeof (uint32_t)];
+} ShmRingQueue;
+
+/* Layout of the shared area:
+ *   ShmRingQueue to_reader;
+ *   ShmRingQueue to_writer;
+ *   ShmRingDesc to_reader_slots[slots];
+ *   ShmRingDesc to_writer_slots[slots];
+ */
+struct _ShmRing
+{
+  int shm_fd;
+  char *area;
+  size_t area_len;
+
+  unsigned int slots;
+
+  /* The queue we push to and the one we pop from */
+  ShmRingQueue *out;
+  ShmRingDesc *out_slots;
+  ShmRingQueue *in;
+  ShmRingDesc *in_slots;
+
+  /* Our own copies of the indexes we write, the other side can write in
+   * the shared area */
+  uint32_t out_head;
+  uint32_t in_tail;
+
+  /* fd that becomes readable when our input queue becomes non-empty, and fd
+   * to write to when our output queue becomes non-empty. They are the same
+   * fd when using a socketpair */
+  int wait_fd;
+  int kick_fd;
+
+  /* Writer only: the fds passed to the reader */
+  int peer_wait_fd;
+  int peer_kick_fd;
+};
+
+/* The stores and loads of the indexes must be sequentially consistent: the
+ * producer stores the head then loads the tail to know if the queue was
+ * empty while the consumer stores the tail then loads the head to know if
+ * it is empty, neither of these may be reordered or a wake up is lost */
+#define INDEX_LOAD(p) __atomic_load_n ((p), __ATOMIC_SEQ_CST)
+#define INDEX_STORE(p, v) __atomic_store_n ((p), (v), __ATOMIC_SEQ_CST)
+
+static size_t
+shm_ring_area_size (unsigned int slots)
+{
+  return 2 * sizeof (ShmRingQueue) + 2 * slots * sizeof (ShmRingDesc);
+}
+
+static int
+shm_ring_map (ShmRing * self, int writer)
+{
+  ShmRingQueue *to_reader, *to_writer;
+  ShmRingDesc *to_reader_slots, *to_writer_slots;
+
+  self->area_len = shm_ring_area_size (self->slots);
+  self->area = mmap (NULL, self->area_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+      self->shm_fd, 0);
+  if (self->area == MAP_FAILED)
+    return 0;
+
+  to_reader = (ShmRingQueue *) self->area;
+  to_writer = to_reader + 1;
+  to_reader_slots = (ShmRingDesc *) (to_writer + 1);
+  to_writer_slots = to_reader_slots + self->slots;
+
+  if (writer) {
+    self->out = to_reader;
+    self->out_slots = to_reader_slots;
+    self->in = to_writer;
+    self->in_slots = to_writer_slots;
+  } else {
+    self->out = to_writer;
+    self->out_slots = to_writer_slots;
+    self->in = to_reader;
+    self->in_slots = to_reader_slots;
+  }
+
+  self->out_head = INDEX_LOAD (&self->out->head);
+  self->in_tail = INDEX_LOAD (&self->in->tail);
+
+  return 1;
+}
+
+static ShmRing *
+shm_ring_alloc (unsigned int slots)
+{
+  ShmRing *self = spalloc_new (ShmRing);
+
+  memset (self, 0, sizeof (ShmRing));
+  self->slots = slots;
+  self->area = MAP_FAILED;
+  self->shm_fd = -1;
+  self->wait_fd = -1;
+  self->kick_fd = -1;
+  self->peer_wait_fd = -1;
+  self->peer_kick_fd = -1;
+
+  return self;
+}
+
+static int
+set_nonblock (int fd)
+{
+  int flags = fcntl (fd, F_GETFL, 0);
+
+  if (flags < 0)
+    return 0;
+
+  return fcntl (fd, F_SETFL, flags | O_NONBLOCK) >= 0 &&
+      fcntl (fd, F_SETFD, FD_CLOEXEC) >= 0;
+}
+
+/**
+ * shm_ring_new:
+ * @slots: Number of descriptors in each direction, must be a power of 2
+ *
+ * Creates the writer side of a ring. The shared memory is unlinked right
+ * away, it is only reachable through the fd passed to the reader.
+ */
+ShmRing *
+shm_ring_new (unsigned int slots)
+{
+  ShmRing *self;
+  char tmppath[32];
+  int i = 0;
+
+  if (slots == 0 || (slots & (slots - 1)) != 0)
+    return NULL;
+
+  self = shm_ring_alloc (slots);
+
+  do {
+    snprintf (tmppath, sizeof (tmppath), "/shmring.%5d.%5d", getpid (), i++);
+    self->shm_fd = shm_open (tmppath, O_RDWR | O_CREAT | O_EXCL,
+        S_IRUSR | S_IWUSR);
+  } while (self->shm_fd < 0 && errno == EEXIST);
+
+  if (self->shm_fd < 0)
+    goto error;
+
+  shm_unlink (tmppath);
+
+  if (ftruncate (self->shm_fd, shm_ring_area_size (slots)))
+    goto error;
+
+  if (!shm_ring_map (self, 1))
+    goto error;
+
+#ifdef HAVE_SYS_EVENTFD_H
+  self->wait_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  self->kick_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (self->wait_fd < 0 || self->kick_fd < 0)
+    goto error;
+
+  /* The reader waits on what we kick and the other way around */
+  self->peer_wait_fd = self->kick_fd;
+  self->peer_kick_fd = self->wait_fd;
+#else
+  {
+    int sv[2];
+
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+      goto error;
+
+    self->wait_fd = self->kick_fd = sv[0];
+    self->peer_wait_fd = self->peer_kick_fd = sv[1];
+
+    if (!set_nonblock (sv[0]) || !set_nonblock (sv[1]))
+      goto error;
+  }
+#endif
+
+  return self;
+
+error:
+  fprintf (stderr, "Could not create shm ring (%d): %s\n", errno,
+      strerror (errno));
+  shm_ring_free (self);
+  return NULL;
+}
+
+/**
+ * shm_ring_open:
+ * @fds: The fds received from the writer, this takes ownership of them
+ * @slots: The number of slots of the ring
+ *
+ * Creates the reader side of a ring.
+ */
+ShmRing *
+shm_ring_open (const int fds[SHM_RING_N_FDS], unsigned int slots)
+{
+  ShmRing *self;
+
+  if (slots == 0 || (slots & (slots - 1)) != 0) {
+    int i;
+
+    for (i = 0; i < SHM_RING_N_FDS; i++)
+      if (fds[i] >= 0)
+        close (fds[i]);
+    return NULL;
+  }
+
+  self = shm_ring_alloc (slots);
+  self->shm_fd = fds[0];
+  self->wait_fd = fds[1];
+  self->kick_fd = fds[2];
+
+  if (self->shm_fd < 0 || self->wait_fd < 0 || self->kick_fd < 0)
+    goto error;
+
+  if (!set_nonblock (self->wait_fd) || !set_nonblock (self->kick_fd))
+    goto error;
+
+  if (!shm_ring_map (self, 0))
+    goto error;
+
+  return self;
+
+error:
+  shm_ring_free (self);
+  return NULL;
+}
+
+static void
+close_fd (int fd, int *others, int n_others)
+{
+  int i;
+
+  if (fd < 0)
+    return;
+
+  /* With a socketpair, the same fd is used for several things */
+  for (i = 0; i < n_others; i++)
+    if (others[i] == fd)
+      return;
+
+  close (fd);
+}
+
+void
+shm_ring_free (ShmRing * self)
+{
+  int fds[4] = { self->wait_fd, self->kick_fd, self->peer_wait_fd,
+    self->peer_kick_fd
+  };
+  int i;
+
+  for (i = 0; i < 4; i++)
+    close_fd (fds[i], fds + i + 1, 3 - i);
+
+  if (self->area != MAP_FAILED)
+    munmap (self->area, self->area_len);
+
+  if (self->shm_fd >= 0)
+    close (self->shm_fd);
+
+  spalloc_free (ShmRing, self);
+}
+
+/**
+ * shm_ring_get_peer_fds:
+ *
+ * Returns the fds to pass to shm_ring_open() on the other side. They stay
+ * owned by the ring.
+ */
+void
+shm_ring_get_peer_fds (ShmRing * self, int fds[SHM_RING_N_FDS])
+{
+  fds[0] = self->shm_fd;
+  fds[1] = self->peer_wait_fd;
+  fds[2] = self->peer_kick_fd;
+}
+
+/**
+ * shm_ring_get_fd:
+ *
+ * Returns the fd that becomes readable when the input queue becomes
+ * non-empty
+ */
+int
+shm_ring_get_fd (ShmRing * self)
+{
+  return self->wait_fd;
+}
+
+unsigned int
+shm_ring_get_slots (ShmRing * self)
+{
+  return self->slots;
+}
+
+static void
+shm_ring_kick (ShmRing * self)
+{
+  uint64_t one = 1;
+
+  /* If this fails, there is already a wake up pending or the other side is
+   * gone, which the control socket will tell us about */
+  if (write (self->kick_fd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+    fprintf (stderr, "Could not notify shm ring (%d): %s\n", errno,
+        strerror (errno));
+}
+
+/**
+ * shm_ring_push:
+ *
+ * Returns 1 if @desc was queued, 0 if the queue is full.
+ */
+int
+shm_ring_push (ShmRing * self, const ShmRingDesc * desc)
+{
+  uint32_t head = self->out_head;
+
+  if (head - INDEX_LOAD (&self->out->tail) >= self->slots)
+    return 0;
+
+  self->out_slots[head & (self->slots - 1)] = *desc;
+  self->out_head = head + 1;
+  INDEX_STORE (&self->out->head, self->out_head);
+
+  /* Only wake up the other side if it could have seen an empty queue */
+  if (INDEX_LOAD (&self->out->tail) == head)
+    shm_ring_kick (self);
+
+  return 1;
+}
+
+/**
+ * shm_ring_get_pushed:
+ *
+ * Returns the number of descriptors pushed since the ring was created
+ * (modulo 2^32)
+ */
+uint32_t
+shm_ring_get_pushed (ShmRing * self)
+{
+  return self->out_head;
+}
+
+/**
+ * shm_ring_peek:
+ *
+ * Copies the first descriptor of the input queue without removing it.
+ * Returns 1 on success, 0 if the queue is empty and -1 if the other side
+ * corrupted the indexes.
+ */
+int
+shm_ring_peek (ShmRing * self, ShmRingDesc * desc)
+{
+  uint32_t tail = self->in_tail;
+  uint32_t head = INDEX_LOAD (&self->in->head);
+
+  if (head == tail)
+    return 0;
+
+  if (head - tail > self->slots)
+    return -1;
+
+  *desc = self->in_slots[tail & (self->slots - 1)];
+
+  return 1;
+}
+
+/**
+ * shm_ring_pop:
+ *
+ * Removes the descriptor returned by the last successful shm_ring_peek()
+ */
+void
+shm_ring_pop (ShmRing * self)
+{
+  self->in_tail++;
+  INDEX_STORE (&self->in->tail, self->in_tail);
+}
+
+/**
+ * shm_ring_get_popped:
+ *
+ * Returns the number of descriptors popped since the ring was created
+ * (modulo 2^32)
+ */
+uint32_t
+shm_ring_get_popped (ShmRing * self)
+{
+  return self->in_tail;
+}
+
+/**
+ * shm_ring_clear:
+ *
+ * Acknowledges the pending notifications. The input queue must be drained
+ * after this, anything pushed before the call might not be notified again.
+ */
+void
+shm_ring_clear (ShmRing * self)
+{
+  char buf[64];
+
+  while (read (self->wait_fd, buf, sizeof (buf)) > 0);
+}
@@ -0,0 +1,88 @@
+/* GStreamer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * A ShmRing is a pair of single-producer single-consumer queues of
+ * descriptors living in a small shared memory area of their own, one going
+ * from the writer to the reader and one going back.
+ *
+ * Pushing and popping never do a system call. The consumer side is only
+ * woken up through the notification fd when a queue goes from empty to
+ * non-empty, so a consumer that keeps up with the producer is never
+ * signalled at all. A consumer must call shm_ring_clear() before it drains
+ * its queue until it is empty, then wait for the fd from shm_ring_get_fd()
+ * to become readable.
+ *
+ * The writer creates the ring with shm_ring_new(), and passes the fds from
+ * shm_ring_get_peer_fds() to the reader, which calls shm_ring_open() with
+ * them.
+ */
+
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHM_RING_N_FDS 3
+
+typedef struct _ShmRing ShmRing;
+typedef struct _ShmRingDesc ShmRingDesc;
+
+struct _ShmRingDesc
+{
+  uint32_t type;
+  int32_t area_id;
+  uint64_t offset;
+  uint64_t size;
+
+  /* The ShmBufferMeta of the buffers, with COMMAND_NEW_BUFFER_META */
+  uint64_t pts;
+  uint64_t dts;
+  uint64_t duration;
+  uint32_t flags;
+  uint32_t buffer_type;
+};
+
+ShmRing *shm_ring_new (unsigned int slots);
+ShmRing *shm_ring_open (const int fds[SHM_RING_N_FDS], unsigned int slots);
+void shm_ring_free (ShmRing * self);
+
+void shm_ring_get_peer_fds (ShmRing * self, int fds[SHM_RING_N_FDS]);
+int shm_ring_get_fd (ShmRing * self);
+unsigned int shm_ring_get_slots (ShmRing * self);
+
+int shm_ring_push (ShmRing * self, const ShmRingDesc * desc);
+uint32_t shm_ring_get_pushed (ShmRing * self);
+
+int shm_ring_peek (ShmRing * self, ShmRingDesc * desc);
+void shm_ring_pop (ShmRing * self);
+uint32_t shm_ring_get_popped (ShmRing * self);
+void shm_ring_clear (ShmRing * self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SHMRING_H__ */
@@ -43,6 +43,13 @@ GstStaticPadTemplate sinktemplate_avc_au = GST_STATIC_PAD_TEMPLATE ("sink",
         ", stream-format = (string) avc, alignment = (string) au")
     );
 
+GstStaticPadTemplate sinktemplate_bs_au = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (SINK_CAPS_TMPL
+        ", stream-format = (string) byte-stream, alignment = (string) au")
+    );
+
 GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
@@ -59,6 +66,14 @@ static guint8 h264_sps[] = {
   0xc5, 0xb2, 0xc0
 };
 
+/* SPS, with a 48 pixels wide picture */
+static guint8 h264_sps_wide[] = {
+  0x00, 0x00, 0x00, 0x01, 0x67, 0x4d, 0x40, 0x15,
+  0xec, 0xa6, 0xbf, 0x2e, 0x02, 0x20, 0x00, 0x00,
+  0x03, 0x00, 0x2e, 0xe6, 0xb2, 0x80, 0x01, 0xe2,
+  0xc5, 0xb2, 0xc0
+};
+
 /* PPS */
 static guint8 h264_pps[] = {
   0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xec, 0xb2
@@ -148,6 +163,25 @@ GST_START_TEST (test_parse_normal)
 GST_END_TEST;
 
 
+GST_START_TEST (test_parse_normal_large)
+{
+  guint8 *frame;
+  guint size = 4096;
+
+  /* large enough for the slice to be shared rather than copied when
+   * converting to avc */
+  frame = g_malloc (size);
+  memcpy (frame, h264_idrframe, sizeof (h264_idrframe));
+  memset (frame + sizeof (h264_idrframe), 0x55, size - sizeof (h264_idrframe));
+
+  gst_parser_test_normal (frame, size);
+
+  g_free (frame);
+}
+
+GST_END_TEST;
+
+
 GST_START_TEST (test_parse_drain_single)
 {
   gst_parser_test_drain_single (h264_idrframe, sizeof (h264_idrframe));
@@ -233,6 +267,7 @@ h264parse_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, test_parse_normal);
+  tcase_add_test (tc_chain, test_parse_normal_large);
   tcase_add_test (tc_chain, test_parse_drain_single);
   tcase_add_test (tc_chain, test_parse_drain_garbage);
   tcase_add_test (tc_chain, test_parse_split);
@@ -315,6 +350,148 @@ GST_START_TEST (test_parse_packetized)
 
 GST_END_TEST;
 
+static gboolean
+verify_buffer_avc_passthrough (buffer_verify_data_s * vdata,
+    GstBuffer * buffer)
+{
+  /* data is checked as usual, but must be flagged as the keyframe it is */
+  fail_if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT));
+
+  return FALSE;
+}
+
+GST_START_TEST (test_parse_packetized_passthrough)
+{
+  static const datablob nals[] = {
+    {h264_sps_wide, sizeof (h264_sps_wide)},
+    {h264_pps, sizeof (h264_pps)},
+    {h264_idrframe, sizeof (h264_idrframe)}
+  };
+  GstParserTest ptest;
+  VerifyBuffer verify_buffer;
+  guint8 *frame;
+  guint i, size = 0;
+  GstCaps *caps;
+  GstBuffer *cdata;
+  GstStructure *s;
+  const GValue *value;
+
+  /* make AVC AU, carrying a config that differs from the codec_data */
+  frame = g_malloc (sizeof (h264_sps_wide) + sizeof (h264_pps) +
+      sizeof (h264_idrframe));
+  for (i = 0; i < G_N_ELEMENTS (nals); i++) {
+    GST_WRITE_UINT32_BE (frame + size, nals[i].size - 4);
+    memcpy (frame + size + 4, nals[i].data + 4, nals[i].size - 4);
+    size += nals[i].size;
+  }
+
+  caps = gst_caps_from_string (SRC_CAPS_TMPL);
+  cdata =
+      gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, h264_codec_data,
+      sizeof (h264_codec_data), 0, sizeof (h264_codec_data), NULL, NULL);
+  gst_caps_set_simple (caps, "codec_data", GST_TYPE_BUFFER, cdata, NULL);
+  gst_buffer_unref (cdata);
+
+  /* avc au both ways, so AUs should go out untouched */
+  gst_parser_test_init (&ptest, frame, size, 10);
+  ptest.src_caps = caps;
+  ptest.sink_template = &sinktemplate_avc_au;
+  ptest.discard = 0;
+  verify_buffer = ctx_verify_buffer;
+  ctx_verify_buffer = verify_buffer_avc_passthrough;
+  gst_parser_test_run (&ptest, &caps);
+  ctx_verify_buffer = verify_buffer;
+  gst_caps_unref (ptest.src_caps);
+  g_free (frame);
+
+  /* but the in-stream config was picked up */
+  GST_LOG ("h264 output caps: %" GST_PTR_FORMAT, caps);
+  s = gst_caps_get_structure (caps, 0);
+  fail_unless (gst_structure_has_name (s, "video/x-h264"));
+  fail_unless_structure_field_int_equals (s, "width", 48);
+  fail_unless_structure_field_int_equals (s, "height", 24);
+  value = gst_structure_get_value (s, "codec_data");
+  fail_unless (value != NULL);
+  cdata = gst_value_get_buffer (value);
+  fail_unless (gst_buffer_memcmp (cdata, 8, h264_sps_wide + 4,
+          sizeof (h264_sps_wide) - 4) == 0);
+
+  gst_caps_unref (caps);
+}
+
+GST_END_TEST;
+
+#define N_SLICES 12
+#define SLICE_SIZE 512
+
+/* byte-stream AU expected from the multi-slice AVC AU */
+static guint8 *multi_slice_bs;
+
+static gboolean
+verify_buffer_multi_slice (buffer_verify_data_s * vdata, GstBuffer * buffer)
+{
+  gsize size = gst_buffer_get_size (buffer);
+  guint n_mem = gst_buffer_n_memory (buffer);
+
+  /* the first AU is preceded by the codec_data NALs */
+  fail_unless (size >= N_SLICES * SLICE_SIZE);
+  fail_unless (gst_buffer_memcmp (buffer, size - N_SLICES * SLICE_SIZE,
+          multi_slice_bs, N_SLICES * SLICE_SIZE) == 0);
+
+  /* only the slices that do not fit in the memories of the buffer are
+   * copied, not the whole AU */
+  fail_unless (n_mem <= gst_buffer_get_max_memory ());
+  if (vdata->buffer_counter > 0)
+    fail_unless (n_mem > 1);
+
+  return TRUE;
+}
+
+GST_START_TEST (test_parse_packetized_multi_slice)
+{
+  GstParserTest ptest;
+  VerifyBuffer verify_buffer;
+  guint8 *frame, *slice;
+  GstCaps *caps;
+  GstBuffer *cdata;
+  guint i;
+
+  /* make AVC AU of many slices, too big to be copied along with their
+   * prefix, and the byte-stream AU it converts to */
+  frame = g_malloc (N_SLICES * SLICE_SIZE);
+  multi_slice_bs = g_malloc (N_SLICES * SLICE_SIZE);
+  for (i = 0; i < N_SLICES; i++) {
+    slice = frame + i * SLICE_SIZE;
+    GST_WRITE_UINT32_BE (slice, SLICE_SIZE - 4);
+    memcpy (slice + 4, h264_idrframe + 4, sizeof (h264_idrframe) - 4);
+    memset (slice + sizeof (h264_idrframe), 0x55,
+        SLICE_SIZE - sizeof (h264_idrframe));
+    memcpy (multi_slice_bs + i * SLICE_SIZE, slice, SLICE_SIZE);
+    GST_WRITE_UINT32_BE (multi_slice_bs + i * SLICE_SIZE, 1);
+  }
+
+  caps = gst_caps_from_string (SRC_CAPS_TMPL);
+  cdata =
+      gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, h264_codec_data,
+      sizeof (h264_codec_data), 0, sizeof (h264_codec_data), NULL, NULL);
+  gst_caps_set_simple (caps, "codec_data", GST_TYPE_BUFFER, cdata, NULL);
+  gst_buffer_unref (cdata);
+
+  gst_parser_test_init (&ptest, frame, N_SLICES * SLICE_SIZE, 10);
+  ptest.src_caps = caps;
+  ptest.sink_template = &sinktemplate_bs_au;
+  ptest.discard = 0;
+  verify_buffer = ctx_verify_buffer;
+  ctx_verify_buffer = verify_buffer_multi_slice;
+  gst_parser_test_run (&ptest, NULL);
+  ctx_verify_buffer = verify_buffer;
+  gst_caps_unref (ptest.src_caps);
+  g_free (multi_slice_bs);
+  g_free (frame);
+}
+
+GST_END_TEST;
+
 static Suite *
 h264parse_packetized_suite (void)
 {
@@ -323,6 +500,8 @@ h264parse_packetized_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, test_parse_packetized);
+  tcase_add_test (tc_chain, test_parse_packetized_passthrough);
+  tcase_add_test (tc_chain, test_parse_packetized_multi_slice);
 
   return s;
 }
@@ -0,0 +1,248 @@
+/* GStreamer
+ *
+ * unit test for hlsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "tsgenerator.h"
+
+#define N_FRAGMENTS 6
+
+typedef struct
+{
+  gchar *dir;
+  GPtrArray *files;
+  gchar *playlist;              /* file name of the main playlist */
+  GByteArray *expected;         /* all the fragments, in playlist order */
+} TestStream;
+
+/* Writes @data in the stream directory and returns its URI */
+static gchar *
+test_stream_write (TestStream * stream, const gchar * name,
+    const guint8 * data, gsize size)
+{
+  gchar *filename;
+
+  filename = g_build_filename (stream->dir, name, NULL);
+  fail_unless (g_file_set_contents (filename, (const gchar *) data, size,
+          NULL));
+  g_ptr_array_add (stream->files, filename);
+
+  return gst_filename_to_uri (filename, NULL);
+}
+
+/* Writes a VOD stream of N_FRAGMENTS one second MPEG-TS fragments, fragment
+ * i having 25 + i frames so that they all differ. With @variants, the main
+ * playlist has two variants made of the same fragments, so that the output
+ * is the same whatever variant switches happen. Playback starts with the
+ * first variant, whose bitrate is way below the rate the fragments are read
+ * from disk at, so that the demuxer always switches to the second one */
+static TestStream *
+test_stream_new (gboolean variants)
+{
+  TestStream *stream = g_new0 (TestStream, 1);
+  GString *media, *main_playlist;
+  gchar *uri;
+  guint i;
+
+  stream->dir = g_dir_make_tmp ("hlsdemux-test-XXXXXX", NULL);
+  fail_unless (stream->dir != NULL);
+  stream->files = g_ptr_array_new_with_free_func (g_free);
+  stream->expected = g_byte_array_new ();
+
+  media = g_string_new ("#EXTM3U\n#EXT-X-TARGETDURATION:1\n"
+      "#EXT-X-MEDIA-SEQUENCE:0\n");
+  for (i = 0; i < N_FRAGMENTS; i++) {
+    GByteArray *data = create_stream (188, 25 + i, FRAME_SIZE, 10, 10, 0);
+    gchar *name = g_strdup_printf ("fragment-%u.ts", i);
+
+    uri = test_stream_write (stream, name, data->data, data->len);
+    g_string_append_printf (media, "#EXTINF:1,\n%s\n", uri);
+    g_byte_array_append (stream->expected, data->data, data->len);
+    g_byte_array_free (data, TRUE);
+    g_free (name);
+    g_free (uri);
+  }
+  g_string_append (media, "#EXT-X-ENDLIST\n");
+
+  if (variants) {
+    main_playlist = g_string_new ("#EXTM3U\n");
+    for (i = 0; i < 2; i++) {
+      gchar *name = g_strdup_printf ("variant-%u.m3u8", i);
+
+      uri = test_stream_write (stream, name, (guint8 *) media->str,
+          media->len);
+      g_string_append_printf (main_playlist,
+          "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=%u\n%s\n",
+          i == 0 ? 1000 : 100000, uri);
+      g_free (name);
+      g_free (uri);
+    }
+    uri = test_stream_write (stream, "main.m3u8",
+        (guint8 *) main_playlist->str, main_playlist->len);
+    g_string_free (main_playlist, TRUE);
+  } else {
+    uri = test_stream_write (stream, "main.m3u8", (guint8 *) media->str,
+        media->len);
+  }
+  g_free (uri);
+  g_string_free (media, TRUE);
+
+  stream->playlist = g_strdup (g_ptr_array_index (stream->files,
+          stream->files->len - 1));
+
+  return stream;
+}
+
+static void
+test_stream_free (TestStream * stream)
+{
+  guint i;
+
+  for (i = 0; i < stream->files->len; i++)
+    g_unlink (g_ptr_array_index (stream->files, i));
+  g_rmdir (stream->dir);
+  g_ptr_array_free (stream->files, TRUE);
+  g_byte_array_free (stream->expected, TRUE);
+  g_free (stream->playlist);
+  g_free (stream->dir);
+  g_free (stream);
+}
+
+static void
+output_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    GByteArray * output)
+{
+  GstMapInfo map;
+
+  fail_unless (gst_buffer_map (buffer, &map, GST_MAP_READ));
+  g_byte_array_append (output, map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+}
+
+/* Plays @stream to EOS and checks that the fragments came out complete and
+ * in playlist order, whatever order their downloads finished in. Returns
+ * the number of variant switches */
+static guint
+check_playback (TestStream * stream, guint max_downloads, gboolean streaming)
+{
+  GstElement *pipeline, *sink;
+  GstMessage *msg;
+  GstBus *bus;
+  GByteArray *output = g_byte_array_new ();
+  gboolean done = FALSE;
+  guint n_switches = 0;
+  gchar *desc;
+
+  GST_DEBUG ("max-downloads %u, streaming %d", max_downloads, streaming);
+
+  /* without streaming, cache all the fragments up front so that the test
+   * doesn't wait for the scheduled fragment updates */
+  desc = g_strdup_printf ("filesrc location=%s ! hlsdemux max-downloads=%u "
+      "streaming=%d fragments-cache=%u ! fakesink name=sink sync=false "
+      "signal-handoffs=true", stream->playlist, max_downloads, streaming,
+      N_FRAGMENTS);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (output_handoff), output);
+  gst_object_unref (sink);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+  bus = gst_element_get_bus (pipeline);
+  while (!done) {
+    msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_ELEMENT);
+    fail_if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR);
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS) {
+      done = TRUE;
+    } else if (gst_message_has_name (msg, "hls-switch-decision")) {
+      const GstStructure *s = gst_message_get_structure (msg);
+      gint old_bitrate, new_bitrate;
+
+      /* Decisions are only posted for actual switches */
+      fail_unless (gst_structure_get_int (s, "old-bitrate", &old_bitrate));
+      fail_unless (gst_structure_get_int (s, "new-bitrate", &new_bitrate));
+      fail_if (old_bitrate == new_bitrate);
+      n_switches++;
+    }
+    gst_message_unref (msg);
+  }
+  gst_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  fail_unless_equals_int (output->len, stream->expected->len);
+  fail_unless (memcmp (output->data, stream->expected->data,
+          output->len) == 0);
+  g_byte_array_free (output, TRUE);
+
+  return n_switches;
+}
+
+/* Prefetched fragments are pushed in playlist order, with or without
+ * parallel downloads */
+GST_START_TEST (test_prefetch)
+{
+  TestStream *stream = test_stream_new (FALSE);
+
+  fail_unless_equals_int (check_playback (stream, 1, FALSE), 0);
+  fail_unless_equals_int (check_playback (stream, 4, FALSE), 0);
+  fail_unless_equals_int (check_playback (stream, 1, TRUE), 0);
+  fail_unless_equals_int (check_playback (stream, 4, TRUE), 0);
+
+  test_stream_free (stream);
+}
+
+GST_END_TEST;
+
+/* Switching variants drops the prefetched fragments and fetches them again
+ * from the new variant, without skipping or repeating any */
+GST_START_TEST (test_prefetch_switch)
+{
+  TestStream *stream = test_stream_new (TRUE);
+
+  fail_unless (check_playback (stream, 4, FALSE) > 0);
+  fail_unless (check_playback (stream, 4, TRUE) > 0);
+
+  test_stream_free (stream);
+}
+
+GST_END_TEST;
+
+static Suite *
+hlsdemux_suite (void)
+{
+  Suite *s = suite_create ("hlsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_prefetch);
+  tcase_add_test (tc_chain, test_prefetch_switch);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hlsdemux);
@@ -0,0 +1,137 @@
+/* GStreamer
+ *
+ * unit test for the fragment downloads of hlsdemux
+ *
+ * Built from the fragment and downloader sources, so it must not load the
+ * fragmented plugin, which registers the same types
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "gstfragment.h"
+#include "gsturidownloader.h"
+
+GST_DEBUG_CATEGORY (fragmented_debug);
+
+#define FRAGMENT_SIZE (4 * 1024 * 1024)
+#define MAX_QUEUED (64 * 1024)
+
+static guint8 *
+create_fragment_data (void)
+{
+  guint8 *data = g_malloc (FRAGMENT_SIZE);
+  guint i;
+
+  for (i = 0; i < FRAGMENT_SIZE; i++)
+    data[i] = (i * 7) ^ (i >> 12);
+
+  return data;
+}
+
+static gchar *
+write_fragment (const guint8 * data)
+{
+  GError *err = NULL;
+  gchar *filename;
+  gint fd;
+
+  fd = g_file_open_tmp ("hlsdemux-test-XXXXXX.ts", &filename, &err);
+  fail_unless (fd != -1, "Failed to create a temporary file");
+  close (fd);
+  fail_unless (g_file_set_contents (filename, (gchar *) data, FRAGMENT_SIZE,
+          &err));
+
+  return filename;
+}
+
+/* A streaming fragment hands out its data while it is being downloaded: the
+ * download is throttled to MAX_QUEUED bytes ahead of the consumer, so it
+ * can't have completed when the first chunk is popped */
+GST_START_TEST (test_streaming_fragment)
+{
+  GstUriDownloader *downloader;
+  GstFragment *fragment;
+  GstBuffer *buf;
+  GstMapInfo map;
+  guint8 *data;
+  gchar *filename, *uri;
+  gsize offset = 0;
+  guint n_chunks = 0;
+
+  data = create_fragment_data ();
+  filename = write_fragment (data);
+  uri = gst_filename_to_uri (filename, NULL);
+  fail_unless (uri != NULL);
+
+  downloader = gst_uri_downloader_new ();
+  fragment = gst_fragment_new_streaming (MAX_QUEUED);
+  fail_unless (gst_uri_downloader_start (downloader, uri, fragment));
+
+  while ((buf = gst_fragment_pop_buffer (fragment))) {
+    if (n_chunks == 0) {
+      fail_if (fragment->completed);
+      fail_unless_equals_uint64 (gst_fragment_get_download_time (fragment),
+          GST_CLOCK_TIME_NONE);
+    }
+
+    fail_unless (gst_buffer_map (buf, &map, GST_MAP_READ));
+    fail_unless (offset + map.size <= FRAGMENT_SIZE);
+    fail_unless (memcmp (map.data, data + offset, map.size) == 0);
+    offset += map.size;
+    gst_buffer_unmap (buf, &map);
+    gst_buffer_unref (buf);
+    n_chunks++;
+  }
+
+  /* Popping returns NULL at the end of the data, and on cancellation */
+  fail_unless (fragment->completed);
+  fail_unless_equals_uint64 (offset, FRAGMENT_SIZE);
+  fail_unless_equals_uint64 (gst_fragment_get_size (fragment), FRAGMENT_SIZE);
+  fail_unless (n_chunks > 1);
+  fail_unless (GST_CLOCK_TIME_IS_VALID (gst_fragment_get_download_time
+          (fragment)));
+
+  gst_uri_downloader_reset (downloader);
+  g_object_unref (fragment);
+  g_object_unref (downloader);
+  g_unlink (filename);
+  g_free (filename);
+  g_free (uri);
+  g_free (data);
+}
+
+GST_END_TEST;
+
+static Suite *
+hlsfragment_suite (void)
+{
+  Suite *s = suite_create ("hlsfragment");
+  TCase *tc_chain = tcase_create ("general");
+
+  GST_DEBUG_CATEGORY_INIT (fragmented_debug, "fragmented", 0, "fragmented");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_streaming_fragment);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hlsfragment);
@@ -0,0 +1,475 @@
+/* GStreamer
+ *
+ * unit test for interstreamsink and interstreamsrc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstElement *sink;
+static GstPad *mysrcpad;
+static GList *upstream_events;
+
+/* An interstreamsrc and what came out of it. While blocked, its streaming
+ * thread waits in the chain function after each buffer. */
+typedef struct
+{
+  GstElement *src;
+  GstPad *pad;
+  GMutex lock;
+  GCond cond;
+  GList *buffers;
+  GList *events;
+  gboolean blocked;
+  GstFlowReturn flow;
+} Output;
+
+static gboolean
+upstream_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  upstream_events = g_list_append (upstream_events, event);
+
+  return TRUE;
+}
+
+static void
+setup_sink (void)
+{
+  sink = gst_check_setup_element ("interstreamsink");
+  g_object_set (sink, "channel", "test", NULL);
+  mysrcpad = gst_check_setup_src_pad (sink, &src_template);
+  gst_pad_set_event_function (mysrcpad, upstream_event);
+  gst_pad_set_active (mysrcpad, TRUE);
+  fail_unless (gst_element_set_state (sink,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+}
+
+static void
+teardown_sink (void)
+{
+  fail_unless (gst_element_set_state (sink,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_check_teardown_src_pad (sink);
+  gst_check_teardown_element (sink);
+  g_list_free_full (upstream_events, (GDestroyNotify) gst_event_unref);
+  upstream_events = NULL;
+}
+
+static GstFlowReturn
+output_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  Output *output = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&output->lock);
+  output->buffers = g_list_append (output->buffers, buffer);
+  g_cond_broadcast (&output->cond);
+  while (output->blocked)
+    g_cond_wait (&output->cond, &output->lock);
+  g_mutex_unlock (&output->lock);
+
+  return output->flow;
+}
+
+static gboolean
+output_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  Output *output = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&output->lock);
+  output->events = g_list_append (output->events, event);
+  g_cond_broadcast (&output->cond);
+  g_mutex_unlock (&output->lock);
+
+  return TRUE;
+}
+
+static Output *
+output_new (guint max_buffers, const gchar * leaky, gboolean blocked)
+{
+  Output *output = g_new0 (Output, 1);
+  GstPad *srcpad;
+
+  g_mutex_init (&output->lock);
+  g_cond_init (&output->cond);
+  output->blocked = blocked;
+  output->flow = GST_FLOW_OK;
+
+  output->src = gst_check_setup_element ("interstreamsrc");
+  gst_util_set_object_arg (G_OBJECT (output->src), "leaky", leaky);
+  g_object_set (output->src, "channel", "test", "max-buffers", max_buffers,
+      NULL);
+
+  output->pad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_element_private (output->pad, output);
+  gst_pad_set_chain_function (output->pad, output_chain);
+  gst_pad_set_event_function (output->pad, output_event);
+  srcpad = gst_element_get_static_pad (output->src, "src");
+  fail_unless (gst_pad_link (srcpad, output->pad) == GST_PAD_LINK_OK);
+  gst_object_unref (srcpad);
+  gst_pad_set_active (output->pad, TRUE);
+
+  fail_unless (gst_element_set_state (output->src,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  return output;
+}
+
+static void
+output_set_blocked (Output * output, gboolean blocked)
+{
+  g_mutex_lock (&output->lock);
+  output->blocked = blocked;
+  g_cond_broadcast (&output->cond);
+  g_mutex_unlock (&output->lock);
+}
+
+static void
+output_wait_buffers (Output * output, guint n_buffers)
+{
+  g_mutex_lock (&output->lock);
+  while (g_list_length (output->buffers) < n_buffers)
+    g_cond_wait (&output->cond, &output->lock);
+  g_mutex_unlock (&output->lock);
+}
+
+static void
+output_free (Output * output)
+{
+  GstPad *srcpad;
+
+  output_set_blocked (output, FALSE);
+  fail_unless (gst_element_set_state (output->src,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+  gst_pad_set_active (output->pad, FALSE);
+  srcpad = gst_element_get_static_pad (output->src, "src");
+  gst_pad_unlink (srcpad, output->pad);
+  gst_object_unref (srcpad);
+  gst_object_unref (output->pad);
+  gst_check_teardown_element (output->src);
+
+  g_list_free_full (output->buffers, (GDestroyNotify) gst_buffer_unref);
+  g_list_free_full (output->events, (GDestroyNotify) gst_event_unref);
+  g_mutex_clear (&output->lock);
+  g_cond_clear (&output->cond);
+  g_free (output);
+}
+
+static guint64
+get_dropped (Output * output)
+{
+  guint64 n_dropped;
+
+  g_object_get (output->src, "buffers-dropped", &n_dropped, NULL);
+
+  return n_dropped;
+}
+
+/* The events are pushed from the streaming thread of the src before the
+ * next buffer, so they are all there once that buffer is */
+static void
+check_sticky_events (Output * output)
+{
+  GList *l = output->events;
+
+  fail_unless_equals_int (g_list_length (l), 3);
+  fail_unless_equals_int (GST_EVENT_TYPE (l->data), GST_EVENT_STREAM_START);
+  fail_unless_equals_int (GST_EVENT_TYPE (l->next->data), GST_EVENT_CAPS);
+  fail_unless_equals_int (GST_EVENT_TYPE (l->next->next->data),
+      GST_EVENT_SEGMENT);
+}
+
+static void
+push_sticky_events (void)
+{
+  GstCaps *caps = gst_caps_new_empty_simple ("application/x-test");
+  GstSegment segment;
+
+  fail_unless (gst_pad_push_event (mysrcpad,
+          gst_event_new_stream_start ("test")));
+  fail_unless (gst_pad_set_caps (mysrcpad, caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (mysrcpad,
+          gst_event_new_segment (&segment)));
+}
+
+static GstBuffer *
+create_buffer (guint8 index)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, 1, NULL);
+
+  gst_buffer_memset (buffer, 0, index, 1);
+
+  return buffer;
+}
+
+static void
+check_buffers (Output * output, const guint8 * expected, guint n_expected)
+{
+  GList *l;
+  guint i;
+
+  fail_unless_equals_int (g_list_length (output->buffers), n_expected);
+  for (i = 0, l = output->buffers; i < n_expected; i++, l = l->next)
+    fail_unless (gst_buffer_memcmp (l->data, 0, &expected[i], 1) == 0);
+}
+
+/* Every src gets every buffer, by reference */
+GST_START_TEST (test_fan_out)
+{
+  Output *outputs[3];
+  GstBuffer *pushed[5];
+  guint i, j;
+
+  setup_sink ();
+  for (i = 0; i < G_N_ELEMENTS (outputs); i++)
+    outputs[i] = output_new (0, "no", FALSE);
+
+  push_sticky_events ();
+  for (i = 0; i < G_N_ELEMENTS (pushed); i++) {
+    pushed[i] = create_buffer (i);
+    fail_unless_equals_int (gst_pad_push (mysrcpad,
+            gst_buffer_ref (pushed[i])), GST_FLOW_OK);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (outputs); i++) {
+    GList *l;
+
+    output_wait_buffers (outputs[i], G_N_ELEMENTS (pushed));
+    check_sticky_events (outputs[i]);
+    for (j = 0, l = outputs[i]->buffers; l; j++, l = l->next)
+      fail_unless (l->data == pushed[j]);
+    fail_unless_equals_uint64 (get_dropped (outputs[i]), 0);
+    output_free (outputs[i]);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (pushed); i++)
+    gst_buffer_unref (pushed[i]);
+  teardown_sink ();
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  GstBuffer *buffer;
+  volatile gint done;
+} PushData;
+
+static gpointer
+push_thread (PushData * data)
+{
+  fail_unless_equals_int (gst_pad_push (mysrcpad, data->buffer), GST_FLOW_OK);
+  g_atomic_int_set (&data->done, 1);
+
+  return NULL;
+}
+
+/* With the src stuck on buffer 0 and buffers 1 and 2 filling its queue of
+ * 2, pushes buffer 3 and checks what comes out once the src is unstuck */
+static void
+check_leaky (const gchar * leaky, const guint8 * expected,
+    guint64 expected_dropped)
+{
+  Output *output;
+  PushData data = { NULL, 0 };
+  GThread *thread;
+  guint i;
+
+  setup_sink ();
+  output = output_new (2, leaky, TRUE);
+  push_sticky_events ();
+
+  fail_unless_equals_int (gst_pad_push (mysrcpad, create_buffer (0)),
+      GST_FLOW_OK);
+  output_wait_buffers (output, 1);
+  for (i = 1; i <= 2; i++)
+    fail_unless_equals_int (gst_pad_push (mysrcpad, create_buffer (i)),
+        GST_FLOW_OK);
+
+  data.buffer = create_buffer (3);
+  thread = g_thread_new ("push", (GThreadFunc) push_thread, &data);
+  if (expected_dropped == 0) {
+    /* not leaky, the sink waits for room */
+    g_usleep (G_USEC_PER_SEC / 10);
+    fail_if (g_atomic_int_get (&data.done));
+  }
+  output_set_blocked (output, FALSE);
+  g_thread_join (thread);
+
+  output_wait_buffers (output, 4 - expected_dropped);
+  check_sticky_events (output);
+  check_buffers (output, expected, 4 - expected_dropped);
+  fail_unless_equals_uint64 (get_dropped (output), expected_dropped);
+
+  output_free (output);
+  teardown_sink ();
+}
+
+GST_START_TEST (test_leaky_no)
+{
+  static const guint8 expected[] = { 0, 1, 2, 3 };
+
+  check_leaky ("no", expected, 0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_leaky_upstream)
+{
+  static const guint8 expected[] = { 0, 1, 2 };
+
+  check_leaky ("upstream", expected, 1);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_leaky_downstream)
+{
+  static const guint8 expected[] = { 0, 2, 3 };
+
+  check_leaky ("downstream", expected, 1);
+}
+
+GST_END_TEST;
+
+/* A src stopped by a downstream error doesn't make the sink wait for room
+ * in its queue */
+GST_START_TEST (test_downstream_error)
+{
+  Output *output;
+  guint i;
+
+  setup_sink ();
+  output = output_new (2, "no", FALSE);
+  output->flow = GST_FLOW_ERROR;
+  push_sticky_events ();
+
+  fail_unless_equals_int (gst_pad_push (mysrcpad, create_buffer (0)),
+      GST_FLOW_OK);
+  output_wait_buffers (output, 1);
+  for (i = 1; i < 10; i++)
+    fail_unless_equals_int (gst_pad_push (mysrcpad, create_buffer (i)),
+        GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (output->buffers), 1);
+
+  output_free (output);
+  teardown_sink ();
+}
+
+GST_END_TEST;
+
+/* A src that joins in the middle of a stream gets its sticky events, then
+ * only the buffers pushed after it joined */
+GST_START_TEST (test_late_src)
+{
+  static const guint8 expected[] = { 1 };
+  Output *output;
+  GstCaps *caps, *current;
+
+  setup_sink ();
+  push_sticky_events ();
+  fail_unless_equals_int (gst_pad_push (mysrcpad, create_buffer (0)),
+      GST_FLOW_OK);
+
+  output = output_new (0, "no", FALSE);
+  fail_unless_equals_int (gst_pad_push (mysrcpad, create_buffer (1)),
+      GST_FLOW_OK);
+  output_wait_buffers (output, 1);
+
+  check_sticky_events (output);
+  gst_event_parse_caps (output->events->next->data, &caps);
+  current = gst_pad_get_current_caps (mysrcpad);
+  fail_unless (gst_caps_is_equal (caps, current));
+  gst_caps_unref (current);
+  check_buffers (output, expected, G_N_ELEMENTS (expected));
+
+  output_free (output);
+  teardown_sink ();
+}
+
+GST_END_TEST;
+
+/* QoS, latency and reconfigure events go upstream of the sink, seeks are
+ * refused */
+GST_START_TEST (test_upstream_events)
+{
+  Output *output;
+  GList *l;
+
+  setup_sink ();
+  output = output_new (0, "no", FALSE);
+  push_sticky_events ();
+
+  fail_unless (gst_pad_push_event (output->pad,
+          gst_event_new_qos (GST_QOS_TYPE_UNDERFLOW, 0.5, GST_MSECOND,
+              GST_SECOND)));
+  fail_unless (gst_pad_push_event (output->pad,
+          gst_event_new_latency (10 * GST_MSECOND)));
+  fail_unless (gst_pad_push_event (output->pad,
+          gst_event_new_reconfigure ()));
+  fail_if (gst_pad_push_event (output->pad,
+          gst_event_new_seek (1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
+              GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, -1)));
+
+  l = upstream_events;
+  fail_unless_equals_int (g_list_length (l), 3);
+  fail_unless_equals_int (GST_EVENT_TYPE (l->data), GST_EVENT_QOS);
+  fail_unless_equals_int (GST_EVENT_TYPE (l->next->data), GST_EVENT_LATENCY);
+  fail_unless_equals_int (GST_EVENT_TYPE (l->next->next->data),
+      GST_EVENT_RECONFIGURE);
+
+  output_free (output);
+  teardown_sink ();
+}
+
+GST_END_TEST;
+
+static Suite *
+interstream_suite (void)
+{
+  Suite *s = suite_create ("interstream");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_fan_out);
+  tcase_add_test (tc_chain, test_leaky_no);
+  tcase_add_test (tc_chain, test_leaky_upstream);
+  tcase_add_test (tc_chain, test_leaky_downstream);
+  tcase_add_test (tc_chain, test_late_src);
+  tcase_add_test (tc_chain, test_downstream_error);
+  tcase_add_test (tc_chain, test_upstream_events);
+
+  return s;
+}
+
+GST_CHECK_MAIN (interstream);
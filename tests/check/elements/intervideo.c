@@ -0,0 +1,261 @@
+/* GStreamer
+ *
+ * unit test for intervideosink and intervideosrc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include "gstintersurface.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+#define FRAME_SIZE (WIDTH * HEIGHT * 3 / 2)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw, format=(string)I420, "
+        "width=(int)320, height=(int)240, framerate=(fraction)30/1"));
+
+/* A frame whose first byte is @index */
+static GstBuffer *
+create_frame (guint8 index)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, FRAME_SIZE, NULL);
+
+  gst_buffer_memset (buffer, 0, index, 1);
+
+  return buffer;
+}
+
+static guint8
+frame_index (GstBuffer * buffer)
+{
+  guint8 index;
+
+  fail_unless_equals_int (gst_buffer_extract (buffer, 0, &index, 1), 1);
+
+  return index;
+}
+
+static void
+check_take (GstInterSurface * surface, GstClockTime target,
+    GstClockTime current, gint expected, guint expected_skipped)
+{
+  GstBuffer *buffer;
+  GstClockTime time = GST_CLOCK_TIME_NONE;
+  guint n_skipped;
+
+  buffer = gst_inter_surface_take_video (surface, target, current, &time,
+      &n_skipped);
+  fail_unless_equals_int (n_skipped, expected_skipped);
+  if (expected < 0) {
+    fail_unless (buffer == NULL);
+    return;
+  }
+
+  fail_unless (buffer != NULL);
+  fail_unless_equals_int (frame_index (buffer), expected);
+  if (GST_CLOCK_TIME_IS_VALID (target))
+    fail_unless_equals_uint64 (time, expected * GST_MSECOND);
+  gst_buffer_unref (buffer);
+}
+
+/* Frames are handed out in time order whatever order they were queued in */
+GST_START_TEST (test_surface_order)
+{
+  GstInterSurface *surface = gst_inter_surface_get ("order");
+
+  fail_unless_equals_int (gst_inter_surface_push_video (surface,
+          create_frame (30), 30 * GST_MSECOND, 4), 0);
+  fail_unless_equals_int (gst_inter_surface_push_video (surface,
+          create_frame (10), 10 * GST_MSECOND, 4), 0);
+  fail_unless_equals_int (gst_inter_surface_push_video (surface,
+          create_frame (20), 20 * GST_MSECOND, 4), 0);
+
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, 10, 0);
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, 20, 0);
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, 30, 0);
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, -1, 0);
+
+  /* without times, in arrival order */
+  gst_inter_surface_push_video (surface, create_frame (2),
+      GST_CLOCK_TIME_NONE, 4);
+  gst_inter_surface_push_video (surface, create_frame (1),
+      GST_CLOCK_TIME_NONE, 4);
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, 2, 0);
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, 1, 0);
+
+  gst_inter_surface_unref (surface);
+}
+
+GST_END_TEST;
+
+/* Beyond max_frames, the oldest frames are dropped */
+GST_START_TEST (test_surface_drop)
+{
+  GstInterSurface *surface = gst_inter_surface_get ("drop");
+  guint i;
+
+  for (i = 1; i <= 4; i++)
+    fail_unless_equals_int (gst_inter_surface_push_video (surface,
+            create_frame (i), i * GST_MSECOND, 4), 0);
+  fail_unless_equals_int (gst_inter_surface_push_video (surface,
+          create_frame (5), 5 * GST_MSECOND, 4), 1);
+  /* lowering the limit drops as many as needed */
+  fail_unless_equals_int (gst_inter_surface_push_video (surface,
+          create_frame (6), 6 * GST_MSECOND, 2), 3);
+
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, 5, 0);
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, 6, 0);
+  check_take (surface, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, -1, 0);
+
+  gst_inter_surface_unref (surface);
+}
+
+GST_END_TEST;
+
+/* The frame nearest to the target is taken and the older ones are skipped,
+ * unless the frame already shown is nearer, which is then duplicated */
+GST_START_TEST (test_surface_nearest)
+{
+  GstInterSurface *surface = gst_inter_surface_get ("nearest");
+  guint i;
+
+  for (i = 10; i <= 50; i += 10)
+    gst_inter_surface_push_video (surface, create_frame (i),
+        i * GST_MSECOND, 8);
+
+  check_take (surface, 26 * GST_MSECOND, GST_CLOCK_TIME_NONE, 30, 2);
+  /* 30 is still nearer than 40 */
+  check_take (surface, 33 * GST_MSECOND, 30 * GST_MSECOND, -1, 0);
+  check_take (surface, 36 * GST_MSECOND, 30 * GST_MSECOND, 40, 0);
+  /* late, so 50 is taken right away */
+  check_take (surface, 100 * GST_MSECOND, 40 * GST_MSECOND, 50, 0);
+  check_take (surface, 133 * GST_MSECOND, 50 * GST_MSECOND, -1, 0);
+
+  gst_inter_surface_unref (surface);
+}
+
+GST_END_TEST;
+
+static guint64
+get_uint64 (GstElement * element, const gchar * name)
+{
+  guint64 value;
+
+  g_object_get (element, name, &value, NULL);
+
+  return value;
+}
+
+/* Without a clock, the src outputs the queued frames in order, then
+ * duplicates the last one */
+GST_START_TEST (test_elements)
+{
+  GstElement *sink, *src;
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  GstCaps *caps;
+  GList *l;
+  guint i;
+
+  sink = gst_check_setup_element ("intervideosink");
+  g_object_set (sink, "channel", "elements", "max-frames", 4, NULL);
+  srcpad = gst_check_setup_src_pad (sink, &src_template);
+  gst_pad_set_active (srcpad, TRUE);
+  fail_unless (gst_element_set_state (sink,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  fail_unless (gst_pad_push_event (srcpad,
+          gst_event_new_stream_start ("test")));
+  caps = gst_pad_get_pad_template_caps (srcpad);
+  fail_unless (gst_pad_set_caps (srcpad, caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+
+  for (i = 1; i <= 6; i++) {
+    GstBuffer *buffer = create_frame (i);
+
+    GST_BUFFER_PTS (buffer) = (i - 1) * GST_SECOND / 30;
+    GST_BUFFER_DURATION (buffer) = GST_SECOND / 30;
+    fail_unless_equals_int (gst_pad_push (srcpad, buffer), GST_FLOW_OK);
+  }
+  fail_unless_equals_uint64 (get_uint64 (sink, "frames-dropped"), 2);
+
+  src = gst_check_setup_element ("intervideosrc");
+  g_object_set (src, "channel", "elements", NULL);
+  sinkpad = gst_check_setup_sink_pad (src, &sink_template);
+  gst_pad_set_active (sinkpad, TRUE);
+  fail_unless (gst_element_set_state (src,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < 6)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  fail_unless (gst_element_set_state (src,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+
+  /* the src might have gone on to a blank frame after those */
+  for (i = 3, l = buffers; i <= 8; i++, l = l->next)
+    fail_unless_equals_int (frame_index (l->data), MIN (i, 6));
+  fail_unless_equals_uint64 (get_uint64 (src, "frames-dropped"), 0);
+  fail_unless (get_uint64 (src, "frames-duplicated") >= 2);
+
+  gst_check_drop_buffers ();
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_check_teardown_sink_pad (src);
+  gst_check_teardown_element (src);
+
+  fail_unless (gst_element_set_state (sink,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+  gst_pad_set_active (srcpad, FALSE);
+  gst_check_teardown_src_pad (sink);
+  gst_check_teardown_element (sink);
+}
+
+GST_END_TEST;
+
+static Suite *
+intervideo_suite (void)
+{
+  Suite *s = suite_create ("intervideo");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_surface_order);
+  tcase_add_test (tc_chain, test_surface_drop);
+  tcase_add_test (tc_chain, test_surface_nearest);
+  tcase_add_test (tc_chain, test_elements);
+
+  return s;
+}
+
+GST_CHECK_MAIN (intervideo);
@@ -734,6 +734,125 @@ GST_START_TEST (test_multiple_state_change)
 
 GST_END_TEST;
 
+/* Pushes video buffers with a keyframe every 4th one, and checks that each
+ * keyframe starts an output buffer that is the only one flagged as a
+ * keyframe */
+static void
+check_keyframe_blocks (gint alignment, gboolean m2ts_mode,
+    gboolean align_keyframes)
+{
+  GstElement *mux;
+  GstSegment segment;
+  GstCaps *caps;
+  gchar *padname;
+  guint packet_size = m2ts_mode ? 192 : 188, prefix = packet_size - 188;
+  guint32 last_header = 0;
+  gint i, es_pid = -1, keyframes = 0;
+  gboolean aligned = alignment > 0 || (m2ts_mode && alignment < 0);
+  GList *l;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "alignment", alignment, "m2ts-mode", m2ts_mode,
+      "align-keyframes", align_keyframes, NULL);
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_pad_set_caps (mysrcpad, caps);
+  gst_caps_unref (caps);
+
+  for (i = 0; i < 12; i++) {
+    GstBuffer *inbuffer;
+    GstMapInfo map;
+
+    inbuffer = gst_buffer_new_and_alloc (1000);
+    gst_buffer_map (inbuffer, &map, GST_MAP_WRITE);
+    memset (map.data, 0xa5, map.size);
+    GST_WRITE_UINT32_BE (map.data, 0x00000001);
+    map.data[4] = i % 4 == 0 ? 0x65 : 0x41;
+    gst_buffer_unmap (inbuffer, &map);
+    if (i % 4 != 0)
+      GST_BUFFER_FLAG_SET (inbuffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    GST_BUFFER_PTS (inbuffer) = i * 40 * GST_MSECOND;
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  for (l = buffers; l; l = l->next) {
+    GstBuffer *outbuffer = l->data;
+    gboolean has_keyframe = FALSE, seen_es = FALSE;
+    GstMapInfo map;
+    guint8 *data;
+    gsize size;
+
+    gst_buffer_map (outbuffer, &map, GST_MAP_READ);
+    fail_unless_equals_int (map.size % packet_size, 0);
+    if (alignment > 0)
+      fail_unless_equals_int (map.size, alignment * packet_size);
+
+    for (data = map.data, size = map.size; size;
+        data += packet_size, size -= packet_size) {
+      guint8 *packet = data + prefix, *payload = packet + 4;
+      guint pid = GST_READ_UINT16_BE (packet + 1) & 0x1fff;
+
+      /* the timestamp headers, padding included, keep increasing */
+      if (m2ts_mode) {
+        fail_unless (GST_READ_UINT32_BE (data) >= last_header);
+        last_header = GST_READ_UINT32_BE (data);
+      }
+
+      fail_unless_equals_int (packet[0], 0x47);
+      /* without align-keyframes, only the last buffer is padded */
+      if (!align_keyframes && l->next)
+        fail_if (pid == 0x1fff);
+      if (packet[3] & 0x20)
+        payload += 1 + packet[4];
+
+      if ((packet[1] & 0x40) && GST_READ_UINT32_BE (payload) == 0x000001e0) {
+        guint8 *es = payload + 9 + payload[8];
+
+        es_pid = pid;
+        fail_unless_equals_int (GST_READ_UINT32_BE (es), 0x00000001);
+        if (es[4] == 0x65) {
+          GST_DEBUG ("keyframe at packet %u of buffer %p",
+              (guint) ((data - map.data) / packet_size), outbuffer);
+          /* no packet of the previous frame in this buffer, unless that
+           * would have taken padding */
+          if (!aligned || align_keyframes)
+            fail_if (seen_es);
+          has_keyframe = TRUE;
+          keyframes++;
+        }
+      }
+      if (pid == es_pid)
+        seen_es = TRUE;
+    }
+    gst_buffer_unmap (outbuffer, &map);
+
+    fail_unless_equals_int (GST_BUFFER_FLAG_IS_SET (outbuffer,
+            GST_BUFFER_FLAG_DELTA_UNIT), !has_keyframe);
+  }
+  fail_unless_equals_int (keyframes, 3);
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_START_TEST (test_keyframe_blocks)
+{
+  check_keyframe_blocks (-1, FALSE, FALSE);
+  check_keyframe_blocks (7, FALSE, FALSE);
+  check_keyframe_blocks (7, FALSE, TRUE);
+  check_keyframe_blocks (32, TRUE, FALSE);
+  check_keyframe_blocks (32, TRUE, TRUE);
+}
+
+GST_END_TEST;
+
 static Suite *
 mpegtsmux_suite (void)
 {
@@ -748,6 +867,7 @@ mpegtsmux_suite (void)
   tcase_add_test (tc_chain, test_force_key_unit_event_upstream);
   tcase_add_test (tc_chain, test_propagate_flow_status);
   tcase_add_test (tc_chain, test_multiple_state_change);
+  tcase_add_test (tc_chain, test_keyframe_blocks);
 
   return s;
 }
@@ -21,7 +21,9 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "mxfdemux.h"
 
 static GstPad *mysrcpad, *mysinkpad;
@@ -189,6 +191,7 @@ GST_START_TEST (test_pull)
   GstStateChangeReturn sret;
   GstElement *mxfdemux;
   GstPad *sinkpad;
+  guint64 n_reads, n_pulls;
 
   have_eos = FALSE;
   have_data = FALSE;
@@ -219,6 +222,12 @@ GST_START_TEST (test_pull)
   fail_unless (have_eos == TRUE);
   fail_unless (have_data == TRUE);
 
+  /* The whole file fits into the read-ahead window */
+  g_object_get (mxfdemux, "read-count", &n_reads, "pull-count", &n_pulls,
+      NULL);
+  fail_unless (n_pulls > 0);
+  fail_unless (n_pulls < n_reads);
+
   gst_element_set_state (mxfdemux, GST_STATE_NULL);
   gst_pad_set_active (mysinkpad, FALSE);
   gst_pad_set_active (mysrcpad, FALSE);
@@ -282,6 +291,367 @@ GST_START_TEST (test_push)
 
 GST_END_TEST;
 
+static void
+_seek_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  GstClockTime *first_pts = user_data;
+
+  if (*first_pts == GST_CLOCK_TIME_NONE)
+    *first_pts = GST_BUFFER_PTS (buffer);
+}
+
+static guint64
+_get_read_count (GstElement * pipeline)
+{
+  GstElement *demux;
+  guint64 read_count;
+
+  demux = gst_bin_get_by_name (GST_BIN (pipeline), "demux");
+  g_object_get (demux, "read-count", &read_count, NULL);
+  gst_object_unref (demux);
+
+  return read_count;
+}
+
+/* Seeking close to the end of the file resolves the target from the index
+ * table, instead of reading all the essence elements on the way there */
+GST_START_TEST (test_seek_index_table)
+{
+  GstElement *pipeline, *sink;
+  GstClockTime first_pts = GST_CLOCK_TIME_NONE;
+  guint64 read_count;
+  GstMessage *msg;
+  GstBus *bus;
+  gchar *filename, *desc;
+  gint fd;
+
+  fd = g_file_open_tmp ("mxfdemux-XXXXXX.mxf", &filename, NULL);
+  fail_unless (fd != -1);
+  close (fd);
+
+  /* The muxer writes an index table to the footer partition */
+  desc = g_strdup_printf ("videotestsrc num-buffers=500 ! "
+      "video/x-raw,format=(string)v308,width=64,height=48,framerate=25/1 ! "
+      "mxfmux ! filesink location=\"%s\"", filename);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  desc = g_strdup_printf ("filesrc location=\"%s\" ! mxfdemux "
+      "name=demux ! fakesink name=sink signal-handoffs=true", filename);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PAUSED) != GST_STATE_CHANGE_FAILURE);
+  fail_unless_equals_int (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (_seek_handoff), &first_pts);
+  gst_object_unref (sink);
+
+  read_count = _get_read_count (pipeline);
+  fail_unless (gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, 18 * GST_SECOND));
+  fail_unless_equals_int (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+
+  /* Scanning would read at least the 450 elements before the target */
+  read_count = _get_read_count (pipeline) - read_count;
+  GST_DEBUG ("seek took %" G_GUINT64_FORMAT " reads", read_count);
+  fail_unless (read_count < 100);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  /* Frame 450 is the first one after the seek */
+  fail_unless_equals_uint64 (first_pts, 18 * GST_SECOND);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+GST_END_TEST;
+
+/* The material package and the fill item that ends the header metadata
+ * of mxf_file */
+#define MATERIAL_PACKAGE_OFFSET 1886
+#define HEADER_FILL_OFFSET 4137
+#define HEADER_FILL_END 19995
+
+#define DM_EVENT_COMMENT "TestEvent"
+
+static const guint8 dm_track_uid[16] = {
+  0x5e, 0x2c, 0x41, 0x0a, 0x8d, 0x13, 0x4f, 0x62,
+  0x9b, 0x07, 0x3e, 0xd1, 0x26, 0xa4, 0x70, 0x01
+};
+
+static const guint8 dm_sequence_uid[16] = {
+  0x5e, 0x2c, 0x41, 0x0a, 0x8d, 0x13, 0x4f, 0x62,
+  0x9b, 0x07, 0x3e, 0xd1, 0x26, 0xa4, 0x70, 0x02
+};
+
+static const guint8 dm_segment_uid[16] = {
+  0x5e, 0x2c, 0x41, 0x0a, 0x8d, 0x13, 0x4f, 0x62,
+  0x9b, 0x07, 0x3e, 0xd1, 0x26, 0xa4, 0x70, 0x03
+};
+
+static const guint8 dm_framework_uid[16] = {
+  0x5e, 0x2c, 0x41, 0x0a, 0x8d, 0x13, 0x4f, 0x62,
+  0x9b, 0x07, 0x3e, 0xd1, 0x26, 0xa4, 0x70, 0x04
+};
+
+/* Descriptive metadata data definition, SMPTE RP224 */
+static const guint8 dm_data_definition[16] = {
+  0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01, 0x01,
+  0x01, 0x03, 0x02, 0x01, 0x10, 0x00, 0x00, 0x00
+};
+
+static const guint8 dms1_production_framework_key[16] = {
+  0x06, 0x0e, 0x2b, 0x34, 0x02, 0x53, 0x01, 0x01,
+  0x0d, 0x01, 0x04, 0x01, 0x01, 0x01, 0x01, 0x00
+};
+
+static void
+_append_tag (GByteArray * set, guint16 tag, const guint8 * data, guint16 size)
+{
+  guint8 header[4];
+
+  GST_WRITE_UINT16_BE (header, tag);
+  GST_WRITE_UINT16_BE (header + 2, size);
+  g_byte_array_append (set, header, 4);
+  g_byte_array_append (set, data, size);
+}
+
+static void
+_append_tag_uint64 (GByteArray * set, guint16 tag, guint64 value)
+{
+  guint8 data[8];
+
+  GST_WRITE_UINT64_BE (data, value);
+  _append_tag (set, tag, data, 8);
+}
+
+static void
+_append_tag_uint32 (GByteArray * set, guint16 tag, guint32 value)
+{
+  guint8 data[4];
+
+  GST_WRITE_UINT32_BE (data, value);
+  _append_tag (set, tag, data, 4);
+}
+
+/* Appends @set as a KLV packet with a 4 bytes length, like the sets of
+ * mxf_file, and empties it */
+static void
+_append_klv (GByteArray * data, const guint8 * key, GByteArray * set)
+{
+  guint8 length[4] = { 0x83, set->len >> 16, set->len >> 8, set->len };
+
+  g_byte_array_append (data, key, 16);
+  g_byte_array_append (data, length, 4);
+  g_byte_array_append (data, set->data, set->len);
+  g_byte_array_set_size (set, 0);
+}
+
+static void
+_append_metadata (GByteArray * data, guint16 type, GByteArray * set)
+{
+  guint8 key[16] = {
+    0x06, 0x0e, 0x2b, 0x34, 0x02, 0x53, 0x01, 0x01,
+    0x0d, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00
+  };
+
+  GST_WRITE_UINT16_BE (key + 13, type);
+  _append_klv (data, key, set);
+}
+
+/* Returns mxf_file with a static track added to its material package, whose
+ * DM segment refers to a DMS-1 production framework. Without
+ * @with_framework the framework set is left out. The sets overwrite the
+ * start of the fill item after the header metadata, so that no offset of
+ * the file changes */
+static GByteArray *
+_create_dm_file (gboolean with_framework)
+{
+  GByteArray *file, *sets, *set;
+  const guint8 *package;
+  guint8 batch[24], comment[2 * (sizeof (DM_EVENT_COMMENT) - 1)];
+  guint8 *fill;
+  guint package_size, fill_size, i;
+
+  sets = g_byte_array_new ();
+  set = g_byte_array_new ();
+
+  /* The material package again, with the static track. Coming later in
+   * the file, it replaces the first one */
+  package = mxf_file + MATERIAL_PACKAGE_OFFSET;
+  fail_unless_equals_int (GST_READ_UINT16_BE (package + 13), 0x0136);
+  package_size = GST_READ_UINT24_BE (package + 17);
+  package += 20;
+  while (package_size > 0) {
+    guint16 tag = GST_READ_UINT16_BE (package);
+    guint16 tag_size = GST_READ_UINT16_BE (package + 2);
+
+    if (tag == 0x4403) {
+      guint8 *tracks = g_malloc (tag_size + 16);
+
+      memcpy (tracks, package + 4, tag_size);
+      GST_WRITE_UINT32_BE (tracks, GST_READ_UINT32_BE (tracks) + 1);
+      memcpy (tracks + tag_size, dm_track_uid, 16);
+      _append_tag (set, tag, tracks, tag_size + 16);
+      g_free (tracks);
+    } else {
+      _append_tag (set, tag, package + 4, tag_size);
+    }
+
+    package += 4 + tag_size;
+    package_size -= 4 + tag_size;
+  }
+  _append_metadata (sets, 0x0136, set);
+
+  _append_tag (set, 0x3c0a, dm_track_uid, 16);
+  _append_tag_uint32 (set, 0x4801, 3);
+  _append_tag_uint32 (set, 0x4804, 0);
+  _append_tag (set, 0x4803, dm_sequence_uid, 16);
+  _append_metadata (sets, 0x013a, set);
+
+  GST_WRITE_UINT32_BE (batch, 1);
+  GST_WRITE_UINT32_BE (batch + 4, 16);
+  memcpy (batch + 8, dm_segment_uid, 16);
+  _append_tag (set, 0x3c0a, dm_sequence_uid, 16);
+  _append_tag (set, 0x0201, dm_data_definition, 16);
+  _append_tag_uint64 (set, 0x0202, 1);
+  _append_tag (set, 0x1001, batch, sizeof (batch));
+  _append_metadata (sets, 0x010f, set);
+
+  /* UTF-16BE */
+  for (i = 0; i < sizeof (DM_EVENT_COMMENT) - 1; i++) {
+    comment[2 * i] = 0;
+    comment[2 * i + 1] = DM_EVENT_COMMENT[i];
+  }
+  _append_tag (set, 0x3c0a, dm_segment_uid, 16);
+  _append_tag (set, 0x0201, dm_data_definition, 16);
+  _append_tag_uint64 (set, 0x0202, 1);
+  _append_tag_uint64 (set, 0x0601, 0);
+  _append_tag (set, 0x0602, comment, sizeof (comment));
+  _append_tag (set, 0x6101, dm_framework_uid, 16);
+  _append_metadata (sets, 0x0141, set);
+
+  if (with_framework) {
+    _append_tag (set, 0x3c0a, dm_framework_uid, 16);
+    _append_klv (sets, dms1_production_framework_key, set);
+  }
+
+  /* What is left of the fill item */
+  fail_unless (sets->len + 20 <= HEADER_FILL_END - HEADER_FILL_OFFSET);
+  fill_size = HEADER_FILL_END - HEADER_FILL_OFFSET - sets->len - 20;
+  fill = g_malloc0 (fill_size);
+  g_byte_array_append (set, fill, fill_size);
+  g_free (fill);
+  _append_klv (sets, mxf_file + HEADER_FILL_OFFSET, set);
+
+  file = g_byte_array_new ();
+  g_byte_array_append (file, mxf_file, sizeof (mxf_file));
+  memcpy (file->data + HEADER_FILL_OFFSET, sets->data, sets->len);
+
+  g_byte_array_free (sets, TRUE);
+  g_byte_array_free (set, TRUE);
+
+  return file;
+}
+
+/* Plays the file to the end and checks whether the DM segment made it into
+ * the structure */
+static void
+_check_descriptive_metadata (gboolean lazy, gboolean with_framework)
+{
+  GstElement *pipeline, *demux;
+  GstStructure *structure;
+  GByteArray *file;
+  GstMessage *msg;
+  GstBus *bus;
+  gchar *filename, *desc, *str;
+  gint fd;
+
+  GST_DEBUG ("lazy %d, with framework %d", lazy, with_framework);
+
+  fd = g_file_open_tmp ("mxfdemux-XXXXXX.mxf", &filename, NULL);
+  fail_unless (fd != -1);
+  close (fd);
+  file = _create_dm_file (with_framework);
+  fail_unless (g_file_set_contents (filename, (gchar *) file->data, file->len,
+          NULL));
+  g_byte_array_free (file, TRUE);
+
+  desc = g_strdup_printf ("filesrc location=\"%s\" ! mxfdemux name=demux "
+      "lazy-descriptive-metadata=%d ! fakesink", filename, lazy);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  /* In lazy mode this parses the framework */
+  demux = gst_bin_get_by_name (GST_BIN (pipeline), "demux");
+  g_object_get (demux, "structure", &structure, NULL);
+  gst_object_unref (demux);
+  fail_unless (structure != NULL);
+
+  str = gst_structure_to_string (structure);
+  GST_DEBUG ("structure %s", str);
+  if (with_framework)
+    fail_unless (strstr (str, DM_EVENT_COMMENT) != NULL);
+  else
+    fail_unless (strstr (str, DM_EVENT_COMMENT) == NULL);
+  g_free (str);
+  gst_structure_free (structure);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+/* The DM segment is kept whether its framework is parsed right away or on
+ * request. A missing framework drops the DM track in both modes, and
+ * playback goes on */
+GST_START_TEST (test_descriptive_metadata)
+{
+  _check_descriptive_metadata (FALSE, TRUE);
+  _check_descriptive_metadata (TRUE, TRUE);
+  _check_descriptive_metadata (FALSE, FALSE);
+  _check_descriptive_metadata (TRUE, FALSE);
+}
+
+GST_END_TEST;
+
 static Suite *
 mxfdemux_suite (void)
 {
@@ -297,6 +667,8 @@ mxfdemux_suite (void)
   tcase_set_timeout (tc_chain, 180);
   tcase_add_test (tc_chain, test_pull);
   tcase_add_test (tc_chain, test_push);
+  tcase_add_test (tc_chain, test_seek_index_table);
+  tcase_add_test (tc_chain, test_descriptive_metadata);
 
   return s;
 }
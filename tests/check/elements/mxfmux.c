@@ -65,7 +65,8 @@ on_message_cb (GstBus * bus, GstMessage * message, gpointer user_data)
 }
 
 static void
-run_test (const gchar * pipeline_string)
+run_test_full (const gchar * pipeline_string, GCallback handoff_cb,
+    gpointer handoff_data)
 {
   GstElement *pipeline;
   GstBus *bus;
@@ -79,6 +80,15 @@ run_test (const gchar * pipeline_string)
   fail_unless (pipeline != NULL);
   g_object_set (G_OBJECT (pipeline), "async-handling", TRUE, NULL);
 
+  if (handoff_cb) {
+    GstElement *sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+
+    fail_unless (sink != NULL);
+    g_object_set (sink, "signal-handoffs", TRUE, NULL);
+    g_signal_connect (sink, "handoff", handoff_cb, handoff_data);
+    gst_object_unref (sink);
+  }
+
   loop = g_main_loop_new (NULL, FALSE);
 
   bus = gst_element_get_bus (pipeline);
@@ -107,6 +117,12 @@ run_test (const gchar * pipeline_string)
   gst_object_unref (bus);
 }
 
+static void
+run_test (const gchar * pipeline_string)
+{
+  run_test_full (pipeline_string, NULL, NULL);
+}
+
 GST_START_TEST (test_mpeg2)
 {
   const gchar *mpeg2enc_name = get_mpeg2enc_element_name ();
@@ -239,6 +255,56 @@ GST_START_TEST (test_multiple_av_streams)
 
 GST_END_TEST;
 
+static const guint8 index_table_segment_key[] = {
+  0x06, 0x0e, 0x2b, 0x34, 0x02, 0x53, 0x01, 0x01,
+  0x0d, 0x01, 0x02, 0x01, 0x01, 0x10, 0x01, 0x00
+};
+
+typedef struct
+{
+  guint n_segments;
+  guint32 edit_unit_byte_count;
+  guint64 index_duration;
+} IndexTableInfo;
+
+static void
+on_index_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    IndexTableInfo * info)
+{
+  GstMapInfo map;
+  guint i;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  if (map.size > 20 && memcmp (map.data, index_table_segment_key, 16) == 0) {
+    info->n_segments++;
+    /* the segment is a local set, find the edit unit byte count and the
+     * index duration */
+    for (i = 17; i + 12 <= map.size; i++) {
+      if (GST_READ_UINT32_BE (map.data + i) == 0x3f050004)
+        info->edit_unit_byte_count = GST_READ_UINT32_BE (map.data + i + 4);
+      else if (GST_READ_UINT32_BE (map.data + i) == 0x3f0d0008)
+        info->index_duration += GST_READ_UINT64_BE (map.data + i + 4);
+    }
+  }
+  gst_buffer_unmap (buffer, &map);
+}
+
+GST_START_TEST (test_index_table)
+{
+  IndexTableInfo info = { 0, };
+
+  /* raw video has constant size edit units */
+  run_test_full ("videotestsrc num-buffers=50 ! "
+      "video/x-raw,format=(string)v308,width=320,height=240,framerate=25/1 ! "
+      "mxfmux ! fakesink name=sink", G_CALLBACK (on_index_handoff), &info);
+
+  fail_unless_equals_int (info.n_segments, 1);
+  fail_unless (info.edit_unit_byte_count > 320 * 240 * 3);
+  fail_unless_equals_uint64 (info.index_duration, 50);
+}
+
+GST_END_TEST;
+
 static Suite *
 mxfmux_suite (void)
 {
@@ -259,6 +325,7 @@ mxfmux_suite (void)
   tcase_add_test (tc_chain, test_jpeg2000_alaw);
   tcase_add_test (tc_chain, test_dnxhd_mp3);
   tcase_add_test (tc_chain, test_multiple_av_streams);
+  tcase_add_test (tc_chain, test_index_table);
 
   return s;
 }
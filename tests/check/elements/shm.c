@@ -27,6 +27,8 @@
 #include <gst/gst.h>
 #include <gst/check/gstcheck.h>
 
+#include "shmalloc.h"
+
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -42,7 +44,7 @@ GstElement *src, *sink;
 GstPad *sinkpad, *srcpad;
 
 static void
-setup_shm (void)
+setup_shm_full (guint ring_size, gboolean send_meta)
 {
   gchar *socket_path = NULL;
 
@@ -52,7 +54,8 @@ setup_shm (void)
   srcpad = gst_check_setup_src_pad (sink, &src_template);
   sinkpad = gst_check_setup_sink_pad (src, &sink_template);
 
-  g_object_set (sink, "socket-path", "shm-unit-test", NULL);
+  g_object_set (sink, "socket-path", "shm-unit-test", "ring-size", ring_size,
+      "send-meta", send_meta, NULL);
 
   fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
       GST_STATE_CHANGE_ASYNC);
@@ -69,6 +72,30 @@ setup_shm (void)
       GST_STATE_CHANGE_SUCCESS);
 }
 
+static void
+setup_shm (void)
+{
+  setup_shm_full (0, FALSE);
+}
+
+static void
+setup_shm_ring (void)
+{
+  setup_shm_full (8, FALSE);
+}
+
+static void
+setup_shm_meta (void)
+{
+  setup_shm_full (0, TRUE);
+}
+
+static void
+setup_shm_ring_meta (void)
+{
+  setup_shm_full (8, TRUE);
+}
+
 static void
 teardown_shm (void)
 {
@@ -154,6 +181,264 @@ GST_START_TEST (test_shm_alloc)
 
 GST_END_TEST;
 
+GST_START_TEST (test_shm_alloc_stats)
+{
+  GstBuffer *bufs[3];
+  GstQuery *query;
+  GstCaps *caps = gst_caps_new_empty_simple ("application/x-test");
+  GstAllocator *alloc;
+  GstAllocationParams params;
+  guint size, used, free_blocks, largest;
+  gdouble fragmentation;
+  gint i;
+
+  query = gst_query_new_allocation (caps, FALSE);
+  gst_caps_unref (caps);
+  fail_unless (gst_pad_peer_query (srcpad, query));
+  gst_query_parse_nth_allocation_param (query, 0, &alloc, &params);
+  fail_unless (alloc != NULL);
+  gst_query_unref (query);
+
+  g_object_get (sink, "shm-size", &size, "shm-used", &used,
+      "shm-free-blocks", &free_blocks, "shm-largest-free-block", &largest,
+      NULL);
+  fail_unless_equals_int (used, 0);
+  fail_unless_equals_int (free_blocks, 1);
+  fail_unless_equals_int (largest, size);
+
+  for (i = 0; i < 3; i++)
+    bufs[i] = gst_buffer_new_allocate (alloc, 1000, &params);
+  gst_object_unref (alloc);
+
+  /* free the middle one to leave a hole */
+  gst_buffer_unref (bufs[1]);
+  g_object_get (sink, "shm-used", &used, "shm-free-blocks", &free_blocks,
+      "shm-fragmentation", &fragmentation, NULL);
+  fail_unless (used >= 2000);
+  fail_unless_equals_int (free_blocks, 2);
+  fail_unless (fragmentation > 0.0);
+
+  /* and the holes are merged back */
+  gst_buffer_unref (bufs[0]);
+  gst_buffer_unref (bufs[2]);
+  g_object_get (sink, "shm-used", &used, "shm-free-blocks", &free_blocks,
+      "shm-largest-free-block", &largest, "shm-fragmentation",
+      &fragmentation, NULL);
+  fail_unless_equals_int (used, 0);
+  fail_unless_equals_int (free_blocks, 1);
+  fail_unless_equals_int (largest, size);
+  fail_unless (fragmentation == 0.0);
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+static void
+push_stream_start (GstCaps * caps)
+{
+  GstSegment segment;
+
+  fail_unless (gst_pad_push_event (srcpad,
+          gst_event_new_stream_start ("test")));
+  fail_unless (gst_pad_set_caps (srcpad, caps));
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  segment.start = 5 * GST_SECOND;
+  segment.time = 5 * GST_SECOND;
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+}
+
+static GstBuffer *
+push_and_pull (GstClockTime pts, GstClockTime dts, GstBufferFlags flags)
+{
+  GstBuffer *buf;
+
+  buf = gst_buffer_new_allocate (NULL, 1000, NULL);
+  GST_BUFFER_PTS (buf) = pts;
+  GST_BUFFER_DTS (buf) = dts;
+  GST_BUFFER_DURATION (buf) = GST_SECOND;
+  GST_BUFFER_FLAG_SET (buf, flags);
+  fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+
+  g_mutex_lock (&check_mutex);
+  while (buffers == NULL)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  buf = gst_buffer_ref (buffers->data);
+  fail_unless (gst_buffer_get_size (buf) == 1000);
+  gst_check_drop_buffers ();
+
+  return buf;
+}
+
+/* Old sources can't tell metadata from data, so nothing but the data is
+ * sent by default */
+GST_START_TEST (test_shm_no_meta)
+{
+  GstBuffer *buf;
+  GstCaps *caps = gst_caps_new_empty_simple ("application/x-test");
+
+  push_stream_start (caps);
+  gst_caps_unref (caps);
+
+  buf = push_and_pull (10 * GST_SECOND, 9 * GST_SECOND,
+      GST_BUFFER_FLAG_DELTA_UNIT);
+  fail_if (GST_BUFFER_PTS_IS_VALID (buf));
+  fail_if (GST_BUFFER_DTS_IS_VALID (buf));
+  fail_if (GST_BUFFER_DURATION_IS_VALID (buf));
+  fail_if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+  gst_buffer_unref (buf);
+
+  fail_unless (gst_pad_get_current_caps (sinkpad) == NULL);
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_meta)
+{
+  GstBuffer *buf;
+  GstCaps *caps = gst_caps_new_empty_simple ("application/x-test");
+  GstCaps *srccaps;
+
+  /* The segment starts at 5s, so those are sent as running times 5s and 4s.
+   * The source is not in a running pipeline, so the first DTS is mapped to
+   * running time 0 */
+  push_stream_start (caps);
+
+  buf = push_and_pull (10 * GST_SECOND, 9 * GST_SECOND,
+      GST_BUFFER_FLAG_DISCONT | GST_BUFFER_FLAG_DELTA_UNIT);
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buf), GST_SECOND);
+  fail_unless_equals_uint64 (GST_BUFFER_DTS (buf), 0);
+  fail_unless_equals_uint64 (GST_BUFFER_DURATION (buf), GST_SECOND);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DISCONT));
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+  gst_buffer_unref (buf);
+
+  buf = push_and_pull (11 * GST_SECOND, 10 * GST_SECOND, 0);
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buf), 2 * GST_SECOND);
+  fail_unless_equals_uint64 (GST_BUFFER_DTS (buf), GST_SECOND);
+  fail_if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DISCONT));
+  fail_if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+  gst_buffer_unref (buf);
+
+  srccaps = gst_pad_get_current_caps (sinkpad);
+  fail_unless (srccaps != NULL);
+  fail_unless (gst_caps_is_equal (caps, srccaps));
+  gst_caps_unref (srccaps);
+  gst_caps_unref (caps);
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_ring)
+{
+  GstBuffer *buf;
+  guint ring_size;
+  guint8 i;
+
+  g_object_get (sink, "ring-size", &ring_size, NULL);
+  fail_unless_equals_int (ring_size, 8);
+
+  /* more buffers than slots, so that they have to be acked through the
+   * ring for the sink not to drop any */
+  for (i = 0; i < 32; i++) {
+    buf = gst_buffer_new_allocate (NULL, 1000, NULL);
+    gst_buffer_memset (buf, 0, i, 1000);
+    fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+
+    g_mutex_lock (&check_mutex);
+    while (g_list_length (buffers) < 1)
+      g_cond_wait (&check_cond, &check_mutex);
+    g_mutex_unlock (&check_mutex);
+
+    buf = buffers->data;
+    fail_unless (gst_buffer_get_size (buf) == 1000);
+    fail_unless (gst_buffer_memcmp (buf, 999, &i, 1) == 0);
+    gst_check_drop_buffers ();
+  }
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+/* Three frames of 1080p I420 */
+#define FRAME_SIZE 6220800
+#define AREA_SIZE (3 * FRAME_SIZE)
+
+/* An empty space can be filled exactly, in one block or in several */
+GST_START_TEST (test_alloc_space_exact_fill)
+{
+  ShmAllocSpace *space = shm_alloc_space_new (AREA_SIZE);
+  ShmAllocBlock *blocks[3];
+  ShmAllocStats stats;
+  gint i;
+
+  blocks[0] = shm_alloc_space_alloc_block (space, AREA_SIZE);
+  fail_unless (blocks[0] != NULL);
+  shm_alloc_space_block_dec (blocks[0]);
+
+  for (i = 0; i < 3; i++) {
+    blocks[i] = shm_alloc_space_alloc_block (space, FRAME_SIZE);
+    fail_unless (blocks[i] != NULL);
+  }
+  shm_alloc_space_get_stats (space, &stats);
+  fail_unless_equals_int (stats.used, AREA_SIZE);
+  fail_unless_equals_int (stats.failures, 0);
+
+  for (i = 0; i < 3; i++)
+    shm_alloc_space_block_dec (blocks[i]);
+  shm_alloc_space_free (space);
+}
+
+GST_END_TEST;
+
+/* A hole left by a freed block is reused for a block of the same size, so
+ * that a pool of frames cycling through a space they fill never fails */
+GST_START_TEST (test_alloc_space_exact_hole)
+{
+  ShmAllocSpace *space = shm_alloc_space_new (AREA_SIZE);
+  ShmAllocBlock *blocks[3];
+  unsigned long offset;
+  gint i;
+
+  for (i = 0; i < 3; i++)
+    blocks[i] = shm_alloc_space_alloc_block (space, FRAME_SIZE);
+
+  offset = shm_alloc_space_alloc_block_get_offset (blocks[1]);
+  shm_alloc_space_block_dec (blocks[1]);
+  blocks[1] = shm_alloc_space_alloc_block (space, FRAME_SIZE);
+  fail_unless (blocks[1] != NULL);
+  fail_unless_equals_uint64 (shm_alloc_space_alloc_block_get_offset
+      (blocks[1]), offset);
+
+  for (i = 0; i < 1000; i++) {
+    shm_alloc_space_block_dec (blocks[i % 3]);
+    blocks[i % 3] = shm_alloc_space_alloc_block (space, FRAME_SIZE);
+    fail_unless (blocks[i % 3] != NULL);
+  }
+
+  /* any offset in a block leads back to it */
+  for (i = 0; i < 3; i++) {
+    offset = shm_alloc_space_alloc_block_get_offset (blocks[i]);
+    fail_unless (shm_alloc_space_block_get (space, offset) == blocks[i]);
+    fail_unless (shm_alloc_space_block_get (space,
+            offset + FRAME_SIZE - 1) == blocks[i]);
+  }
+
+  for (i = 0; i < 3; i++)
+    shm_alloc_space_block_dec (blocks[i]);
+  shm_alloc_space_free (space);
+}
+
+GST_END_TEST;
+
 static Suite *
 shm_suite (void)
 {
@@ -164,6 +449,28 @@ shm_suite (void)
   tcase_add_checked_fixture (tc, setup_shm, NULL);
   tcase_add_test (tc, test_shm_sysmem_alloc);
   tcase_add_test (tc, test_shm_alloc);
+  tcase_add_test (tc, test_shm_alloc_stats);
+  tcase_add_test (tc, test_shm_no_meta);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("alloc-space");
+  tcase_add_test (tc, test_alloc_space_exact_fill);
+  tcase_add_test (tc, test_alloc_space_exact_hole);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("shm-ring");
+  tcase_add_checked_fixture (tc, setup_shm_ring, NULL);
+  tcase_add_test (tc, test_shm_ring);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("shm-meta");
+  tcase_add_checked_fixture (tc, setup_shm_meta, NULL);
+  tcase_add_test (tc, test_shm_meta);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("shm-ring-meta");
+  tcase_add_checked_fixture (tc, setup_shm_ring_meta, NULL);
+  tcase_add_test (tc, test_shm_meta);
   suite_add_tcase (s, tc);
 
   return s;
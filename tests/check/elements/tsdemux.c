@@ -0,0 +1,339 @@
+/* GStreamer
+ *
+ * unit test for tsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "tsgenerator.h"
+
+static gchar *
+write_stream (GByteArray * data)
+{
+  GError *err = NULL;
+  gchar *filename;
+  gint fd;
+
+  fd = g_file_open_tmp ("tsdemux-test-XXXXXX.ts", &filename, &err);
+  fail_unless (fd != -1, "Failed to create a temporary file");
+  close (fd);
+  fail_unless (g_file_set_contents (filename, (gchar *) data->data, data->len,
+          &err));
+  g_byte_array_free (data, TRUE);
+
+  return filename;
+}
+
+static GstClockTime preroll_pts;
+
+static void
+preroll_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  preroll_pts = GST_BUFFER_PTS (buffer);
+}
+
+static GstElement *
+setup_pipeline (const gchar * filename)
+{
+  GstElement *pipeline, *sink;
+  gchar *desc;
+
+  desc = g_strdup_printf ("filesrc location=%s ! tsdemux ! "
+      "fakesink name=sink signal-handoffs=true", filename);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "preroll-handoff", G_CALLBACK (preroll_handoff),
+      NULL);
+  gst_object_unref (sink);
+
+  preroll_pts = GST_CLOCK_TIME_NONE;
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PAUSED) != GST_STATE_CHANGE_FAILURE);
+  fail_unless (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS);
+
+  return pipeline;
+}
+
+static void
+check_seek (GstElement * pipeline, GstClockTime target)
+{
+  preroll_pts = GST_CLOCK_TIME_NONE;
+  fail_unless (gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH, target));
+  fail_unless (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS);
+
+  /* Buffers before the target are clipped by the sink, so the first one
+   * prerolled is the first frame at the target, unless the demuxer started
+   * past it */
+  GST_DEBUG ("seek to %" GST_TIME_FORMAT " prerolled %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (target), GST_TIME_ARGS (preroll_pts));
+  fail_unless (GST_CLOCK_TIME_IS_VALID (preroll_pts));
+  fail_unless (preroll_pts >= target);
+  fail_unless (preroll_pts < target + 100 * GST_MSECOND);
+}
+
+/* 20 seconds where the second half has four times the bitrate of the first
+ * one, so that a seek only lands on its target if the demuxer maps time to
+ * offsets through the PCRs around it and not through the average bitrate */
+GST_START_TEST (test_duration_and_seek)
+{
+  GstElement *pipeline;
+  gchar *filename;
+  gint64 duration;
+
+  filename = write_stream (create_stream (188, 500, FRAME_SIZE, 16, 64, 0));
+  pipeline = setup_pipeline (filename);
+
+  fail_unless (gst_element_query_duration (pipeline, GST_FORMAT_TIME,
+          &duration));
+  GST_DEBUG ("duration %" GST_TIME_FORMAT, GST_TIME_ARGS (duration));
+  fail_unless (duration > 20 * GST_SECOND - 100 * GST_MSECOND);
+  fail_unless (duration < 20 * GST_SECOND + 100 * GST_MSECOND);
+
+  check_seek (pipeline, 15 * GST_SECOND);
+  check_seek (pipeline, 5 * GST_SECOND);
+  check_seek (pipeline, 12 * GST_SECOND);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  guint n_frames;
+  guint64 n_bytes;
+  GstClockTime last_pts;
+} FrameCount;
+
+static void
+count_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    FrameCount * count)
+{
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    if (count->n_frames == 0)
+      fail_unless_equals_uint64 (GST_BUFFER_PTS (buffer), 0);
+    else
+      fail_unless_equals_uint64 (GST_BUFFER_PTS (buffer),
+          count->last_pts + FRAME_DURATION * GST_SECOND / 90000);
+    count->last_pts = GST_BUFFER_PTS (buffer);
+    count->n_frames++;
+  }
+  count->n_bytes += gst_buffer_get_size (buffer);
+}
+
+/* Runs the stream to EOS through tsdemux, optionally in push mode, and
+ * checks that every frame came out */
+static void
+check_sync (guint packet_size, gboolean push_mode)
+{
+  GstElement *pipeline, *sink;
+  GstMessage *msg;
+  GstBus *bus;
+  FrameCount count = { 0, 0, GST_CLOCK_TIME_NONE };
+  gchar *filename, *desc;
+
+  GST_DEBUG ("packet size %u, push mode %d", packet_size, push_mode);
+
+  filename = write_stream (create_stream (packet_size, 100, FRAME_SIZE, 10, 10, 50));
+  desc = g_strdup_printf ("filesrc location=%s ! %s tsdemux ! "
+      "fakesink name=sink signal-handoffs=true", filename,
+      push_mode ? "queue !" : "");
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (count_handoff), &count);
+  gst_object_unref (sink);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  fail_unless_equals_int (count.n_frames, 100);
+  fail_unless_equals_uint64 (count.n_bytes, 100 * FRAME_SIZE);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+GST_START_TEST (test_sync_pull)
+{
+  check_sync (188, FALSE);
+  check_sync (192, FALSE);
+  check_sync (204, FALSE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_sync_push)
+{
+  check_sync (188, TRUE);
+  check_sync (192, TRUE);
+  check_sync (204, TRUE);
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  guint frame_size;
+  gboolean shared;
+  guint n_frames;
+} PESCheck;
+
+static void
+pes_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    PESCheck * check)
+{
+  GstMapInfo map;
+  guint8 fill;
+  guint i;
+
+  /* Every buffer is one complete PES payload */
+  fail_unless (GST_BUFFER_PTS_IS_VALID (buffer));
+  fail_unless_equals_int (gst_buffer_get_size (buffer), check->frame_size);
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buffer),
+      check->n_frames * FRAME_DURATION * GST_SECOND / 90000);
+
+  /* The first PES is pushed before downstream was queried, and is always
+   * copied. After that input memory is only shared if the PES fits in the
+   * memories of a single buffer */
+  if (check->n_frames > 0 && check->shared)
+    fail_unless (gst_buffer_n_memory (buffer) > 1);
+  else
+    fail_unless_equals_int (gst_buffer_n_memory (buffer), 1);
+
+  fill = check->n_frames & 0xff;
+  fail_unless (gst_buffer_map (buffer, &map, GST_MAP_READ));
+  for (i = 0; i < map.size; i++)
+    fail_unless_equals_int (map.data[i], fill);
+  gst_buffer_unmap (buffer, &map);
+
+  check->n_frames++;
+}
+
+static void
+check_pes_output (guint frame_size, guint packets, gboolean zero_copy,
+    gboolean video)
+{
+  GstElement *pipeline, *sink;
+  GstMessage *msg;
+  GstBus *bus;
+  PESCheck check = { frame_size, FALSE, 0 };
+  gchar *filename, *desc;
+
+  /* Payload of the first packet, after the PES header and PCR, then of the
+   * following ones. Unbounded video PES are never shared */
+  check.shared = zero_copy && !video &&
+      (frame_size - (176 - PES_HEADER_SIZE) + 183) / 184 + 1 <
+      gst_buffer_get_max_memory ();
+  GST_DEBUG ("frame size %u, zero-copy %d, video %d, sharing %d", frame_size,
+      zero_copy, video, check.shared);
+
+  filename = write_stream (create_stream_full (188, 50, frame_size, packets,
+          packets, 0, video));
+  desc = g_strdup_printf ("filesrc location=%s ! "
+      "tsdemux zero-copy-small-pes=%d ! "
+      "fakesink name=sink signal-handoffs=true", filename, zero_copy);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (pes_handoff), &check);
+  gst_object_unref (sink);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  /* The last video PES is only complete once the next one starts */
+  fail_unless_equals_int (check.n_frames, video ? 49 : 50);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+/* PES spanning several packets come out as a single buffer, shared or not,
+ * including those spanning more packets than a buffer can hold memories */
+GST_START_TEST (test_multi_packet_pes)
+{
+  check_pes_output (FRAME_SIZE, 10, FALSE, FALSE);
+  check_pes_output (FRAME_SIZE, 10, TRUE, FALSE);
+  check_pes_output (8000, 50, FALSE, FALSE);
+  check_pes_output (8000, 50, TRUE, FALSE);
+}
+
+GST_END_TEST;
+
+/* Video PES are unbounded and usually span many packets, they are copied
+ * into a single buffer even when small PES are shared */
+GST_START_TEST (test_multi_packet_video_pes)
+{
+  check_pes_output (FRAME_SIZE, 10, TRUE, TRUE);
+  check_pes_output (8000, 50, FALSE, TRUE);
+  check_pes_output (8000, 50, TRUE, TRUE);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsdemux_suite (void)
+{
+  Suite *s = suite_create ("tsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_duration_and_seek);
+  tcase_add_test (tc_chain, test_sync_pull);
+  tcase_add_test (tc_chain, test_sync_push);
+  tcase_add_test (tc_chain, test_multi_packet_pes);
+  tcase_add_test (tc_chain, test_multi_packet_video_pes);
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsdemux);
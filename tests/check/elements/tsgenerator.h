@@ -0,0 +1,274 @@
+/* GStreamer
+ *
+ * MPEG transport stream generator for the unit tests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __TS_GENERATOR_H__
+#define __TS_GENERATOR_H__
+
+#include <gst/check/gstcheck.h>
+#include <string.h>
+
+#define PMT_PID 0x1000
+#define ES_PID 0x100
+#define NULL_PID 0x1fff
+
+/* 25 frames per second, in 90kHz units */
+#define FRAME_DURATION 3600
+#define FRAME_SIZE 1000
+#define PES_HEADER_SIZE 14
+
+typedef struct
+{
+  GByteArray *data;
+  guint packet_size;
+  gboolean video;
+  guint8 cc[0x2000];
+} TSWriter;
+
+static guint32
+crc32_mpeg (const guint8 * data, guint size)
+{
+  guint32 crc = 0xffffffff;
+  guint i, j;
+
+  for (i = 0; i < size; i++) {
+    crc ^= data[i] << 24;
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+  }
+
+  return crc;
+}
+
+/* Writes one packet with up to @size bytes of @payload, and a PCR if @pcr
+ * is not -1. Returns the number of payload bytes written */
+static guint
+ts_writer_packet (TSWriter * w, guint16 pid, gboolean pusi, gint64 pcr,
+    const guint8 * payload, guint size)
+{
+  guint8 pkt[188], *p = pkt + 4;
+  guint room = 184;
+  gint af_len = -1;
+
+  if (pcr != -1)
+    af_len = 7;
+  if (af_len >= 0)
+    room -= 1 + af_len;
+  if (size < room) {
+    /* Pad with adaptation field stuffing */
+    af_len = 184 - size - 1;
+    room = size;
+  }
+
+  pkt[0] = 0x47;
+  pkt[1] = (pusi ? 0x40 : 0x00) | (pid >> 8);
+  pkt[2] = pid & 0xff;
+  pkt[3] = (af_len >= 0 ? 0x30 : 0x10) | (w->cc[pid] & 0xf);
+  w->cc[pid]++;
+
+  if (af_len >= 0) {
+    guint8 *af_end = p + 1 + af_len;
+
+    *p++ = af_len;
+    if (af_len > 0) {
+      *p++ = pcr != -1 ? 0x10 : 0x00;
+      if (pcr != -1) {
+        guint64 base = pcr / 300;
+        guint ext = pcr % 300;
+
+        *p++ = base >> 25;
+        *p++ = base >> 17;
+        *p++ = base >> 9;
+        *p++ = base >> 1;
+        *p++ = ((base & 1) << 7) | 0x7e | (ext >> 8);
+        *p++ = ext & 0xff;
+      }
+      memset (p, 0xff, af_end - p);
+      p = af_end;
+    }
+  }
+  memcpy (p, payload, room);
+
+  if (w->packet_size == 192) {
+    static const guint8 tp_extra_header[4] = { 0, };
+    g_byte_array_append (w->data, tp_extra_header, 4);
+  }
+  g_byte_array_append (w->data, pkt, 188);
+  if (w->packet_size == 204) {
+    static const guint8 parity[16] = { 0, };
+    g_byte_array_append (w->data, parity, 16);
+  }
+
+  return room;
+}
+
+static void
+ts_writer_section (TSWriter * w, guint16 pid, guint8 * section, guint size)
+{
+  guint8 payload[184];
+  guint32 crc;
+
+  /* pointer_field, then the section with its CRC */
+  memset (payload, 0xff, sizeof (payload));
+  payload[0] = 0;
+  crc = crc32_mpeg (section, size - 4);
+  GST_WRITE_UINT32_BE (section + size - 4, crc);
+  memcpy (payload + 1, section, size);
+
+  ts_writer_packet (w, pid, TRUE, -1, payload, sizeof (payload));
+}
+
+static void
+ts_writer_pat (TSWriter * w)
+{
+  guint8 pat[] = {
+    0x00, 0xb0, 13, 0x00, 0x01, 0xc1, 0x00, 0x00,
+    0x00, 0x01, 0xe0 | (PMT_PID >> 8), PMT_PID & 0xff,
+    0, 0, 0, 0
+  };
+
+  ts_writer_section (w, 0, pat, sizeof (pat));
+}
+
+static void
+ts_writer_pmt (TSWriter * w)
+{
+  /* program 1, with the MPEG audio (or video) stream carrying the PCR */
+  guint8 pmt[] = {
+    0x02, 0xb0, 18, 0x00, 0x01, 0xc1, 0x00, 0x00,
+    0xe0 | (ES_PID >> 8), ES_PID & 0xff, 0xf0, 0x00,
+    w->video ? 0x02 : 0x03, 0xe0 | (ES_PID >> 8), ES_PID & 0xff, 0xf0, 0x00,
+    0, 0, 0, 0
+  };
+
+  ts_writer_section (w, PMT_PID, pmt, sizeof (pmt));
+}
+
+/* Writes a PES of @size bytes with @pts, spread over several packets, the
+ * first of which carries a PCR equal to @pts. Video PES are unbounded, like
+ * most muxers write them. Returns the number of packets written */
+static guint
+ts_writer_pes (TSWriter * w, guint64 pts, guint size, guint8 fill)
+{
+  guint8 *pes = g_malloc (PES_HEADER_SIZE + size), *p = pes;
+  guint n = 0, pos = 0;
+
+  *p++ = 0x00;
+  *p++ = 0x00;
+  *p++ = 0x01;
+  *p++ = w->video ? 0xe0 : 0xc0;
+  GST_WRITE_UINT16_BE (p, w->video ? 0 : PES_HEADER_SIZE - 6 + size);
+  p += 2;
+  *p++ = 0x80;
+  *p++ = 0x80;
+  *p++ = 5;
+  *p++ = 0x21 | ((pts >> 29) & 0x0e);
+  *p++ = pts >> 22;
+  *p++ = ((pts >> 14) & 0xfe) | 1;
+  *p++ = pts >> 7;
+  *p++ = ((pts << 1) & 0xfe) | 1;
+  memset (p, fill, size);
+
+  while (pos < PES_HEADER_SIZE + size) {
+    pos += ts_writer_packet (w, ES_PID, pos == 0, pos == 0 ? pts * 300 : -1,
+        pes + pos, PES_HEADER_SIZE + size - pos);
+    n++;
+  }
+  g_free (pes);
+
+  return n;
+}
+
+/* Writes @size bytes that are not part of any packet, with a sync byte in
+ * the middle */
+static void
+ts_writer_garbage (TSWriter * w, guint size)
+{
+  guint8 garbage[256];
+  guint i;
+
+  fail_unless (size <= sizeof (garbage));
+  for (i = 0; i < size; i++)
+    garbage[i] = (i * 13) & 0x3f;
+  garbage[size / 2] = 0x47;
+  g_byte_array_append (w->data, garbage, size);
+}
+
+static void
+ts_writer_null (TSWriter * w)
+{
+  guint8 payload[184];
+
+  memset (payload, 0xff, sizeof (payload));
+  ts_writer_packet (w, NULL_PID, FALSE, -1, payload, sizeof (payload));
+}
+
+/* Creates a stream of @n_frames audio (or @video) frames of @frame_size
+ * bytes, each taking the same number of
+ * packets: @packets_first for the first half and @packets_second for the
+ * second half of the stream. Each frame slot starts with the PAT and PMT
+ * (every 10th frame, null packets otherwise) so that the PCR is always at
+ * the same position in its slot. If @garbage is not 0, that many bytes of
+ * garbage are written before the stream and before the frame a quarter of
+ * the way in. */
+static GByteArray *
+create_stream_full (guint packet_size, guint n_frames, guint frame_size,
+    guint packets_first, guint packets_second, guint garbage, gboolean video)
+{
+  TSWriter *w = g_new0 (TSWriter, 1);
+  GByteArray *data;
+  guint i, n, slot;
+
+  w->data = g_byte_array_new ();
+  w->packet_size = packet_size;
+  w->video = video;
+
+  for (i = 0; i < n_frames; i++) {
+    if (garbage && (i == 0 || i == n_frames / 4))
+      ts_writer_garbage (w, garbage);
+    slot = i < n_frames / 2 ? packets_first : packets_second;
+    if (i % 10 == 0) {
+      ts_writer_pat (w);
+      ts_writer_pmt (w);
+    } else {
+      ts_writer_null (w);
+      ts_writer_null (w);
+    }
+    n = 2 + ts_writer_pes (w, 90000 + i * FRAME_DURATION, frame_size,
+        i & 0xff);
+    fail_unless (n <= slot);
+    for (; n < slot; n++)
+      ts_writer_null (w);
+  }
+
+  data = w->data;
+  g_free (w);
+
+  return data;
+}
+
+static GByteArray *
+create_stream (guint packet_size, guint n_frames, guint frame_size,
+    guint packets_first, guint packets_second, guint garbage)
+{
+  return create_stream_full (packet_size, n_frames, frame_size,
+      packets_first, packets_second, garbage, FALSE);
+}
+
+#endif /* __TS_GENERATOR_H__ */
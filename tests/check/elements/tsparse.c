@@ -0,0 +1,484 @@
+/* GStreamer
+ *
+ * unit test for tsparse
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <string.h>
+
+#include "tsgenerator.h"
+
+#define N_FRAMES 50
+#define SLOT_PACKETS 10
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true"));
+
+static GstPad *mysrcpad, *mysinkpad, *myprogrampad;
+static GList *program_buffers;
+
+static GstFlowReturn
+program_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  program_buffers = g_list_append (program_buffers, buffer);
+
+  return GST_FLOW_OK;
+}
+
+static GstElement *
+setup_tsparse (guint max_packets, GstClockTime max_latency)
+{
+  GstElement *tsparse;
+  GstPad *pad;
+
+  tsparse = gst_check_setup_element ("tsparse");
+  g_object_set (tsparse, "max-packets", max_packets, "max-latency",
+      max_latency, NULL);
+  mysrcpad = gst_check_setup_src_pad (tsparse, &src_template);
+  mysinkpad = gst_check_setup_sink_pad (tsparse, &sink_template);
+
+  pad = gst_element_get_request_pad (tsparse, "program_1");
+  fail_unless (pad != NULL);
+  myprogrampad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_chain_function (myprogrampad, program_chain);
+  gst_pad_set_active (myprogrampad, TRUE);
+  fail_unless (gst_pad_link (pad, myprogrampad) == GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+  fail_unless (gst_element_set_state (tsparse,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS);
+
+  return tsparse;
+}
+
+static void
+cleanup_tsparse (GstElement * tsparse)
+{
+  GstPad *pad;
+
+  gst_element_set_state (tsparse, GST_STATE_NULL);
+
+  pad = gst_pad_get_peer (myprogrampad);
+  gst_pad_unlink (pad, myprogrampad);
+  gst_element_release_request_pad (tsparse, pad);
+  gst_object_unref (pad);
+  gst_object_unref (myprogrampad);
+
+  g_list_free_full (program_buffers, (GDestroyNotify) gst_buffer_unref);
+  program_buffers = NULL;
+
+  gst_check_drop_buffers ();
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (tsparse);
+  gst_check_teardown_sink_pad (tsparse);
+  gst_check_teardown_element (tsparse);
+}
+
+static void
+push_stream_start (void)
+{
+  GstSegment segment;
+  GstCaps *caps;
+
+  fail_unless (gst_pad_push_event (mysrcpad,
+          gst_event_new_stream_start ("test")));
+  caps = gst_caps_from_string ("video/mpegts, systemstream = (boolean) true");
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_caps (caps)));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+}
+
+/* Pushes the stream, one frame slot per input buffer timestamped with the
+ * frame time, then EOS */
+static void
+push_stream (GByteArray * data)
+{
+  guint i, slot_size = SLOT_PACKETS * 188;
+
+  push_stream_start ();
+
+  for (i = 0; i < data->len / slot_size; i++) {
+    GstBuffer *buf;
+
+    buf = gst_buffer_new_and_alloc (slot_size);
+    gst_buffer_fill (buf, 0, data->data + i * slot_size, slot_size);
+    GST_BUFFER_TIMESTAMP (buf) = i * FRAME_DURATION * GST_SECOND / 90000;
+    fail_unless_equals_int (gst_pad_push (mysrcpad, buf), GST_FLOW_OK);
+  }
+
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+}
+
+/* Checks that the program pad got the packets of the program, in order,
+ * and returns for each output buffer the frame slots of its first and last
+ * packets */
+static GArray *
+check_program_packets (GByteArray * data)
+{
+  GByteArray *expected = g_byte_array_new ();
+  GArray *slots = g_array_new (FALSE, FALSE, sizeof (guint)), *ranges;
+  guint i, pos, n_out = 0, skip;
+  GList *l;
+
+  for (i = 0; i < data->len / 188; i++) {
+    const guint8 *p = data->data + i * 188;
+    guint16 pid = GST_READ_UINT16_BE (p + 1) & 0x1fff;
+    guint slot = i / SLOT_PACKETS;
+
+    if (pid == 0 || pid == PMT_PID || pid == ES_PID) {
+      g_byte_array_append (expected, p, 188);
+      g_array_append_val (slots, slot);
+    }
+  }
+
+  for (l = program_buffers; l; l = l->next) {
+    gsize size = gst_buffer_get_size (l->data);
+
+    fail_unless (size > 0);
+    fail_unless_equals_int (size % 188, 0);
+    n_out += size / 188;
+  }
+
+  /* Packets before the PMT was seen are not pushed */
+  fail_unless (n_out <= slots->len);
+  fail_unless (n_out + 2 >= slots->len);
+  skip = slots->len - n_out;
+
+  ranges = g_array_new (FALSE, FALSE, sizeof (guint) * 2);
+  pos = skip;
+  for (l = program_buffers; l; l = l->next) {
+    GstMapInfo map;
+    guint range[2];
+
+    fail_unless (gst_buffer_map (l->data, &map, GST_MAP_READ));
+    fail_unless (memcmp (map.data, expected->data + pos * 188, map.size) == 0);
+    range[0] = g_array_index (slots, guint, pos);
+    pos += map.size / 188;
+    range[1] = g_array_index (slots, guint, pos - 1);
+    gst_buffer_unmap (l->data, &map);
+    g_array_append_val (ranges, range);
+  }
+
+  g_byte_array_free (expected, TRUE);
+  g_array_free (slots, TRUE);
+
+  return ranges;
+}
+
+/* With no latency allowed, packets are aggregated up to max-packets but
+ * never across input buffers, and consecutive packets share a single
+ * memory of the input buffer */
+GST_START_TEST (test_program_pad_aggregation)
+{
+  GstElement *tsparse;
+  GByteArray *data;
+  GArray *ranges;
+  GList *l;
+  guint i;
+
+  tsparse = setup_tsparse (4, 0);
+  data = create_stream (188, N_FRAMES, FRAME_SIZE, SLOT_PACKETS,
+      SLOT_PACKETS, 0);
+  push_stream (data);
+
+  ranges = check_program_packets (data);
+  for (i = 0, l = program_buffers; l; i++, l = l->next) {
+    guint *range = &g_array_index (ranges, guint, 2 * i);
+
+    fail_unless (gst_buffer_get_size (l->data) <= 4 * 188);
+    fail_unless_equals_int (range[0], range[1]);
+    fail_unless_equals_int (gst_buffer_n_memory (l->data), 1);
+  }
+  fail_unless (i >= (N_FRAMES - 1) * 2);
+
+  g_array_free (ranges, TRUE);
+  g_byte_array_free (data, TRUE);
+  cleanup_tsparse (tsparse);
+}
+
+GST_END_TEST;
+
+/* With max-latency set, packets are held back across input buffers until
+ * one arrives max-latency after the first one */
+GST_START_TEST (test_program_pad_latency)
+{
+  GstElement *tsparse;
+  GByteArray *data;
+  GArray *ranges;
+  GList *l;
+  guint i;
+
+  /* 100ms is between 2 and 3 frames */
+  tsparse = setup_tsparse (1000, 100 * GST_MSECOND);
+  data = create_stream (188, N_FRAMES, FRAME_SIZE, SLOT_PACKETS,
+      SLOT_PACKETS, 0);
+  push_stream (data);
+
+  ranges = check_program_packets (data);
+  fail_unless (ranges->len > 2);
+  for (i = 0, l = program_buffers; l; i++, l = l->next) {
+    guint *range = &g_array_index (ranges, guint, 2 * i);
+
+    /* The last buffer is pushed at EOS */
+    if (l->next)
+      fail_unless_equals_int (range[1] - range[0], 3);
+    else
+      fail_unless (range[1] - range[0] <= 3);
+  }
+
+  g_array_free (ranges, TRUE);
+  g_byte_array_free (data, TRUE);
+  cleanup_tsparse (tsparse);
+}
+
+GST_END_TEST;
+
+/* Must match SECTION_CACHE_MAX_ENTRIES in mpegtspacketizer.c */
+#define SECTION_CACHE_SIZE 4096
+#define EIT_PID 0x12
+
+/* Writes section @section_number of an EIT schedule subtable of
+ * @service_id, with a single event */
+static void
+ts_writer_eit (TSWriter * w, guint16 service_id, guint8 version,
+    guint8 section_number, guint8 last_section_number)
+{
+  guint8 eit[] = {
+    0x50, 0xf0, 27, service_id >> 8, service_id & 0xff,
+    0xc1 | ((version & 0x1f) << 1), section_number, last_section_number,
+    0x00, 0x01, 0x00, 0x01, last_section_number, 0x50,
+    /* event_id, undefined start time, 30 minutes, no descriptors */
+    0x00, section_number, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x30, 0x00,
+    0x00, 0x00,
+    0, 0, 0, 0
+  };
+
+  ts_writer_section (w, EIT_PID, eit, sizeof (eit));
+}
+
+static TSWriter *
+ts_writer_new (void)
+{
+  TSWriter *w = g_new0 (TSWriter, 1);
+
+  w->data = g_byte_array_new ();
+  w->packet_size = 188;
+
+  return w;
+}
+
+/* Pushes what was written so far as a single buffer */
+static void
+ts_writer_push (TSWriter * w)
+{
+  GstBuffer *buf;
+
+  buf = gst_buffer_new_and_alloc (w->data->len);
+  gst_buffer_fill (buf, 0, w->data->data, w->data->len);
+  fail_unless_equals_int (gst_pad_push (mysrcpad, buf), GST_FLOW_OK);
+  g_byte_array_set_size (w->data, 0);
+}
+
+static void
+ts_writer_free (TSWriter * w)
+{
+  g_byte_array_free (w->data, TRUE);
+  g_free (w);
+}
+
+/* Returns the EIT messages posted on @bus so far */
+static GPtrArray *
+pop_eit_messages (GstBus * bus)
+{
+  GPtrArray *msgs =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_message_unref);
+  GstMessage *msg;
+
+  while ((msg = gst_bus_pop_filtered (bus, GST_MESSAGE_ELEMENT))) {
+    if (gst_message_has_name (msg, "eit"))
+      g_ptr_array_add (msgs, msg);
+    else
+      gst_message_unref (msg);
+  }
+
+  return msgs;
+}
+
+static guint
+count_eit_messages (GstBus * bus)
+{
+  GPtrArray *msgs = pop_eit_messages (bus);
+  guint n = msgs->len;
+
+  g_ptr_array_unref (msgs);
+
+  return n;
+}
+
+static void
+check_stats (GstElement * tsparse, guint64 hits, guint64 misses,
+    guint entries, guint64 evictions)
+{
+  GstStructure *stats;
+  guint64 stat_hits, stat_misses, stat_evictions;
+  guint stat_entries;
+
+  g_object_get (tsparse, "stats", &stats, NULL);
+  fail_unless (stats != NULL);
+  GST_DEBUG ("stats %" GST_PTR_FORMAT, stats);
+  fail_unless (gst_structure_get (stats,
+          "section-cache-hits", G_TYPE_UINT64, &stat_hits,
+          "section-cache-misses", G_TYPE_UINT64, &stat_misses,
+          "section-cache-entries", G_TYPE_UINT, &stat_entries,
+          "section-cache-evictions", G_TYPE_UINT64, &stat_evictions, NULL));
+  fail_unless_equals_uint64 (stat_hits, hits);
+  fail_unless_equals_uint64 (stat_misses, misses);
+  fail_unless_equals_int (stat_entries, entries);
+  fail_unless_equals_uint64 (stat_evictions, evictions);
+  gst_structure_free (stats);
+}
+
+/* The sections of a multi-section EIT subtable all get past the subtable
+ * version check as they cycle, and are only parsed once until their version
+ * changes. Every repetition is still posted, with the same content */
+GST_START_TEST (test_section_cache)
+{
+  GstElement *tsparse;
+  GPtrArray *msgs;
+  GstBus *bus;
+  TSWriter *w;
+  guint i, j;
+
+  tsparse = setup_tsparse (1, 0);
+  bus = gst_bus_new ();
+  gst_element_set_bus (tsparse, bus);
+  push_stream_start ();
+  w = ts_writer_new ();
+
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 4; j++)
+      ts_writer_eit (w, 1, 0, j, 3);
+  ts_writer_push (w);
+  msgs = pop_eit_messages (bus);
+  fail_unless_equals_int (msgs->len, 12);
+  for (i = 4; i < msgs->len; i++) {
+    GstMessage *first = g_ptr_array_index (msgs, i % 4);
+    GstMessage *repeated = g_ptr_array_index (msgs, i);
+
+    fail_unless (gst_structure_is_equal (gst_message_get_structure (first),
+            gst_message_get_structure (repeated)));
+  }
+  g_ptr_array_unref (msgs);
+  check_stats (tsparse, 8, 4, 4, 0);
+
+  /* A new version replaces the cached sections */
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 4; j++)
+      ts_writer_eit (w, 1, 1, j, 3);
+  ts_writer_push (w);
+  fail_unless_equals_int (count_eit_messages (bus), 8);
+  check_stats (tsparse, 12, 8, 4, 0);
+
+  ts_writer_free (w);
+  gst_element_set_bus (tsparse, NULL);
+  gst_object_unref (bus);
+  cleanup_tsparse (tsparse);
+}
+
+GST_END_TEST;
+
+/* A full cache evicts the least recently used section, and keeps the ones
+ * that are still repeated */
+GST_START_TEST (test_section_cache_eviction)
+{
+  GstElement *tsparse;
+  GstBus *bus;
+  TSWriter *w;
+  guint i;
+
+  tsparse = setup_tsparse (1, 0);
+  bus = gst_bus_new ();
+  gst_element_set_bus (tsparse, bus);
+  push_stream_start ();
+  w = ts_writer_new ();
+
+  /* Two sections per service, so that repeating one of them gets past the
+   * subtable version check */
+  for (i = 0; i < SECTION_CACHE_SIZE / 2; i++) {
+    ts_writer_eit (w, i, 0, 0, 1);
+    ts_writer_eit (w, i, 0, 1, 1);
+  }
+  ts_writer_push (w);
+  fail_unless_equals_int (count_eit_messages (bus), SECTION_CACHE_SIZE);
+  check_stats (tsparse, 0, SECTION_CACHE_SIZE, SECTION_CACHE_SIZE, 0);
+
+  /* The oldest section is used again */
+  ts_writer_eit (w, 0, 0, 0, 1);
+  ts_writer_push (w);
+  fail_unless_equals_int (count_eit_messages (bus), 1);
+  check_stats (tsparse, 1, SECTION_CACHE_SIZE, SECTION_CACHE_SIZE, 0);
+
+  /* A new section evicts the second oldest one, and the evicted one evicts
+   * the next one in turn */
+  ts_writer_eit (w, SECTION_CACHE_SIZE, 0, 0, 0);
+  ts_writer_eit (w, 0, 0, 1, 1);
+  ts_writer_push (w);
+  fail_unless_equals_int (count_eit_messages (bus), 2);
+  check_stats (tsparse, 1, SECTION_CACHE_SIZE + 2, SECTION_CACHE_SIZE, 2);
+
+  /* The section used last is still cached */
+  ts_writer_eit (w, 0, 0, 0, 1);
+  ts_writer_push (w);
+  fail_unless_equals_int (count_eit_messages (bus), 1);
+  check_stats (tsparse, 2, SECTION_CACHE_SIZE + 2, SECTION_CACHE_SIZE, 2);
+
+  ts_writer_free (w);
+  gst_element_set_bus (tsparse, NULL);
+  gst_object_unref (bus);
+  cleanup_tsparse (tsparse);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsparse_suite (void)
+{
+  Suite *s = suite_create ("tsparse");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_program_pad_aggregation);
+  tcase_add_test (tc_chain, test_program_pad_latency);
+  tcase_add_test (tc_chain, test_section_cache);
+  tcase_add_test (tc_chain, test_section_cache_eviction);
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsparse);
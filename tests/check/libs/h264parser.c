@@ -132,6 +132,72 @@ static guint8 slice_dpa[] = {
   0x63, 0x72, 0x6f, 0x6e, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02
 };
 
+/* has an emulation prevention byte in the middle of its timing info */
+static guint8 sps_epb[] = {
+  0x00, 0x00, 0x00, 0x01, 0x67, 0x4d, 0x40, 0x15, 0xec, 0xa4, 0xbf, 0x2e,
+  0x02, 0x20, 0x00, 0x00, 0x03, 0x00, 0x2e, 0xe6, 0xb2, 0x80, 0x01, 0xe2,
+  0xc5, 0xb2, 0xc0
+};
+
+static guint8 pps[] = {
+  0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xec, 0xb2
+};
+
+typedef struct
+{
+  guint8 *data;
+  guint pos;
+} BitWriter;
+
+static void
+put_bits (BitWriter * bw, guint32 value, guint nbits)
+{
+  while (nbits--) {
+    if (value & (1U << nbits))
+      bw->data[bw->pos / 8] |= 0x80 >> (bw->pos % 8);
+    bw->pos++;
+  }
+}
+
+static void
+put_ue (BitWriter * bw, guint32 value)
+{
+  guint nbits = g_bit_storage (value + 1);
+
+  put_bits (bw, 0, nbits - 1);
+  put_bits (bw, value + 1, nbits);
+}
+
+static void
+put_se (BitWriter * bw, gint32 value)
+{
+  put_ue (bw, value > 0 ? 2 * value - 1 : -2 * value);
+}
+
+/* Writes a start code followed by the NAL unit in @rbsp, with emulation
+ * prevention bytes inserted. Returns the size written */
+static guint
+escape_nal (guint8 * data, const guint8 * rbsp, guint size)
+{
+  guint i, n = 0, zeros = 0;
+
+  data[n++] = 0x00;
+  data[n++] = 0x00;
+  data[n++] = 0x00;
+  data[n++] = 0x01;
+
+  for (i = 0; i < size; i++) {
+    if (zeros == 2 && rbsp[i] <= 0x03) {
+      data[n++] = 0x03;
+      zeros = 0;
+    }
+    data[n++] = rbsp[i];
+    zeros = rbsp[i] == 0x00 ? zeros + 1 : 0;
+  }
+
+  return n;
+}
+
 GST_START_TEST (test_h264_parse_slice_dpa)
 {
   GstH264ParserResult res;
@@ -150,6 +216,275 @@ GST_START_TEST (test_h264_parse_slice_dpa)
 
 GST_END_TEST;
 
+static void
+check_sps_epb (GstH264SPS * sps)
+{
+  assert_equals_int (sps->width, 32);
+  assert_equals_int (sps->height, 24);
+  assert_equals_int (sps->vui_parameters.timing_info_present_flag, 1);
+  assert_equals_int (sps->vui_parameters.num_units_in_tick, 1);
+  assert_equals_int (sps->vui_parameters.time_scale, 2000000000);
+}
+
+GST_START_TEST (test_h264_parse_sps_epb)
+{
+  GstH264ParserResult res;
+  GstH264NalUnit nalu;
+  GstH264SPS sps;
+
+  GstH264NalParser *parser = gst_h264_nal_parser_new ();
+
+  res = gst_h264_parser_identify_nalu_unchecked (parser, sps_epb, 0,
+      sizeof (sps_epb), &nalu);
+  assert_equals_int (res, GST_H264_PARSER_OK);
+  assert_equals_int (nalu.type, GST_H264_NAL_SPS);
+
+  res = gst_h264_parser_parse_sps (parser, &nalu, &sps, TRUE);
+  assert_equals_int (res, GST_H264_PARSER_OK);
+  check_sps_epb (&sps);
+
+  /* and without a parser */
+  memset (&sps, 0, sizeof (sps));
+  res = gst_h264_parse_sps (&nalu, &sps, TRUE);
+  assert_equals_int (res, GST_H264_PARSER_OK);
+  check_sps_epb (&sps);
+
+  gst_h264_nal_parser_free (parser);
+}
+
+GST_END_TEST;
+
+static void
+setup_parameter_sets (GstH264NalParser * parser)
+{
+  GstH264NalUnit nalu;
+  GstH264SPS sps;
+  GstH264PPS pps_hdr;
+
+  assert_equals_int (gst_h264_parser_identify_nalu_unchecked (parser,
+          sps_epb, 0, sizeof (sps_epb), &nalu), GST_H264_PARSER_OK);
+  assert_equals_int (gst_h264_parser_parse_sps (parser, &nalu, &sps, TRUE),
+      GST_H264_PARSER_OK);
+  assert_equals_int (gst_h264_parser_identify_nalu_unchecked (parser, pps, 0,
+          sizeof (pps), &nalu), GST_H264_PARSER_OK);
+  assert_equals_int (gst_h264_parser_parse_pps (parser, &nalu, &pps_hdr),
+      GST_H264_PARSER_OK);
+}
+
+/* A reference P slice over 32 reference pictures, with weights for the 16th
+ * one only. The unset flags of the others make runs of zero bytes in the
+ * header, and the flag and luma weight of the 16th one end the first run
+ * with 00 00 00 03, which is escaped as 00 00 03 00 03 */
+static guint
+make_slice_epb (guint8 * data)
+{
+  guint8 rbsp[64] = { 0, };
+  BitWriter bw = { rbsp, 0 };
+  guint i;
+
+  put_bits (&bw, 0x41, 8);
+
+  put_ue (&bw, 0);              /* first_mb_in_slice */
+  put_ue (&bw, 5);              /* slice_type, P */
+  put_ue (&bw, 0);              /* pic_parameter_set_id */
+  put_bits (&bw, 3, 4);         /* frame_num */
+  put_bits (&bw, 6, 6);         /* pic_order_cnt_lsb */
+  put_bits (&bw, 1, 1);         /* num_ref_idx_active_override_flag */
+  put_ue (&bw, 31);             /* num_ref_idx_l0_active_minus1 */
+  put_bits (&bw, 0, 1);         /* ref_pic_list_modification_flag_l0 */
+
+  /* pred_weight_table () */
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  for (i = 0; i < 32; i++) {
+    if (i == 15) {
+      put_bits (&bw, 1, 1);
+      put_se (&bw, 0);
+      put_se (&bw, 0);
+    } else {
+      put_bits (&bw, 0, 1);
+    }
+    put_bits (&bw, 0, 1);
+  }
+
+  put_bits (&bw, 0, 1);         /* adaptive_ref_pic_marking_mode_flag */
+  put_ue (&bw, 0);              /* cabac_init_idc */
+  put_se (&bw, -2);             /* slice_qp_delta */
+  put_ue (&bw, 0);              /* disable_deblocking_filter_idc */
+  put_se (&bw, 1);              /* slice_alpha_c0_offset_div2 */
+  put_se (&bw, -1);             /* slice_beta_offset_div2 */
+
+  /* slice data */
+  for (i = (bw.pos + 7) / 8; i < sizeof (rbsp); i++)
+    rbsp[i] = 0x5a;
+
+  return escape_nal (data, rbsp, sizeof (rbsp));
+}
+
+GST_START_TEST (test_h264_parse_slice_epb)
+{
+  static const guint8 epb_03[] = { 0x00, 0x00, 0x03, 0x00, 0x03 };
+  GstH264ParserResult res;
+  GstH264NalUnit nalu;
+  GstH264SliceHdr slice;
+  guint8 data[128];
+  guint size;
+
+  GstH264NalParser *parser = gst_h264_nal_parser_new ();
+
+  setup_parameter_sets (parser);
+
+  size = make_slice_epb (data);
+  fail_unless (memcmp (data + 9, epb_03, sizeof (epb_03)) == 0);
+
+  res = gst_h264_parser_identify_nalu_unchecked (parser, data, 0, size,
+      &nalu);
+  assert_equals_int (res, GST_H264_PARSER_OK);
+  res = gst_h264_parser_parse_slice_hdr (parser, &nalu, &slice, TRUE, TRUE);
+  assert_equals_int (res, GST_H264_PARSER_OK);
+
+  /* only the first 03 is an emulation prevention byte */
+  assert_equals_int (slice.num_ref_idx_l0_active_minus1, 31);
+  assert_equals_int (slice.pred_weight_table.luma_weight_l0[14], 1);
+  assert_equals_int (slice.pred_weight_table.luma_weight_l0[15], 0);
+  assert_equals_int (slice.pred_weight_table.luma_offset_l0[15], 0);
+  assert_equals_int (slice.slice_qp_delta, -2);
+  assert_equals_int (slice.slice_alpha_c0_offset_div2, 1);
+  assert_equals_int (slice.slice_beta_offset_div2, -1);
+
+  /* 112 bits of RBSP, and two emulation prevention bytes */
+  assert_equals_int (slice.n_emulation_prevention_bytes, 2);
+  assert_equals_int (slice.header_size, 128);
+
+  gst_h264_nal_parser_free (parser);
+}
+
+GST_END_TEST;
+
+/* A reference P slice with list modifications, weights and memory
+ * management operations, as h264parse sees most of the time */
+static guint
+make_slice (guint8 * data, guint first_mb, guint frame_num, guint poc_lsb)
+{
+  guint8 rbsp[64] = { 0, };
+  BitWriter bw = { rbsp, 0 };
+  guint i;
+
+  put_bits (&bw, 0x41, 8);
+
+  put_ue (&bw, first_mb);       /* first_mb_in_slice */
+  put_ue (&bw, 5);              /* slice_type, P */
+  put_ue (&bw, 0);              /* pic_parameter_set_id */
+  put_bits (&bw, frame_num, 4); /* frame_num */
+  put_bits (&bw, poc_lsb, 6);   /* pic_order_cnt_lsb */
+  put_bits (&bw, 1, 1);         /* num_ref_idx_active_override_flag */
+  put_ue (&bw, 3);              /* num_ref_idx_l0_active_minus1 */
+
+  /* ref_pic_list_modification () */
+  put_bits (&bw, 1, 1);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  put_ue (&bw, 1);
+  put_ue (&bw, 3);
+
+  /* pred_weight_table () */
+  put_ue (&bw, 5);
+  put_ue (&bw, 5);
+  for (i = 0; i < 4; i++) {
+    put_bits (&bw, 1, 1);
+    put_se (&bw, 30);
+    put_se (&bw, -3);
+    put_bits (&bw, 1, 1);
+    put_se (&bw, 31);
+    put_se (&bw, 2);
+    put_se (&bw, 33);
+    put_se (&bw, -1);
+  }
+
+  /* dec_ref_pic_marking () */
+  put_bits (&bw, 1, 1);
+  put_ue (&bw, 1);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+
+  put_ue (&bw, 0);              /* cabac_init_idc */
+  put_se (&bw, -2);             /* slice_qp_delta */
+  put_ue (&bw, 0);              /* disable_deblocking_filter_idc */
+  put_se (&bw, 1);              /* slice_alpha_c0_offset_div2 */
+  put_se (&bw, -1);             /* slice_beta_offset_div2 */
+
+  /* slice data */
+  for (i = (bw.pos + 7) / 8; i < sizeof (rbsp); i++)
+    rbsp[i] = 0x5a;
+
+  return escape_nal (data, rbsp, sizeof (rbsp));
+}
+
+/* The header depth fills the fields identifying the picture the same way
+ * as a full parse */
+static void
+check_slice_hdr_depth (GstH264NalParser * parser, const guint8 * data,
+    guint size)
+{
+  GstH264NalUnit nalu;
+  GstH264SliceHdr full, header;
+
+  assert_equals_int (gst_h264_parser_identify_nalu_unchecked (parser, data,
+          0, size, &nalu), GST_H264_PARSER_OK);
+
+  memset (&full, 0x00, sizeof (full));
+  assert_equals_int (gst_h264_parser_parse_slice_hdr_depth (parser, &nalu,
+          &full, GST_H264_SLICE_HDR_PARSE_FULL), GST_H264_PARSER_OK);
+  memset (&header, 0xff, sizeof (header));
+  assert_equals_int (gst_h264_parser_parse_slice_hdr_depth (parser, &nalu,
+          &header, GST_H264_SLICE_HDR_PARSE_HEADER), GST_H264_PARSER_OK);
+
+  assert_equals_int (header.first_mb_in_slice, full.first_mb_in_slice);
+  assert_equals_int (header.type, full.type);
+  fail_unless (header.pps == full.pps);
+  assert_equals_int (header.frame_num, full.frame_num);
+  assert_equals_int (header.field_pic_flag, full.field_pic_flag);
+  assert_equals_int (header.bottom_field_flag, full.bottom_field_flag);
+  assert_equals_int (header.pic_order_cnt_lsb, full.pic_order_cnt_lsb);
+  assert_equals_int (header.delta_pic_order_cnt_bottom,
+      full.delta_pic_order_cnt_bottom);
+  assert_equals_int (header.delta_pic_order_cnt[0],
+      full.delta_pic_order_cnt[0]);
+  assert_equals_int (header.delta_pic_order_cnt[1],
+      full.delta_pic_order_cnt[1]);
+}
+
+GST_START_TEST (test_h264_parse_slice_hdr_depth)
+{
+  GstH264NalUnit nalu;
+  GstH264SliceHdr slice;
+  guint8 data[128];
+  guint size;
+
+  GstH264NalParser *parser = gst_h264_nal_parser_new ();
+
+  setup_parameter_sets (parser);
+
+  size = make_slice (data, 120, 9, 42);
+  check_slice_hdr_depth (parser, data, size);
+
+  gst_h264_parser_identify_nalu_unchecked (parser, data, 0, size, &nalu);
+  gst_h264_parser_parse_slice_hdr_depth (parser, &nalu, &slice,
+      GST_H264_SLICE_HDR_PARSE_HEADER);
+  assert_equals_int (slice.first_mb_in_slice, 120);
+  assert_equals_int (slice.type, 5);
+  assert_equals_int (slice.frame_num, 9);
+  assert_equals_int (slice.pic_order_cnt_lsb, 42);
+
+  size = make_slice_epb (data);
+  check_slice_hdr_depth (parser, data, size);
+
+  gst_h264_nal_parser_free (parser);
+}
+
+GST_END_TEST;
+
 static Suite *
 h264parser_suite (void)
 {
@@ -159,6 +494,9 @@ h264parser_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, test_h264_parse_slice_dpa);
+  tcase_add_test (tc_chain, test_h264_parse_sps_epb);
+  tcase_add_test (tc_chain, test_h264_parse_slice_epb);
+  tcase_add_test (tc_chain, test_h264_parse_slice_hdr_depth);
 
   return s;
 }
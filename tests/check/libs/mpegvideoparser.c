@@ -22,6 +22,8 @@
 #include <gst/check/gstcheck.h>
 #include <gst/codecparsers/gstmpegvideoparser.h>
 
+#include "parserutils.h"
+
 /* actually seq + gop */
 static const guint8 mpeg2_seq[] = {
   0x00, 0x00, 0x01, 0xb3, 0x02, 0x00, 0x18, 0x15, 0xff, 0xff, 0xe0, 0x28,
@@ -164,6 +166,115 @@ GST_START_TEST (test_mis_identified_datas)
 
 GST_END_TEST;
 
+/* Start code prefix followed by at least one byte, the way the parser
+ * looks for them, one byte at a time */
+static gint
+find_start_code (const guint8 * data, guint size, guint offset)
+{
+  guint i;
+
+  for (i = offset; i + 4 <= size; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+      return i;
+  }
+
+  return -1;
+}
+
+GST_START_TEST (test_mpeg_parse_start_codes)
+{
+  static const guint8 bytes[] = { 0x00, 0x00, 0x00, 0x01, 0x01, 0xb3, 0xff };
+  GstMpegVideoPacket packet;
+  guint8 data[300];
+  guint size, i, iter;
+  gint ref;
+
+  /* Random buffers full of zeroes and ones, so that they contain start codes
+   * at any alignment, including the very beginning and end */
+  for (iter = 0; iter < 2000; iter++) {
+    guint off = 0;
+
+    size = g_random_int_range (1, sizeof (data) + 1);
+    for (i = 0; i < size; i++)
+      data[i] = bytes[g_random_int_range (0, G_N_ELEMENTS (bytes))];
+
+    while (TRUE) {
+      ref = find_start_code (data, size, off);
+
+      if (!gst_mpeg_video_parse (&packet, data, size, off)) {
+        assert_equals_int (ref, -1);
+        break;
+      }
+
+      assert_equals_int (packet.offset, ref + 4);
+      assert_equals_int (packet.type, data[ref + 3]);
+
+      ref = find_start_code (data, size, packet.offset);
+      if (ref > (gint) packet.offset)
+        assert_equals_int (packet.size, ref - packet.offset);
+      else
+        assert_equals_int (packet.size, -1);
+
+      off = packet.offset;
+    }
+  }
+}
+
+GST_END_TEST;
+
+/* Two zero bytes followed by a byte matching @value after @mask, one byte
+ * at a time */
+static gint
+find_start_code_prefix (const guint8 * data, guint size, guint8 mask,
+    guint8 value)
+{
+  guint i;
+
+  for (i = 0; i + 3 <= size; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && (data[i + 2] & mask) == value)
+      return i;
+  }
+
+  return -1;
+}
+
+/* Every implementation the CPU can run, including the scalar one, finds
+ * the same prefixes as the reference, at any alignment of the data. 0x80
+ * with mask 0xfc is the MPEG-4 short video header start code */
+GST_START_TEST (test_scan_start_code_prefix)
+{
+  static const guint8 bytes[] =
+      { 0x00, 0x00, 0x00, 0x01, 0x80, 0x82, 0x84, 0xb3, 0xff };
+  const ScanForStartCodePrefixImpl *impls;
+  guint8 data[300 + 32];
+  guint n_impls, i, j, iter;
+
+  impls = scan_for_start_code_prefix_get_impls (&n_impls);
+  fail_unless (n_impls > 0);
+  fail_unless_equals_string (impls[0].name, "c");
+
+  for (i = 0; i < n_impls; i++) {
+    GST_DEBUG ("testing the %s implementation", impls[i].name);
+
+    for (iter = 0; iter < 20000; iter++) {
+      guint offset = g_random_int_range (0, 32);
+      guint size = g_random_int_range (0, 301);
+      guint8 mask = (iter & 1) ? 0xfc : 0xff;
+      guint8 value = (iter & 1) ? 0x80 : 0x01;
+      gint ref;
+
+      for (j = 0; j < size; j++)
+        data[offset + j] = bytes[g_random_int_range (0, G_N_ELEMENTS (bytes))];
+
+      ref = find_start_code_prefix (data + offset, size, mask, value);
+      assert_equals_int (impls[i].func (data + offset, size, mask, value),
+          ref);
+    }
+  }
+}
+
+GST_END_TEST;
+
 static Suite *
 videoparsers_suite (void)
 {
@@ -176,6 +287,8 @@ videoparsers_suite (void)
   tcase_add_test (tc_chain, test_mpeg_parse_sequence_header);
   tcase_add_test (tc_chain, test_mpeg_parse_sequence_extension);
   tcase_add_test (tc_chain, test_mis_identified_datas);
+  tcase_add_test (tc_chain, test_mpeg_parse_start_codes);
+  tcase_add_test (tc_chain, test_scan_start_code_prefix);
 
   return s;
 }
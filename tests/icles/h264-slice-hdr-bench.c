@@ -0,0 +1,212 @@
+/* GStreamer
+ *
+ * Micro-benchmark for the H.264 slice header parsing depths
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Compares the cost per slice of a full slice header parse, which is what
+ * h264parse used to do for every slice, with the header-only parse it does
+ * now, on a weighted P slice with list modifications and memory management
+ * operations.
+ *
+ * Usage: h264-slice-hdr-bench [iterations]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/codecparsers/gsth264parser.h>
+
+/* main profile, CABAC, weighted prediction, 4 bits of frame_num and 6 of
+ * pic_order_cnt_lsb */
+static const guint8 sps[] = {
+  0x00, 0x00, 0x00, 0x01, 0x67, 0x4d, 0x40, 0x15, 0xec, 0xa4, 0xbf, 0x2e,
+  0x02, 0x20, 0x00, 0x00, 0x03, 0x00, 0x2e, 0xe6, 0xb2, 0x80, 0x01, 0xe2,
+  0xc5, 0xb2, 0xc0
+};
+
+static const guint8 pps[] = {
+  0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xec, 0xb2
+};
+
+typedef struct
+{
+  guint8 *data;
+  guint pos;
+} BitWriter;
+
+static void
+put_bits (BitWriter * bw, guint32 value, guint nbits)
+{
+  while (nbits--) {
+    if (value & (1U << nbits))
+      bw->data[bw->pos / 8] |= 0x80 >> (bw->pos % 8);
+    bw->pos++;
+  }
+}
+
+static void
+put_ue (BitWriter * bw, guint32 value)
+{
+  guint nbits = g_bit_storage (value + 1);
+
+  put_bits (bw, 0, nbits - 1);
+  put_bits (bw, value + 1, nbits);
+}
+
+static void
+put_se (BitWriter * bw, gint32 value)
+{
+  put_ue (bw, value > 0 ? 2 * value - 1 : -2 * value);
+}
+
+/* start code, then a reference P slice header followed by some slice
+ * data */
+static guint
+make_slice (guint8 * data, guint size)
+{
+  BitWriter bw = { data, 0 };
+  guint i;
+
+  memset (data, 0, size);
+  put_bits (&bw, 0x00000001, 32);
+  put_bits (&bw, 0x41, 8);
+
+  put_ue (&bw, 0);              /* first_mb_in_slice */
+  put_ue (&bw, 5);              /* slice_type, P */
+  put_ue (&bw, 0);              /* pic_parameter_set_id */
+  put_bits (&bw, 3, 4);         /* frame_num */
+  put_bits (&bw, 6, 6);         /* pic_order_cnt_lsb */
+  put_bits (&bw, 1, 1);         /* num_ref_idx_active_override_flag */
+  put_ue (&bw, 3);              /* num_ref_idx_l0_active_minus1 */
+
+  /* ref_pic_list_modification () */
+  put_bits (&bw, 1, 1);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  put_ue (&bw, 1);
+  put_ue (&bw, 3);
+
+  /* pred_weight_table () */
+  put_ue (&bw, 5);
+  put_ue (&bw, 5);
+  for (i = 0; i < 4; i++) {
+    put_bits (&bw, 1, 1);
+    put_se (&bw, 30);
+    put_se (&bw, -3);
+    put_bits (&bw, 1, 1);
+    put_se (&bw, 31);
+    put_se (&bw, 2);
+    put_se (&bw, 33);
+    put_se (&bw, -1);
+  }
+
+  /* dec_ref_pic_marking () */
+  put_bits (&bw, 1, 1);
+  put_ue (&bw, 1);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+
+  put_ue (&bw, 0);              /* cabac_init_idc */
+  put_se (&bw, -2);             /* slice_qp_delta */
+  put_ue (&bw, 0);              /* disable_deblocking_filter_idc */
+  put_se (&bw, 1);              /* slice_alpha_c0_offset_div2 */
+  put_se (&bw, -1);             /* slice_beta_offset_div2 */
+
+  /* slice data */
+  for (i = (bw.pos + 7) / 8; i < size; i++)
+    data[i] = 0x5a;
+
+  return size;
+}
+
+static gdouble
+run (GstH264NalParser * parser, GstH264NalUnit * nalu,
+    GstH264SliceHdrParseDepth depth, guint iterations, GstH264SliceHdr * slice)
+{
+  gint64 start;
+  guint i;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++) {
+    if (gst_h264_parser_parse_slice_hdr_depth (parser, nalu, slice,
+            depth) != GST_H264_PARSER_OK) {
+      g_printerr ("Failed to parse the slice header\n");
+      exit (1);
+    }
+  }
+
+  return (g_get_monotonic_time () - start) * 1000.0 / iterations;
+}
+
+int
+main (int argc, char **argv)
+{
+  GstH264NalParser *parser;
+  GstH264NalUnit nalu;
+  GstH264SliceHdr full, header;
+  GstH264SPS sps_hdr;
+  GstH264PPS pps_hdr;
+  guint8 slice[512];
+  guint iterations = 5000000, size;
+  gdouble t_full, t_header;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    iterations = MAX (atoi (argv[1]), 1);
+
+  parser = gst_h264_nal_parser_new ();
+
+  gst_h264_parser_identify_nalu_unchecked (parser, sps, 0, sizeof (sps),
+      &nalu);
+  if (gst_h264_parser_parse_sps (parser, &nalu, &sps_hdr,
+          TRUE) != GST_H264_PARSER_OK) {
+    g_printerr ("Failed to parse the SPS\n");
+    return 1;
+  }
+  gst_h264_parser_identify_nalu_unchecked (parser, pps, 0, sizeof (pps),
+      &nalu);
+  if (gst_h264_parser_parse_pps (parser, &nalu,
+          &pps_hdr) != GST_H264_PARSER_OK) {
+    g_printerr ("Failed to parse the PPS\n");
+    return 1;
+  }
+
+  size = make_slice (slice, sizeof (slice));
+  gst_h264_parser_identify_nalu_unchecked (parser, slice, 0, size, &nalu);
+
+  t_full = run (parser, &nalu, GST_H264_SLICE_HDR_PARSE_FULL, iterations,
+      &full);
+  t_header = run (parser, &nalu, GST_H264_SLICE_HDR_PARSE_HEADER, iterations,
+      &header);
+
+  if (full.first_mb_in_slice != header.first_mb_in_slice ||
+      full.type != header.type || full.frame_num != header.frame_num ||
+      full.pic_order_cnt_lsb != header.pic_order_cnt_lsb) {
+    g_printerr ("Header fields differ between the parsing depths\n");
+    return 1;
+  }
+
+  g_print ("%12s %12s %8s\n", "full ns", "header ns", "speedup");
+  g_print ("%12.1f %12.1f %7.2fx\n", t_full, t_header, t_full / t_header);
+
+  gst_h264_nal_parser_free (parser);
+
+  return 0;
+}